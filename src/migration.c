@@ -394,6 +394,9 @@ migrate_profile (TerminalSettingsList *list,
 
   path = gconf_concat_dir_and_key (GCONF_PROFILES_PREFIX, gconf_id);
 
+  /* Write the whole profile in one go instead of one dconf write per key */
+  g_settings_delay (settings);
+
   migrate_string (client, path, KEY_VISIBLE_NAME,
                   settings, TERMINAL_PROFILE_VISIBLE_NAME_KEY);
 
@@ -470,6 +473,8 @@ migrate_profile (TerminalSettingsList *list,
   migrate_string (client, path, KEY_ENCODING,
                   settings, TERMINAL_PROFILE_ENCODING_KEY);
 
+  g_settings_apply (settings);
+
   g_free (path);
   g_object_unref (settings);
 }
@@ -578,6 +583,7 @@ migrate_accels (GSettings *global_settings,
 
   client = gconf_client_get_default ();
   settings = g_settings_get_child (global_settings, "keybindings");
+  g_settings_delay (settings);
 
   for (i = 0; i < G_N_ELEMENTS (data); ++i) {
     gconf_path = g_strdup_printf ("/apps/gnome-terminal/keybindings/%s", data[i].gconf_key);
@@ -593,6 +599,7 @@ migrate_accels (GSettings *global_settings,
     gconf_value_free (value);
   }
 
+  g_settings_apply (settings);
   g_object_unref (settings);
   g_object_unref (client);
 
@@ -603,9 +610,18 @@ static gboolean
 migrate (GSettings *global_settings,
          GError **error)
 {
-  return migrate_global_prefs (global_settings, error) &&
+  gboolean rv;
+
+  /* Collect the global settings' changes and write them all at once */
+  g_settings_delay (global_settings);
+
+  rv = migrate_global_prefs (global_settings, error) &&
     migrate_profiles (global_settings, error) &&
     migrate_accels (global_settings, error);
+
+  g_settings_apply (global_settings);
+
+  return rv;
 }
 
 static void
@@ -207,17 +207,46 @@ static const GdkRGBA terminal_palettes[TERMINAL_PALETTE_N_BUILTINS][TERMINAL_PAL
 
 #undef COLOR
 
+typedef struct {
+  GObject *object;
+  const char *property;
+} ProfileEditorBinding;
+
+typedef struct {
+  GtkWidget *editor;
+  GtkBuilder *builder;
+  GSettings *profile;
+  GArray *bindings;
+  guint built_pages;
+  guint bound_pages;
+} ProfileEditorData;
+
+enum {
+  PAGE_GENERAL,
+  PAGE_COMMAND,
+  PAGE_COLORS,
+  PAGE_SCROLLING,
+  PAGE_COMPATIBILITY,
+};
+
+/* The profile editor is shared between all profiles, and rebound to
+ * the profile being edited.
+ */
+static GtkWidget *profile_editor = NULL;
+
+static GHashTable *monospace_families = NULL;
+
 static void profile_colors_notify_scheme_combo_cb (GSettings *profile,
                                                    const char *key,
-                                                   GtkComboBox *combo);
+                                                   ProfileEditorData *data);
 
 static void profile_palette_notify_scheme_combo_cb (GSettings *profile,
                                                     const char *key,
-                                                    GtkComboBox *combo);
+                                                    ProfileEditorData *data);
 
 static void profile_palette_notify_colorpickers_cb (GSettings *profile,
                                                     const char *key,
-                                                    GtkWidget *editor);
+                                                    ProfileEditorData *data);
 
 
 /* gdk_rgba_equal is too strict! */
@@ -247,19 +276,64 @@ palette_cmp (const GdkRGBA *ca,
   return TRUE;
 }
 
+/* Hashes the palette with its colours rounded to 8 bits per channel,
+ * which is what the settings store, so a palette read back from the
+ * settings hashes the same as the one it was set from.
+ */
+static guint32
+palette_hash (const GdkRGBA *colors)
+{
+  guint32 hash = 2166136261u;
+  guint i;
+
+  for (i = 0; i < TERMINAL_PALETTE_SIZE; ++i)
+    {
+      guint32 rgb;
+
+      rgb = ((guint32) (colors[i].red * 255. + .5) << 16) |
+            ((guint32) (colors[i].green * 255. + .5) << 8) |
+            (guint32) (colors[i].blue * 255. + .5);
+      hash = (hash ^ rgb) * 16777619u;
+    }
+
+  return hash;
+}
+
 static gboolean
 palette_is_builtin (const GdkRGBA *colors,
                     gsize n_colors,
                     guint *n)
 {
+  static guint32 builtin_hashes[TERMINAL_PALETTE_N_BUILTINS];
+  static gboolean builtin_hashes_valid = FALSE;
+  guint32 hash;
   guint i;
 
   if (n_colors != TERMINAL_PALETTE_SIZE)
     return FALSE;
 
+  if (!builtin_hashes_valid)
+    {
+      for (i = 0; i < TERMINAL_PALETTE_N_BUILTINS; ++i)
+        builtin_hashes[i] = palette_hash (terminal_palettes[i]);
+      builtin_hashes_valid = TRUE;
+    }
+
+  /* Usually the palette is exactly one of the builtins */
+  hash = palette_hash (colors);
+  for (i = 0; i < TERMINAL_PALETTE_N_BUILTINS; ++i)
+    {
+      if (hash == builtin_hashes[i] && palette_cmp (colors, terminal_palettes[i]))
+        {
+          *n = i;
+          return TRUE;
+        }
+    }
+
+  /* Fall back to the fuzzy comparison, for palettes close to a builtin */
   for (i = 0; i < TERMINAL_PALETTE_N_BUILTINS; ++i)
     {
-      if (palette_cmp (colors, terminal_palettes[i]))
+      if (hash != builtin_hashes[i] && palette_cmp (colors, terminal_palettes[i]))
         {
           *n = i;
           return TRUE;
@@ -292,18 +366,22 @@ modify_palette_entry (GSettings       *profile,
 static void
 color_scheme_combo_changed_cb (GtkWidget *combo,
                                GParamSpec *pspec,
-                               GSettings *profile)
+                               ProfileEditorData *data)
 {
+  GSettings *profile = data->profile;
   guint i;
 
+  if (profile == NULL)
+    return;
+
   i = gtk_combo_box_get_active (GTK_COMBO_BOX (combo));
 
   if (i < G_N_ELEMENTS (color_schemes))
     {
-      g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), combo);
+      g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), data);
       terminal_g_settings_set_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &color_schemes[i].foreground);
       terminal_g_settings_set_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &color_schemes[i].background);
-      g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), combo);
+      g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), data);
     }
   else
     {
@@ -314,11 +392,14 @@ color_scheme_combo_changed_cb (GtkWidget *combo,
 static void
 profile_colors_notify_scheme_combo_cb (GSettings *profile,
                                        const char *key,
-                                       GtkComboBox *combo)
+                                       ProfileEditorData *data)
 {
+  GtkComboBox *combo;
   GdkRGBA fg, bg;
   guint i;
 
+  combo = GTK_COMBO_BOX (gtk_builder_get_object (data->builder, "color-scheme-combobox"));
+
   terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &fg);
   terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &bg);
 
@@ -330,21 +411,25 @@ profile_colors_notify_scheme_combo_cb (GSettings *profile,
     }
   /* If we didn't find a match, then we get the last combo box item which is "custom" */
 
-  g_signal_handlers_block_by_func (combo, G_CALLBACK (color_scheme_combo_changed_cb), profile);
-  gtk_combo_box_set_active (GTK_COMBO_BOX (combo), i);
-  g_signal_handlers_unblock_by_func (combo, G_CALLBACK (color_scheme_combo_changed_cb), profile);
+  g_signal_handlers_block_by_func (combo, G_CALLBACK (color_scheme_combo_changed_cb), data);
+  gtk_combo_box_set_active (combo, i);
+  g_signal_handlers_unblock_by_func (combo, G_CALLBACK (color_scheme_combo_changed_cb), data);
 }
 
 static void
 palette_scheme_combo_changed_cb (GtkComboBox *combo,
                                  GParamSpec *pspec,
-                                 GSettings *profile)
+                                 ProfileEditorData *data)
 {
+  GSettings *profile = data->profile;
   int i;
 
+  if (profile == NULL)
+    return;
+
   i = gtk_combo_box_get_active (GTK_COMBO_BOX (combo));
 
-  g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), combo);
+  g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_palette_notify_scheme_combo_cb), data);
   if (i < TERMINAL_PALETTE_N_BUILTINS)
     terminal_g_settings_set_rgba_palette (profile, TERMINAL_PROFILE_PALETTE_KEY,
                                           terminal_palettes[i], TERMINAL_PALETTE_SIZE);
@@ -352,18 +437,21 @@ palette_scheme_combo_changed_cb (GtkComboBox *combo,
     {
       /* "custom" selected, no change */
     }
-  g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_colors_notify_scheme_combo_cb), combo);
+  g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_palette_notify_scheme_combo_cb), data);
 }
 
 static void
 profile_palette_notify_scheme_combo_cb (GSettings *profile,
                                         const char *key,
-                                        GtkComboBox *combo)
+                                        ProfileEditorData *data)
 {
+  GtkComboBox *combo;
   gs_free GdkRGBA *colors;
   gsize n_colors;
   guint i;
 
+  combo = GTK_COMBO_BOX (gtk_builder_get_object (data->builder, "palette-combobox"));
+
   colors = terminal_g_settings_get_rgba_palette (profile, TERMINAL_PROFILE_PALETTE_KEY, &n_colors);
   if (!palette_is_builtin (colors, n_colors, &i))
     /* If we didn't find a match, then we want the last combo
@@ -371,44 +459,42 @@ profile_palette_notify_scheme_combo_cb (GSettings *profile,
      */
     i = TERMINAL_PALETTE_N_BUILTINS;
 
-  g_signal_handlers_block_by_func (combo, G_CALLBACK (palette_scheme_combo_changed_cb), profile);
+  g_signal_handlers_block_by_func (combo, G_CALLBACK (palette_scheme_combo_changed_cb), data);
   gtk_combo_box_set_active (combo, i);
-  g_signal_handlers_unblock_by_func (combo, G_CALLBACK (palette_scheme_combo_changed_cb), profile);
+  g_signal_handlers_unblock_by_func (combo, G_CALLBACK (palette_scheme_combo_changed_cb), data);
 }
 
 static void
 palette_color_notify_cb (GtkColorButton *button,
                          GParamSpec *pspec,
-                         GSettings *profile)
+                         ProfileEditorData *data)
 {
-  GtkWidget *editor;
+  GSettings *profile = data->profile;
   GdkRGBA color;
   guint i;
 
+  if (profile == NULL)
+    return;
+
   gtk_color_chooser_get_rgba (GTK_COLOR_CHOOSER (button), &color);
   i = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (button), "palette-entry-index"));
 
-  editor = gtk_widget_get_toplevel (GTK_WIDGET (button));
-  g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_palette_notify_colorpickers_cb), editor);
+  g_signal_handlers_block_by_func (profile, G_CALLBACK (profile_palette_notify_colorpickers_cb), data);
   modify_palette_entry (profile, i, &color);
-  g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_palette_notify_colorpickers_cb), editor);
+  g_signal_handlers_unblock_by_func (profile, G_CALLBACK (profile_palette_notify_colorpickers_cb), data);
 }
 
 static void
 profile_palette_notify_colorpickers_cb (GSettings *profile,
                                         const char *key,
-                                        GtkWidget *editor)
+                                        ProfileEditorData *data)
 {
   GtkWidget *w;
-  GtkBuilder *builder;
   gs_free GdkRGBA *colors;
   gsize n_colors, i;
 
   g_assert (strcmp (key, TERMINAL_PROFILE_PALETTE_KEY) == 0);
 
-  builder = g_object_get_data (G_OBJECT (editor), "builder");
-  g_assert (builder != NULL);
-
   colors = terminal_g_settings_get_rgba_palette (profile, TERMINAL_PROFILE_PALETTE_KEY, &n_colors);
 
   n_colors = MIN (n_colors, TERMINAL_PALETTE_SIZE);
@@ -417,11 +503,11 @@ profile_palette_notify_colorpickers_cb (GSettings *profile,
       char name[32];
 
       g_snprintf (name, sizeof (name), "palette-colorpicker-%" G_GSIZE_FORMAT, i);
-      w = (GtkWidget *) gtk_builder_get_object  (builder, name);
+      w = (GtkWidget *) gtk_builder_get_object  (data->builder, name);
 
-      g_signal_handlers_block_by_func (w, G_CALLBACK (palette_color_notify_cb), profile);
+      g_signal_handlers_block_by_func (w, G_CALLBACK (palette_color_notify_cb), data);
       gtk_color_chooser_set_rgba (GTK_COLOR_CHOOSER (w), &colors[i]);
-      g_signal_handlers_unblock_by_func (w, G_CALLBACK (palette_color_notify_cb), profile);
+      g_signal_handlers_unblock_by_func (w, G_CALLBACK (palette_color_notify_cb), data);
     }
 }
 
@@ -451,28 +537,37 @@ custom_command_entry_changed_cb (GtkEntry *entry)
 
 static void
 default_size_reset_cb (GtkWidget *button,
-                       GSettings *profile)
+                       ProfileEditorData *data)
 {
-  g_settings_reset (profile, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY);
-  g_settings_reset (profile, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY);
+  if (data->profile == NULL)
+    return;
+
+  g_settings_reset (data->profile, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY);
+  g_settings_reset (data->profile, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY);
 }
 
 static void
 cell_scale_reset_cb (GtkWidget *button,
-                     GSettings *profile)
+                     ProfileEditorData *data)
 {
-  g_settings_reset (profile, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY);
-  g_settings_reset (profile, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY);
+  if (data->profile == NULL)
+    return;
+
+  g_settings_reset (data->profile, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY);
+  g_settings_reset (data->profile, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY);
 }
 
 static void
 reset_compat_defaults_cb (GtkWidget *button,
-                          GSettings *profile)
+                          ProfileEditorData *data)
 {
-  g_settings_reset (profile, TERMINAL_PROFILE_DELETE_BINDING_KEY);
-  g_settings_reset (profile, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY);
-  g_settings_reset (profile, TERMINAL_PROFILE_ENCODING_KEY);
-  g_settings_reset (profile, TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY);
+  if (data->profile == NULL)
+    return;
+
+  g_settings_reset (data->profile, TERMINAL_PROFILE_DELETE_BINDING_KEY);
+  g_settings_reset (data->profile, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY);
+  g_settings_reset (data->profile, TERMINAL_PROFILE_ENCODING_KEY);
+  g_settings_reset (data->profile, TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY);
 }
 
 /*
@@ -543,22 +638,6 @@ editor_close_button_clicked_cb (GtkWidget *button,
   gtk_widget_destroy (editor);
 }
 
-static void
-profile_editor_destroyed (GtkWidget *editor,
-                          GSettings *profile)
-{
-  g_signal_handlers_disconnect_matched (profile, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-                                        G_CALLBACK (profile_colors_notify_scheme_combo_cb), NULL);
-  g_signal_handlers_disconnect_matched (profile, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-                                        G_CALLBACK (profile_palette_notify_scheme_combo_cb), NULL);
-  g_signal_handlers_disconnect_matched (profile, G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
-                                        G_CALLBACK (profile_palette_notify_colorpickers_cb), NULL);
-
-  g_object_set_data (G_OBJECT (profile), "editor-window", NULL);
-  g_object_set_data (G_OBJECT (editor), "builder", NULL);
-}
-
-
 /* Tab scrolling was removed from GtkNotebook in gtk 3, so reimplement it here */
 static gboolean
 scroll_event_cb (GtkWidget      *widget,
@@ -795,50 +874,628 @@ fixup_color_chooser_button (void)
 
 #endif /* GTK+ < 3.19.8 HACK */
 
+static void
+monospace_families_invalidate_cb (GtkSettings *settings,
+                                  GParamSpec *pspec,
+                                  gpointer user_data)
+{
+  g_clear_pointer (&monospace_families, g_hash_table_unref);
+}
+
+/*
+ * monospace_families_lookup:
+ * @family: a #PangoFontFamily
+ *
+ * Returns whether @family is monospace. The result for all families of the
+ * default font map is computed once and cached until fontconfig changes, so
+ * that re-creating the font chooser doesn't walk every family again.
+ */
+static gboolean
+monospace_families_lookup (PangoFontFamily *family)
+{
+  const char *name;
+  gpointer value;
+
+  if (monospace_families == NULL) {
+    static gboolean monitoring = FALSE;
+    PangoFontFamily **families;
+    int n_families, i;
+
+    if (!monitoring) {
+      g_signal_connect (gtk_settings_get_default (), "notify::gtk-fontconfig-timestamp",
+                        G_CALLBACK (monospace_families_invalidate_cb), NULL);
+      monitoring = TRUE;
+    }
+
+    monospace_families = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    pango_font_map_list_families (pango_cairo_font_map_get_default (), &families, &n_families);
+    for (i = 0; i < n_families; i++)
+      g_hash_table_insert (monospace_families,
+                           g_strdup (pango_font_family_get_name (families[i])),
+                           GINT_TO_POINTER (pango_font_family_is_monospace (families[i]) ? 2 : 1));
+    g_free (families);
+  }
+
+  name = pango_font_family_get_name (family);
+  value = g_hash_table_lookup (monospace_families, name);
+  if (value == NULL) {
+    /* Not in the default font map; remember it anyway */
+    value = GINT_TO_POINTER (pango_font_family_is_monospace (family) ? 2 : 1);
+    g_hash_table_insert (monospace_families, g_strdup (name), value);
+  }
+
+  return GPOINTER_TO_INT (value) == 2;
+}
+
 static gboolean
 monospace_filter (const PangoFontFamily *family,
                   const PangoFontFace   *face,
                   gpointer data)
 {
-  return pango_font_family_is_monospace ((PangoFontFamily *) family);
+  return monospace_families_lookup ((PangoFontFamily *) family);
 }
 
-/**
- * terminal_profile_edit:
- * @profile: a #GSettings
- * @widget_name: a widget name in the profile editor's UI, or %NULL
+/* Bindings */
+
+static void
+profile_editor_add_binding (ProfileEditorData *data,
+                            gpointer object,
+                            const char *property)
+{
+  ProfileEditorBinding binding = { G_OBJECT (object), property };
+
+  g_array_append_val (data->bindings, binding);
+}
+
+static void
+profile_editor_bind_with_mapping (ProfileEditorData *data,
+                                  const char *key,
+                                  gpointer object,
+                                  const char *property,
+                                  GSettingsBindFlags flags,
+                                  GSettingsBindGetMapping get_mapping,
+                                  GSettingsBindSetMapping set_mapping,
+                                  gpointer user_data)
+{
+  g_settings_bind_with_mapping (data->profile, key, object, property, flags,
+                                get_mapping, set_mapping, user_data, NULL);
+  profile_editor_add_binding (data, object, property);
+}
+
+static void
+profile_editor_bind (ProfileEditorData *data,
+                     const char *key,
+                     gpointer object,
+                     const char *property,
+                     GSettingsBindFlags flags)
+{
+  profile_editor_bind_with_mapping (data, key, object, property, flags,
+                                    NULL, NULL, NULL);
+}
+
+static void
+profile_editor_bind_writable (ProfileEditorData *data,
+                              const char *key,
+                              gpointer object,
+                              const char *property,
+                              gboolean inverted)
+{
+  g_settings_bind_writable (data->profile, key, object, property, inverted);
+  profile_editor_add_binding (data, object, property);
+}
+
+static void
+profile_editor_unbind (ProfileEditorData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->bindings->len; i++) {
+    ProfileEditorBinding *binding = &g_array_index (data->bindings, ProfileEditorBinding, i);
+
+    g_settings_unbind (binding->object, binding->property);
+  }
+  g_array_set_size (data->bindings, 0);
+
+  if (data->profile != NULL) {
+    g_signal_handlers_disconnect_by_data (data->profile, data);
+    g_clear_object (&data->profile);
+  }
+
+  data->bound_pages = 0;
+}
+
+#define EDITOR_OBJECT(name) (gtk_builder_get_object (data->builder, name))
+#define EDITOR_ADJUSTMENT(name) (gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON (EDITOR_OBJECT (name))))
+
+/* Pages */
+
+static void
+profile_editor_build_page (ProfileEditorData *data,
+                           int page)
+{
+  GtkWidget *w;
+  char *text;
+  guint i;
+
+  switch (page) {
+  case PAGE_GENERAL:
+    g_signal_connect (EDITOR_OBJECT ("default-size-reset-button"),
+                      "clicked",
+                      G_CALLBACK (default_size_reset_cb),
+                      data);
+    g_signal_connect (EDITOR_OBJECT ("cell-scale-reset-button"),
+                      "clicked",
+                      G_CALLBACK (cell_scale_reset_cb),
+                      data);
+
+    /* Translators: Appears as: [numeric entry] × width */
+    text = g_strdup_printf ("× %s", _("width"));
+    gtk_label_set_text (GTK_LABEL (EDITOR_OBJECT ("cell-width-scale-label")), text);
+    g_free (text);
+    /* Translators: Appears as: [numeric entry] × height */
+    text = g_strdup_printf ("× %s", _("height"));
+    gtk_label_set_text (GTK_LABEL (EDITOR_OBJECT ("cell-height-scale-label")), text);
+    g_free (text);
+
+    gtk_font_chooser_set_filter_func (GTK_FONT_CHOOSER (EDITOR_OBJECT ("font-selector")),
+                                      monospace_filter, NULL, NULL);
+    break;
+
+  case PAGE_COMMAND:
+    g_signal_connect (EDITOR_OBJECT ("custom-command-entry"), "changed",
+                      G_CALLBACK (custom_command_entry_changed_cb), NULL);
+    break;
+
+  case PAGE_COLORS: {
+#if GTK_CHECK_VERSION (3, 19, 8)
+    static const char *const colorpickers[] = {
+      "foreground-colorpicker",
+      "background-colorpicker",
+      "bold-colorpicker",
+      "cursor-foreground-colorpicker",
+      "cursor-background-colorpicker",
+      "highlight-foreground-colorpicker",
+      "highlight-background-colorpicker"
+    };
+
+    for (i = 0; i < G_N_ELEMENTS (colorpickers); i++)
+      g_object_set (EDITOR_OBJECT (colorpickers[i]), "show-editor", TRUE, NULL);
+#endif
+
+    /* Hook up the palette colorpickers and combo box */
+    for (i = 0; i < TERMINAL_PALETTE_SIZE; ++i)
+      {
+        char name[32];
+
+        g_snprintf (name, sizeof (name), "palette-colorpicker-%u", i);
+        w = (GtkWidget *) EDITOR_OBJECT (name);
+
+#if GTK_CHECK_VERSION (3, 19, 8)
+        g_object_set (w, "show-editor", TRUE, NULL);
+#endif
+
+        g_object_set_data (G_OBJECT (w), "palette-entry-index", GUINT_TO_POINTER (i));
+
+        text = g_strdup_printf (_("Choose Palette Color %u"), i);
+        gtk_color_button_set_title (GTK_COLOR_BUTTON (w), text);
+        g_free (text);
+
+        text = g_strdup_printf (_("Palette entry %u"), i);
+        gtk_widget_set_tooltip_text (w, text);
+        g_free (text);
+
+        g_signal_connect (w, "notify::rgba",
+                          G_CALLBACK (palette_color_notify_cb),
+                          data);
+      }
+
+    g_signal_connect (EDITOR_OBJECT ("palette-combobox"), "notify::active",
+                      G_CALLBACK (palette_scheme_combo_changed_cb),
+                      data);
+
+    /* Hook up the color scheme pickers and combo box */
+    w = (GtkWidget *) EDITOR_OBJECT ("color-scheme-combobox");
+    init_color_scheme_menu (w);
+    g_signal_connect (w, "notify::active",
+                      G_CALLBACK (color_scheme_combo_changed_cb),
+                      data);
+    break;
+  }
+
+  case PAGE_SCROLLING:
+    break;
+
+  case PAGE_COMPATIBILITY:
+    g_signal_connect (EDITOR_OBJECT ("reset-compat-defaults-button"),
+                      "clicked",
+                      G_CALLBACK (reset_compat_defaults_cb),
+                      data);
+
+    init_encodings_combo ((GtkWidget *) EDITOR_OBJECT ("encoding-combobox"));
+    break;
+
+  default:
+    break;
+  }
+}
+
+static void
+profile_editor_bind_page (ProfileEditorData *data,
+                          int page)
+{
+  GSettings *profile = data->profile;
+  GObject *w;
+
+  switch (page) {
+  case PAGE_GENERAL:
+    profile_editor_bind (data, TERMINAL_PROFILE_VISIBLE_NAME_KEY,
+                         EDITOR_OBJECT ("profile-name-entry"),
+                         "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY,
+                         EDITOR_ADJUSTMENT ("default-size-columns-spinbutton"),
+                         "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY,
+                         EDITOR_ADJUSTMENT ("default-size-rows-spinbutton"),
+                         "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY,
+                         EDITOR_ADJUSTMENT ("cell-height-scale-spinbutton"),
+                         "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY,
+                         EDITOR_ADJUSTMENT ("cell-width-scale-spinbutton"),
+                         "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY,
+                         EDITOR_OBJECT ("custom-font-checkbutton"),
+                         "active",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET |
+                         G_SETTINGS_BIND_INVERT_BOOLEAN);
+    w = EDITOR_OBJECT ("font-selector");
+    profile_editor_bind (data, TERMINAL_PROFILE_FONT_KEY,
+                         w,
+                         "font-name", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_INVERT_BOOLEAN |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind (data, TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY,
+                         EDITOR_OBJECT ("rewrap-on-resize-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_CURSOR_SHAPE_KEY,
+                                      EDITOR_OBJECT ("cursor-shape-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      vte_cursor_shape_get_type);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY,
+                                      EDITOR_OBJECT ("cursor-blink-mode-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      vte_cursor_blink_mode_get_type);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_TEXT_BLINK_MODE_KEY,
+                                      EDITOR_OBJECT ("text-blink-mode-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      vte_text_blink_mode_get_type);
+    profile_editor_bind (data, TERMINAL_PROFILE_AUDIBLE_BELL_KEY,
+                         EDITOR_OBJECT ("bell-checkbutton"),
+                         "active",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    break;
+
+  case PAGE_COMMAND:
+    profile_editor_bind (data, TERMINAL_PROFILE_LOGIN_SHELL_KEY,
+                         EDITOR_OBJECT ("login-shell-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY,
+                         EDITOR_OBJECT ("use-custom-command-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY,
+                         EDITOR_OBJECT ("custom-command-box"),
+                         "sensitive",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+    w = EDITOR_OBJECT ("custom-command-entry");
+    profile_editor_bind (data, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY,
+                         w,
+                         "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    custom_command_entry_changed_cb (GTK_ENTRY (w));
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_EXIT_ACTION_KEY,
+                                      EDITOR_OBJECT ("exit-action-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      terminal_exit_action_get_type);
+    break;
+
+  case PAGE_COLORS:
+    profile_palette_notify_colorpickers_cb (profile, TERMINAL_PROFILE_PALETTE_KEY, data);
+    g_signal_connect (profile, "changed::" TERMINAL_PROFILE_PALETTE_KEY,
+                      G_CALLBACK (profile_palette_notify_colorpickers_cb),
+                      data);
+
+    profile_palette_notify_scheme_combo_cb (profile, TERMINAL_PROFILE_PALETTE_KEY, data);
+    g_signal_connect (profile, "changed::" TERMINAL_PROFILE_PALETTE_KEY,
+                      G_CALLBACK (profile_palette_notify_scheme_combo_cb),
+                      data);
+
+    profile_colors_notify_scheme_combo_cb (profile, NULL, data);
+    g_signal_connect (profile, "changed::" TERMINAL_PROFILE_FOREGROUND_COLOR_KEY,
+                      G_CALLBACK (profile_colors_notify_scheme_combo_cb),
+                      data);
+    g_signal_connect (profile, "changed::" TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
+                      G_CALLBACK (profile_colors_notify_scheme_combo_cb),
+                      data);
+
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_THEME_COLORS_KEY,
+                         EDITOR_OBJECT ("use-theme-colors-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_USE_THEME_COLORS_KEY,
+                         EDITOR_OBJECT ("colors-box"),
+                         "sensitive",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_INVERT_BOOLEAN |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY,
+                                      EDITOR_OBJECT ("foreground-colorpicker"),
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
+                                      EDITOR_OBJECT ("background-colorpicker"),
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+
+    profile_editor_bind (data, TERMINAL_PROFILE_BOLD_IS_BRIGHT_KEY,
+                         EDITOR_OBJECT ("bold-is-bright-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY,
+                         EDITOR_OBJECT ("bold-color-checkbutton"),
+                         "active",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_INVERT_BOOLEAN |
+                         G_SETTINGS_BIND_SET);
+    w = EDITOR_OBJECT ("bold-colorpicker");
+    profile_editor_bind (data, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_INVERT_BOOLEAN |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_BOLD_COLOR_KEY,
+                                      w,
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+
+    profile_editor_bind (data, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
+                         EDITOR_OBJECT ("cursor-colors-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    w = EDITOR_OBJECT ("cursor-foreground-colorpicker");
+    profile_editor_bind (data, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY,
+                                      w,
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+    w = EDITOR_OBJECT ("cursor-background-colorpicker");
+    profile_editor_bind (data, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY,
+                                      w,
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+
+    profile_editor_bind (data, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
+                         EDITOR_OBJECT ("highlight-colors-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    w = EDITOR_OBJECT ("highlight-foreground-colorpicker");
+    profile_editor_bind (data, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY,
+                                      w,
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+    w = EDITOR_OBJECT ("highlight-background-colorpicker");
+    profile_editor_bind (data, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
+                         w,
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY,
+                                      w,
+                                      "rgba",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
+                                      (GSettingsBindGetMapping) s_to_rgba,
+                                      (GSettingsBindSetMapping) rgba_to_s,
+                                      NULL);
+
+    profile_editor_bind_writable (data, TERMINAL_PROFILE_PALETTE_KEY,
+                                  EDITOR_OBJECT ("palette-box"),
+                                  "sensitive",
+                                  FALSE);
+    break;
+
+  case PAGE_SCROLLING:
+    profile_editor_bind (data, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY,
+                         EDITOR_ADJUSTMENT ("scrollback-lines-spinbutton"),
+                         "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY,
+                         EDITOR_OBJECT ("scrollback-limited-checkbutton"),
+                         "active",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET |
+                         G_SETTINGS_BIND_INVERT_BOOLEAN);
+    profile_editor_bind (data, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY,
+                         EDITOR_OBJECT ("scrollback-box"),
+                         "sensitive",
+                         G_SETTINGS_BIND_GET |
+                         G_SETTINGS_BIND_INVERT_BOOLEAN |
+                         G_SETTINGS_BIND_NO_SENSITIVITY);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY,
+                                      EDITOR_OBJECT ("scrollbar-checkbutton"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) scrollbar_policy_to_bool,
+                                      (GSettingsBindSetMapping) bool_to_scrollbar_policy,
+                                      NULL);
+    profile_editor_bind (data, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY,
+                         EDITOR_OBJECT ("scroll-on-keystroke-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY,
+                         EDITOR_OBJECT ("scroll-on-output-checkbutton"),
+                         "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    break;
+
+  case PAGE_COMPATIBILITY:
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY,
+                                      EDITOR_OBJECT ("backspace-binding-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      vte_erase_binding_get_type);
+    profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_DELETE_BINDING_KEY,
+                                      EDITOR_OBJECT ("delete-binding-combobox"),
+                                      "active",
+                                      G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                      (GSettingsBindGetMapping) string_to_enum,
+                                      (GSettingsBindSetMapping) enum_to_string,
+                                      vte_erase_binding_get_type);
+    profile_editor_bind (data, TERMINAL_PROFILE_ENCODING_KEY,
+                         EDITOR_OBJECT ("encoding-combobox"),
+                         "active-id", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    profile_editor_bind (data, TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY,
+                         EDITOR_OBJECT ("cjk-ambiguous-width-combobox"),
+                         "active-id",
+                         G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+    break;
+
+  default:
+    break;
+  }
+}
+
+#undef EDITOR_ADJUSTMENT
+#undef EDITOR_OBJECT
+
+/*
+ * profile_editor_ensure_page:
+ * @data: the editor data
+ * @page: the notebook page number
  *
- * Shows the profile editor with @profile, anchored to @transient_parent.
- * If @widget_name is non-%NULL, focuses the corresponding widget and
- * switches the notebook to its containing page.
+ * Builds the widgets of @page on first use, and binds them to the
+ * current profile if they aren't bound yet. Pages are only bound when
+ * they are shown, and rebound lazily after switching profiles.
  */
-void
-terminal_profile_edit (GSettings  *profile,
-                       const char *widget_name)
+static void
+profile_editor_ensure_page (ProfileEditorData *data,
+                            int page)
+{
+  if (page < 0)
+    return;
+
+  if ((data->built_pages & (1u << page)) == 0) {
+    data->built_pages |= (1u << page);
+    profile_editor_build_page (data, page);
+  }
+
+  if (data->profile != NULL &&
+      (data->bound_pages & (1u << page)) == 0) {
+    data->bound_pages |= (1u << page);
+    profile_editor_bind_page (data, page);
+  }
+}
+
+static void
+profile_editor_notebook_switch_page_cb (GtkNotebook *notebook,
+                                        GtkWidget *page,
+                                        guint page_num,
+                                        ProfileEditorData *data)
+{
+  profile_editor_ensure_page (data, page_num);
+}
+
+static void
+profile_editor_set_profile (ProfileEditorData *data,
+                            GSettings *profile)
 {
   TerminalSettingsList *profiles_list;
-  GtkBuilder *builder;
-  GError *error = NULL;
-  GtkWidget *editor, *w;
+  GtkNotebook *notebook;
   gs_free char *uuid = NULL;
-  char *text;
-  guint i;
 
-  editor = g_object_get_data (G_OBJECT (profile), "editor-window");
-  if (editor)
-    {
-      terminal_util_dialog_focus_widget (editor, widget_name);
+  profile_editor_unbind (data);
 
-      gtk_window_present (GTK_WINDOW (editor));
-      return;
-    }
+  data->profile = g_object_ref (profile);
+
+  profile_editor_bind_with_mapping (data, TERMINAL_PROFILE_VISIBLE_NAME_KEY,
+                                    data->editor,
+                                    "title",
+                                    G_SETTINGS_BIND_GET |
+                                    G_SETTINGS_BIND_NO_SENSITIVITY,
+                                    (GSettingsBindGetMapping) string_to_window_title,
+                                    NULL, NULL);
+
+  profiles_list = terminal_app_get_profiles_list (terminal_app_get ());
+  uuid = terminal_settings_list_dup_uuid_from_child (profiles_list, profile);
+  gtk_label_set_text (GTK_LABEL (gtk_builder_get_object (data->builder, "profile-uuid")),
+                      uuid);
+
+  notebook = GTK_NOTEBOOK (gtk_builder_get_object (data->builder, "profile-editor-notebook"));
+  profile_editor_ensure_page (data, gtk_notebook_get_current_page (notebook));
+}
+
+static void
+profile_editor_destroyed (GtkWidget *editor,
+                          ProfileEditorData *data)
+{
+  profile_editor_unbind (data);
+  g_array_free (data->bindings, TRUE);
+
+  g_object_set_data (G_OBJECT (editor), "builder", NULL);
+  g_free (data);
+}
+
+static GtkWidget *
+profile_editor_new (void)
+{
+  ProfileEditorData *data;
+  GtkBuilder *builder;
+  GError *error = NULL;
+  GtkWidget *editor, *w;
 
 #if !GTK_CHECK_VERSION (3, 19, 8)
   fixup_color_chooser_button ();
 #endif
 
-  profiles_list = terminal_app_get_profiles_list (terminal_app_get ());
-
   builder = gtk_builder_new ();
   gtk_builder_add_from_resource (builder, "/org/gnome/terminal/ui/profile-preferences.ui", &error);
   g_assert_no_error (error);
@@ -847,16 +1504,17 @@ terminal_profile_edit (GSettings  *profile,
   g_object_set_data_full (G_OBJECT (editor), "builder",
                           builder, (GDestroyNotify) g_object_unref);
 
-  gtk_window_set_application (GTK_WINDOW (editor), GTK_APPLICATION (terminal_app_get ()));
+  data = g_new0 (ProfileEditorData, 1);
+  data->editor = editor;
+  data->builder = builder;
+  data->bindings = g_array_new (FALSE, FALSE, sizeof (ProfileEditorBinding));
+  g_object_set_data (G_OBJECT (editor), "editor-data", data);
 
-  /* Store the dialogue on the profile, so we can acccess it above to check if
-   * there's already a profile editor for this profile.
-   */
-  g_object_set_data (G_OBJECT (profile), "editor-window", editor);
+  gtk_window_set_application (GTK_WINDOW (editor), GTK_APPLICATION (terminal_app_get ()));
 
   g_signal_connect (editor, "destroy",
                     G_CALLBACK (profile_editor_destroyed),
-                    profile);
+                    data);
 
   w = (GtkWidget *) gtk_builder_get_object  (builder, "close-button");
   g_signal_connect (w, "clicked", G_CALLBACK (editor_close_button_clicked_cb), editor);
@@ -867,431 +1525,41 @@ terminal_profile_edit (GSettings  *profile,
   w = (GtkWidget *) gtk_builder_get_object  (builder, "profile-editor-notebook");
   gtk_widget_add_events (w, GDK_BUTTON_PRESS_MASK | GDK_SCROLL_MASK);
   g_signal_connect (w, "scroll-event", G_CALLBACK (scroll_event_cb), NULL);
+  g_signal_connect (w, "switch-page",
+                    G_CALLBACK (profile_editor_notebook_switch_page_cb), data);
 
-  uuid = terminal_settings_list_dup_uuid_from_child (profiles_list, profile);
-  gtk_label_set_text (GTK_LABEL (gtk_builder_get_object (builder, "profile-uuid")),
-                      uuid);
-
-  g_signal_connect (gtk_builder_get_object  (builder, "default-size-reset-button"),
-                    "clicked",
-                    G_CALLBACK (default_size_reset_cb),
-                    profile);
-  g_signal_connect (gtk_builder_get_object  (builder, "cell-scale-reset-button"),
-                    "clicked",
-                    G_CALLBACK (cell_scale_reset_cb),
-                    profile);
-
-  /* Translators: Appears as: [numeric entry] × width */
-  text = g_strdup_printf ("× %s", _("width"));
-  gtk_label_set_text ((GtkLabel *) gtk_builder_get_object (builder, "cell-width-scale-label"),
-                      text);
-  g_free (text);
-  /* Translators: Appears as: [numeric entry] × height */
-  text = g_strdup_printf ("× %s", _("height"));
-  gtk_label_set_text ((GtkLabel *) gtk_builder_get_object (builder, "cell-height-scale-label"),
-                      text);
-  g_free (text);
-
-  w = (GtkWidget *) gtk_builder_get_object  (builder, "color-scheme-combobox");
-  init_color_scheme_menu (w);
-
-  /* Hook up the palette colorpickers and combo box */
-
-  for (i = 0; i < TERMINAL_PALETTE_SIZE; ++i)
-    {
-      char name[32];
-
-      g_snprintf (name, sizeof (name), "palette-colorpicker-%u", i);
-      w = (GtkWidget *) gtk_builder_get_object  (builder, name);
-
-#if GTK_CHECK_VERSION (3, 19, 8)
-      g_object_set (w, "show-editor", TRUE, NULL);
-#endif
+  terminal_util_bind_mnemonic_label_sensitivity (editor);
 
-      g_object_set_data (G_OBJECT (w), "palette-entry-index", GUINT_TO_POINTER (i));
+  profile_editor = editor;
+  g_object_add_weak_pointer (G_OBJECT (editor), (gpointer *) &profile_editor);
 
-      text = g_strdup_printf (_("Choose Palette Color %u"), i);
-      gtk_color_button_set_title (GTK_COLOR_BUTTON (w), text);
-      g_free (text);
+  return editor;
+}
 
-      text = g_strdup_printf (_("Palette entry %u"), i);
-      gtk_widget_set_tooltip_text (w, text);
-      g_free (text);
+/**
+ * terminal_profile_edit:
+ * @profile: a #GSettings
+ * @widget_name: a widget name in the profile editor's UI, or %NULL
+ *
+ * Shows the profile editor with @profile. There is only one profile
+ * editor; if it is showing a different profile, it is rebound to @profile.
+ * If @widget_name is non-%NULL, focuses the corresponding widget and
+ * switches the notebook to its containing page.
+ */
+void
+terminal_profile_edit (GSettings  *profile,
+                       const char *widget_name)
+{
+  ProfileEditorData *data;
+  GtkWidget *editor;
 
-      g_signal_connect (w, "notify::rgba",
-                        G_CALLBACK (palette_color_notify_cb),
-                        profile);
-    }
+  editor = profile_editor;
+  if (editor == NULL)
+    editor = profile_editor_new ();
 
-  profile_palette_notify_colorpickers_cb (profile, TERMINAL_PROFILE_PALETTE_KEY, editor);
-  g_signal_connect (profile, "changed::" TERMINAL_PROFILE_PALETTE_KEY,
-                    G_CALLBACK (profile_palette_notify_colorpickers_cb),
-                    editor);
-
-  w = (GtkWidget *) gtk_builder_get_object  (builder, "palette-combobox");
-  g_signal_connect (w, "notify::active",
-                    G_CALLBACK (palette_scheme_combo_changed_cb),
-                    profile);
-
-  profile_palette_notify_scheme_combo_cb (profile, TERMINAL_PROFILE_PALETTE_KEY, GTK_COMBO_BOX (w));
-  g_signal_connect (profile, "changed::" TERMINAL_PROFILE_PALETTE_KEY,
-                    G_CALLBACK (profile_palette_notify_scheme_combo_cb),
-                    w);
-
-  /* Hook up the color scheme pickers and combo box */
-  w = (GtkWidget *) gtk_builder_get_object  (builder, "color-scheme-combobox");
-  g_signal_connect (w, "notify::active",
-                    G_CALLBACK (color_scheme_combo_changed_cb),
-                    profile);
-
-  profile_colors_notify_scheme_combo_cb (profile, NULL, GTK_COMBO_BOX (w));
-  g_signal_connect (profile, "changed::" TERMINAL_PROFILE_FOREGROUND_COLOR_KEY,
-                    G_CALLBACK (profile_colors_notify_scheme_combo_cb),
-                    w);
-  g_signal_connect (profile, "changed::" TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
-                    G_CALLBACK (profile_colors_notify_scheme_combo_cb),
-                    w);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "custom-command-entry"));
-  custom_command_entry_changed_cb (GTK_ENTRY (w));
-  g_signal_connect (w, "changed",
-                    G_CALLBACK (custom_command_entry_changed_cb), NULL);
-
-  g_signal_connect (gtk_builder_get_object  (builder, "reset-compat-defaults-button"),
-                    "clicked",
-                    G_CALLBACK (reset_compat_defaults_cb),
-                    profile);
-
-  g_settings_bind_with_mapping (profile,
-                                TERMINAL_PROFILE_VISIBLE_NAME_KEY,
-                                editor,
-                                "title",
-                                G_SETTINGS_BIND_GET |
-                                G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping)
-                                string_to_window_title, NULL, NULL, NULL);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "background-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind_with_mapping (profile,
-                                TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  g_settings_bind_with_mapping (profile,
-                                TERMINAL_PROFILE_BACKSPACE_BINDING_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "backspace-binding-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                vte_erase_binding_get_type, NULL);
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_BOLD_IS_BRIGHT_KEY,
-                   gtk_builder_get_object (builder, "bold-is-bright-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY,
-                   gtk_builder_get_object (builder,
-                                           "bold-color-checkbutton"),
-                   "active",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_INVERT_BOOLEAN |
-                   G_SETTINGS_BIND_SET);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "bold-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY,
-                   w,
-                   "sensitive",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_INVERT_BOOLEAN |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_BOLD_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  g_settings_bind (profile, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY,
-                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
-                                                   (gtk_builder_get_object
-                                                    (builder,
-                                                     "cell-height-scale-spinbutton"))),
-                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY,
-                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
-                                                   (gtk_builder_get_object
-                                                    (builder,
-                                                     "cell-width-scale-spinbutton"))),
-                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
-                   gtk_builder_get_object (builder,
-                                           "cursor-colors-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "cursor-foreground-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind (profile, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
-                   w,
-                   "sensitive",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "cursor-background-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind (profile, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,
-                   w,
-                   "sensitive",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  g_settings_bind (profile, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
-                   gtk_builder_get_object (builder,
-                                           "highlight-colors-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "highlight-foreground-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind (profile, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
-                   w,
-                   "sensitive",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "highlight-background-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-  g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind (profile, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,
-                   w,
-                   "sensitive",
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET | G_SETTINGS_BIND_NO_SENSITIVITY,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_CURSOR_SHAPE_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "cursor-shape-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                vte_cursor_shape_get_type, NULL);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "cursor-blink-mode-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                vte_cursor_blink_mode_get_type, NULL);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_TEXT_BLINK_MODE_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "text-blink-mode-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                vte_text_blink_mode_get_type, NULL);
-  g_settings_bind (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY,
-                   gtk_builder_get_object (builder, "custom-command-entry"),
-                   "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY,
-                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
-                                                   (gtk_builder_get_object
-                                                    (builder,
-                                                     "default-size-columns-spinbutton"))),
-                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY,
-                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
-                                                   (gtk_builder_get_object
-                                                    (builder,
-                                                     "default-size-rows-spinbutton"))),
-                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_DELETE_BINDING_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "delete-binding-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                vte_erase_binding_get_type, NULL);
-  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_EXIT_ACTION_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "exit-action-combobox"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) string_to_enum,
-                                (GSettingsBindSetMapping) enum_to_string,
-                                terminal_exit_action_get_type, NULL);
-  w = (GtkWidget*) gtk_builder_get_object (builder, "font-selector");
-  gtk_font_chooser_set_filter_func (GTK_FONT_CHOOSER (w), monospace_filter, NULL, NULL);
-  g_settings_bind (profile, TERMINAL_PROFILE_FONT_KEY,
-                   w,
-                   "font-name", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  w = GTK_WIDGET (gtk_builder_get_object (builder, "foreground-colorpicker"));
-#if GTK_CHECK_VERSION (3, 19, 8)
-      g_object_set (w, "show-editor", TRUE, NULL);
-#endif
-  g_settings_bind_with_mapping (profile,
-                                TERMINAL_PROFILE_FOREGROUND_COLOR_KEY,
-                                w,
-                                "rgba",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) s_to_rgba,
-                                (GSettingsBindSetMapping) rgba_to_s,
-                                NULL, NULL);
-
-  g_settings_bind (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY,
-                   gtk_builder_get_object (builder,
-                                           "login-shell-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_VISIBLE_NAME_KEY,
-                   gtk_builder_get_object (builder, "profile-name-entry"),
-                   "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY,
-                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
-                                                   (gtk_builder_get_object
-                                                    (builder,
-                                                     "scrollback-lines-spinbutton"))),
-                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY,
-                   gtk_builder_get_object (builder,
-                                           "scrollback-limited-checkbutton"),
-                   "active",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET |
-                   G_SETTINGS_BIND_INVERT_BOOLEAN);
-  g_settings_bind (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY,
-                   gtk_builder_get_object (builder,
-                                           "scrollback-box"),
-                   "sensitive", 
-                   G_SETTINGS_BIND_GET |
-                   G_SETTINGS_BIND_INVERT_BOOLEAN |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_with_mapping (profile,
-                                TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY,
-                                gtk_builder_get_object (builder,
-                                                        "scrollbar-checkbutton"),
-                                "active",
-                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
-                                (GSettingsBindGetMapping) scrollbar_policy_to_bool,
-                                (GSettingsBindSetMapping) bool_to_scrollbar_policy,
-                                NULL, NULL);
-  g_settings_bind (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY,
-                   gtk_builder_get_object (builder,
-                                           "scroll-on-keystroke-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY,
-                   gtk_builder_get_object (builder,
-                                           "scroll-on-output-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY,
-                   gtk_builder_get_object (builder,
-                                           "custom-font-checkbutton"),
-                   "active",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET |
-                   G_SETTINGS_BIND_INVERT_BOOLEAN);
-  g_settings_bind (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY,
-                   gtk_builder_get_object (builder,
-                                           "use-custom-command-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY,
-                   gtk_builder_get_object (builder,
-                                           "use-theme-colors-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-  g_settings_bind (profile, TERMINAL_PROFILE_AUDIBLE_BELL_KEY,
-                   gtk_builder_get_object (builder, "bell-checkbutton"),
-                   "active",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY,
-                   gtk_builder_get_object (builder, "custom-command-box"),
-                   "sensitive",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY,
-                   gtk_builder_get_object (builder, "font-selector"),
-                   "sensitive",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_INVERT_BOOLEAN |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_USE_THEME_COLORS_KEY,
-                   gtk_builder_get_object (builder, "colors-box"),
-                   "sensitive",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_INVERT_BOOLEAN |
-                   G_SETTINGS_BIND_NO_SENSITIVITY);
-  g_settings_bind_writable (profile,
-                            TERMINAL_PROFILE_PALETTE_KEY,
-                            gtk_builder_get_object (builder, "palette-box"),
-                            "sensitive",
-                            FALSE);
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY,
-                   gtk_builder_get_object (builder, "rewrap-on-resize-checkbutton"),
-                   "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  /* Compatibility options */
-  w = (GtkWidget *) gtk_builder_get_object  (builder, "encoding-combobox");
-  init_encodings_combo (w);
-  g_settings_bind (profile,
-                   TERMINAL_PROFILE_ENCODING_KEY,
-                   w,
-                   "active-id", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  w = (GtkWidget *) gtk_builder_get_object  (builder, "cjk-ambiguous-width-combobox");
-  g_settings_bind (profile, TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY,
-                   w,
-                   "active-id",
-                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
-
-  /* Finished! */
-  terminal_util_bind_mnemonic_label_sensitivity (editor);
+  data = g_object_get_data (G_OBJECT (editor), "editor-data");
+  if (data->profile != profile)
+    profile_editor_set_profile (data, profile);
 
   terminal_util_dialog_focus_widget (editor, widget_name);
 
@@ -40,9 +40,12 @@
 #include "terminal-gdbus.h"
 #include "terminal-i18n.h"
 #include "terminal-defines.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 static char *app_id = NULL;
+static gboolean standby = FALSE;
 
 #define INACTIVITY_TIMEOUT (100 /* ms */)
 
@@ -66,6 +69,7 @@ option_app_id_cb (const gchar *option_name,
 
 static const GOptionEntry options[] = {
   { "app-id", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_CALLBACK, option_app_id_cb, "Application ID", "ID" },
+  { "standby", 0, 0, G_OPTION_ARG_NONE, &standby, "Keep running without windows", NULL },
   { NULL }
 };
 
@@ -145,6 +149,7 @@ init_server (int argc,
 #endif
 
   _terminal_debug_init ();
+  _terminal_watchdog_init ();
 
   /* Change directory to $HOME so we don't prevent unmounting, e.g. if the
    * factory is started by nautilus-open-terminal. See bug #565328.
@@ -175,9 +180,15 @@ init_server (int argc,
   g_free (app_id);
   app_id = NULL;
 
-  /* We stay around a bit after the last window closed */
+  /* Until the first window; after the last window closed, see the
+   * "server-inactivity-timeout" setting.
+   */
   g_application_set_inactivity_timeout (app, INACTIVITY_TIMEOUT);
 
+  /* Started ahead of time, e.g. at login */
+  if (standby)
+    terminal_app_set_standby (TERMINAL_APP (app), TRUE);
+
   *application = app;
   return 0;
 }
@@ -187,9 +198,13 @@ main (int argc,
       char *argv[])
 {
   gs_unref_object GApplication *app = NULL;
+
+  _terminal_trace_init ("gnome-terminal-server");
+  gint64 trace_begin = _terminal_trace_begin ();
   int r = init_server (argc, argv, &app);
   if (r != 0)
     return r;
+  _terminal_trace_end ("init_server", trace_begin);
 
   return g_application_run (app, 0, NULL);
 }
@@ -30,6 +30,7 @@
 #include "terminal-schemas.h"
 #include "terminal-intl.h"
 #include "terminal-util.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 /* NOTES
@@ -106,6 +107,9 @@ typedef struct
   const char *action_parameter;
   GVariant *parameter;
   const char *shadow_action_name;
+  char *detailed_action_name;
+  char *shadow_detailed_action_name;
+  gboolean pending;
 } KeyEntry;
 
 typedef struct
@@ -116,7 +120,7 @@ typedef struct
 } KeyEntryList;
 
 #define ENTRY_FULL(name, key, action, type, parameter, shadow_name) \
-  { name, key, "win." action, (const GVariantType *) type, parameter, NULL, shadow_name }
+  { name, key, "win." action, (const GVariantType *) type, parameter, NULL, shadow_name, NULL, NULL, FALSE }
 #define ENTRY(name, key, action, type, parameter) \
   ENTRY_FULL (name, key, action, type, parameter, "win.shadow")
 #define ENTRY_MDI(name, key, action, type, parameter) \
@@ -132,9 +136,7 @@ static KeyEntry file_entries[] = {
 #ifdef ENABLE_EXPORT
   ENTRY (N_("Export"),        KEY_EXPORT,        "export",        NULL,    NULL                  ),
 #endif
-#ifdef ENABLE_PRINT
   ENTRY (N_("Print"),         KEY_PRINT,         "print",         NULL,    NULL                  ),
-#endif
   ENTRY (N_("Close Tab"),     KEY_CLOSE_TAB,     "close",         "s",     "'tab'"               ),
   ENTRY (N_("Close Window"),  KEY_CLOSE_WINDOW,  "close",         "s",     "'window'"            ),
 };
@@ -241,6 +243,8 @@ enum
 
 static GHashTable *settings_key_to_entry;
 static GSettings *keybinding_settings = NULL;
+static GPtrArray *pending_entries = NULL;
+static guint pending_entries_source_id = 0;
 
 GS_DEFINE_CLEANUP_FUNCTION(GtkTreePath*, _terminal_local_free_tree_path, gtk_tree_path_free)
 #define terminal_free_tree_path __attribute__((__cleanup__(_terminal_local_free_tree_path)))
@@ -255,13 +259,65 @@ binding_name (guint            keyval,
   return g_strdup ("disabled");
 }
 
+static void
+key_entry_apply (GtkApplication *application,
+                 KeyEntry *key_entry)
+{
+  gs_free char *value = g_settings_get_string (keybinding_settings, key_entry->settings_key);
+  const char *accels[2] = { NULL, NULL };
+
+  /* We want to always consume the action's accelerators, even if the corresponding
+   * action is insensitive, so the corresponding shortcut key escape code isn't sent
+   * to the terminal. See bug #453193, bug #138609, and bug #559728.
+   * Since GtkApplication's accelerators don't use GtkAccelGroup, we have no way
+   * to intercept/chain on its activation. The only way to do this that I found
+   * was to install an extra action with the same accelerator that shadows
+   * the real action and gets activated when the shadowed action is disabled.
+   */
+
+  if (!g_str_equal (value, "disabled"))
+    accels[0] = value;
+
+  gtk_application_set_accels_for_action (application,
+                                         key_entry->detailed_action_name,
+                                         accels);
+  gtk_application_set_accels_for_action (application,
+                                         key_entry->shadow_detailed_action_name,
+                                         accels);
+}
+
+static gboolean
+pending_entries_flush_cb (gpointer user_data)
+{
+  GtkApplication *application = user_data;
+  guint i;
+
+  pending_entries_source_id = 0;
+
+  _terminal_debug_print (TERMINAL_DEBUG_ACCELS,
+                         "applying %u changed keys\n",
+                         pending_entries->len);
+
+  for (i = 0; i < pending_entries->len; i++) {
+    KeyEntry *key_entry = g_ptr_array_index (pending_entries, i);
+
+    key_entry->pending = FALSE;
+    key_entry_apply (application, key_entry);
+  }
+
+  g_ptr_array_set_size (pending_entries, 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Changes are collected and applied together from an idle, so that a bulk
+ * update of the keybindings (e.g. from dconf) only updates the accels once.
+ */
 static void
 key_changed_cb (GSettings *settings,
                 const char *settings_key,
                 gpointer user_data)
 {
-  GtkApplication *application = user_data;
-
   _terminal_debug_print (TERMINAL_DEBUG_ACCELS,
                          "key %s changed\n",
                          settings_key);
@@ -275,38 +331,14 @@ key_changed_cb (GSettings *settings,
       return;
     }
 
-  gs_free char *value = g_settings_get_string (settings, settings_key);
+  if (key_entry->pending)
+    return;
 
-  gs_free char *detailed = g_action_print_detailed_name (key_entry->action_name,
-                                                         key_entry->parameter);
-  gs_unref_variant GVariant *shadow_parameter = g_variant_new_string (detailed);
+  key_entry->pending = TRUE;
+  g_ptr_array_add (pending_entries, key_entry);
 
-  /* We want to always consume the action's accelerators, even if the corresponding
-   * action is insensitive, so the corresponding shortcut key escape code isn't sent
-   * to the terminal. See bug #453193, bug #138609, and bug #559728.
-   * Since GtkApplication's accelerators don't use GtkAccelGroup, we have no way
-   * to intercept/chain on its activation. The only way to do this that I found
-   * was to install an extra action with the same accelerator that shadows
-   * the real action and gets activated when the shadowed action is disabled.
-   */
-
-  if (g_str_equal (value, "disabled")) {
-    gtk_application_remove_accelerator (application,
-                                        key_entry->action_name,
-                                        key_entry->parameter);
-    gtk_application_remove_accelerator (application,
-                                        key_entry->shadow_action_name,
-                                        shadow_parameter);
-  } else {
-    gtk_application_add_accelerator (application,
-                                     value,
-                                     key_entry->action_name,
-                                     key_entry->parameter);
-    gtk_application_add_accelerator (application,
-                                     value,
-                                     key_entry->shadow_action_name,
-                                     shadow_parameter);
-  }
+  if (pending_entries_source_id == 0)
+    pending_entries_source_id = _terminal_watchdog_idle_add ("accels flush", pending_entries_flush_cb, user_data);
 }
 
 void
@@ -318,6 +350,7 @@ terminal_accels_init (GApplication *application,
   keybinding_settings = g_object_ref (settings);
 
   settings_key_to_entry = g_hash_table_new (g_str_hash, g_str_equal);
+  pending_entries = g_ptr_array_new ();
 
   /* Initialise names of tab_switch_entries */
   j = 1;
@@ -337,6 +370,7 @@ terminal_accels_init (GApplication *application,
       for (j = 0; j < all_entries[i].n_elements; ++j)
 	{
 	  KeyEntry *key_entry;
+          gs_unref_variant GVariant *shadow_parameter = NULL;
 
 	  key_entry = &(all_entries[i].key_entry[j]);
           if (key_entry->action_parameter) {
@@ -349,11 +383,20 @@ terminal_accels_init (GApplication *application,
             g_assert (key_entry->parameter != NULL);
           }
 
+          /* The detailed names never change, so build them only once */
+          key_entry->detailed_action_name =
+            g_action_print_detailed_name (key_entry->action_name,
+                                          key_entry->parameter);
+          shadow_parameter = g_variant_ref_sink (g_variant_new_string (key_entry->detailed_action_name));
+          key_entry->shadow_detailed_action_name =
+            g_action_print_detailed_name (key_entry->shadow_action_name,
+                                          shadow_parameter);
+
           g_hash_table_insert (settings_key_to_entry,
                                (gpointer) key_entry->settings_key,
                                key_entry);
 
-          key_changed_cb (keybinding_settings, key_entry->settings_key, application);
+          key_entry_apply (GTK_APPLICATION (application), key_entry);
 	}
     }
 
@@ -372,9 +415,18 @@ terminal_accels_shutdown (void)
       key_entry = &(all_entries[i].key_entry[j]);
       if (key_entry->parameter)
         g_variant_unref (key_entry->parameter);
+      g_clear_pointer (&key_entry->detailed_action_name, g_free);
+      g_clear_pointer (&key_entry->shadow_detailed_action_name, g_free);
+      key_entry->pending = FALSE;
     }
   }
 
+  if (pending_entries_source_id != 0) {
+    g_source_remove (pending_entries_source_id);
+    pending_entries_source_id = 0;
+  }
+  g_clear_pointer (&pending_entries, (GDestroyNotify) g_ptr_array_unref);
+
   g_signal_handlers_disconnect_by_func (keybinding_settings,
                                         G_CALLBACK (key_changed_cb),
                                         g_application_get_default ());
@@ -508,9 +560,62 @@ static void
 treeview_destroy_cb (GtkWidget *tree_view,
                      gpointer user_data)
 {
+  guint fill_source_id;
+
   g_signal_handlers_disconnect_by_func (keybinding_settings,
                                         G_CALLBACK (treeview_key_changed_cb),
                                         tree_view);
+
+  fill_source_id = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (tree_view), "fill-source-id"));
+  if (fill_source_id != 0)
+    g_source_remove (fill_source_id);
+}
+
+typedef struct {
+  GtkTreeView *tree_view; /* unowned */
+  GtkTreeStore *tree;
+  guint next_entry;
+} FillData;
+
+static void
+fill_data_free (FillData *data)
+{
+  g_object_set_data (G_OBJECT (data->tree_view), "fill-source-id", NULL);
+  g_object_unref (data->tree);
+  g_free (data);
+}
+
+/* Adds one group of shortcuts per call */
+static gboolean
+fill_treeview_cb (FillData *data)
+{
+  GtkTreeIter parent_iter;
+  GtkTreePath *path;
+  guint i, j;
+
+  i = data->next_entry++;
+
+  gtk_tree_store_insert_with_values (data->tree, &parent_iter, NULL, -1,
+                                     ACTION_COLUMN, _(all_entries[i].user_visible_name),
+                                     KEYVAL_COLUMN, NULL,
+                                     -1);
+
+  for (j = 0; j < all_entries[i].n_elements; ++j)
+    {
+      KeyEntry *key_entry = &(all_entries[i].key_entry[j]);
+      GtkTreeIter iter;
+
+      gtk_tree_store_insert_with_values (data->tree, &iter, &parent_iter, -1,
+                                         ACTION_COLUMN, _(key_entry->user_visible_name),
+                                         KEYVAL_COLUMN, key_entry,
+                                         -1);
+    }
+
+  path = gtk_tree_model_get_path (GTK_TREE_MODEL (data->tree), &parent_iter);
+  gtk_tree_view_expand_row (data->tree_view, path, FALSE);
+  gtk_tree_path_free (path);
+
+  return data->next_entry < G_N_ELEMENTS (all_entries) ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
 }
 
 #ifdef ENABLE_DEBUG
@@ -532,7 +637,7 @@ terminal_accels_fill_treeview (GtkWidget *tree_view,
   GtkTreeViewColumn *column;
   GtkCellRenderer *cell_renderer;
   gs_unref_object GtkTreeStore *tree = NULL;
-  guint i;
+  FillData *fill_data;
 
   /* Column 1 */
   cell_renderer = gtk_cell_renderer_text_new ();
@@ -561,7 +666,7 @@ terminal_accels_fill_treeview (GtkWidget *tree_view,
                                            disable_shortcuts_button, NULL);
   gtk_tree_view_append_column (GTK_TREE_VIEW (tree_view), column);
 
-  /* Add the data */
+  /* Add the data; the first group right away, the others from idle */
 
   tree = gtk_tree_store_new (N_COLUMNS, G_TYPE_STRING, G_TYPE_POINTER);
 
@@ -570,31 +675,25 @@ terminal_accels_fill_treeview (GtkWidget *tree_view,
     g_signal_connect (tree, "row-changed", G_CALLBACK (row_changed), NULL);
 #endif
 
-  for (i = 0; i < G_N_ELEMENTS (all_entries); ++i)
-    {
-      GtkTreeIter parent_iter;
-      guint j;
-
-      gtk_tree_store_insert_with_values (tree, &parent_iter, NULL, -1,
-                                         ACTION_COLUMN, _(all_entries[i].user_visible_name),
-                                         KEYVAL_COLUMN, NULL,
-                                         -1);
-
-      for (j = 0; j < all_entries[i].n_elements; ++j)
-	{
-	  KeyEntry *key_entry = &(all_entries[i].key_entry[j]);
-	  GtkTreeIter iter;
+  gtk_tree_view_set_model (GTK_TREE_VIEW (tree_view), GTK_TREE_MODEL (tree));
 
-          gtk_tree_store_insert_with_values (tree, &iter, &parent_iter, -1,
-                                             ACTION_COLUMN, _(key_entry->user_visible_name),
-                                             KEYVAL_COLUMN, key_entry,
-                                             -1);
-	}
-    }
+  fill_data = g_new (FillData, 1);
+  fill_data->tree_view = GTK_TREE_VIEW (tree_view);
+  fill_data->tree = g_object_ref (tree);
+  fill_data->next_entry = 0;
 
-  gtk_tree_view_set_model (GTK_TREE_VIEW (tree_view), GTK_TREE_MODEL (tree));
+  if (fill_treeview_cb (fill_data)) {
+    guint fill_source_id;
 
-  gtk_tree_view_expand_all (GTK_TREE_VIEW (tree_view));
+    fill_source_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+                                      (GSourceFunc) fill_treeview_cb,
+                                      fill_data,
+                                      (GDestroyNotify) fill_data_free);
+    g_object_set_data (G_OBJECT (tree_view), "fill-source-id",
+                       GUINT_TO_POINTER (fill_source_id));
+  } else {
+    fill_data_free (fill_data);
+  }
 
   g_signal_connect (keybinding_settings, "changed",
                     G_CALLBACK (treeview_key_changed_cb), tree_view);
@@ -43,14 +43,20 @@
 #include "terminal-gdbus.h"
 #include "terminal-defines.h"
 #include "terminal-prefs.h"
+#include "terminal-snapshot.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 #ifdef ENABLE_SEARCH_PROVIDER
 #include "terminal-search-provider.h"
 #endif /* ENABLE_SEARCH_PROVIDER */
 
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -65,6 +71,24 @@
 #define GTK_DEBUG_ENABLE_INSPECTOR_KEY          "enable-inspector-keybinding"
 #define GTK_DEBUG_ENABLE_INSPECTOR_TYPE         G_VARIANT_TYPE_BOOLEAN
 
+#define MEMORY_CHECK_INTERVAL (5 /* s */)
+
+#define CLIPBOARD_TARGETS_DELAY (100 /* ms */)
+
+#define DEFERRED_STARTUP_TIMEOUT (2 /* s */)
+
+/* FD accounting, see terminal_app_reserve_fds() */
+#define FD_USAGE_MAX_AGE (1000 * 1000 /* µs */)
+#define FD_HEADROOM (64) /* kept free for D-Bus, dialogs, files, … */
+#define N_RESERVED_FDS (16) /* held open until an operation needs them */
+
+/* How long a registered environment is kept without a screen using it */
+#define REGISTERED_ENVIRONMENT_TTL (10 * 60 * G_USEC_PER_SEC)
+
+/* Bounds of the adaptive inactivity timeout, see terminal_app_window_removed() */
+#define ADAPTIVE_INACTIVITY_TIMEOUT_MIN (10 * 1000 /* ms */)
+#define ADAPTIVE_INACTIVITY_TIMEOUT_MAX (10 * 60 * 1000 /* ms */)
+
 /*
  * Session state is stored entirely in the RestartCommand command line.
  *
@@ -81,6 +105,39 @@ struct _TerminalAppClass {
                                       GtkClipboard *clipboard);
 };
 
+typedef struct {
+  TerminalScreen *screen; /* NULL if the slot is free */
+  TerminalReceiverImpl *impl; /* NULL until the screen is exported */
+  guint generation; /* bumped for each screen that uses the slot */
+} ScreenSlot;
+
+static void
+screen_slot_clear (ScreenSlot *slot)
+{
+  g_clear_object (&slot->impl);
+}
+
+typedef struct {
+  char *id; /* the SHA-256 of the contents */
+  char **envv;
+  guint ref_count; /* held by the screens using envv */
+  gint64 registered_time; /* monotonic time of the last registration or use, or 0 */
+} EnvironmentEntry;
+
+static void
+environment_entry_free (EnvironmentEntry *entry)
+{
+  g_free (entry->id);
+  g_strfreev (entry->envv);
+  g_slice_free (EnvironmentEntry, entry);
+}
+
+#ifndef DISUNIFY_NEW_TERMINAL_SECTION
+#define N_NEW_TERMINAL_ITEMS (1)
+#else
+#define N_NEW_TERMINAL_ITEMS (2)
+#endif
+
 struct _TerminalApp
 {
   GtkApplication parent_instance;
@@ -90,6 +147,12 @@ struct _TerminalApp
   TerminalSettingsList *profiles_list;
 
   GHashTable *screen_map;
+  GArray *screen_slots; /* ScreenSlot, indexed by screen handle */
+  GArray *free_screen_slots; /* guint */
+
+  /* The deduplicated initial environments of the screens and clients */
+  GHashTable *environments; /* id → EnvironmentEntry */
+  GHashTable *environment_map; /* envv → EnvironmentEntry */
 
   GSettings *global_settings;
   GSettings *desktop_interface_settings;
@@ -98,6 +161,8 @@ struct _TerminalApp
 
 #ifdef ENABLE_SEARCH_PROVIDER
   TerminalSearchProvider *search_provider;
+  GPtrArray *search_records;
+  GHashTable *search_record_map;
 #endif /* ENABLE_SEARCH_PROVIDER */
 
   GMenuModel *menubar;
@@ -105,10 +170,55 @@ struct _TerminalApp
   GMenu *menubar_set_profile_section;
   GMenu *menubar_set_encoding_submenu;
   GMenu *set_profile_menu;
+  GMenu *new_terminal_submenus[N_NEW_TERMINAL_ITEMS];
+  GArray *profile_menu_data; /* the profiles currently in the menus */
+
+  /* What startup leaves for after the first prompt,
+   * see terminal_app_deferred_startup()
+   */
+  guint deferred_startup_source_id;
+  gboolean deferred_startup_done;
+
+  /* Open FDs, as counted at fd_usage_time plus what was reserved since */
+  guint fd_limit; /* or 0 if unlimited */
+  guint fd_usage;
+  gint64 fd_usage_time;
+  int reserved_fds[N_RESERVED_FDS];
+  guint n_reserved_fds;
+
+  /* Staying around without windows */
+  gboolean standby_forced; /* by terminal_app_set_standby() */
+  gboolean standby_held;
+  guint adaptive_inactivity_timeout; /* ms */
+  gint64 idle_since; /* monotonic time the last window closed, or 0 */
 
   GtkClipboard *clipboard;
   GdkAtom *clipboard_targets;
   int n_clipboard_targets;
+  guint clipboard_flags; /* TerminalClipboardFlags */
+  guint clipboard_generation;
+  guint clipboard_targets_source_id;
+
+  /* A screen with its child already running, for the next new terminal */
+  TerminalScreen *spare_screen;
+  GSettings *spare_profile;
+  char *spare_working_dir;
+  char **spare_env;
+  guint prewarm_source_id;
+
+  /* Screens not in any window yet; see terminal_app_add_headless_screen() */
+  GPtrArray *headless_screens;
+
+  guint memory_check_source_id;
+
+  guint snapshot_source_id;
+  GCancellable *snapshot_cancellable; /* while a snapshot is being written */
+  gboolean session_dirty; /* changed since the last snapshot */
+
+  /* Parsed theme CSS by resource path, with NULL for paths that don't exist */
+  GHashTable *theme_css_providers;
+  GtkCssProvider *theme_css_provider; /* the one currently added, owned by the hash table */
+  int theme_variant; /* the TerminalThemeVariant last applied, or -1 */
 };
 
 enum
@@ -256,58 +366,162 @@ done:
                        TERMINAL_SCHEMA_VERSION);
 }
 
-static gboolean
+static GtkCssProvider *
 load_css_from_resource (GApplication *application,
-                        GtkCssProvider *provider,
-                        gboolean theme)
+                        const char *path)
 {
-  const char *base_path;
-  gs_free char *uri;
-  gs_unref_object GFile *file;
+  gs_free char *resource_path = NULL;
+  gs_free char *uri = NULL;
+  gs_unref_object GFile *file = NULL;
   gs_free_error GError *error = NULL;
+  GtkCssProvider *provider;
 
-  base_path = g_application_get_resource_base_path (application);
-
-  if (theme) {
-    gs_free char *str, *theme_name;
-
-    g_object_get (gtk_settings_get_default (), "gtk-theme-name", &str, NULL);
-    theme_name = g_ascii_strdown (str, -1);
-    uri = g_strdup_printf ("resource://%s/css/%s/terminal.css", base_path, theme_name);
-  } else {
-    uri = g_strdup_printf ("resource://%s/css/terminal.css", base_path);
-  }
+  resource_path = g_strdup_printf ("%s/%s", g_application_get_resource_base_path (application), path);
+  if (!g_resources_get_info (resource_path, G_RESOURCE_LOOKUP_FLAGS_NONE, NULL, NULL, NULL))
+    return NULL;
 
+  uri = g_strconcat ("resource://", resource_path, NULL);
   file = g_file_new_for_uri (uri);
-  if (!g_file_query_exists (file, NULL /* cancellable */))
-    return FALSE;
 
+  provider = gtk_css_provider_new ();
   if (!gtk_css_provider_load_from_file (provider, file, &error))
     g_assert_no_error (error);
 
-  return TRUE;
+  return provider;
 }
 
 static void
-add_css_provider (GApplication *application,
-                  gboolean theme)
+css_provider_unref (gpointer provider)
 {
-  gs_unref_object GtkCssProvider *provider;
+  if (provider != NULL)
+    g_object_unref (provider);
+}
 
-  provider = gtk_css_provider_new ();
-  if (!load_css_from_resource (application, provider, theme))
+/* Returns the parsed CSS for the current theme and variant, parsing it only
+ * the first time that theme and variant are used.
+ */
+static GtkCssProvider *
+app_lookup_theme_css_provider (TerminalApp *app)
+{
+  gs_free char *str = NULL;
+  gs_free char *theme_name = NULL;
+  gboolean dark = FALSE;
+  const char *file_names[2];
+  guint i, n = 0;
+
+  g_object_get (gtk_settings_get_default (),
+                "gtk-theme-name", &str,
+                GTK_SETTING_PREFER_DARK_THEME, &dark,
+                NULL);
+  theme_name = g_ascii_strdown (str ? str : "", -1);
+
+  if (dark)
+    file_names[n++] = "terminal-dark.css";
+  file_names[n++] = "terminal.css";
+
+  for (i = 0; i < n; i++) {
+    gs_free char *path = g_strdup_printf ("css/%s/%s", theme_name, file_names[i]);
+    gpointer provider;
+
+    if (!g_hash_table_lookup_extended (app->theme_css_providers, path, NULL, &provider)) {
+      provider = load_css_from_resource (G_APPLICATION (app), path);
+      g_hash_table_insert (app->theme_css_providers, g_strdup (path), provider);
+    }
+
+    if (provider != NULL)
+      return provider;
+  }
+
+  return NULL;
+}
+
+static void
+app_update_theme_css (TerminalApp *app)
+{
+  GdkScreen *screen = gdk_screen_get_default ();
+  GtkCssProvider *provider;
+
+  provider = app_lookup_theme_css_provider (app);
+  if (provider == app->theme_css_provider)
     return;
 
-  gtk_style_context_add_provider_for_screen (gdk_screen_get_default (),
-                                             GTK_STYLE_PROVIDER (provider),
-                                             GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  /* Add the new provider before removing the old one, so the style is swapped in one go */
+  if (provider != NULL)
+    gtk_style_context_add_provider_for_screen (screen,
+                                               GTK_STYLE_PROVIDER (provider),
+                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+  if (app->theme_css_provider != NULL)
+    gtk_style_context_remove_provider_for_screen (screen,
+                                                  GTK_STYLE_PROVIDER (app->theme_css_provider));
+
+  app->theme_css_provider = provider;
+}
+
+static void
+app_theme_css_changed_cb (GtkSettings *settings,
+                          GParamSpec *pspec,
+                          TerminalApp *app)
+{
+  const char *section = _terminal_watchdog_enter ("theme CSS update");
+
+  app_update_theme_css (app);
+
+  _terminal_watchdog_leave (section);
 }
 
 static void
 app_load_css (GApplication *application)
 {
-  add_css_provider (application, FALSE);
-  add_css_provider (application, TRUE);
+  TerminalApp *app = TERMINAL_APP (application);
+  GtkSettings *gtk_settings = gtk_settings_get_default ();
+  gs_unref_object GtkCssProvider *provider = NULL;
+  gint64 trace_begin = _terminal_trace_begin ();
+
+  provider = load_css_from_resource (application, "css/terminal.css");
+  if (provider != NULL)
+    gtk_style_context_add_provider_for_screen (gdk_screen_get_default (),
+                                               GTK_STYLE_PROVIDER (provider),
+                                               GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+
+  app->theme_css_providers = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, css_provider_unref);
+  app_update_theme_css (app);
+
+  g_signal_connect (gtk_settings, "notify::gtk-theme-name",
+                    G_CALLBACK (app_theme_css_changed_cb), app);
+  g_signal_connect (gtk_settings, "notify::" GTK_SETTING_PREFER_DARK_THEME,
+                    G_CALLBACK (app_theme_css_changed_cb), app);
+
+  _terminal_trace_end ("app_load_css", trace_begin);
+}
+
+/**
+ * terminal_app_new_profiles:
+ * @app: a #TerminalApp
+ * @base_profile: (allow-none): the profile to clone, or %NULL
+ * @n_profiles: the number of profiles to create
+ *
+ * Creates @n_profiles new profiles, as copies of @base_profile if it is
+ * not %NULL, with one change to the settings for all of them.
+ *
+ * Returns: (transfer full): the UUIDs of the new profiles, or %NULL
+ */
+char **
+terminal_app_new_profiles (TerminalApp *app,
+                           GSettings   *base_profile,
+                           guint        n_profiles)
+{
+  gs_free char *base_uuid = NULL;
+
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+
+  if (base_profile) {
+    base_uuid = terminal_settings_list_dup_uuid_from_child (app->profiles_list, base_profile);
+    if (base_uuid == NULL)
+      return NULL;
+  }
+
+  return terminal_settings_list_clone_children (app->profiles_list, base_uuid, n_profiles);
 }
 
 void
@@ -315,21 +529,13 @@ terminal_app_new_profile (TerminalApp *app,
                           GSettings   *base_profile)
 {
   gs_unref_object GSettings *profile = NULL;
-  gs_free char *uuid;
-
-  if (base_profile) {
-    gs_free char *base_uuid;
-
-    base_uuid = terminal_settings_list_dup_uuid_from_child (app->profiles_list, base_profile);
-    uuid = terminal_settings_list_clone_child (app->profiles_list, base_uuid);
-  } else {
-    uuid = terminal_settings_list_add_child (app->profiles_list);
-  }
+  gs_strfreev char **uuids;
 
-  if (uuid == NULL)
+  uuids = terminal_app_new_profiles (app, base_profile, 1);
+  if (uuids == NULL || uuids[0] == NULL)
     return;
 
-  profile = terminal_settings_list_ref_child (app->profiles_list, uuid);
+  profile = terminal_settings_list_ref_child (app->profiles_list, uuids[0]);
   if (profile == NULL)
     return;
 
@@ -366,11 +572,18 @@ terminal_app_remove_profile (TerminalApp *app,
 static void
 terminal_app_theme_variant_changed_cb (GSettings   *settings,
                                        const char  *key,
-                                       GtkSettings *gtk_settings)
+                                       TerminalApp *app)
 {
+  GtkSettings *gtk_settings = gtk_settings_get_default ();
   TerminalThemeVariant theme;
 
+  /* Changing the variant restyles every widget, so don't do it needlessly */
   theme = g_settings_get_enum (settings, key);
+  if ((int) theme == app->theme_variant)
+    return;
+
+  app->theme_variant = theme;
+
   if (theme == TERMINAL_THEME_VARIANT_SYSTEM)
     gtk_settings_reset_property (gtk_settings, GTK_SETTING_PREFER_DARK_THEME);
   else
@@ -384,6 +597,7 @@ terminal_app_theme_variant_changed_cb (GSettings   *settings,
 /* Submenus for New Terminal per profile, and to change profiles */
 
 static void terminal_app_update_profile_menus (TerminalApp *app);
+static void terminal_app_update_standby (TerminalApp *app);
 
 typedef struct {
   char *uuid;
@@ -431,15 +645,14 @@ compare_profile_label_cb (gconstpointer ap,
   return g_utf8_collate (a->label, b->label);
 }
 
-static void
-menu_append_numbered (GMenu *menu,
-                      const char *label,
-                      int num,
-                      const char *action_name,
-                      GVariant *target)
+static GMenuItem *
+menu_item_new_numbered (const char *label,
+                        int num,
+                        const char *action_name,
+                        GVariant *target)
 {
   gs_free_gstring GString *str;
-  gs_unref_object GMenuItem *item;
+  GMenuItem *item;
   const char *p;
 
   /* Who'd use more that 4 underscores in a profile name... */
@@ -460,7 +673,88 @@ menu_append_numbered (GMenu *menu,
 
   item = g_menu_item_new (str->str, NULL);
   g_menu_item_set_action_and_target_value (item, action_name, target);
-  g_menu_append_item (menu, item);
+  return item;
+}
+
+/* Only the first 35 items get a mnemonic number, see menu_item_new_numbered() */
+#define MAX_NUMBERED_ITEMS (35)
+
+static gboolean
+profile_menu_item_equal (const ProfileData *a,
+                         guint a_pos,
+                         const ProfileData *b,
+                         guint b_pos)
+{
+  return (a_pos == b_pos ||
+          (a_pos >= MAX_NUMBERED_ITEMS && b_pos >= MAX_NUMBERED_ITEMS)) &&
+    g_str_equal (a->uuid, b->uuid) &&
+    g_str_equal (a->label, b->label);
+}
+
+static GMenuItem *
+profile_menu_item_new (const ProfileData *data,
+                       guint pos,
+                       const char *new_terminal_target)
+{
+  if (new_terminal_target != NULL)
+    return menu_item_new_numbered (data->label, pos + 1,
+                                   "win.new-terminal",
+                                   g_variant_new ("(ss)", new_terminal_target, data->uuid));
+
+  return menu_item_new_numbered (data->label, pos + 1,
+                                 "win.profile",
+                                 g_variant_new_string (data->uuid));
+}
+
+/*
+ * profile_submenu_update:
+ * @menu: a profiles submenu, containing items for @old_data
+ * @new_terminal_target: the new terminal target, or %NULL for the set profile menu
+ *
+ * Updates @menu to contain items for @data, only replacing the items
+ * between the common head and tail of the old and new lists.
+ */
+static void
+profile_submenu_update (GMenu *menu,
+                        const char *new_terminal_target,
+                        const ProfileData *old_data,
+                        guint n_old,
+                        const ProfileData *data,
+                        guint n_profiles)
+{
+  guint head = 0, tail = 0, i;
+
+  while (head < n_old && head < n_profiles &&
+         profile_menu_item_equal (&old_data[head], head, &data[head], head))
+    head++;
+
+  while (tail < n_old - head && tail < n_profiles - head &&
+         profile_menu_item_equal (&old_data[n_old - 1 - tail], n_old - 1 - tail,
+                                  &data[n_profiles - 1 - tail], n_profiles - 1 - tail))
+    tail++;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Profile menu: replacing %u items with %u at %u\n",
+                         n_old - head - tail, n_profiles - head - tail, head);
+
+  for (i = n_old - tail; i > head; i--)
+    g_menu_remove (menu, i - 1);
+
+  for (i = head; i < n_profiles - tail; i++) {
+    gs_unref_object GMenuItem *item = profile_menu_item_new (&data[i], i, new_terminal_target);
+    g_menu_insert_item (menu, i, item);
+  }
+}
+
+static GMenu *
+profile_submenu_new (const char *new_terminal_target,
+                     ProfileData *data,
+                     guint n_profiles)
+{
+  GMenu *menu = g_menu_new ();
+
+  profile_submenu_update (menu, new_terminal_target, NULL, 0, data, n_profiles);
+  return menu;
 }
 
 static void
@@ -468,20 +762,17 @@ append_new_terminal_item (GMenu *section,
                           const char *label,
                           const char *target,
                           ProfileData *data,
-                          guint n_profiles)
+                          guint n_profiles,
+                          GMenu **submenu_out)
 {
   gs_unref_object GMenuItem *item = g_menu_item_new (label, NULL);
 
   if (n_profiles > 1) {
-    gs_unref_object GMenu *submenu = g_menu_new ();
-
-    for (guint i = 0; i < n_profiles; i++) {
-      menu_append_numbered (submenu, data[i].label, i + 1,
-                            "win.new-terminal",
-                            g_variant_new ("(ss)", target, data[i].uuid));
-    }
+    gs_unref_object GMenu *submenu = profile_submenu_new (target, data, n_profiles);
 
     g_menu_item_set_link (item, G_MENU_LINK_SUBMENU, G_MENU_MODEL (submenu));
+    if (submenu_out)
+      *submenu_out = g_object_ref (submenu);
   } else {
     g_menu_item_set_action_and_target (item, "win.new-terminal",
                                        "(ss)", target, "default");
@@ -489,48 +780,64 @@ append_new_terminal_item (GMenu *section,
   g_menu_append_item (section, item);
 }
 
+static const char *new_terminal_targets[N_NEW_TERMINAL_ITEMS] = {
+#ifndef DISUNIFY_NEW_TERMINAL_SECTION
+  "default"
+#else
+  "tab",
+  "window"
+#endif
+};
+
 static void
 fill_new_terminal_section (GMenu *section,
                            ProfileData *profiles,
-                           guint n_profiles)
+                           guint n_profiles,
+                           GMenu **submenus /* N_NEW_TERMINAL_ITEMS */)
 {
 #ifndef DISUNIFY_NEW_TERMINAL_SECTION
-  append_new_terminal_item (section, _("New _Terminal"), "default", profiles, n_profiles);
+  append_new_terminal_item (section, _("New _Terminal"), new_terminal_targets[0],
+                            profiles, n_profiles, submenus ? &submenus[0] : NULL);
 #else
-  append_new_terminal_item (section, _("New _Tab"), "tab", profiles, n_profiles);
-  append_new_terminal_item (section, _("New _Window"), "window", profiles, n_profiles);
+  append_new_terminal_item (section, _("New _Tab"), new_terminal_targets[0],
+                            profiles, n_profiles, submenus ? &submenus[0] : NULL);
+  append_new_terminal_item (section, _("New _Window"), new_terminal_targets[1],
+                            profiles, n_profiles, submenus ? &submenus[1] : NULL);
 #endif
 }
 
-static GMenu *
-set_profile_submenu_new (ProfileData *data,
-                         guint n_profiles)
+static void
+terminal_app_rebuild_profile_menus (TerminalApp *app,
+                                    ProfileData *profiles,
+                                    guint n_profiles)
 {
-  GMenu *menu = g_menu_new ();
+  guint i;
 
-  /* No submenu if there's only one profile */
-  if (n_profiles <= 1)
-    return NULL;
+  g_menu_remove_all (G_MENU (app->menubar_new_terminal_section));
+  g_menu_remove_all (G_MENU (app->menubar_set_profile_section));
+  g_clear_object (&app->set_profile_menu);
+  for (i = 0; i < N_NEW_TERMINAL_ITEMS; i++)
+    g_clear_object (&app->new_terminal_submenus[i]);
 
-  for (guint i = 0; i < n_profiles; i++) {
-    menu_append_numbered (menu, data[i].label, i + 1,
-                          "win.profile",
-                          g_variant_new_string (data[i].uuid));
-  }
+  fill_new_terminal_section (app->menubar_new_terminal_section, profiles, n_profiles,
+                             app->new_terminal_submenus);
 
-  return menu;
+  /* No submenu if there's only one profile */
+  if (n_profiles > 1) {
+    app->set_profile_menu = profile_submenu_new (NULL, profiles, n_profiles);
+    g_menu_append_submenu (app->menubar_set_profile_section, _("Change _Profile"),
+                           G_MENU_MODEL (app->set_profile_menu));
+  }
 }
 
 static void
 terminal_app_update_profile_menus (TerminalApp *app)
 {
-  g_menu_remove_all (G_MENU (app->menubar_new_terminal_section));
-  g_menu_remove_all (G_MENU (app->menubar_set_profile_section));
-  g_clear_object (&app->set_profile_menu);
+  gint64 trace_begin = _terminal_trace_begin ();
 
   /* Get profiles list and sort by label */
-  gs_unref_array GArray *array = g_array_sized_new (FALSE, TRUE, sizeof (ProfileData),
-                                                    terminal_settings_list_get_n_children (app->profiles_list));
+  GArray *array = g_array_sized_new (FALSE, TRUE, sizeof (ProfileData),
+                                     terminal_settings_list_get_n_children (app->profiles_list));
   g_array_set_clear_func (array, (GDestroyNotify) profile_data_clear);
 
   ProfilesForeachData data = { array, app };
@@ -541,15 +848,33 @@ terminal_app_update_profile_menus (TerminalApp *app)
 
   ProfileData *profiles = (ProfileData*) array->data;
   guint n_profiles = array->len;
+  GArray *old_array = app->profile_menu_data;
 
-  fill_new_terminal_section (app->menubar_new_terminal_section, profiles, n_profiles);
+  /* Only the affected items are updated, unless the menus change shape
+   * between a single profile and submenus.
+   */
+  if (old_array != NULL && (old_array->len > 1) == (n_profiles > 1)) {
+    ProfileData *old_profiles = (ProfileData*) old_array->data;
+    guint i;
+
+    if (n_profiles > 1) {
+      for (i = 0; i < N_NEW_TERMINAL_ITEMS; i++)
+        profile_submenu_update (app->new_terminal_submenus[i], new_terminal_targets[i],
+                                old_profiles, old_array->len,
+                                profiles, n_profiles);
+      profile_submenu_update (app->set_profile_menu, NULL,
+                              old_profiles, old_array->len,
+                              profiles, n_profiles);
+    }
+  } else {
+    terminal_app_rebuild_profile_menus (app, profiles, n_profiles);
+  }
 
-  app->set_profile_menu = set_profile_submenu_new (profiles, n_profiles);
+  if (old_array != NULL)
+    g_array_unref (old_array);
+  app->profile_menu_data = array; /* adopts */
 
-  if (app->set_profile_menu != NULL) {
-    g_menu_append_submenu (app->menubar_set_profile_section, _("Change _Profile"),
-                           G_MENU_MODEL (app->set_profile_menu));
-  }
+  _terminal_trace_end ("terminal_app_update_profile_menus", trace_begin);
 }
 
 /* Clipboard */
@@ -576,12 +901,44 @@ update_clipboard_targets (TerminalApp *app,
   }
 }
 
+static void
+update_clipboard_flags (TerminalApp *app,
+                        GtkClipboard *clipboard)
+{
+  guint flags = 0;
+
+  if (app->clipboard_targets != NULL) {
+    if (gtk_targets_include_text (app->clipboard_targets, app->n_clipboard_targets))
+      flags |= TERMINAL_CLIPBOARD_CAN_PASTE_TEXT;
+    if (gtk_targets_include_uri (app->clipboard_targets, app->n_clipboard_targets))
+      flags |= TERMINAL_CLIPBOARD_CAN_PASTE_URIS;
+  }
+
+  /* Only bother the windows if what they can paste has changed */
+  if (flags == app->clipboard_flags)
+    return;
+
+  app->clipboard_flags = flags;
+  g_signal_emit (app, signals[CLIPBOARD_TARGETS_CHANGED], 0, clipboard);
+}
+
 static void
 clipboard_targets_received_cb (GtkClipboard *clipboard,
                                GdkAtom *targets,
                                int n_targets,
-                               TerminalApp *app)
+                               gpointer user_data)
 {
+  TerminalApp *app = terminal_app_get ();
+  guint generation = GPOINTER_TO_UINT (user_data);
+
+  /* The owner changed again after this request was made */
+  if (generation != app->clipboard_generation) {
+    _terminal_debug_print (TERMINAL_DEBUG_CLIPBOARD,
+                           "Dropping stale clipboard targets (generation %u, now %u)\n",
+                           generation, app->clipboard_generation);
+    return;
+  }
+
   update_clipboard_targets (app, targets, n_targets);
 
   _TERMINAL_DEBUG_IF (TERMINAL_DEBUG_CLIPBOARD) {
@@ -595,7 +952,22 @@ clipboard_targets_received_cb (GtkClipboard *clipboard,
     g_printerr ("\n");
   }
 
-  g_signal_emit (app, signals[CLIPBOARD_TARGETS_CHANGED], 0, clipboard);
+  update_clipboard_flags (app, clipboard);
+}
+
+static gboolean
+clipboard_request_targets_cb (TerminalApp *app)
+{
+  app->clipboard_targets_source_id = 0;
+
+  /* We can do this without holding a reference to @app since
+   * the app lives as long as the process.
+   */
+  gtk_clipboard_request_targets (app->clipboard,
+                                 (GtkClipboardTargetsReceivedFunc) clipboard_targets_received_cb,
+                                 GUINT_TO_POINTER (app->clipboard_generation));
+
+  return G_SOURCE_REMOVE;
 }
 
 static void
@@ -606,14 +978,19 @@ clipboard_owner_change_cb (GtkClipboard *clipboard,
   _terminal_debug_print (TERMINAL_DEBUG_CLIPBOARD,
                          "Clipboard owner changed\n");
 
-  clipboard_targets_received_cb (clipboard, NULL, 0, app); /* clear */
+  /* Invalidates any requests still in flight */
+  app->clipboard_generation++;
+  free_clipboard_targets (app);
+  update_clipboard_flags (app, clipboard); /* clear */
 
-  /* We can do this without holding a reference to @app since
-   * the app lives as long as the process.
+  /* Owner changes often come in bursts, so only ask for the targets
+   * once things have settled down.
    */
-  gtk_clipboard_request_targets (clipboard,
-                                 (GtkClipboardTargetsReceivedFunc) clipboard_targets_received_cb,
-                                 app);
+  if (app->clipboard_targets_source_id == 0)
+    app->clipboard_targets_source_id =
+      g_timeout_add (CLIPBOARD_TARGETS_DELAY,
+                     (GSourceFunc) clipboard_request_targets_cb,
+                     app);
 }
 
 /* App menu callbacks */
@@ -671,6 +1048,52 @@ terminal_app_activate (GApplication *application)
   /* No-op required because GApplication is stupid */
 }
 
+/*
+ * terminal_app_deferred_startup:
+ *
+ * Does the part of the startup that the first window can do without:
+ * the profile and encoding menus, and JITing the regexes. Runs when
+ * the first screen has shown its first output, or after
+ * DEFERRED_STARTUP_TIMEOUT if that didn't happen, or when something
+ * needs it, whichever comes first.
+ */
+static void
+terminal_app_deferred_startup (TerminalApp *app)
+{
+  if (app->deferred_startup_done)
+    return;
+
+  gint64 trace_begin = _terminal_trace_begin ();
+
+  app->deferred_startup_done = TRUE;
+  if (app->deferred_startup_source_id != 0) {
+    g_source_remove (app->deferred_startup_source_id);
+    app->deferred_startup_source_id = 0;
+  }
+
+  /* Create dynamic menus and keep them updated */
+  terminal_app_update_profile_menus (app);
+  g_signal_connect_swapped (app->profiles_list, "children-changed",
+                            G_CALLBACK (terminal_app_update_profile_menus), app);
+
+  /* Install the encodings submenu */
+  terminal_encodings_append_menu (app->menubar_set_encoding_submenu);
+
+  terminal_screen_jit_regexes ();
+
+  _terminal_trace_end ("terminal_app_deferred_startup", trace_begin);
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER, "Deferred startup complete\n");
+}
+
+static gboolean
+terminal_app_deferred_startup_cb (TerminalApp *app)
+{
+  app->deferred_startup_source_id = 0;
+  terminal_app_deferred_startup (app);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 terminal_app_startup (GApplication *application)
 {
@@ -683,10 +1106,15 @@ terminal_app_startup (GApplication *application)
     { "quit",        app_menu_quit_cb,          NULL, NULL, NULL }
   };
 
+  gint64 trace_begin = _terminal_trace_begin ();
+
   g_application_set_resource_base_path (application, TERMINAL_RESOURCES_PATH_PREFIX);
 
   G_APPLICATION_CLASS (terminal_app_parent_class)->startup (application);
 
+  /* Not in init, where the application ID isn't set yet */
+  terminal_app_update_standby (app);
+
   /* Need to set the WM class (bug #685742) */
   gdk_set_program_class("Gnome-terminal");
 
@@ -699,7 +1127,7 @@ terminal_app_startup (GApplication *application)
   /* App menu */
   GMenu *appmenu_new_terminal_section = gtk_application_get_menu_by_id (gtk_application,
                                                                         "new-terminal-section");
-  fill_new_terminal_section (appmenu_new_terminal_section, NULL, 0); /* no submenu */
+  fill_new_terminal_section (appmenu_new_terminal_section, NULL, 0, NULL); /* no submenu */
 
   /* Menubar */
   terminal_util_load_objects_resource ("/org/gnome/terminal/ui/menubar.ui",
@@ -709,13 +1137,13 @@ terminal_app_startup (GApplication *application)
                                        "set-encoding-submenu", &app->menubar_set_encoding_submenu,
                                        NULL);
 
-  /* Create dynamic menus and keep them updated */
-  terminal_app_update_profile_menus (app);
-  g_signal_connect_swapped (app->profiles_list, "children-changed",
-                            G_CALLBACK (terminal_app_update_profile_menus), app);
-
-  /* Install the encodings submenu */
-  terminal_encodings_append_menu (app->menubar_set_encoding_submenu);
+  /* The menus are filled in later; the models are live, so that works
+   * for menubars that already exist by then too.
+   */
+  app->deferred_startup_source_id =
+    _terminal_watchdog_timeout_add_seconds (DEFERRED_STARTUP_TIMEOUT, "deferred startup",
+                                            (GSourceFunc) terminal_app_deferred_startup_cb,
+                                            app);
 
   /* If the shell wants to show the appmenu/menubar, make it available */
   gboolean shell_shows_appmenu, shell_shows_menubar;
@@ -728,40 +1156,840 @@ terminal_app_startup (GApplication *application)
   if (shell_shows_menubar)
     gtk_application_set_menubar (GTK_APPLICATION (app), app->menubar);
 
+  _terminal_trace_end ("terminal_app_startup", trace_begin);
   _terminal_debug_print (TERMINAL_DEBUG_SERVER, "Startup complete\n");
 }
 
-/* GObjectClass impl */
+#ifdef ENABLE_SEARCH_PROVIDER
+
+/* Search index
+ *
+ * Each screen has a record holding the normalized strings the search
+ * provider matches against. The title and cwd are only re-normalized
+ * after the screen notified a change, and the foreground process is
+ * only re-read when the foreground process group of the PTY changed.
+ * That happens on a worker thread; searches wait for these lookups, so
+ * they never match against the process that was there before.
+ */
+
+typedef struct {
+  TerminalScreen *screen; /* unowned */
+  char *uuid;
+  char *title;
+  char *cwd;
+  char *process;
+  char *cmdline;
+  int fgpgrp;
+  GCancellable *cancellable; /* the process lookup in progress */
+  GSList *waiters; /* the search GTasks waiting for it */
+  guint dirty : 1;
+} SearchRecord;
 
+typedef struct {
+  char **terms; /* casefolded */
+  char **uuids;
+  guint n_pending; /* process lookups to wait for */
+} SearchScreensData;
+
+static gboolean search_screens_complete_cb (GTask *task);
+
+/* Lets the searches waiting for @record's process lookup go on. They
+ * complete from an idle, since @record may be going away.
+ */
 static void
-terminal_app_init (TerminalApp *app)
+search_record_release_waiters (SearchRecord *record)
 {
-  terminal_app_init_debug ();
+  GSList *l;
+
+  for (l = record->waiters; l != NULL; l = l->next)
+    {
+      GTask *task = l->data;
+      SearchScreensData *data = g_task_get_task_data (task);
+
+      if (--data->n_pending == 0)
+        _terminal_watchdog_idle_add_full (G_PRIORITY_DEFAULT, "search screens",
+                                          (GSourceFunc) search_screens_complete_cb,
+                                          g_object_ref (task), g_object_unref);
+      g_object_unref (task);
+    }
 
-  gtk_window_set_default_icon_name (GNOME_TERMINAL_ICON_NAME);
+  g_slist_free (record->waiters);
+  record->waiters = NULL;
+}
 
-  /* Desktop proxy settings */
-  app->system_proxy_settings = g_settings_new (SYSTEM_PROXY_SETTINGS_SCHEMA);
+static void
+search_record_free (SearchRecord *record)
+{
+  g_signal_handlers_disconnect_matched (record->screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, record);
+  if (record->cancellable)
+    {
+      g_cancellable_cancel (record->cancellable);
+      g_object_unref (record->cancellable);
+    }
+  search_record_release_waiters (record);
+  g_free (record->uuid);
+  g_free (record->title);
+  g_free (record->cwd);
+  g_free (record->process);
+  g_free (record->cmdline);
+  g_slice_free (SearchRecord, record);
+}
 
-  /* Desktop Interface settings */
-  app->desktop_interface_settings = g_settings_new (DESKTOP_INTERFACE_SETTINGS_SCHEMA);
+static void
+search_record_mark_dirty_cb (GObject *object,
+                             GParamSpec *pspec,
+                             SearchRecord *record)
+{
+  record->dirty = TRUE;
+}
 
-  /* Terminal global settings */
-  app->global_settings = g_settings_new (TERMINAL_SETTING_SCHEMA);
+static void
+search_record_cwd_changed_cb (VteTerminal *terminal,
+                              SearchRecord *record)
+{
+  record->dirty = TRUE;
+}
 
-  /* Gtk debug settings */
-  app->gtk_debug_settings = terminal_g_settings_new (GTK_DEBUG_SETTING_SCHEMA,
-                                                     GTK_DEBUG_ENABLE_INSPECTOR_KEY,
-                                                     GTK_DEBUG_ENABLE_INSPECTOR_TYPE);
+static void
+search_record_process_cb (TerminalScreen *screen,
+                          GAsyncResult *result,
+                          SearchRecord *record)
+{
+  gs_free_error GError *error = NULL;
+  gs_free char *process = NULL, *cmdline = NULL;
+
+  gboolean found;
+
+  found = terminal_screen_get_foreground_process_finish (screen, result,
+                                                         &process, &cmdline,
+                                                         &error);
+  /* On cancellation, @record may have been freed already */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  g_clear_object (&record->cancellable);
+  search_record_release_waiters (record);
+  if (!found)
+    return;
+
+  g_free (record->process);
+  record->process = terminal_util_normalize_casefold_and_unaccent (process);
+  g_free (record->cmdline);
+  record->cmdline = terminal_util_normalize_casefold_and_unaccent (cmdline);
+
+  _terminal_debug_print (TERMINAL_DEBUG_SEARCH,
+                         "Refreshed search record %s: process %s\n",
+                         record->uuid, process ? process : "(unknown)");
+}
+
+static void
+search_record_refresh (SearchRecord *record)
+{
+  TerminalScreen *screen = record->screen;
+  int fgpgrp;
+
+  if (record->dirty)
+    {
+      g_free (record->title);
+      record->title = terminal_util_normalize_casefold_and_unaccent (terminal_screen_get_title (screen));
+      g_free (record->cwd);
+      record->cwd = terminal_util_normalize_casefold_and_unaccent (vte_terminal_get_current_directory_uri (VTE_TERMINAL (screen)));
+      record->dirty = FALSE;
+    }
+
+  fgpgrp = terminal_screen_get_foreground_pgrp (screen);
+  if (fgpgrp == record->fgpgrp)
+    return;
+
+  record->fgpgrp = fgpgrp;
+  g_clear_pointer (&record->process, g_free);
+  g_clear_pointer (&record->cmdline, g_free);
+
+  if (record->cancellable)
+    {
+      g_cancellable_cancel (record->cancellable);
+      g_object_unref (record->cancellable);
+      record->cancellable = NULL;
+    }
+
+  /* Searches waiting for the previous lookup now wait for this one */
+  if (fgpgrp == -1)
+    {
+      search_record_release_waiters (record);
+      return;
+    }
+
+  /* Don't block on procfs here */
+  record->cancellable = g_cancellable_new ();
+  terminal_screen_get_foreground_process_async (screen,
+                                                record->cancellable,
+                                                (GAsyncReadyCallback) search_record_process_cb,
+                                                record);
+}
+
+static gboolean
+search_record_match_string (const char *str,
+                            const char *const *terms)
+{
+  guint i;
+
+  if (str == NULL)
+    return FALSE;
+
+  for (i = 0; terms[i] != NULL; i++)
+    {
+      if (strstr (str, terms[i]) == NULL)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+search_record_matches (SearchRecord *record,
+                       const char *const *terms)
+{
+  return search_record_match_string (record->cwd, terms) ||
+         search_record_match_string (record->title, terms) ||
+         search_record_match_string (record->process, terms) ||
+         search_record_match_string (record->cmdline, terms);
+}
+
+static void
+terminal_app_add_search_record (TerminalApp *app,
+                                TerminalScreen *screen)
+{
+  SearchRecord *record;
+
+  record = g_slice_new0 (SearchRecord);
+  record->screen = screen;
+  record->uuid = g_strdup (terminal_screen_get_uuid (screen));
+  record->fgpgrp = -1;
+  record->dirty = TRUE;
+
+  g_signal_connect (screen, "notify::title",
+                    G_CALLBACK (search_record_mark_dirty_cb), record);
+  g_signal_connect (screen, "current-directory-uri-changed",
+                    G_CALLBACK (search_record_cwd_changed_cb), record);
+
+  g_ptr_array_add (app->search_records, record);
+  g_hash_table_insert (app->search_record_map, record->uuid, record);
+}
+
+static void
+terminal_app_remove_search_record (TerminalApp *app,
+                                   TerminalScreen *screen)
+{
+  SearchRecord *record;
+
+  record = g_hash_table_lookup (app->search_record_map,
+                                terminal_screen_get_uuid (screen));
+  if (record == NULL)
+    return;
+
+  g_hash_table_remove (app->search_record_map, record->uuid);
+  g_ptr_array_remove_fast (app->search_records, record);
+}
+
+#endif /* ENABLE_SEARCH_PROVIDER */
+
+/* Prewarming
+ *
+ * For profiles that have the prewarm setting enabled, we keep one spare
+ * screen around whose child process has already been spawned, and hand it
+ * out to the next new terminal that is launched with the same profile,
+ * working directory and environment.
+ */
+
+static gboolean
+strv_equal (char **a,
+            char **b)
+{
+  guint i;
+
+  if (a == NULL || b == NULL)
+    return a == b;
+
+  for (i = 0; a[i] != NULL && b[i] != NULL; i++)
+    if (!g_str_equal (a[i], b[i]))
+      return FALSE;
+
+  return a[i] == NULL && b[i] == NULL;
+}
+
+static void
+terminal_app_discard_spare_screen (TerminalApp *app)
+{
+  if (app->spare_screen == NULL)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Discarding spare screen %p\n",
+                         app->spare_screen);
+
+  g_signal_handlers_disconnect_matched (app->spare_screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, app);
+  gtk_widget_destroy (GTK_WIDGET (app->spare_screen));
+  g_clear_object (&app->spare_screen);
+}
+
+static void
+spare_screen_child_exited_cb (VteTerminal *terminal,
+                              int status,
+                              TerminalApp *app)
+{
+  /* The spare screen isn't in a window, so don't let the default
+   * handler run the profile's exit action.
+   */
+  g_signal_stop_emission_by_name (terminal, "child-exited");
+
+  terminal_app_discard_spare_screen (app);
+}
+
+static gboolean
+terminal_app_prewarm_cb (TerminalApp *app)
+{
+  app->prewarm_source_id = 0;
+
+  if (app->spare_screen != NULL || app->spare_profile == NULL)
+    return G_SOURCE_REMOVE;
+
+  /* Not registered until it is taken, so it isn't on the bus, searched or
+   * counted before it's in a window
+   */
+  app->spare_screen = _terminal_screen_new_spare (app->spare_profile,
+                                                  app->spare_working_dir,
+                                                  app->spare_env);
+  g_object_ref_sink (app->spare_screen);
+  g_signal_connect (app->spare_screen, "child-exited",
+                    G_CALLBACK (spare_screen_child_exited_cb), app);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Prewarming spare screen %p in %s\n",
+                         app->spare_screen,
+                         app->spare_working_dir ? app->spare_working_dir : "(home)");
+
+  _terminal_screen_launch_child_on_idle (app->spare_screen);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+terminal_app_schedule_prewarm (TerminalApp *app,
+                               GSettings *profile,
+                               const char *working_dir,
+                               char **env)
+{
+  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_PREWARM_KEY))
+    return;
+
+  if (app->spare_screen != NULL)
+    return;
+
+  g_object_ref (profile);
+  g_clear_object (&app->spare_profile);
+  app->spare_profile = profile;
+  g_free (app->spare_working_dir);
+  app->spare_working_dir = g_strdup (working_dir);
+  g_strfreev (app->spare_env);
+  app->spare_env = g_strdupv (env);
+
+  if (app->prewarm_source_id == 0)
+    app->prewarm_source_id = _terminal_watchdog_idle_add_full (G_PRIORITY_LOW, "prewarm",
+                                                               (GSourceFunc) terminal_app_prewarm_cb,
+                                                               app, NULL);
+}
+
+/*
+ * terminal_app_take_spare_screen:
+ *
+ * Returns: (transfer full): the spare screen, if it was prewarmed for
+ *   exactly these parameters, or %NULL
+ */
+static TerminalScreen *
+terminal_app_take_spare_screen (TerminalApp *app,
+                                GSettings *profile,
+                                const char *working_dir,
+                                char **env)
+{
+  TerminalScreen *screen;
+
+  if (app->spare_screen == NULL)
+    return NULL;
+
+  if (app->spare_profile != profile ||
+      !g_settings_get_boolean (profile, TERMINAL_PROFILE_PREWARM_KEY) ||
+      terminal_screen_get_profile (app->spare_screen) != profile ||
+      g_strcmp0 (app->spare_working_dir, working_dir) != 0 ||
+      !strv_equal (app->spare_env, env))
+    {
+      /* Don't keep a shell around that we're not going to use */
+      terminal_app_discard_spare_screen (app);
+      return NULL;
+    }
+
+  screen = app->spare_screen;
+  app->spare_screen = NULL;
+  g_signal_handlers_disconnect_matched (screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, app);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Using spare screen %p\n", screen);
+
+  _terminal_screen_register (screen);
+
+  return screen;
+}
+
+/* Headless screens */
+
+static void
+terminal_app_remove_headless_screen (TerminalApp *app,
+                                     TerminalScreen *screen)
+{
+  g_signal_handlers_disconnect_matched (screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, app);
+  g_ptr_array_remove (app->headless_screens, screen);
+  g_application_release (G_APPLICATION (app));
+}
+
+static void
+headless_screen_child_exited_cb (VteTerminal *terminal,
+                                 int status,
+                                 TerminalApp *app)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
+
+  /* The receiver has already sent the exit status on. Nobody can see
+   * the screen, so don't run the profile's exit action; just drop it.
+   */
+  g_signal_stop_emission_by_name (terminal, "child-exited");
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Headless screen %p exited\n", screen);
+
+  g_object_ref (screen);
+  terminal_app_remove_headless_screen (app, screen);
+  gtk_widget_destroy (GTK_WIDGET (screen));
+  g_object_unref (screen);
+}
+
+static void
+terminal_app_discard_headless_screens (TerminalApp *app)
+{
+  while (app->headless_screens->len > 0) {
+    TerminalScreen *screen = g_object_ref (g_ptr_array_index (app->headless_screens,
+                                                              app->headless_screens->len - 1));
+
+    terminal_app_remove_headless_screen (app, screen);
+    gtk_widget_destroy (GTK_WIDGET (screen));
+    g_object_unref (screen);
+  }
+}
+
+/**
+ * terminal_app_add_headless_screen:
+ * @app:
+ * @screen: a new #TerminalScreen
+ *
+ * Keeps @screen alive without putting it into a window, so its child can
+ * run without the widget tree of a window, and without being rendered.
+ * The screen is destroyed when its child exits, unless it has been taken
+ * with terminal_app_take_headless_screen() before.
+ */
+void
+terminal_app_add_headless_screen (TerminalApp *app,
+                                  TerminalScreen *screen)
+{
+  g_return_if_fail (TERMINAL_IS_APP (app));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Adding headless screen %p\n", screen);
+
+  g_ptr_array_add (app->headless_screens, g_object_ref_sink (screen));
+  g_signal_connect (screen, "child-exited",
+                    G_CALLBACK (headless_screen_child_exited_cb), app);
+
+  /* Like a window, a headless screen keeps the server running */
+  g_application_hold (G_APPLICATION (app));
+}
+
+/**
+ * terminal_app_take_headless_screen:
+ * @app:
+ * @screen: a #TerminalScreen
+ *
+ * Removes @screen from the headless screens, so it can be attached to a
+ * window.
+ *
+ * Returns: %TRUE if @screen was headless, in which case the caller owns
+ *   the reference @app held on it; %FALSE otherwise
+ */
+gboolean
+terminal_app_take_headless_screen (TerminalApp *app,
+                                   TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_APP (app), FALSE);
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+
+  guint i;
+  for (i = 0; i < app->headless_screens->len; i++) {
+    if (g_ptr_array_index (app->headless_screens, i) == screen)
+      break;
+  }
+  if (i == app->headless_screens->len)
+    return FALSE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Attaching headless screen %p\n", screen);
+
+  /* Keep the array's reference for the caller */
+  g_object_ref (screen);
+  terminal_app_remove_headless_screen (app, screen);
+
+  return TRUE;
+}
+
+/* GObjectClass impl */
+
+/* Scrollback memory budget */
+
+static gsize
+terminal_app_get_scrollback_budget (TerminalApp *app)
+{
+  return (gsize) g_settings_get_uint (app->global_settings,
+                                      TERMINAL_SETTING_SCROLLBACK_MEMORY_BUDGET_KEY) * 1024 * 1024;
+}
+
+static int
+compare_screens_by_last_focus_time (gconstpointer a,
+                                    gconstpointer b)
+{
+  gint64 ta = terminal_screen_get_last_focus_time (*(TerminalScreen **) a);
+  gint64 tb = terminal_screen_get_last_focus_time (*(TerminalScreen **) b);
+
+  return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+static gboolean
+terminal_app_check_memory_cb (TerminalApp *app)
+{
+  gsize budget, share, total = 0, hibernating = 0;
+  GHashTableIter iter;
+  gpointer screen;
+
+  budget = terminal_app_get_scrollback_budget (app);
+  if (budget == 0) {
+    app->memory_check_source_id = 0;
+    return FALSE; /* don't run again */
+  }
+
+  gs_unref_ptrarray GPtrArray *screens = g_ptr_array_sized_new (g_hash_table_size (app->screen_map));
+  g_hash_table_iter_init (&iter, app->screen_map);
+  while (g_hash_table_iter_next (&iter, NULL, &screen)) {
+    total += terminal_screen_get_scrollback_bytes (screen);
+    g_ptr_array_add (screens, screen);
+  }
+
+  _terminal_debug_print (TERMINAL_DEBUG_MEMORY,
+                         "Scrollback of %u screens uses about %" G_GSIZE_FORMAT " of %" G_GSIZE_FORMAT " bytes\n",
+                         screens->len, total, budget);
+
+  if (total <= budget)
+    return TRUE; /* run again */
+
+  /* Trim the least recently used screens first. Screens that can't move
+   * their scrollback to disk keep their share of the budget. A scrollback
+   * being moved to disk is only taken off the total by the next check,
+   * once that succeeded; until then, don't trim others in its place.
+   */
+  share = budget / screens->len;
+  g_ptr_array_sort (screens, compare_screens_by_last_focus_time);
+  for (guint i = 0; i < screens->len && total > budget + hibernating; i++) {
+    TerminalScreen *s = screens->pdata[i];
+    gsize bytes = terminal_screen_get_scrollback_bytes (s);
+
+    if (bytes == 0)
+      continue;
+
+    if (terminal_screen_trim_scrollback (s, share))
+      hibernating += bytes;
+    else
+      total -= bytes - MIN (bytes, terminal_screen_get_scrollback_bytes (s));
+  }
+
+  return TRUE; /* run again */
+}
+
+static void
+terminal_app_scrollback_budget_changed_cb (GSettings *settings,
+                                           const char *key,
+                                           TerminalApp *app)
+{
+  if (terminal_app_get_scrollback_budget (app) == 0 ||
+      app->memory_check_source_id != 0)
+    return;
+
+  app->memory_check_source_id =
+    _terminal_watchdog_timeout_add_seconds (MEMORY_CHECK_INTERVAL, "memory check",
+                                            (GSourceFunc) terminal_app_check_memory_cb,
+                                            app);
+}
+
+static void
+snapshot_saved_cb (GObject *source,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+  TerminalApp *app = TERMINAL_APP (source);
+  gs_free_error GError *error = NULL;
+
+  if (!terminal_snapshot_save_finish (app, result, &error)) {
+    /* Try again next time */
+    app->session_dirty = TRUE;
+
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_printerr ("Failed to save the session snapshot: %s\n", error->message);
+  }
+
+  g_clear_object (&app->snapshot_cancellable);
+}
+
+static gboolean
+terminal_app_has_terminal_windows (TerminalApp *app)
+{
+  GList *l;
+
+  for (l = gtk_application_get_windows (GTK_APPLICATION (app)); l != NULL; l = l->next)
+    if (TERMINAL_IS_WINDOW (l->data))
+      return TRUE;
+
+  return FALSE;
+}
+
+static gboolean
+terminal_app_snapshot_cb (TerminalApp *app)
+{
+  /* Keep the last snapshot of a session that had windows, don't save
+   * one when nothing changed, and don't start another save while one
+   * is still being written.
+   */
+  if (!app->session_dirty ||
+      app->snapshot_cancellable != NULL ||
+      !terminal_app_has_terminal_windows (app))
+    return TRUE; /* run again */
+
+  /* What changes from now on goes into the next one */
+  app->session_dirty = FALSE;
+  app->snapshot_cancellable = g_cancellable_new ();
+  terminal_snapshot_save_async (app,
+                                g_settings_get_boolean (app->global_settings,
+                                                        TERMINAL_SETTING_SESSION_SNAPSHOT_SCROLLBACK_KEY),
+                                app->snapshot_cancellable,
+                                snapshot_saved_cb, NULL);
+
+  return TRUE; /* run again */
+}
+
+static void
+terminal_app_snapshot_interval_changed_cb (GSettings *settings,
+                                           const char *key,
+                                           TerminalApp *app)
+{
+  guint interval = g_settings_get_uint (settings, TERMINAL_SETTING_SESSION_SNAPSHOT_INTERVAL_KEY);
+
+  if (app->snapshot_source_id != 0) {
+    g_source_remove (app->snapshot_source_id);
+    app->snapshot_source_id = 0;
+  }
+
+  if (interval == 0)
+    return;
+
+  app->snapshot_source_id =
+    _terminal_watchdog_timeout_add_seconds (interval, "session snapshot",
+                                            (GSourceFunc) terminal_app_snapshot_cb, app);
+}
+
+/* FD accounting
+ *
+ * The server raises RLIMIT_NOFILE to the hard limit, but with thousands
+ * of terminals it can still run out. A new child is refused up front
+ * when that would leave less than FD_HEADROOM FDs free, so the D-Bus
+ * connection and the dialogs keep working. In addition, a few FDs are
+ * held open as a reserve, which terminal_app_release_fd_reserve() gives
+ * up for operations that must not fail for lack of an FD.
+ */
+
+static guint
+count_open_fds (void)
+{
+  GDir *dir;
+  guint n = 0;
+
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  if (dir == NULL)
+    dir = g_dir_open ("/dev/fd", 0, NULL);
+  if (dir == NULL)
+    return 0;
+
+  while (g_dir_read_name (dir) != NULL)
+    n++;
+  g_dir_close (dir);
+
+  return n > 0 ? n - 1 : 0; /* the directory's own FD */
+}
+
+static void
+fd_reserve_fill (TerminalApp *app)
+{
+  while (app->n_reserved_fds < N_RESERVED_FDS) {
+    int fd = open ("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      break;
+
+    app->reserved_fds[app->n_reserved_fds++] = fd;
+  }
+}
+
+static void
+terminal_app_update_fd_usage (TerminalApp *app)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (now - app->fd_usage_time < FD_USAGE_MAX_AGE)
+    return;
+
+  app->fd_usage = count_open_fds ();
+  app->fd_usage_time = now;
+
+  /* Take the reserve back once there is room again */
+  if (app->n_reserved_fds < N_RESERVED_FDS &&
+      app->fd_usage + N_RESERVED_FDS + FD_HEADROOM < app->fd_limit)
+    fd_reserve_fill (app);
+}
+
+static void
+terminal_app_init_fd_usage (TerminalApp *app)
+{
+  struct rlimit l;
+
+  if (getrlimit (RLIMIT_NOFILE, &l) == 0 && l.rlim_cur != RLIM_INFINITY)
+    app->fd_limit = MIN (l.rlim_cur, G_MAXUINT);
+
+  fd_reserve_fill (app);
+}
+
+static void
+terminal_app_update_standby (TerminalApp *app)
+{
+  gboolean standby;
+
+  /* The setting is only for the default server; other servers, like
+   * the shards, would otherwise never exit after their last window.
+   */
+  standby = app->standby_forced ||
+            (g_strcmp0 (g_application_get_application_id (G_APPLICATION (app)),
+                        TERMINAL_APPLICATION_ID) == 0 &&
+             g_settings_get_boolean (app->global_settings, TERMINAL_SETTING_SERVER_STANDBY_KEY));
+  if (standby == app->standby_held)
+    return;
+
+  app->standby_held = standby;
+  if (standby)
+    g_application_hold (G_APPLICATION (app));
+  else
+    g_application_release (G_APPLICATION (app));
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER, "Standby %s\n", standby ? "on" : "off");
+}
+
+static void
+terminal_app_standby_changed_cb (GSettings *settings,
+                                 const char *key,
+                                 TerminalApp *app)
+{
+  terminal_app_update_standby (app);
+}
+
+static void
+terminal_app_window_added (GtkApplication *application,
+                           GtkWindow *window)
+{
+  TerminalApp *app = TERMINAL_APP (application);
+
+  /* A window opened while waiting for one: wait longer next time */
+  if (app->idle_since != 0 &&
+      gtk_application_get_windows (application) == NULL) {
+    gint64 idle = (g_get_monotonic_time () - app->idle_since) / 1000;
+
+    if (idle < app->adaptive_inactivity_timeout / 2)
+      app->adaptive_inactivity_timeout = MIN (app->adaptive_inactivity_timeout * 2,
+                                              ADAPTIVE_INACTIVITY_TIMEOUT_MAX);
+
+    _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                           "New window after %" G_GINT64_FORMAT " ms idle, adaptive inactivity timeout now %u ms\n",
+                           idle, app->adaptive_inactivity_timeout);
+  }
+  app->idle_since = 0;
+  app->session_dirty = TRUE;
+
+  GTK_APPLICATION_CLASS (terminal_app_parent_class)->window_added (application, window);
+}
+
+static void
+terminal_app_window_removed (GtkApplication *application,
+                             GtkWindow *window)
+{
+  TerminalApp *app = TERMINAL_APP (application);
+  GList *windows = gtk_application_get_windows (application);
+
+  /* The inactivity timeout starts when the last window releases the app */
+  if (windows != NULL && windows->next == NULL) {
+    int timeout = g_settings_get_int (app->global_settings,
+                                      TERMINAL_SETTING_SERVER_INACTIVITY_TIMEOUT_KEY);
+
+    g_application_set_inactivity_timeout (G_APPLICATION (app),
+                                          timeout < 0 ? app->adaptive_inactivity_timeout
+                                                      : (guint) timeout * 1000);
+    app->idle_since = g_get_monotonic_time ();
+  }
+  app->session_dirty = TRUE;
+
+  GTK_APPLICATION_CLASS (terminal_app_parent_class)->window_removed (application, window);
+}
+
+static void
+terminal_app_init (TerminalApp *app)
+{
+  terminal_app_init_debug ();
+
+  gtk_window_set_default_icon_name (GNOME_TERMINAL_ICON_NAME);
+
+  /* Desktop proxy settings */
+  app->system_proxy_settings = g_settings_new (SYSTEM_PROXY_SETTINGS_SCHEMA);
+
+  /* Desktop Interface settings */
+  app->desktop_interface_settings = g_settings_new (DESKTOP_INTERFACE_SETTINGS_SCHEMA);
+
+  /* Terminal global settings */
+  app->global_settings = g_settings_new (TERMINAL_SETTING_SCHEMA);
+
+  /* Gtk debug settings */
+  app->gtk_debug_settings = terminal_g_settings_new (GTK_DEBUG_SETTING_SCHEMA,
+                                                     GTK_DEBUG_ENABLE_INSPECTOR_KEY,
+                                                     GTK_DEBUG_ENABLE_INSPECTOR_TYPE);
 
 #if GTK_CHECK_VERSION (3, 19, 0)
-  GtkSettings *gtk_settings = gtk_settings_get_default ();
+  app->theme_variant = -1;
   terminal_app_theme_variant_changed_cb (app->global_settings,
-                                         TERMINAL_SETTING_THEME_VARIANT_KEY, gtk_settings);
+                                         TERMINAL_SETTING_THEME_VARIANT_KEY, app);
   g_signal_connect (app->global_settings,
                     "changed::" TERMINAL_SETTING_THEME_VARIANT_KEY,
                     G_CALLBACK (terminal_app_theme_variant_changed_cb),
-                    gtk_settings);
+                    app);
 #endif /* GTK+ 3.19 */
 
   /* Clipboard targets */
@@ -781,6 +2009,42 @@ terminal_app_init (TerminalApp *app)
   app->profiles_list = terminal_profiles_list_new ();
 
   app->screen_map = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  app->screen_slots = g_array_new (FALSE, TRUE, sizeof (ScreenSlot));
+  g_array_set_clear_func (app->screen_slots, (GDestroyNotify) screen_slot_clear);
+  app->free_screen_slots = g_array_new (FALSE, FALSE, sizeof (guint));
+  app->headless_screens = g_ptr_array_new_with_free_func (g_object_unref);
+  app->environments = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                             (GDestroyNotify) environment_entry_free);
+  app->environment_map = g_hash_table_new (NULL, NULL);
+
+  terminal_app_scrollback_budget_changed_cb (app->global_settings,
+                                             TERMINAL_SETTING_SCROLLBACK_MEMORY_BUDGET_KEY, app);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_SCROLLBACK_MEMORY_BUDGET_KEY,
+                    G_CALLBACK (terminal_app_scrollback_budget_changed_cb),
+                    app);
+
+  app->session_dirty = TRUE;
+  terminal_app_snapshot_interval_changed_cb (app->global_settings,
+                                             TERMINAL_SETTING_SESSION_SNAPSHOT_INTERVAL_KEY, app);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_SESSION_SNAPSHOT_INTERVAL_KEY,
+                    G_CALLBACK (terminal_app_snapshot_interval_changed_cb),
+                    app);
+
+  terminal_app_init_fd_usage (app);
+
+  app->adaptive_inactivity_timeout = ADAPTIVE_INACTIVITY_TIMEOUT_MIN;
+  /* The standby is first looked at in terminal_app_startup() */
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_SERVER_STANDBY_KEY,
+                    G_CALLBACK (terminal_app_standby_changed_cb),
+                    app);
+
+#ifdef ENABLE_SEARCH_PROVIDER
+  app->search_records = g_ptr_array_new_with_free_func ((GDestroyNotify) search_record_free);
+  app->search_record_map = g_hash_table_new (g_str_hash, g_str_equal);
+#endif /* ENABLE_SEARCH_PROVIDER */
 
   gs_unref_object GSettings *settings = g_settings_get_child (app->global_settings, "keybindings");
   terminal_accels_init (G_APPLICATION (app), settings);
@@ -794,12 +2058,60 @@ terminal_app_finalize (GObject *object)
   g_signal_handlers_disconnect_by_func (app->clipboard,
                                         G_CALLBACK (clipboard_owner_change_cb),
                                         app);
+  if (app->clipboard_targets_source_id != 0)
+    g_source_remove (app->clipboard_targets_source_id);
   free_clipboard_targets (app);
 
   g_signal_handlers_disconnect_by_func (app->profiles_list,
                                         G_CALLBACK (terminal_app_update_profile_menus),
                                         app);
+  if (app->prewarm_source_id != 0)
+    g_source_remove (app->prewarm_source_id);
+  terminal_app_discard_spare_screen (app);
+
+  if (app->deferred_startup_source_id != 0)
+    g_source_remove (app->deferred_startup_source_id);
+
+  while (app->n_reserved_fds > 0)
+    close (app->reserved_fds[--app->n_reserved_fds]);
+
+  g_clear_object (&app->spare_profile);
+  g_free (app->spare_working_dir);
+  g_strfreev (app->spare_env);
+
+  if (app->memory_check_source_id != 0)
+    g_source_remove (app->memory_check_source_id);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_scrollback_budget_changed_cb),
+                                        app);
+
+  if (app->snapshot_source_id != 0)
+    g_source_remove (app->snapshot_source_id);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_snapshot_interval_changed_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_standby_changed_cb),
+                                        app);
+
+  terminal_app_discard_headless_screens (app);
+  g_ptr_array_unref (app->headless_screens);
+
+  g_signal_handlers_disconnect_by_func (gtk_settings_get_default (),
+                                        G_CALLBACK (app_theme_css_changed_cb),
+                                        app);
+  g_clear_pointer (&app->theme_css_providers, g_hash_table_unref);
+
   g_hash_table_destroy (app->screen_map);
+  g_array_unref (app->screen_slots);
+  g_array_unref (app->free_screen_slots);
+  g_hash_table_destroy (app->environment_map);
+  g_hash_table_destroy (app->environments);
+
+#ifdef ENABLE_SEARCH_PROVIDER
+  g_hash_table_destroy (app->search_record_map);
+  g_ptr_array_unref (app->search_records);
+#endif /* ENABLE_SEARCH_PROVIDER */
 
   g_object_unref (app->global_settings);
   g_object_unref (app->desktop_interface_settings);
@@ -811,6 +2123,10 @@ terminal_app_finalize (GObject *object)
   g_clear_object (&app->menubar_set_profile_section);
   g_clear_object (&app->menubar_set_encoding_submenu);
   g_clear_object (&app->set_profile_menu);
+  for (guint i = 0; i < N_NEW_TERMINAL_ITEMS; i++)
+    g_clear_object (&app->new_terminal_submenus[i]);
+  if (app->profile_menu_data != NULL)
+    g_array_unref (app->profile_menu_data);
 
   terminal_accels_shutdown ();
 
@@ -826,6 +2142,7 @@ terminal_app_dbus_register (GApplication    *application,
   TerminalApp *app = TERMINAL_APP (application);
   gs_unref_object TerminalObjectSkeleton *object = NULL;
   gs_unref_object TerminalFactory *factory = NULL;
+  gs_unref_object TerminalMetrics *metrics = NULL;
 
   if (!G_APPLICATION_CLASS (terminal_app_parent_class)->dbus_register (application,
                                                                        connection,
@@ -834,6 +2151,10 @@ terminal_app_dbus_register (GApplication    *application,
     return FALSE;
 
 #ifdef ENABLE_SEARCH_PROVIDER
+  /* Not deferred: gnome-shell activates the server for a search and calls
+   * it right away, and exporting it costs next to nothing; the searching
+   * only starts once it is called.
+   */
   if (g_settings_get_boolean (app->global_settings, TERMINAL_SETTING_SHELL_INTEGRATION_KEY)) {
     gs_unref_object TerminalSearchProvider *search_provider;
 
@@ -853,6 +2174,9 @@ terminal_app_dbus_register (GApplication    *application,
   factory = terminal_factory_impl_new ();
   terminal_object_skeleton_set_factory (object, factory);
 
+  metrics = terminal_metrics_impl_new ();
+  terminal_object_skeleton_set_metrics (object, metrics);
+
   app->object_manager = g_dbus_object_manager_server_new (TERMINAL_OBJECT_PATH_PREFIX);
   g_dbus_object_manager_server_export (app->object_manager, G_DBUS_OBJECT_SKELETON (object));
 
@@ -868,6 +2192,29 @@ terminal_app_dbus_unregister (GApplication    *application,
 {
   TerminalApp *app = TERMINAL_APP (application);
 
+  /* Losing the bus while windows are open means the session is ending */
+  if (app->snapshot_source_id != 0 &&
+      terminal_app_has_terminal_windows (app)) {
+    gs_free_error GError *error = NULL;
+
+    if (app->snapshot_cancellable != NULL)
+      g_cancellable_cancel (app->snapshot_cancellable);
+
+    if (!terminal_snapshot_save (app,
+                                 g_settings_get_boolean (app->global_settings,
+                                                         TERMINAL_SETTING_SESSION_SNAPSHOT_SCROLLBACK_KEY),
+                                 &error))
+      g_printerr ("Failed to save the session snapshot: %s\n", error->message);
+  }
+
+  /* The spare and headless screens are exported on the object manager too */
+  if (app->prewarm_source_id != 0) {
+    g_source_remove (app->prewarm_source_id);
+    app->prewarm_source_id = 0;
+  }
+  terminal_app_discard_spare_screen (app);
+  terminal_app_discard_headless_screens (app);
+
   if (app->object_manager) {
     g_dbus_object_manager_server_unexport (app->object_manager, TERMINAL_FACTORY_OBJECT_PATH);
     g_object_unref (app->object_manager);
@@ -882,45 +2229,351 @@ terminal_app_dbus_unregister (GApplication    *application,
   }
 #endif /* ENABLE_SEARCH_PROVIDER */
 
-  G_APPLICATION_CLASS (terminal_app_parent_class)->dbus_unregister (application,
-                                                                    connection,
-                                                                    object_path);
+  G_APPLICATION_CLASS (terminal_app_parent_class)->dbus_unregister (application,
+                                                                    connection,
+                                                                    object_path);
+}
+
+static void
+terminal_app_class_init (TerminalAppClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GApplicationClass *g_application_class = G_APPLICATION_CLASS (klass);
+  GtkApplicationClass *gtk_application_class = GTK_APPLICATION_CLASS (klass);
+
+  object_class->finalize = terminal_app_finalize;
+
+  g_application_class->activate = terminal_app_activate;
+  g_application_class->startup = terminal_app_startup;
+  g_application_class->dbus_register = terminal_app_dbus_register;
+  g_application_class->dbus_unregister = terminal_app_dbus_unregister;
+
+  gtk_application_class->window_added = terminal_app_window_added;
+  gtk_application_class->window_removed = terminal_app_window_removed;
+
+  signals[CLIPBOARD_TARGETS_CHANGED] =
+    g_signal_new (I_("clipboard-targets-changed"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalAppClass, clipboard_targets_changed),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE, 1, G_TYPE_OBJECT);
+}
+
+/* Public API */
+
+GApplication *
+terminal_app_new (const char *app_id)
+{
+  const GApplicationFlags flags = G_APPLICATION_IS_SERVICE;
+
+  return g_object_new (TERMINAL_TYPE_APP,
+                       "application-id", app_id ? app_id : TERMINAL_APPLICATION_ID,
+                       "flags", flags,
+                       NULL);
+}
+
+/**
+ * terminal_app_set_standby:
+ * @app: a #TerminalApp
+ * @standby: whether to stay in standby
+ *
+ * Keeps @app running without windows even if the "server-standby"
+ * setting is off, e.g. when the server was started at login to have
+ * everything ready for the first window.
+ */
+void
+terminal_app_set_standby (TerminalApp *app,
+                          gboolean standby)
+{
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  app->standby_forced = standby != FALSE;
+  terminal_app_update_standby (app);
+}
+
+/**
+ * terminal_app_mark_session_dirty:
+ * @app: a #TerminalApp
+ *
+ * Notes that something the session snapshot records has changed, so
+ * that the next periodic snapshot is saved. Snapshots are skipped while
+ * nothing changed.
+ */
+void
+terminal_app_mark_session_dirty (TerminalApp *app)
+{
+  app->session_dirty = TRUE;
+}
+
+/**
+ * terminal_app_reserve_fds:
+ * @app: a #TerminalApp
+ * @n_fds: the number of FDs the operation is going to open
+ * @error: return location for a #GError
+ *
+ * Checks that opening @n_fds more FDs leaves enough free for the
+ * operations that must keep working, and accounts for them until the
+ * open FDs are counted again.
+ *
+ * Returns: %TRUE if there is room for @n_fds more FDs, or %FALSE with @error set
+ */
+gboolean
+terminal_app_reserve_fds (TerminalApp *app,
+                          guint n_fds,
+                          GError **error)
+{
+  g_return_val_if_fail (TERMINAL_IS_APP (app), FALSE);
+
+  if (app->fd_limit == 0)
+    return TRUE;
+
+  terminal_app_update_fd_usage (app);
+
+  if (app->fd_usage + n_fds + FD_HEADROOM > app->fd_limit) {
+    _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                           "Refusing %u more FDs with %u of %u in use\n",
+                           n_fds, app->fd_usage, app->fd_limit);
+
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_TOO_MANY_OPEN_FILES,
+                 _("The terminal server has %u of at most %u files open. "
+                   "Close some terminals and try again."),
+                 app->fd_usage, app->fd_limit);
+    return FALSE;
+  }
+
+  app->fd_usage += n_fds;
+  return TRUE;
+}
+
+/**
+ * terminal_app_unreserve_fds:
+ * @app: a #TerminalApp
+ * @n_fds: the number of FDs reserved with terminal_app_reserve_fds()
+ *
+ * Gives back FDs that were reserved for an operation that failed before
+ * opening them.
+ */
+void
+terminal_app_unreserve_fds (TerminalApp *app,
+                            guint n_fds)
+{
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  if (app->fd_limit == 0)
+    return;
+
+  app->fd_usage -= MIN (app->fd_usage, n_fds);
+}
+
+/**
+ * terminal_app_release_fd_reserve:
+ * @app: a #TerminalApp
+ *
+ * Closes the reserved FDs when the server is close to its FD limit, so
+ * that an operation that must not fail, like saving the contents of a
+ * terminal, gets them. The reserve is taken back once there is room again.
+ */
+void
+terminal_app_release_fd_reserve (TerminalApp *app)
+{
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  if (app->fd_limit == 0 || app->n_reserved_fds == 0)
+    return;
+
+  app->fd_usage_time = 0; /* count again */
+  terminal_app_update_fd_usage (app);
+  if (app->fd_usage + FD_HEADROOM <= app->fd_limit)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Releasing %u reserved FDs with %u of %u in use\n",
+                         app->n_reserved_fds, app->fd_usage, app->fd_limit);
+
+  while (app->n_reserved_fds > 0) {
+    close (app->reserved_fds[--app->n_reserved_fds]);
+    app->fd_usage--;
+  }
+}
+
+/* Clients compute the same ID, see terminal_client_compute_environment_id() */
+static char *
+environment_compute_id (char **envv)
+{
+  gs_free_checksum GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  guint i;
+
+  for (i = 0; envv != NULL && envv[i] != NULL; i++)
+    g_checksum_update (checksum, (const guchar *) envv[i], strlen (envv[i]) + 1 /* NUL */);
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+static EnvironmentEntry *
+terminal_app_ensure_environment (TerminalApp *app,
+                                 char **envv)
+{
+  EnvironmentEntry *entry;
+  char *id;
+
+  id = environment_compute_id (envv);
+  entry = g_hash_table_lookup (app->environments, id);
+  if (entry != NULL) {
+    g_free (id);
+    return entry;
+  }
+
+  entry = g_slice_new0 (EnvironmentEntry);
+  entry->id = id;
+  entry->envv = g_strdupv (envv);
+  g_hash_table_insert (app->environments, entry->id, entry);
+  g_hash_table_insert (app->environment_map, entry->envv, entry);
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Added environment %s with %u variables, %u environments now\n",
+                         entry->id, g_strv_length (entry->envv),
+                         g_hash_table_size (app->environments));
+
+  return entry;
+}
+
+static gboolean
+environment_entry_is_unused (EnvironmentEntry *entry,
+                             gint64 now)
+{
+  return entry->ref_count == 0 &&
+    (entry->registered_time == 0 ||
+     now - entry->registered_time > REGISTERED_ENVIRONMENT_TTL);
+}
+
+static void
+terminal_app_remove_environment (TerminalApp *app,
+                                 EnvironmentEntry *entry)
+{
+  g_hash_table_remove (app->environment_map, entry->envv);
+  g_hash_table_remove (app->environments, entry->id); /* frees entry */
+}
+
+/**
+ * terminal_app_intern_environment:
+ * @app: a #TerminalApp
+ * @envv: (allow-none): an environment
+ *
+ * Returns the shared copy of @envv, so that screens created with the
+ * same environment don't each keep their own. Release it with
+ * terminal_app_release_environment().
+ *
+ * Returns: (transfer none): the shared copy, or %NULL if @envv is %NULL
+ */
+char **
+terminal_app_intern_environment (TerminalApp *app,
+                                 char **envv)
+{
+  EnvironmentEntry *entry;
+
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+
+  if (envv == NULL)
+    return NULL;
+
+  entry = g_hash_table_lookup (app->environment_map, envv);
+  if (entry == NULL)
+    entry = terminal_app_ensure_environment (app, envv);
+
+  entry->ref_count++;
+  return entry->envv;
+}
+
+/**
+ * terminal_app_release_environment:
+ * @app: a #TerminalApp
+ * @envv: (allow-none): an environment returned by terminal_app_intern_environment()
+ *
+ * Drops a reference to @envv.
+ */
+void
+terminal_app_release_environment (TerminalApp *app,
+                                  char **envv)
+{
+  EnvironmentEntry *entry;
+
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  if (envv == NULL)
+    return;
+
+  entry = g_hash_table_lookup (app->environment_map, envv);
+  g_return_if_fail (entry != NULL && entry->ref_count > 0);
+
+  entry->ref_count--;
+  if (environment_entry_is_unused (entry, g_get_monotonic_time ()))
+    terminal_app_remove_environment (app, entry);
 }
 
-static void
-terminal_app_class_init (TerminalAppClass *klass)
+/**
+ * terminal_app_register_environment:
+ * @app: a #TerminalApp
+ * @envv: an environment
+ *
+ * Stores @envv for clients to refer to by ID in their exec options,
+ * instead of sending it along with each of them. It is kept while
+ * screens use it, and for a while after it was last used.
+ *
+ * Returns: (transfer none): the ID of @envv
+ */
+const char *
+terminal_app_register_environment (TerminalApp *app,
+                                   char **envv)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GApplicationClass *g_application_class = G_APPLICATION_CLASS (klass);
+  EnvironmentEntry *entry;
+  GHashTableIter iter;
+  gint64 now;
 
-  object_class->finalize = terminal_app_finalize;
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+  g_return_val_if_fail (envv != NULL, NULL);
 
-  g_application_class->activate = terminal_app_activate;
-  g_application_class->startup = terminal_app_startup;
-  g_application_class->dbus_register = terminal_app_dbus_register;
-  g_application_class->dbus_unregister = terminal_app_dbus_unregister;
+  /* Expire what earlier clients registered */
+  now = g_get_monotonic_time ();
+  g_hash_table_iter_init (&iter, app->environments);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry)) {
+    if (!environment_entry_is_unused (entry, now))
+      continue;
 
-  signals[CLIPBOARD_TARGETS_CHANGED] =
-    g_signal_new (I_("clipboard-targets-changed"),
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  G_STRUCT_OFFSET (TerminalAppClass, clipboard_targets_changed),
-                  NULL, NULL,
-                  g_cclosure_marshal_VOID__OBJECT,
-                  G_TYPE_NONE, 1, G_TYPE_OBJECT);
-}
+    g_hash_table_remove (app->environment_map, entry->envv);
+    g_hash_table_iter_remove (&iter);
+  }
 
-/* Public API */
+  entry = terminal_app_ensure_environment (app, envv);
+  entry->registered_time = now;
 
-GApplication *
-terminal_app_new (const char *app_id)
+  return entry->id;
+}
+
+/**
+ * terminal_app_lookup_environment:
+ * @app: a #TerminalApp
+ * @id: an ID returned by terminal_app_register_environment()
+ *
+ * Returns: (transfer none): the registered environment, or %NULL if
+ *   there is none with ID @id
+ */
+char **
+terminal_app_lookup_environment (TerminalApp *app,
+                                 const char *id)
 {
-  const GApplicationFlags flags = G_APPLICATION_IS_SERVICE;
+  EnvironmentEntry *entry;
 
-  return g_object_new (TERMINAL_TYPE_APP,
-                       "application-id", app_id ? app_id : TERMINAL_APPLICATION_ID,
-                       "flags", flags,
-                       NULL);
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+  g_return_val_if_fail (id != NULL, NULL);
+
+  entry = g_hash_table_lookup (app->environments, id);
+  if (entry == NULL || entry->registered_time == 0)
+    return NULL;
+
+  entry->registered_time = g_get_monotonic_time ();
+  return entry->envv;
 }
 
 /**
@@ -958,15 +2611,38 @@ terminal_app_new_terminal (TerminalApp     *app,
   g_return_val_if_fail (TERMINAL_IS_WINDOW (window), NULL);
   g_return_val_if_fail (charset == NULL || terminal_encodings_is_known_charset (charset), NULL);
 
-  screen = terminal_screen_new (profile, charset, override_command, title,
-                                working_dir, child_env, zoom);
+  /* Only a plain shell can have been prewarmed */
+  if (charset == NULL && override_command == NULL && title == NULL)
+    screen = terminal_app_take_spare_screen (app, profile, working_dir, child_env);
+  else
+    screen = NULL;
+
+  if (screen != NULL)
+    {
+      vte_terminal_set_font_scale (VTE_TERMINAL (screen), zoom);
+
+      terminal_window_add_screen (window, screen, -1);
+      terminal_window_switch_screen (window, screen);
+      gtk_widget_grab_focus (GTK_WIDGET (screen));
+
+      /* The window holds a reference now */
+      g_object_unref (screen);
+    }
+  else
+    {
+      screen = terminal_screen_new (profile, charset, override_command, title,
+                                    working_dir, child_env, zoom);
+
+      terminal_window_add_screen (window, screen, -1);
+      terminal_window_switch_screen (window, screen);
+      gtk_widget_grab_focus (GTK_WIDGET (screen));
 
-  terminal_window_add_screen (window, screen, -1);
-  terminal_window_switch_screen (window, screen);
-  gtk_widget_grab_focus (GTK_WIDGET (screen));
+      /* Launch the child on idle */
+      _terminal_screen_launch_child_on_idle (screen);
+    }
 
-  /* Launch the child on idle */
-  _terminal_screen_launch_child_on_idle (screen);
+  if (override_command == NULL)
+    terminal_app_schedule_prewarm (app, profile, working_dir, child_env);
 
   return screen;
 }
@@ -980,41 +2656,229 @@ terminal_app_get_screen_by_uuid (TerminalApp *app,
   return g_hash_table_lookup (app->screen_map, uuid);
 }
 
+/**
+ * terminal_app_list_screens:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer container): all registered screens, in no particular order
+ */
+GList *
+terminal_app_list_screens (TerminalApp *app)
+{
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+
+  return g_hash_table_get_values (app->screen_map);
+}
+
+/* Whether @screen is in a window, i.e. not headless */
+static gboolean
+screen_is_in_window (TerminalScreen *screen)
+{
+  return TERMINAL_IS_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (screen)));
+}
+
+typedef struct {
+  TerminalAppSearchResultFunc result_func;
+  gpointer user_data;
+  guint n_pending;
+} SearchContentsData;
+
+static void
+search_contents_screen_done_cb (GObject *source,
+                                GAsyncResult *result,
+                                gpointer user_data)
+{
+  GTask *task = user_data;
+  SearchContentsData *data = g_task_get_task_data (task);
+  TerminalScreen *screen = TERMINAL_SCREEN (source);
+  gs_free_error GError *error = NULL;
+  GArray *matches;
+
+  matches = terminal_screen_search_finish (screen, result, &error);
+  if (matches != NULL) {
+    if (matches->len > 0 && !g_task_had_error (task) &&
+        !g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+      data->result_func (screen, matches, data->user_data);
+    g_array_unref (matches);
+  } else if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+             !g_task_had_error (task)) {
+    /* Every screen fails the same way on a bad pattern */
+    g_task_return_error (task, error);
+    error = NULL;
+  }
+
+  if (--data->n_pending == 0 && !g_task_had_error (task) &&
+      !g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+/**
+ * terminal_app_search_contents_async:
+ * @app:
+ * @pattern: a PCRE2 pattern
+ * @compile_flags: the PCRE2 flags to compile @pattern with
+ * @uuids: (allow-none): the UUIDs of the screens to search, or %NULL to search all
+ * @max_rows: only search this many of the last rows of each screen, or -1
+ *   to search all of them
+ * @result_func: called with the matches of each screen as soon as they are found
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: called once all screens have been searched
+ * @user_data: data for @result_func and @callback
+ *
+ * Searches the scrollback of the screens in parallel, see
+ * terminal_screen_search_async() and terminal_screen_search_tail_async().
+ * Headless screens are skipped. @result_func is not called for screens
+ * without a match, nor after @cancellable was cancelled.
+ */
+void
+terminal_app_search_contents_async (TerminalApp *app,
+                                    const char *pattern,
+                                    guint32 compile_flags,
+                                    const char *const *uuids,
+                                    glong max_rows,
+                                    TerminalAppSearchResultFunc result_func,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+  gs_free_list GList *screens = NULL;
+  SearchContentsData *data;
+  GTask *task;
+  GList *l;
+  guint i;
+
+  g_return_if_fail (TERMINAL_IS_APP (app));
+  g_return_if_fail (pattern != NULL);
+  g_return_if_fail (result_func != NULL);
+
+  task = g_task_new (app, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_app_search_contents_async);
+
+  data = g_new0 (SearchContentsData, 1);
+  data->result_func = result_func;
+  data->user_data = user_data;
+  g_task_set_task_data (task, data, g_free);
+
+  if (uuids == NULL)
+    screens = g_hash_table_get_values (app->screen_map);
+  else {
+    for (i = 0; uuids[i] != NULL; i++) {
+      TerminalScreen *screen = g_hash_table_lookup (app->screen_map, uuids[i]);
+
+      if (screen != NULL)
+        screens = g_list_prepend (screens, screen);
+    }
+  }
+
+  /* Hold a reference until every screen is done */
+  data->n_pending = 1;
+
+  for (l = screens; l != NULL; l = l->next) {
+    if (!screen_is_in_window (l->data))
+      continue;
+
+    data->n_pending++;
+    if (max_rows < 0)
+      terminal_screen_search_async (l->data, pattern, compile_flags, cancellable,
+                                    search_contents_screen_done_cb, g_object_ref (task));
+    else
+      terminal_screen_search_tail_async (l->data, pattern, compile_flags, max_rows, cancellable,
+                                         search_contents_screen_done_cb, g_object_ref (task));
+  }
+
+  if (--data->n_pending == 0 && !g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+
+  g_object_unref (task);
+}
+
+/**
+ * terminal_app_search_contents_finish:
+ * @app:
+ * @result: the #GAsyncResult
+ * @error: a #GError location, or %NULL
+ *
+ * Returns: %TRUE if all screens were searched, %FALSE on error
+ */
+gboolean
+terminal_app_search_contents_finish (TerminalApp *app,
+                                     GAsyncResult *result,
+                                     GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, app), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 char *
 terminal_app_dup_screen_object_path (TerminalApp *app,
                                      TerminalScreen *screen)
 {
-  char *object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_FORMAT,
-                                       terminal_screen_get_uuid (screen));
-  object_path = g_strdelimit (object_path,  "-", '_');
-  g_assert (g_variant_is_object_path (object_path));
-  return object_path;
+  guint handle = terminal_screen_get_handle (screen);
+
+  g_return_val_if_fail (handle < app->screen_slots->len, NULL);
+
+  return g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_FORMAT, handle,
+                          g_array_index (app->screen_slots, ScreenSlot, handle).generation);
+}
+
+/* Parses a decimal number up to @end_char, without allocating */
+static gboolean
+parse_object_path_number (const char **str,
+                          char end_char,
+                          guint *number)
+{
+  const char *p = *str;
+  guint64 value = 0;
+
+  if (!g_ascii_isdigit (*p))
+    return FALSE;
+
+  for (; g_ascii_isdigit (*p); p++) {
+    value = value * 10 + (*p - '0');
+    if (value > G_MAXUINT)
+      return FALSE;
+  }
+
+  if (*p != end_char)
+    return FALSE;
+
+  *number = (guint) value;
+  *str = p + 1;
+  return TRUE;
 }
 
 /**
- * terminal_app_get_receiver_impl_by_object_path:
+ * terminal_app_get_screen_slot_by_object_path:
  * @app:
  * @object_path:
  *
- * Returns: (transfer full): the #TerminalReceiverImpl for @object_path, or %NULL
+ * Returns: (transfer none): the registered #ScreenSlot for @object_path, or %NULL
  */
-static TerminalReceiverImpl *
-terminal_app_get_receiver_impl_by_object_path (TerminalApp *app,
-                                               const char *object_path)
-{
-  gs_unref_object GDBusObject *skeleton =
-    g_dbus_object_manager_get_object (G_DBUS_OBJECT_MANAGER (app->object_manager),
-                                      object_path);
-  if (skeleton == NULL || !TERMINAL_IS_OBJECT_SKELETON (skeleton))
+static ScreenSlot *
+terminal_app_get_screen_slot_by_object_path (TerminalApp *app,
+                                             const char *object_path)
+{
+  const char *p;
+  guint handle, generation;
+  ScreenSlot *slot;
+
+  if (!g_str_has_prefix (object_path, TERMINAL_RECEIVER_OBJECT_PATH_PREFIX))
+    return NULL;
+
+  p = object_path + strlen (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX);
+  if (!parse_object_path_number (&p, '_', &handle) ||
+      !parse_object_path_number (&p, '\0', &generation) ||
+      handle >= app->screen_slots->len)
     return NULL;
 
-  TerminalReceiverImpl *impl = NULL;
-  g_object_get (skeleton, "receiver", &impl, NULL);
-  if (impl == NULL)
+  slot = &g_array_index (app->screen_slots, ScreenSlot, handle);
+  if (slot->impl == NULL || slot->generation != generation)
     return NULL;
 
-  g_assert (TERMINAL_IS_RECEIVER_IMPL (impl));
-  return impl;
+  return slot;
 }
 
 /**
@@ -1022,59 +2886,292 @@ terminal_app_get_receiver_impl_by_object_path (TerminalApp *app,
  * @app:
  * @object_path:
  *
- * Returns: (transfer full): the #TerminalScreen for @object_path, or %NULL
+ * Returns: (transfer none): the #TerminalScreen for @object_path, or %NULL
  */
 TerminalScreen *
 terminal_app_get_screen_by_object_path (TerminalApp *app,
                                         const char *object_path)
 {
-  gs_unref_object TerminalReceiverImpl *impl =
-    terminal_app_get_receiver_impl_by_object_path (app, object_path);
-  if (impl == NULL)
+  ScreenSlot *slot = terminal_app_get_screen_slot_by_object_path (app, object_path);
+  if (slot == NULL)
     return NULL;
 
-  return terminal_receiver_impl_get_screen (impl);
+  return slot->screen;
+}
+
+/**
+ * terminal_app_reserve_screen_slot:
+ * @app:
+ * @screen:
+ *
+ * Assigns @screen its handle, and so its object path, without exporting
+ * it yet; see terminal_app_register_screen(). The slot is given back by
+ * terminal_app_unregister_screen().
+ *
+ * Returns: the handle of @screen, which its object path encodes
+ */
+guint
+terminal_app_reserve_screen_slot (TerminalApp *app,
+                                  TerminalScreen *screen)
+{
+  /* Reuse a free slot if there is one; the generation tells the old and
+   * new screens in it apart.
+   */
+  guint handle;
+  if (app->free_screen_slots->len > 0) {
+    handle = g_array_index (app->free_screen_slots, guint, app->free_screen_slots->len - 1);
+    g_array_set_size (app->free_screen_slots, app->free_screen_slots->len - 1);
+  } else {
+    handle = app->screen_slots->len;
+    g_array_set_size (app->screen_slots, handle + 1);
+  }
+
+  ScreenSlot *slot = &g_array_index (app->screen_slots, ScreenSlot, handle);
+  slot->screen = screen;
+  slot->generation++;
+
+  return handle;
 }
 
+/**
+ * terminal_app_register_screen:
+ * @app:
+ * @screen:
+ *
+ * Exports @screen on the bus, at the object path of the slot reserved
+ * with terminal_app_reserve_screen_slot().
+ */
 void
 terminal_app_register_screen (TerminalApp *app,
                               TerminalScreen *screen)
 {
+  gint64 trace_begin = _terminal_trace_begin ();
+  guint handle = terminal_screen_get_handle (screen);
+  g_return_if_fail (handle < app->screen_slots->len);
+
+  ScreenSlot *slot = &g_array_index (app->screen_slots, ScreenSlot, handle);
+  g_return_if_fail (slot->screen == screen && slot->impl == NULL);
+
   const char *uuid = terminal_screen_get_uuid (screen);
   g_hash_table_insert (app->screen_map, g_strdup (uuid), screen);
 
-  gs_free char *object_path = terminal_app_dup_screen_object_path (app, screen);
+#ifdef ENABLE_SEARCH_PROVIDER
+  terminal_app_add_search_record (app, screen);
+#endif
+
+  gs_free char *object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_FORMAT,
+                                               handle, slot->generation);
   TerminalObjectSkeleton *skeleton = terminal_object_skeleton_new (object_path);
 
-  TerminalReceiverImpl *impl = terminal_receiver_impl_new (screen);
-  terminal_object_skeleton_set_receiver (skeleton, TERMINAL_RECEIVER (impl));
-  g_object_unref (impl);
+  slot->impl = terminal_receiver_impl_new (screen);
+  terminal_object_skeleton_set_receiver (skeleton, TERMINAL_RECEIVER (slot->impl));
 
   g_dbus_object_manager_server_export (app->object_manager,
                                        G_DBUS_OBJECT_SKELETON (skeleton));
+
+  _terminal_trace_end ("terminal_app_register_screen", trace_begin);
 }
 
+/**
+ * terminal_app_unregister_screen:
+ * @app:
+ * @screen:
+ *
+ * Unexports @screen if it was exported, and frees its slot.
+ */
 void
 terminal_app_unregister_screen (TerminalApp *app,
                                 TerminalScreen *screen)
 {
-  const char *uuid = terminal_screen_get_uuid (screen);
-  gboolean found = g_hash_table_remove (app->screen_map, uuid);
-  g_warn_if_fail (found);
-  if (!found)
+  gint64 trace_begin = _terminal_trace_begin ();
+  guint handle = terminal_screen_get_handle (screen);
+  g_return_if_fail (handle < app->screen_slots->len);
+
+  ScreenSlot *slot = &g_array_index (app->screen_slots, ScreenSlot, handle);
+  g_warn_if_fail (slot->screen == screen);
+  if (slot->screen != screen)
     return; /* repeat unregistering */
 
-  gs_free char *object_path = terminal_app_dup_screen_object_path (app, screen);
-  gs_unref_object TerminalReceiverImpl *impl =
-    terminal_app_get_receiver_impl_by_object_path (app, object_path);
-  g_warn_if_fail (impl != NULL);
+  if (slot->impl != NULL) {
+    gs_free char *object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_FORMAT,
+                                                 handle, slot->generation);
+
+    g_hash_table_remove (app->screen_map, terminal_screen_get_uuid (screen));
+
+#ifdef ENABLE_SEARCH_PROVIDER
+    terminal_app_remove_search_record (app, screen);
+#endif
+
+    terminal_receiver_impl_unset_screen (slot->impl);
+    g_clear_object (&slot->impl);
+    g_dbus_object_manager_server_unexport (app->object_manager, object_path);
+  }
+
+  slot->screen = NULL;
+  g_array_append_val (app->free_screen_slots, handle);
+
+  _terminal_trace_end ("terminal_app_unregister_screen", trace_begin);
+}
+
+#ifdef ENABLE_SEARCH_PROVIDER
+
+static void
+search_screens_data_free (SearchScreensData *data)
+{
+  g_strfreev (data->terms);
+  g_strfreev (data->uuids);
+  g_slice_free (SearchScreensData, data);
+}
+
+/* Returns: (transfer container): the records of the screens in a window
+ *   to search, of all screens or of those in @uuids
+ */
+static GPtrArray *
+search_screens_get_records (TerminalApp *app,
+                            char **uuids)
+{
+  GPtrArray *records;
+  guint i;
+
+  records = g_ptr_array_new ();
+
+  if (uuids == NULL)
+    {
+      for (i = 0; i < app->search_records->len; i++)
+        {
+          SearchRecord *record = g_ptr_array_index (app->search_records, i);
+
+          if (screen_is_in_window (record->screen))
+            g_ptr_array_add (records, record);
+        }
+    }
+  else
+    {
+      for (i = 0; uuids[i] != NULL; i++)
+        {
+          SearchRecord *record = g_hash_table_lookup (app->search_record_map, uuids[i]);
+
+          if (record == NULL)
+            {
+              _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "Not a screen: %s\n", uuids[i]);
+              continue;
+            }
+
+          if (screen_is_in_window (record->screen))
+            g_ptr_array_add (records, record);
+        }
+    }
+
+  return records;
+}
+
+static gboolean
+search_screens_complete_cb (GTask *task)
+{
+  TerminalApp *app = g_task_get_source_object (task);
+  SearchScreensData *data = g_task_get_task_data (task);
+  gs_unref_ptrarray GPtrArray *records = NULL;
+  GPtrArray *results;
+  guint i;
+
+  if (g_task_return_error_if_cancelled (task))
+    return G_SOURCE_REMOVE;
+
+  records = search_screens_get_records (app, data->uuids);
+  results = g_ptr_array_new ();
+  for (i = 0; i < records->len; i++)
+    {
+      SearchRecord *record = g_ptr_array_index (records, i);
+
+      if (search_record_matches (record, (const char *const *) data->terms))
+        g_ptr_array_add (results, g_strdup (record->uuid));
+    }
+
+  g_ptr_array_add (results, NULL);
+  g_task_return_pointer (task, g_ptr_array_free (results, FALSE), (GDestroyNotify) g_strfreev);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * terminal_app_search_screens_async:
+ * @app:
+ * @terms: the search terms
+ * @uuids: (allow-none): restrict the search to these screens, or %NULL
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
+ *
+ * Matches @terms against the title, working directory and foreground
+ * process of each screen in a window. Foreground processes that changed
+ * since the last search are looked up first.
+ */
+void
+terminal_app_search_screens_async (TerminalApp *app,
+                                   const char *const *terms,
+                                   const char *const *uuids,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+  gs_unref_ptrarray GPtrArray *records = NULL;
+  SearchScreensData *data;
+  GTask *task;
+  guint i;
+
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  task = g_task_new (app, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_app_search_screens_async);
 
-  if (impl != NULL)
-    terminal_receiver_impl_unset_screen (impl);
+  data = g_slice_new0 (SearchScreensData);
+  data->terms = terminal_util_normalize_casefold_and_unaccent_terms (terms);
+  data->uuids = g_strdupv ((char **) uuids);
+  g_task_set_task_data (task, data, (GDestroyNotify) search_screens_data_free);
 
-  g_dbus_object_manager_server_unexport (app->object_manager, object_path);
+  /* Hold a reference until all lookups are done */
+  data->n_pending = 1;
+
+  records = search_screens_get_records (app, data->uuids);
+  for (i = 0; i < records->len; i++)
+    {
+      SearchRecord *record = g_ptr_array_index (records, i);
+
+      search_record_refresh (record);
+      if (record->cancellable == NULL)
+        continue;
+
+      data->n_pending++;
+      record->waiters = g_slist_prepend (record->waiters, g_object_ref (task));
+    }
+
+  if (--data->n_pending == 0)
+    search_screens_complete_cb (task);
+
+  g_object_unref (task);
+}
+
+/**
+ * terminal_app_search_screens_finish:
+ * @app:
+ * @result: the #GAsyncResult
+ * @error: a #GError location, or %NULL
+ *
+ * Returns: (transfer full): a %NULL-terminated array of the UUIDs of the
+ *   matching screens, or %NULL on error
+ */
+char **
+terminal_app_search_screens_finish (TerminalApp *app,
+                                    GAsyncResult *result,
+                                    GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, app), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
 }
 
+#endif /* ENABLE_SEARCH_PROVIDER */
+
 GdkAtom *
 terminal_app_get_clipboard_targets (TerminalApp *app,
                                     GtkClipboard *clipboard,
@@ -1092,6 +3189,25 @@ terminal_app_get_clipboard_targets (TerminalApp *app,
   return app->clipboard_targets;
 }
 
+/**
+ * terminal_app_get_clipboard_flags:
+ * @app: a #TerminalApp
+ * @clipboard: a #GtkClipboard
+ *
+ * Returns: what can be pasted from @clipboard, as #TerminalClipboardFlags
+ */
+guint
+terminal_app_get_clipboard_flags (TerminalApp *app,
+                                  GtkClipboard *clipboard)
+{
+  g_return_val_if_fail (TERMINAL_IS_APP (app), 0);
+
+  if (clipboard != app->clipboard)
+    return 0;
+
+  return app->clipboard_flags;
+}
+
 void
 terminal_app_edit_profile (TerminalApp     *app,
                            GSettings       *profile,
@@ -1117,6 +3233,29 @@ terminal_app_get_profiles_list (TerminalApp *app)
   return app->profiles_list;
 }
 
+/**
+ * terminal_app_first_output:
+ * @app: a #TerminalApp
+ *
+ * Tells @app that a screen showed its first output, so the deferred part
+ * of the startup can run once the main loop is idle.
+ */
+void
+terminal_app_first_output (TerminalApp *app)
+{
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  if (app->deferred_startup_done)
+    return;
+
+  if (app->deferred_startup_source_id != 0)
+    g_source_remove (app->deferred_startup_source_id);
+  app->deferred_startup_source_id =
+    _terminal_watchdog_idle_add_full (G_PRIORITY_LOW, "deferred startup",
+                                      (GSourceFunc) terminal_app_deferred_startup_cb,
+                                      app, NULL);
+}
+
 /**
  * terminal_app_get_menubar:
  * @app: a #TerminalApp
@@ -1138,9 +3277,44 @@ terminal_app_get_menubar (TerminalApp *app)
 GMenuModel *
 terminal_app_get_profile_section (TerminalApp *app)
 {
+  terminal_app_deferred_startup (app);
   return G_MENU_MODEL (app->set_profile_menu);
 }
 
+/**
+ * terminal_app_get_scrollback_usage:
+ * @app: a #TerminalApp
+ * @total: (out): location to store the estimated total scrollback size in bytes
+ * @budget: (out): location to store the scrollback budget in bytes, or 0
+ *
+ * Returns: (transfer floating): a "a{ot}" #GVariant mapping each screen's
+ *   object path to the estimated size of its scrollback in bytes
+ */
+GVariant *
+terminal_app_get_scrollback_usage (TerminalApp *app,
+                                   guint64 *total,
+                                   guint64 *budget)
+{
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer screen;
+
+  *total = 0;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ot}"));
+  g_hash_table_iter_init (&iter, app->screen_map);
+  while (g_hash_table_iter_next (&iter, NULL, &screen)) {
+    gs_free char *object_path = terminal_app_dup_screen_object_path (app, screen);
+    guint64 bytes = terminal_screen_get_scrollback_bytes (screen);
+
+    g_variant_builder_add (&builder, "{ot}", object_path, bytes);
+    *total += bytes;
+  }
+
+  *budget = terminal_app_get_scrollback_budget (app);
+
+  return g_variant_builder_end (&builder);
+}
+
 /**
  * terminal_app_get_global_settings:
  * @app: a #TerminalApp
@@ -48,6 +48,32 @@ GType terminal_app_get_type (void);
 
 GApplication *terminal_app_new (const char *app_id);
 
+void terminal_app_set_standby (TerminalApp *app,
+                               gboolean standby);
+
+void terminal_app_mark_session_dirty (TerminalApp *app);
+
+gboolean terminal_app_reserve_fds (TerminalApp *app,
+                                   guint n_fds,
+                                   GError **error);
+
+void terminal_app_unreserve_fds (TerminalApp *app,
+                                 guint n_fds);
+
+void terminal_app_release_fd_reserve (TerminalApp *app);
+
+char **terminal_app_intern_environment (TerminalApp *app,
+                                        char **envv);
+
+void terminal_app_release_environment (TerminalApp *app,
+                                       char **envv);
+
+const char *terminal_app_register_environment (TerminalApp *app,
+                                               char **envv);
+
+char **terminal_app_lookup_environment (TerminalApp *app,
+                                        const char *id);
+
 #define terminal_app_get (TerminalApp *) g_application_get_default
 
 GDBusObjectManagerServer *terminal_app_get_object_manager (TerminalApp *app);
@@ -56,10 +82,22 @@ GdkAtom *terminal_app_get_clipboard_targets (TerminalApp *app,
                                              GtkClipboard *clipboard,
                                              int *n_targets);
 
+typedef enum {
+  TERMINAL_CLIPBOARD_CAN_PASTE_TEXT = 1 << 0,
+  TERMINAL_CLIPBOARD_CAN_PASTE_URIS = 1 << 1
+} TerminalClipboardFlags;
+
+guint terminal_app_get_clipboard_flags (TerminalApp *app,
+                                        GtkClipboard *clipboard);
+
 void terminal_app_edit_profile (TerminalApp *app,
                                 GSettings   *profile,
                                 const char  *widget_name);
 
+char **terminal_app_new_profiles (TerminalApp *app,
+                                  GSettings   *base_profile,
+                                  guint        n_profiles);
+
 void terminal_app_new_profile (TerminalApp *app,
                                GSettings   *default_base_profile);
 
@@ -85,21 +123,65 @@ char *terminal_app_dup_screen_object_path (TerminalApp *app,
 TerminalScreen *terminal_app_get_screen_by_uuid (TerminalApp *app,
                                                  const char  *uuid);
 
+GList *terminal_app_list_screens (TerminalApp *app);
+
 TerminalScreen *terminal_app_get_screen_by_object_path (TerminalApp *app,
                                                         const char *object_path);
 
+guint terminal_app_reserve_screen_slot (TerminalApp *app,
+                                        TerminalScreen *screen);
+
 void terminal_app_register_screen (TerminalApp *app,
                                    TerminalScreen *screen);
 
 void terminal_app_unregister_screen (TerminalApp *app,
                                      TerminalScreen *screen);
 
+void terminal_app_add_headless_screen (TerminalApp *app,
+                                       TerminalScreen *screen);
+
+gboolean terminal_app_take_headless_screen (TerminalApp *app,
+                                            TerminalScreen *screen);
+
+typedef void (* TerminalAppSearchResultFunc) (TerminalScreen *screen,
+                                              GArray *matches,
+                                              gpointer user_data);
+
+void terminal_app_search_contents_async (TerminalApp *app,
+                                         const char *pattern,
+                                         guint32 compile_flags,
+                                         const char *const *uuids,
+                                         glong max_rows,
+                                         TerminalAppSearchResultFunc result_func,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data);
+
+gboolean terminal_app_search_contents_finish (TerminalApp *app,
+                                              GAsyncResult *result,
+                                              GError **error);
+
+#ifdef ENABLE_SEARCH_PROVIDER
+void terminal_app_search_screens_async (TerminalApp *app,
+                                        const char *const *terms,
+                                        const char *const *uuids,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data);
+
+char **terminal_app_search_screens_finish (TerminalApp *app,
+                                           GAsyncResult *result,
+                                           GError **error);
+#endif
+
 void terminal_app_edit_preferences (TerminalApp *app);
 
 TerminalSettingsList *terminal_app_get_profiles_list (TerminalApp *app);
 
 /* Menus */
 
+void terminal_app_first_output (TerminalApp *app);
+
 GMenuModel *terminal_app_get_menubar (TerminalApp *app);
 
 GMenuModel *terminal_app_get_profile_section (TerminalApp *app);
@@ -108,6 +190,10 @@ GMenuModel *terminal_app_get_profile_section (TerminalApp *app);
 
 GSettings *terminal_app_get_global_settings (TerminalApp *app);
 
+GVariant *terminal_app_get_scrollback_usage (TerminalApp *app,
+                                             guint64 *total,
+                                             guint64 *budget);
+
 GSettings *terminal_app_get_desktop_interface_settings (TerminalApp *app);
 
 GSettings *terminal_app_get_proxy_settings (TerminalApp *app);
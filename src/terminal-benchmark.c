@@ -0,0 +1,757 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+#include <gio/gunixinputstream.h>
+
+#include "terminal-client-utils.h"
+#include "terminal-defines.h"
+#include "terminal-gdbus-generated.h"
+#include "terminal-libgsystem.h"
+
+/*
+ * Server benchmarks
+ *
+ * Starts a private gnome-terminal-server, opens terminals in it through
+ * the factory, and runs copies of this program inside them.
+ *
+ * The input latency test measures round trips through the terminal.
+ * The child writes a cursor position request (DSR), and the terminal
+ * has to read it from the PTY, parse it and write its reply back. That
+ * is the path a keypress and its echo take through the server's main
+ * loop, minus the drawing.
+ *
+ * The throughput tests write a stream of plain text lines (like cat of a
+ * large file), of "y" lines (like yes), or of escape sequences, and
+ * time until the terminal has processed all of it.
+ *
+ * Each test runs in the active tab, with the other tabs of the window
+ * either idle or flooding output. Each result is printed to stdout as
+ * one line of JSON.
+ *
+ * With --tabs, it instead opens that many tabs one after the other, then
+ * closes them again, and prints the time per operation and the server's
+ * memory use at regular checkpoints. That shows how opening and closing
+ * a tab scales with the number of tabs already open; run the server with
+ * GNOME_TERMINAL_TRACE set to see where the time goes.
+ */
+
+#define RESULT_FD (3)
+#define CHUNK_SIZE (64 * 1024)
+#define REPLY_TIMEOUT (10000 /* ms */)
+#define SERVER_START_TIMEOUT (30 /* s */)
+#define CLOSE_TIMEOUT (10 /* s */)
+#define N_CHECKPOINTS (20)
+
+static char *server_path;
+static int n_screens = 8;
+static int n_samples = 1000;
+static gint64 n_bytes = 1024 * 1024 * 1024;
+static int n_tabs = 0;
+static int n_tabs_per_window = 50;
+static char *child_mode;
+static char *pattern;
+
+static const GOptionEntry options[] = {
+  { "server", 0, 0, G_OPTION_ARG_FILENAME, &server_path, "The gnome-terminal-server to run", "PATH" },
+  { "screens", 'n', 0, G_OPTION_ARG_INT, &n_screens, "Number of terminals per window, including the measured one", "N" },
+  { "samples", 0, 0, G_OPTION_ARG_INT, &n_samples, "Number of latency samples", "N" },
+  { "bytes", 0, 0, G_OPTION_ARG_INT64, &n_bytes, "Bytes to write per throughput test", "N" },
+  { "tabs", 0, 0, G_OPTION_ARG_INT, &n_tabs, "Measure opening and closing N tabs instead", "N" },
+  { "tabs-per-window", 0, 0, G_OPTION_ARG_INT, &n_tabs_per_window, "Number of tabs per window with --tabs", "N" },
+  { "child", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &child_mode, NULL, NULL },
+  { "pattern", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &pattern, NULL, NULL },
+  { NULL }
+};
+
+/* Child side */
+
+static gboolean
+write_all (int fd,
+           const char *data,
+           gsize len)
+{
+  while (len > 0) {
+    ssize_t r = write (fd, data, len);
+
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return FALSE;
+    }
+
+    data += r;
+    len -= r;
+  }
+
+  return TRUE;
+}
+
+/* Sends a cursor position request and waits for the reply */
+static gboolean
+round_trip (void)
+{
+  struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+  char c;
+
+  if (!write_all (STDOUT_FILENO, "\033[6n", 4))
+    return FALSE;
+
+  /* The reply is ESC [ row ; col R */
+  do {
+    if (poll (&pfd, 1, REPLY_TIMEOUT) <= 0 ||
+        read (STDIN_FILENO, &c, 1) != 1)
+      return FALSE;
+  } while (c != 'R');
+
+  return TRUE;
+}
+
+static void
+fill_chunk (GString *chunk,
+            const char *name)
+{
+  guint32 seed = 42;
+  guint i;
+
+  while (chunk->len < CHUNK_SIZE) {
+    seed = seed * 1103515245 + 12345;
+
+    if (g_str_equal (name, "yes")) {
+      g_string_append (chunk, "y\r\n");
+    } else if (g_str_equal (name, "ansi")) {
+      /* Colours, attributes, cursor movement, scrolling regions,
+       * erasing, insertions and wide and combining characters
+       */
+      g_string_append_printf (chunk,
+                              "\033[%u;%uH\033[38;5;%um\033[48;2;%u;%u;%um\033[%um",
+                              seed % 24 + 1, (seed >> 8) % 80 + 1,
+                              (seed >> 4) % 256,
+                              (seed >> 3) % 256, (seed >> 5) % 256, (seed >> 7) % 256,
+                              (seed >> 12) % 9);
+      switch ((seed >> 16) % 6) {
+      case 0: g_string_append (chunk, "\033[5;20r\033[3S\033[r"); break;
+      case 1: g_string_append (chunk, "\033[2K\033[1J"); break;
+      case 2: g_string_append (chunk, "\033[4L\033[2M\033[3@\033[2P"); break;
+      case 3: g_string_append (chunk, "日本語テキスト"); break;
+      case 4: g_string_append (chunk, "e\xcc\x81o\xcc\x88u\xcc\x8a"); break;
+      default: g_string_append (chunk, "The quick brown fox\033[0m"); break;
+      }
+    } else {
+      guint len = seed % 120;
+
+      for (i = 0; i < len; i++)
+        g_string_append_c (chunk, ' ' + (seed >> (i % 24)) % 95);
+      g_string_append (chunk, "\r\n");
+    }
+  }
+}
+
+static int
+compare_gint64 (gconstpointer a,
+                gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int
+child_latency (FILE *result)
+{
+  gs_free gint64 *samples = g_new (gint64, n_samples);
+  int i;
+
+  for (i = 0; i < n_samples; i++) {
+    gint64 begin = g_get_monotonic_time ();
+
+    if (!round_trip ())
+      return EXIT_FAILURE;
+    samples[i] = g_get_monotonic_time () - begin;
+
+    /* Like an echoed keypress, so the screen has something to draw */
+    if (!write_all (STDOUT_FILENO, i % 80 == 79 ? "x\r\n" : "x", i % 80 == 79 ? 3 : 1))
+      return EXIT_FAILURE;
+  }
+
+  qsort (samples, n_samples, sizeof (gint64), compare_gint64);
+  fprintf (result,
+           "{\"test\":\"latency\",\"samples\":%d,\"min-us\":%" G_GINT64_FORMAT
+           ",\"median-us\":%" G_GINT64_FORMAT ",\"p90-us\":%" G_GINT64_FORMAT
+           ",\"p99-us\":%" G_GINT64_FORMAT ",\"max-us\":%" G_GINT64_FORMAT "}\n",
+           n_samples, samples[0], samples[n_samples / 2],
+           samples[n_samples * 9 / 10], samples[n_samples * 99 / 100],
+           samples[n_samples - 1]);
+
+  return EXIT_SUCCESS;
+}
+
+static int
+child_throughput (FILE *result)
+{
+  gs_free_gstring GString *chunk = g_string_sized_new (CHUNK_SIZE + 256);
+  gint64 written = 0, begin, elapsed;
+
+  fill_chunk (chunk, pattern ? pattern : "text");
+
+  begin = g_get_monotonic_time ();
+  while (written < n_bytes) {
+    if (!write_all (STDOUT_FILENO, chunk->str, chunk->len))
+      return EXIT_FAILURE;
+    written += chunk->len;
+  }
+
+  /* The reply comes once everything before it has been processed */
+  if (!write_all (STDOUT_FILENO, "\033[0m\033[2J\033[H", 11) ||
+      !round_trip ())
+    return EXIT_FAILURE;
+  elapsed = MAX (g_get_monotonic_time () - begin, 1);
+
+  fprintf (result,
+           "{\"test\":\"throughput\",\"pattern\":\"%s\",\"bytes\":%" G_GINT64_FORMAT
+           ",\"seconds\":%.3f,\"mib-per-second\":%.2f}\n",
+           pattern ? pattern : "text", written,
+           (double) elapsed / G_USEC_PER_SEC,
+           ((double) written / (1024 * 1024)) / ((double) elapsed / G_USEC_PER_SEC));
+
+  return EXIT_SUCCESS;
+}
+
+static int
+child_flood (void)
+{
+  gs_free_gstring GString *chunk = g_string_sized_new (CHUNK_SIZE + 256);
+
+  fill_chunk (chunk, "text");
+  while (write_all (STDOUT_FILENO, chunk->str, chunk->len))
+    ;
+
+  return EXIT_SUCCESS;
+}
+
+/* Waits until the controller closes its end of the pipe */
+static int
+child_wait (void)
+{
+  char buf[64];
+  ssize_t len;
+
+  do
+    len = read (RESULT_FD, buf, sizeof (buf));
+  while (len > 0 || (len == -1 && errno == EINTR));
+
+  return EXIT_SUCCESS;
+}
+
+static int
+run_child (void)
+{
+  struct termios saved, raw;
+  FILE *result = NULL;
+  int rv;
+
+  if (g_str_equal (child_mode, "idle")) {
+    for (;;)
+      pause ();
+  }
+  if (g_str_equal (child_mode, "flood"))
+    return child_flood ();
+  if (g_str_equal (child_mode, "wait"))
+    return child_wait ();
+
+  result = fdopen (RESULT_FD, "w");
+  if (result == NULL)
+    return EXIT_FAILURE;
+
+  /* No echo and no line buffering, so the replies come straight back */
+  if (tcgetattr (STDIN_FILENO, &saved) != 0)
+    return EXIT_FAILURE;
+  raw = saved;
+  cfmakeraw (&raw);
+  tcsetattr (STDIN_FILENO, TCSANOW, &raw);
+
+  if (g_str_equal (child_mode, "latency"))
+    rv = child_latency (result);
+  else
+    rv = child_throughput (result);
+
+  tcsetattr (STDIN_FILENO, TCSANOW, &saved);
+  fclose (result);
+
+  return rv;
+}
+
+/* Controller side */
+
+typedef struct {
+  GPid pid;
+  char *app_id;
+  GDBusConnection *connection;
+  TerminalFactory *factory;
+  TerminalMetrics *metrics;
+  char *window_screen; /* object path of the first screen */
+} Server;
+
+static void
+name_appeared_cb (GDBusConnection *connection,
+                  const char *name,
+                  const char *name_owner,
+                  gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+}
+
+static gboolean
+start_timeout_cb (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return FALSE; /* don't run again */
+}
+
+static gboolean
+server_start (Server *server,
+              GError **error)
+{
+  server->app_id = g_strdup_printf ("org.gnome.Terminal.Benchmark%d", (int) getpid ());
+  char *argv[] = { server_path, (char *) "--app-id", server->app_id, NULL };
+
+  server->connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, error);
+  if (server->connection == NULL)
+    return FALSE;
+
+  if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+                      NULL, NULL, &server->pid, error))
+    return FALSE;
+
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  guint watch_id = g_bus_watch_name_on_connection (server->connection, server->app_id,
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   name_appeared_cb, NULL,
+                                                   loop, NULL);
+  guint timeout_id = g_timeout_add_seconds (SERVER_START_TIMEOUT, start_timeout_cb, loop);
+  g_main_loop_run (loop);
+  g_source_remove (timeout_id);
+  g_bus_unwatch_name (watch_id);
+  g_main_loop_unref (loop);
+
+  server->factory = terminal_factory_proxy_new_sync (server->connection,
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS |
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                                                     server->app_id,
+                                                     TERMINAL_FACTORY_OBJECT_PATH,
+                                                     NULL, error);
+  if (server->factory == NULL)
+    return FALSE;
+
+  if (g_dbus_proxy_get_name_owner (G_DBUS_PROXY (server->factory)) == NULL) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                 "%s did not appear on the bus", server_path);
+    return FALSE;
+  }
+
+  server->metrics = terminal_metrics_proxy_new_sync (server->connection,
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS |
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START,
+                                                     server->app_id,
+                                                     TERMINAL_FACTORY_OBJECT_PATH,
+                                                     NULL, error);
+  if (server->metrics == NULL)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Gets the number of screens and the resident set size of the server */
+static gboolean
+server_get_metrics (Server *server,
+                    guint *n_screens_out,
+                    guint64 *rss_out,
+                    GError **error)
+{
+  gs_unref_variant GVariant *metrics = NULL;
+
+  if (!terminal_metrics_call_get_metrics_sync (server->metrics, &metrics, NULL, error))
+    return FALSE;
+
+  if (!g_variant_lookup (metrics, "screens", "u", n_screens_out))
+    *n_screens_out = 0;
+  if (!g_variant_lookup (metrics, "rss", "t", rss_out))
+    *rss_out = 0;
+
+  return TRUE;
+}
+
+static void
+server_stop (Server *server)
+{
+  if (server->pid > 0) {
+    kill (server->pid, SIGTERM);
+    waitpid (server->pid, NULL, 0);
+    g_spawn_close_pid (server->pid);
+  }
+
+  g_clear_object (&server->metrics);
+  g_clear_object (&server->factory);
+  g_clear_object (&server->connection);
+  g_free (server->app_id);
+  g_free (server->window_screen);
+}
+
+/* Opens a terminal running this program with --child=@mode, in the
+ * benchmark window. If @result_fd is not -1, it is passed to the child
+ * as RESULT_FD.
+ */
+static char *
+server_open_terminal (Server *server,
+                      const char *self,
+                      const char *mode,
+                      const char *pattern_name,
+                      gboolean active,
+                      int result_fd,
+                      GError **error)
+{
+  GVariantBuilder builder;
+  gs_free char *object_path = NULL;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  terminal_client_append_create_instance_options (&builder,
+                                                  NULL, NULL, NULL, NULL, NULL, NULL,
+                                                  mode, active, FALSE, FALSE);
+  if (server->window_screen != NULL)
+    g_variant_builder_add (&builder, "{sv}",
+                           "window-from-screen", g_variant_new_object_path (server->window_screen));
+
+  if (!terminal_factory_call_create_instance_sync (server->factory,
+                                                   g_variant_builder_end (&builder),
+                                                   &object_path,
+                                                   NULL, error))
+    return NULL;
+
+  if (server->window_screen == NULL)
+    server->window_screen = g_strdup (object_path);
+
+  gs_unref_object TerminalReceiver *receiver =
+    terminal_receiver_proxy_new_sync (server->connection,
+                                      G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                      G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                      server->app_id, object_path,
+                                      NULL, error);
+  if (receiver == NULL)
+    return NULL;
+
+  gs_unref_object GUnixFDList *fd_list = NULL;
+  PassFdElement pass_fd = { 0, RESULT_FD };
+  if (result_fd != -1) {
+    fd_list = g_unix_fd_list_new ();
+    pass_fd.index = g_unix_fd_list_append (fd_list, result_fd, error);
+    if (pass_fd.index == -1)
+      return NULL;
+  }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  terminal_client_append_exec_options (&builder, NULL, NULL,
+                                       result_fd != -1 ? &pass_fd : NULL,
+                                       result_fd != -1 ? 1 : 0,
+                                       FALSE);
+
+  gs_free char *child_arg = g_strdup_printf ("--child=%s", mode);
+  gs_free char *pattern_arg = g_strdup_printf ("--pattern=%s", pattern_name ? pattern_name : "text");
+  gs_free char *samples_arg = g_strdup_printf ("--samples=%d", n_samples);
+  gs_free char *bytes_arg = g_strdup_printf ("--bytes=%" G_GINT64_FORMAT, n_bytes);
+  const char *argv[] = { self, child_arg, pattern_arg, samples_arg, bytes_arg, NULL };
+
+  if (!terminal_receiver_call_exec_sync (receiver,
+                                         g_variant_builder_end (&builder),
+                                         g_variant_new_bytestring_array (argv, -1),
+                                         fd_list, NULL,
+                                         NULL, error))
+    return NULL;
+
+  char *rv;
+  gs_transfer_out_value (&rv, &object_path);
+  return rv;
+}
+
+/* Runs one test in a new active tab and prints its result */
+static gboolean
+run_test (Server *server,
+          const char *self,
+          const char *background,
+          const char *mode,
+          const char *pattern_name,
+          GError **error)
+{
+  int fds[2];
+
+  if (!g_unix_open_pipe (fds, FD_CLOEXEC, error))
+    return FALSE;
+
+  gs_free char *object_path = server_open_terminal (server, self, mode, pattern_name,
+                                                    TRUE, fds[1], error);
+  close (fds[1]);
+  if (object_path == NULL) {
+    close (fds[0]);
+    return FALSE;
+  }
+
+  /* Read the result until the child exits */
+  gs_unref_object GInputStream *stream = g_unix_input_stream_new (fds[0], TRUE);
+  gs_unref_object GDataInputStream *data_stream = g_data_input_stream_new (stream);
+  gs_free char *line = g_data_input_stream_read_line (data_stream, NULL, NULL, error);
+  if (line == NULL) {
+    if (*error == NULL)
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "The %s test did not report a result", mode);
+    return FALSE;
+  }
+
+  g_print ("{\"background\":\"%s\",\"screens\":%d,\"result\":%s}\n",
+           background, n_screens, line);
+
+  return TRUE;
+}
+
+static gboolean
+run_benchmarks (const char *self,
+                const char *background,
+                GError **error)
+{
+  static const char *patterns[] = { "text", "yes", "ansi" };
+  Server server = { 0, };
+  gboolean rv = FALSE;
+  int i;
+
+  if (!server_start (&server, error))
+    goto out;
+
+  /* The other tabs come first, so the measured ones are in front */
+  for (i = 0; i < n_screens - 1; i++) {
+    gs_free char *object_path = server_open_terminal (&server, self, background, NULL,
+                                                      FALSE, -1, error);
+    if (object_path == NULL)
+      goto out;
+  }
+
+  if (!run_test (&server, self, background, "latency", NULL, error))
+    goto out;
+
+  for (i = 0; i < (int) G_N_ELEMENTS (patterns); i++)
+    if (!run_test (&server, self, background, "throughput", patterns[i], error))
+      goto out;
+
+  rv = TRUE;
+
+ out:
+  server_stop (&server);
+  return rv;
+}
+
+static gboolean
+print_checkpoint (Server *server,
+                  const char *phase,
+                  int n_ops,
+                  gint64 elapsed,
+                  GError **error)
+{
+  guint n_open;
+  guint64 rss;
+
+  if (!server_get_metrics (server, &n_open, &rss, error))
+    return FALSE;
+
+  g_print ("{\"phase\":\"%s\",\"screens\":%u,\"ms-per-op\":%.3f,\"rss\":%" G_GUINT64_FORMAT "}\n",
+           phase, n_open, (double) elapsed / MAX (n_ops, 1) / 1000, rss);
+
+  return TRUE;
+}
+
+/* Opens n_tabs tabs running --child=wait, then closes them by closing
+ * their pipes, timing each step in batches.
+ */
+static gboolean
+run_tabs_benchmark (const char *self,
+                    GError **error)
+{
+  Server server = { 0, };
+  gs_unref_array GArray *pipes = g_array_sized_new (FALSE, FALSE, sizeof (int), n_tabs);
+  int checkpoint = MAX (n_tabs / N_CHECKPOINTS, 1);
+  gboolean rv = FALSE;
+  gint64 begin;
+  guint i;
+
+  if (!server_start (&server, error))
+    goto out;
+
+  if (!print_checkpoint (&server, "open", 0, 0, error))
+    goto out;
+
+  begin = g_get_monotonic_time ();
+  for (i = 0; i < (guint) n_tabs; i++) {
+    int fds[2];
+
+    /* Start the next window */
+    if (i % n_tabs_per_window == 0)
+      g_clear_pointer (&server.window_screen, g_free);
+
+    if (!g_unix_open_pipe (fds, FD_CLOEXEC, error))
+      goto out;
+
+    gs_free char *object_path = server_open_terminal (&server, self, "wait", NULL,
+                                                      FALSE, fds[0], error);
+    close (fds[0]);
+    if (object_path == NULL) {
+      close (fds[1]);
+      goto out;
+    }
+    g_array_append_val (pipes, fds[1]);
+
+    if ((i + 1) % checkpoint == 0 || i + 1 == (guint) n_tabs) {
+      gint64 elapsed = g_get_monotonic_time () - begin;
+
+      if (!print_checkpoint (&server, "open", checkpoint, elapsed, error))
+        goto out;
+      begin = g_get_monotonic_time ();
+    }
+  }
+
+  /* Close the newest tabs first, and wait for each to be gone */
+  begin = g_get_monotonic_time ();
+  while (pipes->len > 0) {
+    guint n_open, expected = pipes->len - 1;
+    guint64 rss;
+    gint64 deadline;
+
+    close (g_array_index (pipes, int, pipes->len - 1));
+    g_array_set_size (pipes, expected);
+
+    deadline = g_get_monotonic_time () + CLOSE_TIMEOUT * G_USEC_PER_SEC;
+    do {
+      if (!server_get_metrics (&server, &n_open, &rss, error))
+        goto out;
+      if (g_get_monotonic_time () > deadline) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                     "The tab did not close");
+        goto out;
+      }
+    } while (n_open > expected);
+
+    if ((n_tabs - expected) % checkpoint == 0 || expected == 0) {
+      gint64 elapsed = g_get_monotonic_time () - begin;
+
+      if (!print_checkpoint (&server, "close", checkpoint, elapsed, error))
+        goto out;
+      begin = g_get_monotonic_time ();
+    }
+  }
+
+  rv = TRUE;
+
+ out:
+  for (i = 0; i < pipes->len; i++)
+    close (g_array_index (pipes, int, i));
+  server_stop (&server);
+  return rv;
+}
+
+/* Every tab keeps one end of a pipe open here */
+static void
+raise_fd_limit (void)
+{
+  struct rlimit limit;
+
+  if (getrlimit (RLIMIT_NOFILE, &limit) != 0)
+    return;
+
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit (RLIMIT_NOFILE, &limit);
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+
+  context = g_option_context_new (NULL);
+  g_option_context_set_summary (context, "Measures the input latency and throughput of gnome-terminal-server.");
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (context);
+
+  if (child_mode != NULL)
+    return run_child ();
+
+  if (server_path == NULL)
+    server_path = g_strdup (g_getenv ("GNOME_TERMINAL_SERVER") ? g_getenv ("GNOME_TERMINAL_SERVER")
+                                                              : "./gnome-terminal-server");
+  n_screens = MAX (n_screens, 1);
+  n_samples = MAX (n_samples, 1);
+  n_tabs_per_window = MAX (n_tabs_per_window, 1);
+
+  /* The children run this program by absolute path */
+  gs_free char *self = g_file_read_link ("/proc/self/exe", NULL);
+  if (self == NULL && g_path_is_absolute (argv[0]))
+    self = g_strdup (argv[0]);
+  else if (self == NULL) {
+    gs_free char *cwd = g_get_current_dir ();
+    self = g_build_filename (cwd, argv[0], NULL);
+  }
+
+  if (n_tabs > 0) {
+    raise_fd_limit ();
+    if (!run_tabs_benchmark (self, &error)) {
+      g_printerr ("Benchmark failed: %s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
+  if (!run_benchmarks (self, "idle", &error) ||
+      !run_benchmarks (self, "flood", &error)) {
+    g_printerr ("Benchmark failed: %s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
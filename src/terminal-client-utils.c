@@ -100,21 +100,38 @@ terminal_client_append_create_instance_options (GVariantBuilder *builder,
 }
 
 /**
- * terminal_client_append_exec_options:
+ * terminal_client_append_headless_options:
  * @builder: a #GVariantBuilder of #GVariantType "a{sv}"
- * @working_directory: (allow-none): the cwd, or %NULL
- * @shell:
+ * @headless: whether to create the terminal without a window
+ * @attach_screen_object_path: (allow-none): the object path of a headless
+ *   terminal to put into the window instead of creating a new one, or %NULL
  *
- * Appends the environment and the working directory to @builder.
+ * Appends the headless mode options to @builder. A headless terminal runs
+ * its command without being shown, until it is attached to a window.
  */
 void
-terminal_client_append_exec_options (GVariantBuilder *builder,
-                                     const char      *working_directory,
-                                     PassFdElement   *fd_array,
-                                     gsize            fd_array_len,
-                                     gboolean         shell)
+terminal_client_append_headless_options (GVariantBuilder *builder,
+                                         gboolean         headless,
+                                         const char      *attach_screen_object_path)
+{
+  if (headless)
+    g_variant_builder_add (builder, "{sv}",
+                           "headless", g_variant_new_boolean (TRUE));
+  if (attach_screen_object_path)
+    g_variant_builder_add (builder, "{sv}",
+                           "attach-screen", g_variant_new_object_path (attach_screen_object_path));
+}
+
+/**
+ * terminal_client_get_environment:
+ *
+ * Returns: (transfer full): the environment to pass to the server, that is
+ *   the client's without the variables that only apply to the client
+ */
+char **
+terminal_client_get_environment (void)
 {
-  gs_strfreev char **envv;
+  char **envv;
 
   envv = g_get_environ ();
   envv = g_environ_unsetenv (envv, "COLORTERM");
@@ -131,9 +148,59 @@ terminal_client_append_exec_options (GVariantBuilder *builder,
   envv = g_environ_unsetenv (envv, TERMINAL_ENV_SERVICE_NAME);
   envv = g_environ_unsetenv (envv, TERMINAL_ENV_SCREEN);
 
-  g_variant_builder_add (builder, "{sv}",
-                         "environ",
-                         g_variant_new_bytestring_array ((const char * const *) envv, -1));
+  return envv;
+}
+
+/**
+ * terminal_client_compute_environment_id:
+ * @envv: an environment
+ *
+ * Computes the ID the server stores @envv under, so that exec options
+ * can refer to it without registering it first. This must match how
+ * the server computes it.
+ *
+ * Returns: (transfer full): the SHA-256 of the variables of @envv
+ */
+char *
+terminal_client_compute_environment_id (char **envv)
+{
+  gs_free_checksum GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  guint i;
+
+  for (i = 0; envv != NULL && envv[i] != NULL; i++)
+    g_checksum_update (checksum, (const guchar *) envv[i], strlen (envv[i]) + 1 /* NUL */);
+
+  return g_strdup (g_checksum_get_string (checksum));
+}
+
+/**
+ * terminal_client_append_exec_options:
+ * @builder: a #GVariantBuilder of #GVariantType "a{sv}"
+ * @environment_id: (allow-none): the ID of the environment, see
+ *   terminal_client_compute_environment_id(), or %NULL to pass the environment
+ * @working_directory: (allow-none): the cwd, or %NULL
+ * @shell:
+ *
+ * Appends the environment and the working directory to @builder.
+ */
+void
+terminal_client_append_exec_options (GVariantBuilder *builder,
+                                     const char      *environment_id,
+                                     const char      *working_directory,
+                                     PassFdElement   *fd_array,
+                                     gsize            fd_array_len,
+                                     gboolean         shell)
+{
+  if (environment_id) {
+    g_variant_builder_add (builder, "{sv}",
+                           "environ-id", g_variant_new_string (environment_id));
+  } else {
+    gs_strfreev char **envv = terminal_client_get_environment ();
+
+    g_variant_builder_add (builder, "{sv}",
+                           "environ",
+                           g_variant_new_bytestring_array ((const char * const *) envv, -1));
+  }
 
   if (working_directory)
     g_variant_builder_add (builder, "{sv}",
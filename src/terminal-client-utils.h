@@ -35,12 +35,21 @@ void terminal_client_append_create_instance_options (GVariantBuilder *builder,
                                                      gboolean         maximise_window,
                                                      gboolean         fullscreen_window);
 
+void terminal_client_append_headless_options        (GVariantBuilder *builder,
+                                                     gboolean         headless,
+                                                     const char      *attach_screen_object_path);
+
 typedef struct {
   int index;
   int fd;
 } PassFdElement;
 
+char ** terminal_client_get_environment             (void);
+
+char * terminal_client_compute_environment_id       (char           **envv);
+
 void terminal_client_append_exec_options            (GVariantBuilder *builder,
+                                                     const char      *environment_id,
                                                      const char      *working_directory,
                                                      PassFdElement   *fd_array,
                                                      gsize            fd_array_len,
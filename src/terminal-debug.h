@@ -34,7 +34,10 @@ typedef enum {
   TERMINAL_DEBUG_PROCESSES     = 1 << 6,
   TERMINAL_DEBUG_PROFILE       = 1 << 7,
   TERMINAL_DEBUG_SETTINGS_LIST = 1 << 8,
-  TERMINAL_DEBUG_SEARCH        = 1 << 9
+  TERMINAL_DEBUG_SEARCH        = 1 << 9,
+  TERMINAL_DEBUG_MEMORY        = 1 << 10,
+  TERMINAL_DEBUG_STALLS        = 1 << 11,
+  TERMINAL_DEBUG_MATCHES       = 1 << 12
 } TerminalDebugFlags;
 
 void _terminal_debug_init(void);
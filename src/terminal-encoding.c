@@ -19,7 +19,6 @@
 #include "config.h"
 
 #include <string.h>
-#include <search.h>
 #include <stdlib.h>
 
 #include <glib.h>
@@ -61,7 +60,7 @@ typedef struct {
   EncodingGroup group;
 } EncodingEntry;
 
-/* These MUST be sorted by charset so that bsearch can work! */
+/* Sorted by charset */
 static const EncodingEntry const encodings[] = {
   { "ARMSCII-8",      N_("Armenian"),            GROUP_OBSOLETE },
   { "BIG5",           N_("Chinese Traditional"), GROUP_CJKV },
@@ -167,16 +166,17 @@ compare_encoding_entry_cb (const void *ap,
   return strcmp (a->charset, b->charset);
 }
 
-/**
- * terminal_encodings_append_menu:
- *
- * Appends to known encodings to a #GMenu, sorted in groups and
- * alphabetically by name inside the groups. The action name
- * used when activating the menu items is "win.encoding".
+/* The sorted encodings and their menu sections only depend on the
+ * locale, so they are computed once and shared by all menus.
  */
-void
-terminal_encodings_append_menu (GMenu *menu)
+static GMenuModel *menu_sections[LAST_GROUP];
+
+static void
+ensure_menu_sections (void)
 {
+  if (menu_sections[0] != NULL)
+    return;
+
   /* First, sort the encodings */
   gs_free EncodingEntry *array = g_memdup (encodings, sizeof encodings);
   for (guint i = 0; i < G_N_ELEMENTS (encodings); i++)
@@ -186,7 +186,7 @@ terminal_encodings_append_menu (GMenu *menu)
          compare_encoding_entry_cb);
 
   for (guint group = 0 ; group < LAST_GROUP; group++) {
-    gs_unref_object GMenu *section = g_menu_new ();
+    GMenu *section = g_menu_new ();
 
     for (guint i = 0; i < G_N_ELEMENTS (encodings); i++) {
       if (array[i].group != group)
@@ -208,10 +208,27 @@ terminal_encodings_append_menu (GMenu *menu)
       g_menu_append_item (section, item);
     }
 
-    g_menu_append_section (menu, _(group_names[group].name), G_MENU_MODEL (section));
+    menu_sections[group] = G_MENU_MODEL (section) /* owned */;
   }
 }
 
+/**
+ * terminal_encodings_append_menu:
+ *
+ * Appends to known encodings to a #GMenu, sorted in groups and
+ * alphabetically by name inside the groups. The action name
+ * used when activating the menu items is "win.encoding".
+ * The sections are shared between all menus this is called on.
+ */
+void
+terminal_encodings_append_menu (GMenu *menu)
+{
+  ensure_menu_sections ();
+
+  for (guint group = 0 ; group < LAST_GROUP; group++)
+    g_menu_append_section (menu, _(group_names[group].name), menu_sections[group]);
+}
+
 /**
  * terminal_encodings_list_store_new:
  *
@@ -242,22 +259,25 @@ terminal_encodings_list_store_new (int column_id,
   return store;
 }
 
-static int
-compare_charset_cb (const void *ap,
-                    const void *bp)
-{
-  const EncodingEntry *a = ap;
-  const EncodingEntry *b = bp;
-
-  return strcmp (a->charset, b->charset);
-}
-
+/**
+ * terminal_encodings_is_known_charset:
+ * @charset: a charset
+ *
+ * Returns: whether @charset is one of the known encodings
+ */
 gboolean
 terminal_encodings_is_known_charset (const char *charset)
 {
-  EncodingEntry key = { charset, NULL, 0 };
-  return bsearch (&key,
-                  encodings, G_N_ELEMENTS (encodings),
-                  sizeof (encodings[0]),
-                  compare_charset_cb) != NULL;
+  static GHashTable *charsets = NULL;
+
+  if (charset == NULL)
+    return FALSE;
+
+  if (charsets == NULL) {
+    charsets = g_hash_table_new (g_str_hash, g_str_equal);
+    for (guint i = 0; i < G_N_ELEMENTS (encodings); i++)
+      g_hash_table_add (charsets, (gpointer) encodings[i].charset);
+  }
+
+  return g_hash_table_contains (charsets, charset);
 }
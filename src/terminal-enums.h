@@ -53,6 +53,13 @@ typedef enum {
   TERMINAL_THEME_VARIANT_DARK   = 2
 } TerminalThemeVariant;
 
+typedef enum {
+  TERMINAL_SERVER_SHARDING_NONE        = 0,
+  TERMINAL_SERVER_SHARDING_PROFILE     = 1,
+  TERMINAL_SERVER_SHARDING_WINDOW      = 2,
+  TERMINAL_SERVER_SHARDING_ROUND_ROBIN = 3
+} TerminalServerSharding;
+
 G_END_DECLS
 
 #endif /* TERMINAL_ENUMS_H */
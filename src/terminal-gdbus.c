@@ -19,6 +19,11 @@
 
 #include "terminal-gdbus.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
 
@@ -26,8 +31,12 @@
 #include "terminal-debug.h"
 #include "terminal-defines.h"
 #include "terminal-mdi-container.h"
+#include "terminal-metrics.h"
+#include "terminal-snapshot.h"
 #include "terminal-util.h"
 #include "terminal-window.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 /* ------------------------------------------------------------------------- */
@@ -36,6 +45,7 @@
 
 struct _TerminalReceiverImplPrivate {
   TerminalScreen *screen; /* unowned! */
+  GArray *exit_status_fds; /* int, owned */
 };
 
 enum {
@@ -45,11 +55,72 @@ enum {
 
 /* helper functions */
 
+/* Writes @data to an exit status FD passed in by the client, without
+ * raising SIGPIPE if the client has gone away in the meantime.
+ */
+static gboolean
+exit_status_fd_write (int fd,
+                      gconstpointer data,
+                      gsize len)
+{
+  const char *buf = data;
+
+  while (len > 0) {
+    gssize n;
+
+    n = send (fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == ENOTSOCK)
+      n = write (fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                             "Failed to write to exit status FD %d: %s\n",
+                             fd, g_strerror (errno));
+      return FALSE;
+    }
+
+    buf += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+/* Closes all exit status FDs of @impl. If @exit_code is non-%NULL, it is
+ * written to them first; otherwise the clients just see EOF.
+ */
+static void
+terminal_receiver_impl_close_exit_status_fds (TerminalReceiverImpl *impl,
+                                              const int *exit_code)
+{
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  guint i;
+
+  if (priv->exit_status_fds == NULL)
+    return;
+
+  for (i = 0; i < priv->exit_status_fds->len; i++) {
+    int fd = g_array_index (priv->exit_status_fds, int, i);
+
+    if (exit_code != NULL) {
+      gint32 status = *exit_code;
+      exit_status_fd_write (fd, &status, sizeof (status));
+    }
+    close (fd);
+  }
+
+  g_array_free (priv->exit_status_fds, TRUE);
+  priv->exit_status_fds = NULL;
+}
+
 static void
 child_exited_cb (VteTerminal *terminal,
                  int exit_code,
                  TerminalReceiver *receiver)
 {
+  terminal_receiver_impl_close_exit_status_fds (TERMINAL_RECEIVER_IMPL (receiver),
+                                                &exit_code);
   terminal_receiver_emit_child_exited (receiver, exit_code);
 }
 
@@ -72,6 +143,9 @@ terminal_receiver_impl_set_screen (TerminalReceiverImpl *impl,
                                           0, 0, NULL, NULL, impl);
   }
 
+  /* The child can't be waited for anymore; let the clients know */
+  terminal_receiver_impl_close_exit_status_fds (impl, NULL);
+
   priv->screen = screen;
   if (screen) {
     g_signal_connect (screen, "child-exited",
@@ -82,49 +156,54 @@ terminal_receiver_impl_set_screen (TerminalReceiverImpl *impl,
   g_object_notify (G_OBJECT (impl), "screen");
 }
 
-/* Class implementation */
-
+/* Validates the exec @options, and execs @arguments in @screen.
+ * The indices in the "fd-set" option refer to @fd_list.
+ * The environment is either in the "environ" option, or was registered
+ * with RegisterEnvironment and is referred to by the "environ-id"
+ * option.
+ */
 static gboolean
-terminal_receiver_impl_exec (TerminalReceiver *receiver,
-                             GDBusMethodInvocation *invocation,
-                             GUnixFDList *fd_list,
-                             GVariant *options,
-                             GVariant *arguments)
+exec_with_options (TerminalScreen *screen,
+                   GUnixFDList *fd_list,
+                   GVariant *options,
+                   GVariant *arguments,
+                   GError **error)
 {
-  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
-  TerminalReceiverImplPrivate *priv = impl->priv;
   const char *working_directory;
   gboolean shell;
-  char **exec_argv, **envv;
+  gs_free char **exec_argv = NULL;
+  gs_free char **inline_envv = NULL;
+  const char *environ_id;
+  char **envv;
   gsize exec_argc;
-  GVariant *fd_array;
-  GError *error;
-
-  if (priv->screen == NULL) {
-    g_dbus_method_invocation_return_error_literal (invocation,
-                                                   G_DBUS_ERROR,
-                                                   G_DBUS_ERROR_FAILED,
-                                                   "Terminal already closed");
-    goto out;
-  }
+  gs_unref_variant GVariant *fd_array = NULL;
 
   if (!g_variant_lookup (options, "cwd", "^&ay", &working_directory))
     working_directory = NULL;
   if (!g_variant_lookup (options, "shell", "b", &shell))
     shell = FALSE;
-  if (!g_variant_lookup (options, "environ", "^a&ay", &envv))
+
+  if (g_variant_lookup (options, "environ-id", "&s", &environ_id)) {
+    envv = terminal_app_lookup_environment (terminal_app_get (), environ_id);
+    if (envv == NULL) {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "Unknown environment %s", environ_id);
+      return FALSE;
+    }
+  } else if (g_variant_lookup (options, "environ", "^a&ay", &inline_envv)) {
+    envv = inline_envv;
+  } else {
     envv = NULL;
+  }
 
   if (!g_variant_lookup (options, "fd-set", "@a(ih)", &fd_array))
     fd_array = NULL;
 
   /* Check FD passing */
-  if ((fd_list != NULL) ^ (fd_array != NULL)) {
-    g_dbus_method_invocation_return_error_literal (invocation,
-                                                   G_DBUS_ERROR,
-                                                   G_DBUS_ERROR_INVALID_ARGS,
-                                                   "Must pass both fd-set options and a FD list");
-    goto out;
+  if (fd_array != NULL && fd_list == NULL) {
+    g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                         "Must pass both fd-set options and a FD list");
+    return FALSE;
   }
   if (fd_list != NULL && fd_array != NULL) {
     const int *fd_array_data;
@@ -140,19 +219,15 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
       if (fd == STDIN_FILENO ||
           fd == STDOUT_FILENO ||
           fd == STDERR_FILENO) {
-        g_dbus_method_invocation_return_error (invocation,
-                                               G_DBUS_ERROR,
-                                               G_DBUS_ERROR_INVALID_ARGS,
-                                               "Passing of std%s not supported",
-                                               fd == STDIN_FILENO ? "in" : fd == STDOUT_FILENO ? "out" : "err");
-        goto out;
+        g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                     "Passing of std%s not supported",
+                     fd == STDIN_FILENO ? "in" : fd == STDOUT_FILENO ? "out" : "err");
+        return FALSE;
       }
       if (idx < 0 || idx >= n_fds) {
-        g_dbus_method_invocation_return_error_literal (invocation,
-                                                       G_DBUS_ERROR,
-                                                       G_DBUS_ERROR_INVALID_ARGS,
-                                                       "Handle out of range");
-        goto out;
+        g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                             "Handle out of range");
+        return FALSE;
       }
     }
   }
@@ -163,23 +238,97 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
 
   exec_argv = (char **) g_variant_get_bytestring_array (arguments, &exec_argc);
 
+  return terminal_screen_exec (screen,
+                               exec_argc > 0 ? exec_argv : NULL,
+                               envv,
+                               shell,
+                               working_directory,
+                               fd_list, fd_array,
+                               error);
+}
+
+/* Class implementation */
+
+static gboolean
+terminal_receiver_impl_exec (TerminalReceiver *receiver,
+                             GDBusMethodInvocation *invocation,
+                             GUnixFDList *fd_list,
+                             GVariant *options,
+                             GVariant *arguments)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  GError *error;
+  gint32 exit_status_fd_idx;
+  int exit_status_fd = -1;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    goto out;
+  }
+
+  if (!g_variant_lookup (options, "exit-status-fd", "h", &exit_status_fd_idx))
+    exit_status_fd_idx = -1;
+
+  if (fd_list != NULL &&
+      exit_status_fd_idx == -1 &&
+      !g_variant_lookup (options, "fd-set", "@a(ih)", NULL)) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_INVALID_ARGS,
+                                                   "Must pass both fd-set options and a FD list");
+    goto out;
+  }
+
+  /* The client waits for the child's exit status on this FD, instead
+   * of having to subscribe to the ChildExited signal before the exec.
+   */
+  if (exit_status_fd_idx != -1) {
+    if (fd_list == NULL ||
+        exit_status_fd_idx < 0 ||
+        exit_status_fd_idx >= g_unix_fd_list_get_length (fd_list)) {
+      g_dbus_method_invocation_return_error_literal (invocation,
+                                                     G_DBUS_ERROR,
+                                                     G_DBUS_ERROR_INVALID_ARGS,
+                                                     "Handle out of range");
+      goto out;
+    }
+
+    error = NULL;
+    exit_status_fd = g_unix_fd_list_get (fd_list, exit_status_fd_idx, &error);
+    if (exit_status_fd == -1) {
+      g_dbus_method_invocation_take_error (invocation, error);
+      goto out;
+    }
+  }
+
+  gint64 trace_begin = _terminal_trace_begin ();
   error = NULL;
-  if (!terminal_screen_exec (priv->screen,
-                             exec_argc > 0 ? exec_argv : NULL,
-                             envv,
-                             shell,
-                             working_directory,
-                             fd_list, fd_array,
-                             &error)) {
+  if (!exec_with_options (priv->screen, fd_list, options, arguments, &error)) {
     g_dbus_method_invocation_take_error (invocation, error);
+    if (exit_status_fd != -1)
+      close (exit_status_fd);
   } else {
+    if (exit_status_fd != -1) {
+      const char ack = 0;
+
+      /* Tell the client the child is running, so it can tell us apart
+       * from a server that ignored the option.
+       */
+      if (exit_status_fd_write (exit_status_fd, &ack, sizeof (ack))) {
+        if (priv->exit_status_fds == NULL)
+          priv->exit_status_fds = g_array_new (FALSE, FALSE, sizeof (int));
+        g_array_append_val (priv->exit_status_fds, exit_status_fd);
+      } else {
+        close (exit_status_fd);
+      }
+    }
     terminal_receiver_complete_exec (receiver, invocation, NULL /* outfdlist */);
   }
-
-  g_free (exec_argv);
-  g_free (envv);
-  if (fd_array)
-    g_variant_unref (fd_array);
+  _terminal_trace_end ("Exec", trace_begin);
 
 out:
 
@@ -321,12 +470,73 @@ struct _TerminalFactoryImplPrivate {
   gpointer dummy;
 };
 
-static gboolean
-terminal_factory_impl_create_instance (TerminalFactory *factory,
-                                       GDBusMethodInvocation *invocation,
-                                       GVariant *options)
+/* Creates a new screen from the CreateInstance @options, using
+ * @parent_screen (if non-%NULL) to fill in missing information.
+ */
+static TerminalScreen *
+create_screen (TerminalApp *app,
+               GVariant *options,
+               TerminalScreen *parent_screen,
+               GError **error)
+{
+  const char *title;
+  if (!g_variant_lookup (options, "title", "&s", &title))
+    title = NULL;
+
+  double zoom;
+  if (!g_variant_lookup (options, "zoom", "d", &zoom)) {
+    if (parent_screen != NULL)
+      zoom = vte_terminal_get_font_scale (VTE_TERMINAL (parent_screen));
+    else
+      zoom = 1.0;
+  }
+
+  const char *encoding;
+  if (!g_variant_lookup (options, "encoding", "&s", &encoding)) {
+    if (parent_screen != NULL)
+      encoding = vte_terminal_get_encoding (VTE_TERMINAL (parent_screen));
+    else
+      encoding = NULL; /* use profile encoding */
+  }
+
+  /* Look up the profile */
+  gs_unref_object GSettings *profile = NULL;
+  const char *profile_uuid;
+  if (!g_variant_lookup (options, "profile", "&s", &profile_uuid))
+    profile_uuid = NULL;
+
+  if (profile_uuid == NULL && parent_screen != NULL) {
+    profile = terminal_screen_ref_profile (parent_screen);
+  } else {
+    GError *err = NULL;
+    profile = terminal_profiles_list_ref_profile_by_uuid (terminal_app_get_profiles_list (app),
+                                                          profile_uuid /* default if NULL */,
+                                                          &err);
+    if (profile == NULL) {
+      g_propagate_error (error, err);
+      return NULL;
+    }
+  }
+
+  g_assert_nonnull (profile);
+
+  /* Now we can create the new screen */
+  return terminal_screen_new (profile, encoding, NULL, title, NULL, NULL, zoom);
+}
+
+/* Creates a new screen from the CreateInstance @options. If @previous_screen
+ * is non-%NULL and @options has "window-from-previous" set, the screen is
+ * added to the window of @previous_screen. The screen is inserted into its
+ * window at @position, or appended if @position is -1.
+ */
+static TerminalScreen *
+create_instance (GVariant *options,
+                 TerminalScreen *previous_screen,
+                 int position,
+                 GError **error)
 {
   TerminalApp *app = terminal_app_get ();
+  TerminalScreen *screen;
 
   /* If a parent screen is specified, use that to fill in missing information */
   TerminalScreen *parent_screen = NULL;
@@ -334,29 +544,36 @@ terminal_factory_impl_create_instance (TerminalFactory *factory,
   if (g_variant_lookup (options, "parent-screen", "&o", &parent_screen_object_path)) {
     parent_screen = terminal_app_get_screen_by_object_path (app, parent_screen_object_path);
     if (parent_screen == NULL) {
-      g_dbus_method_invocation_return_error (invocation,
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "Failed to get screen from object path %s",
-                                             parent_screen_object_path);
-      return TRUE;
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "Failed to get screen from object path %s",
+                   parent_screen_object_path);
+      return NULL;
     }
   }
 
+  /* Headless screens are not put into a window until they're attached with
+   * the "attach-screen" option, so they can run a command without paying for
+   * the widgets around them, or for rendering.
+   */
+  gboolean headless;
+  if (!g_variant_lookup (options, "headless", "b", &headless))
+    headless = FALSE;
+
   /* Try getting a parent window, first by parent screen then by window ID;
    * if that fails, create a new window.
    */
   TerminalWindow *window = NULL;
   gboolean have_new_window = FALSE;
   const char *window_from_screen_object_path;
-  if (g_variant_lookup (options, "window-from-screen", "&o", &window_from_screen_object_path)) {
+  if (!headless &&
+      g_variant_lookup (options, "window-from-screen", "&o", &window_from_screen_object_path)) {
     TerminalScreen *window_screen =
       terminal_app_get_screen_by_object_path (app, window_from_screen_object_path);
     if (window_screen == NULL) {
-      g_dbus_method_invocation_return_error (invocation,
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "Failed to get screen from object path %s",
-                                             parent_screen_object_path);
-      return TRUE;
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "Failed to get screen from object path %s",
+                   window_from_screen_object_path);
+      return NULL;
     }
 
     GtkWidget *win = gtk_widget_get_toplevel (GTK_WIDGET (window_screen));
@@ -364,24 +581,50 @@ terminal_factory_impl_create_instance (TerminalFactory *factory,
       window = TERMINAL_WINDOW (win);
   }
 
+  /* Batched instances can't know the object path of the screen before them */
+  gboolean window_from_previous;
+  if (!headless && window == NULL && previous_screen != NULL &&
+      g_variant_lookup (options, "window-from-previous", "b", &window_from_previous) &&
+      window_from_previous) {
+    GtkWidget *win = gtk_widget_get_toplevel (GTK_WIDGET (previous_screen));
+    if (TERMINAL_IS_WINDOW (win))
+      window = TERMINAL_WINDOW (win);
+  }
+
   /* Support old client */
   guint window_id;
-  if (window == NULL && g_variant_lookup (options, "window-id", "u", &window_id)) {
+  if (!headless && window == NULL && g_variant_lookup (options, "window-id", "u", &window_id)) {
     GtkWindow *win = gtk_application_get_window_by_id (GTK_APPLICATION (app), window_id);
 
     if (!TERMINAL_IS_WINDOW (win)) {
-      g_dbus_method_invocation_return_error (invocation,
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "Nonexisting window %u referenced",
-                                             window_id);
-      return TRUE;
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "Nonexisting window %u referenced",
+                   window_id);
+      return NULL;
     }
 
     window = TERMINAL_WINDOW (win);
   }
 
+  /* Only take the headless screen once nothing can fail anymore, so it
+   * isn't lost on the error paths above
+   */
+  TerminalScreen *attach_screen = NULL;
+  const char *attach_screen_object_path;
+  if (!headless &&
+      g_variant_lookup (options, "attach-screen", "&o", &attach_screen_object_path)) {
+    attach_screen = terminal_app_get_screen_by_object_path (app, attach_screen_object_path);
+    if (attach_screen == NULL ||
+        !terminal_app_take_headless_screen (app, attach_screen)) {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "No headless screen at object path %s",
+                   attach_screen_object_path);
+      return NULL;
+    }
+  }
+
   /* Still no parent window? Create a new one */
-  if (window == NULL) {
+  if (!headless && window == NULL) {
     const char *startup_id, *role;
     gboolean start_maximized, start_fullscreen;
 
@@ -426,53 +669,24 @@ terminal_factory_impl_create_instance (TerminalFactory *factory,
     have_new_window = TRUE;
   }
 
-  g_assert_nonnull (window);
-
-  const char *title;
-  if (!g_variant_lookup (options, "title", "&s", &title))
-    title = NULL;
-
-  double zoom;
-  if (!g_variant_lookup (options, "zoom", "d", &zoom)) {
-    if (parent_screen != NULL)
-      zoom = vte_terminal_get_font_scale (VTE_TERMINAL (parent_screen));
-    else
-      zoom = 1.0;
-  }
-
-  const char *encoding;
-  if (!g_variant_lookup (options, "encoding", "&s", &encoding)) {
-    if (parent_screen != NULL)
-      encoding = vte_terminal_get_encoding (VTE_TERMINAL (parent_screen));
-    else
-      encoding = NULL; /* use profile encoding */
-  }
+  g_assert_true (headless || window != NULL);
 
-  /* Look up the profile */
-  gs_unref_object GSettings *profile = NULL;
-  const char *profile_uuid;
-  if (!g_variant_lookup (options, "profile", "&s", &profile_uuid))
-    profile_uuid = NULL;
-
-  if (profile_uuid == NULL && parent_screen != NULL) {
-    profile = terminal_screen_ref_profile (parent_screen);
+  if (attach_screen != NULL) {
+    screen = attach_screen;
   } else {
-    GError *err = NULL;
-    profile = terminal_profiles_list_ref_profile_by_uuid (terminal_app_get_profiles_list (app),
-                                                          profile_uuid /* default if NULL */,
-                                                          &err);
-    if (profile == NULL) {
-      g_dbus_method_invocation_return_gerror (invocation, err);
-      g_error_free (err);
-      return TRUE;
+    screen = create_screen (app, options, parent_screen, error);
+    if (screen == NULL)
+      return NULL;
+
+    if (headless) {
+      terminal_app_add_headless_screen (app, screen);
+      return screen;
     }
   }
 
-  g_assert_nonnull (profile);
-
-  /* Now we can create the new screen */
-  TerminalScreen *screen = terminal_screen_new (profile, encoding, NULL, title, NULL, NULL, zoom);
-  terminal_window_add_screen (window, screen, -1);
+  terminal_window_add_screen (window, screen, position);
+  if (attach_screen != NULL)
+    g_object_unref (attach_screen); /* the notebook holds it now */
 
   /* Apply window properties */
   gboolean active;
@@ -497,16 +711,354 @@ terminal_factory_impl_create_instance (TerminalFactory *factory,
   if (have_new_window || (present_window_set && present_window))
     gtk_window_present (GTK_WINDOW (window));
 
+  return screen;
+}
+
+static gboolean
+terminal_factory_impl_create_instance (TerminalFactory *factory,
+                                       GDBusMethodInvocation *invocation,
+                                       GVariant *options)
+{
+  TerminalApp *app = terminal_app_get ();
+  GError *error = NULL;
+
+  gint64 trace_begin = _terminal_trace_begin ();
+  const char *section = _terminal_watchdog_enter ("CreateInstance");
+  TerminalScreen *screen = create_instance (options, NULL, -1, &error);
+  _terminal_watchdog_leave (section);
+  _terminal_trace_end ("CreateInstance", trace_begin);
+  if (screen == NULL) {
+    g_dbus_method_invocation_take_error (invocation, error);
+    return TRUE;
+  }
+
   gs_free char *object_path = terminal_app_dup_screen_object_path (app, screen);
   terminal_factory_complete_create_instance (factory, invocation, object_path);
 
   return TRUE; /* handled */
 }
 
+/* Session restore
+ *
+ * CreateInstances requests are handled progressively: first, the active
+ * tab of every window is created, so each window can be shown and painted
+ * with a usable terminal right away. The remaining tabs are then created
+ * one at a time from an idle, taking turns between the windows, and the
+ * call completes once they all exist.
+ */
+
+typedef struct {
+  GVariant *options;
+  GVariant *exec_options;
+  GVariant *arguments;
+  char *object_path;
+  char *error;
+} RestoreInstance;
+
+typedef struct {
+  guint first;    /* the window's instances, in tab order */
+  guint n;
+  guint leader;   /* the instance created first */
+  guint n_created;
+  guint n_before; /* tabs created from the ones before the leader */
+  TerminalScreen *screen; /* the anchor: the first screen created in this window */
+} RestoreWindow;
+
+typedef struct {
+  TerminalFactory *factory;
+  GDBusMethodInvocation *invocation;
+  GUnixFDList *fd_list;
+  GArray *instances; /* RestoreInstance */
+  GArray *windows; /* RestoreWindow */
+  guint current_window;
+  guint n_pending;
+} RestoreData;
+
+static void
+restore_data_free (RestoreData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->instances->len; i++) {
+    RestoreInstance *ri = &g_array_index (data->instances, RestoreInstance, i);
+
+    g_variant_unref (ri->options);
+    g_variant_unref (ri->exec_options);
+    g_variant_unref (ri->arguments);
+    g_free (ri->object_path);
+    g_free (ri->error);
+  }
+  for (i = 0; i < data->windows->len; i++)
+    g_clear_object (&g_array_index (data->windows, RestoreWindow, i).screen);
+
+  g_array_free (data->instances, TRUE);
+  g_array_free (data->windows, TRUE);
+  g_clear_object (&data->fd_list);
+  g_object_unref (data->factory);
+  g_free (data);
+}
+
+static void
+restore_complete (RestoreData *data)
+{
+  GPtrArray *object_paths, *errors;
+  guint i;
+
+  object_paths = g_ptr_array_new ();
+  errors = g_ptr_array_new ();
+
+  for (i = 0; i < data->instances->len; i++) {
+    RestoreInstance *ri = &g_array_index (data->instances, RestoreInstance, i);
+
+    g_ptr_array_add (object_paths, ri->object_path ? ri->object_path : (char *) "/");
+    g_ptr_array_add (errors, ri->error ? ri->error : (char *) "");
+  }
+
+  g_ptr_array_add (object_paths, NULL);
+  g_ptr_array_add (errors, NULL);
+
+  terminal_factory_complete_create_instances (data->factory, data->invocation,
+                                              NULL /* outfdlist */,
+                                              (const char * const *) object_paths->pdata,
+                                              (const char * const *) errors->pdata);
+
+  g_ptr_array_unref (object_paths);
+  g_ptr_array_unref (errors);
+
+  restore_data_free (data);
+}
+
+/* Creates the next tab of @rw. The leader goes first; then the tabs after
+ * it are appended, and the ones before it are inserted in front of it.
+ * If the leader can't be created, the first tab that can be becomes the
+ * anchor instead, opening the window; the others are placed around it
+ * the same way, so the tab order is kept.
+ */
+static void
+restore_window_step (RestoreData *data,
+                     RestoreWindow *rw)
+{
+  TerminalApp *app = terminal_app_get ();
+  RestoreInstance *ri;
+  TerminalScreen *screen;
+  GError *error = NULL;
+  guint k, n_after, idx;
+  int position;
+
+  g_assert_cmpuint (rw->n_created, <, rw->n);
+
+  k = rw->n_created++;
+  n_after = rw->first + rw->n - 1 - rw->leader;
+  if (k == 0) {
+    idx = rw->leader;
+    position = -1;
+  } else if (k <= n_after) {
+    idx = rw->leader + k;
+    position = -1;
+  } else {
+    idx = rw->first + (k - n_after - 1);
+    position = rw->n_before;
+  }
+
+  ri = &g_array_index (data->instances, RestoreInstance, idx);
+
+  screen = create_instance (ri->options, rw->screen, position, &error);
+  if (screen != NULL) {
+    if (rw->screen == NULL) {
+      if (idx != rw->leader)
+        _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                               "Restoring window at instance %u instead of %u\n",
+                               idx, rw->leader);
+      rw->screen = g_object_ref (screen);
+    }
+    if (k > n_after)
+      rw->n_before++;
+
+    if (!exec_with_options (screen, data->fd_list, ri->exec_options, ri->arguments, &error))
+      screen = NULL;
+  }
+
+  if (screen != NULL)
+    ri->object_path = terminal_app_dup_screen_object_path (app, screen);
+  else {
+    ri->error = g_strdup (error->message);
+    g_error_free (error);
+  }
+
+  data->n_pending--;
+}
+
+static gboolean
+restore_idle_cb (RestoreData *data)
+{
+  guint i;
+
+  for (i = 0; i < data->windows->len; i++) {
+    RestoreWindow *rw;
+
+    rw = &g_array_index (data->windows, RestoreWindow, data->current_window);
+    data->current_window = (data->current_window + 1) % data->windows->len;
+
+    if (rw->n_created < rw->n) {
+      restore_window_step (data, rw);
+      break;
+    }
+  }
+
+  if (data->n_pending > 0)
+    return G_SOURCE_CONTINUE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Restored %u instances\n",
+                         data->instances->len);
+
+  restore_complete (data);
+  g_application_release (G_APPLICATION (terminal_app_get ()));
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+terminal_factory_impl_create_instances (TerminalFactory *factory,
+                                        GDBusMethodInvocation *invocation,
+                                        GUnixFDList *fd_list,
+                                        GVariant *instances)
+{
+  RestoreData *data;
+  GVariantIter iter;
+  GVariant *options, *exec_options, *arguments;
+  RestoreWindow *rw = NULL;
+  const char *environ_id;
+  guint i;
+
+  /* Clients refer to their environment by its ID before registering it,
+   * so check them all up front; the client registers it and retries.
+   */
+  g_variant_iter_init (&iter, instances);
+  while (g_variant_iter_loop (&iter, "(@a{sv}@a{sv}@aay)", &options, &exec_options, &arguments)) {
+    if (g_variant_lookup (exec_options, "environ-id", "&s", &environ_id) &&
+        terminal_app_lookup_environment (terminal_app_get (), environ_id) == NULL) {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                             "Unknown environment %s", environ_id);
+      g_variant_unref (options);
+      g_variant_unref (exec_options);
+      g_variant_unref (arguments);
+      return TRUE; /* handled */
+    }
+  }
+
+  data = g_new0 (RestoreData, 1);
+  data->factory = g_object_ref (factory);
+  data->invocation = invocation;
+  data->fd_list = fd_list ? g_object_ref (fd_list) : NULL;
+  data->instances = g_array_new (FALSE, TRUE, sizeof (RestoreInstance));
+  data->windows = g_array_new (FALSE, TRUE, sizeof (RestoreWindow));
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Creating %" G_GSIZE_FORMAT " instances\n",
+                         g_variant_n_children (instances));
+
+  /* Group the instances by window; tabs after the first one of a window
+   * have "window-from-previous" set.
+   */
+  g_variant_iter_init (&iter, instances);
+  while (g_variant_iter_next (&iter, "(@a{sv}@a{sv}@aay)", &options, &exec_options, &arguments)) {
+    RestoreInstance ri = { options, exec_options, arguments, NULL, NULL };
+    gboolean window_from_previous, active;
+
+    if (rw == NULL ||
+        !g_variant_lookup (options, "window-from-previous", "b", &window_from_previous) ||
+        !window_from_previous) {
+      RestoreWindow new_rw = { data->instances->len, 0, data->instances->len, 0, 0, NULL };
+
+      g_array_append_val (data->windows, new_rw);
+      rw = &g_array_index (data->windows, RestoreWindow, data->windows->len - 1);
+    }
+
+    /* Tabs joining an existing window are created in order, since
+     * we don't know where the other tabs of that window are.
+     */
+    if (rw->n > 0 &&
+        g_variant_lookup (options, "active", "b", &active) && active &&
+        !g_variant_lookup (g_array_index (data->instances, RestoreInstance, rw->first).options,
+                           "window-from-screen", "&o", NULL))
+      rw->leader = data->instances->len;
+
+    g_array_append_val (data->instances, ri);
+    rw->n++;
+  }
+
+  data->n_pending = data->instances->len;
+
+  /* The active tabs first */
+  for (i = 0; i < data->windows->len; i++)
+    restore_window_step (data, &g_array_index (data->windows, RestoreWindow, i));
+
+  if (data->n_pending == 0) {
+    restore_complete (data);
+    return TRUE; /* handled */
+  }
+
+  /* Keep running until all the tabs are there */
+  g_application_hold (G_APPLICATION (terminal_app_get ()));
+  _terminal_watchdog_idle_add ("restore", (GSourceFunc) restore_idle_cb, data);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_get_scrollback_usage (TerminalFactory *factory,
+                                            GDBusMethodInvocation *invocation)
+{
+  guint64 total, budget;
+  GVariant *screens;
+
+  screens = terminal_app_get_scrollback_usage (terminal_app_get (), &total, &budget);
+  terminal_factory_complete_get_scrollback_usage (factory, invocation, screens, total, budget);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_restore_snapshot (TerminalFactory *factory,
+                                        GDBusMethodInvocation *invocation)
+{
+  GError *error = NULL;
+
+  gs_strfreev char **object_paths = terminal_snapshot_restore (terminal_app_get (), &error);
+  if (object_paths == NULL) {
+    g_dbus_method_invocation_take_error (invocation, error);
+    return TRUE;
+  }
+
+  terminal_factory_complete_restore_snapshot (factory, invocation,
+                                              (const char * const *) object_paths);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_register_environment (TerminalFactory *factory,
+                                            GDBusMethodInvocation *invocation,
+                                            GVariant *environment)
+{
+  gs_free char **envv = (char **) g_variant_get_bytestring_array (environment, NULL);
+  const char *id;
+
+  id = terminal_app_register_environment (terminal_app_get (), envv);
+  terminal_factory_complete_register_environment (factory, invocation, id);
+
+  return TRUE; /* handled */
+}
+
 static void
 terminal_factory_impl_iface_init (TerminalFactoryIface *iface)
 {
   iface->handle_create_instance = terminal_factory_impl_create_instance;
+  iface->handle_create_instances = terminal_factory_impl_create_instances;
+  iface->handle_get_scrollback_usage = terminal_factory_impl_get_scrollback_usage;
+  iface->handle_restore_snapshot = terminal_factory_impl_restore_snapshot;
+  iface->handle_register_environment = terminal_factory_impl_register_environment;
 }
 
 G_DEFINE_TYPE_WITH_CODE (TerminalFactoryImpl, terminal_factory_impl, TERMINAL_TYPE_FACTORY_SKELETON,
@@ -534,3 +1086,48 @@ terminal_factory_impl_new (void)
 {
   return g_object_new (TERMINAL_TYPE_FACTORY_IMPL, NULL);
 }
+
+/* ---------------------------------------------------------------------------
+ * TerminalMetricsImpl
+ * ---------------------------------------------------------------------------
+ */
+
+static gboolean
+terminal_metrics_impl_get_metrics (TerminalMetrics *metrics,
+                                   GDBusMethodInvocation *invocation)
+{
+  terminal_metrics_complete_get_metrics (metrics, invocation,
+                                         terminal_metrics_get_snapshot (terminal_app_get ()));
+
+  return TRUE; /* handled */
+}
+
+static void
+terminal_metrics_impl_iface_init (TerminalMetricsIface *iface)
+{
+  iface->handle_get_metrics = terminal_metrics_impl_get_metrics;
+}
+
+G_DEFINE_TYPE_WITH_CODE (TerminalMetricsImpl, terminal_metrics_impl, TERMINAL_TYPE_METRICS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (TERMINAL_TYPE_METRICS, terminal_metrics_impl_iface_init))
+
+static void
+terminal_metrics_impl_init (TerminalMetricsImpl *impl)
+{
+}
+
+static void
+terminal_metrics_impl_class_init (TerminalMetricsImplClass *klass)
+{
+}
+
+/**
+ * terminal_metrics_impl_new:
+ *
+ * Returns: (transfer full): a new #TerminalMetricsImpl
+ */
+TerminalMetrics *
+terminal_metrics_impl_new (void)
+{
+  return g_object_new (TERMINAL_TYPE_METRICS_IMPL, NULL);
+}
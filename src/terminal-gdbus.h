@@ -85,6 +85,31 @@ GType terminal_factory_impl_get_type (void);
 
 TerminalFactory *terminal_factory_impl_new (void);
 
+/* ------------------------------------------------------------------------- */
+
+#define TERMINAL_TYPE_METRICS_IMPL              (terminal_metrics_impl_get_type ())
+#define TERMINAL_METRICS_IMPL(object)           (G_TYPE_CHECK_INSTANCE_CAST ((object), TERMINAL_TYPE_METRICS_IMPL, TerminalMetricsImpl))
+#define TERMINAL_METRICS_IMPL_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), TERMINAL_TYPE_METRICS_IMPL, TerminalMetricsImplClass))
+#define TERMINAL_IS_METRICS_IMPL(object)        (G_TYPE_CHECK_INSTANCE_TYPE ((object), TERMINAL_TYPE_METRICS_IMPL))
+#define TERMINAL_IS_METRICS_IMPL_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), TERMINAL_TYPE_METRICS_IMPL))
+#define TERMINAL_METRICS_IMPL_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), TERMINAL_TYPE_METRICS_IMPL, TerminalMetricsImplClass))
+
+typedef struct _TerminalMetricsImpl        TerminalMetricsImpl;
+typedef struct _TerminalMetricsImplClass   TerminalMetricsImplClass;
+
+struct _TerminalMetricsImplClass {
+  TerminalMetricsSkeletonClass parent_class;
+};
+
+struct _TerminalMetricsImpl
+{
+  TerminalMetricsSkeleton parent_instance;
+};
+
+GType terminal_metrics_impl_get_type (void);
+
+TerminalMetrics *terminal_metrics_impl_new (void);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_RECEIVER_IMPL_H */
@@ -0,0 +1,249 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "terminal-metrics.h"
+#include "terminal-screen.h"
+#include "terminal-window.h"
+#include "terminal-libgsystem.h"
+
+/*
+ * Server metrics
+ *
+ * Everything here is cheap to keep up to date, so it is always on,
+ * except the main loop stall probe: it wakes up the main loop ten times
+ * a second, so it only runs while someone is reading the metrics.
+ * The metrics are read as one a{sv} snapshot; durations are in
+ * microseconds, and each histogram is an "au" of counts with
+ * one more bucket than its "at" of upper bounds.
+ */
+
+/* Upper bounds of the histogram buckets; the last bucket has no bound */
+static const guint64 spawn_latency_bounds[] = {
+  1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000
+};
+
+static const guint64 stall_bounds[] = {
+  50000, 100000, 200000, 500000, 1000000, 2000000, 5000000
+};
+
+/* The spawns per second over the last minute */
+#define SPAWN_RATE_SECONDS (60)
+
+#define STALL_PROBE_INTERVAL (100 /* ms */)
+#define STALL_THRESHOLD (50000 /* µs */)
+/* Stop the stall probe when the metrics have not been read for this long */
+#define STALL_PROBE_IDLE_TIMEOUT (60 * G_USEC_PER_SEC)
+
+static guint64 n_spawns;
+static guint64 n_spawn_failures;
+static guint spawn_latency_histogram[G_N_ELEMENTS (spawn_latency_bounds) + 1];
+static guint spawn_rate_buckets[SPAWN_RATE_SECONDS];
+static gint64 spawn_rate_second; /* the second of the newest bucket */
+
+static guint stall_probe_source_id;
+static gint64 stall_probe_last_time;
+static gint64 stall_probe_last_read_time;
+static guint64 n_stalls;
+static guint64 stall_total_time;
+static guint64 stall_max_time;
+static guint stall_histogram[G_N_ELEMENTS (stall_bounds) + 1];
+
+static void
+histogram_add (guint *histogram,
+               const guint64 *bounds,
+               guint n_bounds,
+               guint64 value)
+{
+  guint i;
+
+  for (i = 0; i < n_bounds && value > bounds[i]; i++)
+    ;
+
+  histogram[i]++;
+}
+
+static GVariant *
+histogram_to_variant (const guint *histogram,
+                      guint n_buckets)
+{
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                    histogram, n_buckets, sizeof (guint));
+}
+
+static GVariant *
+bounds_to_variant (const guint64 *bounds,
+                   guint n_bounds)
+{
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                    bounds, n_bounds, sizeof (guint64));
+}
+
+/* Moves the spawn rate window forward to @second, dropping what fell out of it */
+static void
+spawn_rate_advance (gint64 second)
+{
+  gint64 s;
+
+  if (second - spawn_rate_second >= SPAWN_RATE_SECONDS) {
+    memset (spawn_rate_buckets, 0, sizeof (spawn_rate_buckets));
+  } else {
+    for (s = spawn_rate_second + 1; s <= second; s++)
+      spawn_rate_buckets[s % SPAWN_RATE_SECONDS] = 0;
+  }
+
+  spawn_rate_second = MAX (spawn_rate_second, second);
+}
+
+/**
+ * terminal_metrics_record_spawn:
+ * @begin: the monotonic time the spawn was started
+ * @success: whether the child was started
+ *
+ * Records a finished spawn of a terminal's child process.
+ */
+void
+terminal_metrics_record_spawn (gint64 begin,
+                               gboolean success)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 second = now / G_USEC_PER_SEC;
+
+  n_spawns++;
+  if (!success)
+    n_spawn_failures++;
+
+  if (begin > 0 && now >= begin)
+    histogram_add (spawn_latency_histogram,
+                   spawn_latency_bounds, G_N_ELEMENTS (spawn_latency_bounds),
+                   (guint64) (now - begin));
+
+  spawn_rate_advance (second);
+  spawn_rate_buckets[second % SPAWN_RATE_SECONDS]++;
+}
+
+static gboolean
+stall_probe_cb (gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 late = now - stall_probe_last_time - STALL_PROBE_INTERVAL * 1000;
+
+  stall_probe_last_time = now;
+
+  if (now - stall_probe_last_read_time > STALL_PROBE_IDLE_TIMEOUT) {
+    stall_probe_source_id = 0;
+    return FALSE; /* remove */
+  }
+
+  if (late < STALL_THRESHOLD)
+    return TRUE; /* run again */
+
+  n_stalls++;
+  stall_total_time += late;
+  stall_max_time = MAX (stall_max_time, (guint64) late);
+  histogram_add (stall_histogram, stall_bounds, G_N_ELEMENTS (stall_bounds), late);
+
+  return TRUE; /* run again */
+}
+
+/* Returns the resident set size of this process in bytes, or 0 */
+static guint64
+get_rss (void)
+{
+  gs_free char *contents = NULL;
+  unsigned long size, resident;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL) ||
+      sscanf (contents, "%lu %lu", &size, &resident) != 2)
+    return 0;
+
+  return (guint64) resident * sysconf (_SC_PAGESIZE);
+}
+
+/**
+ * terminal_metrics_get_snapshot:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer floating): an "a{sv}" #GVariant with the current metrics
+ */
+GVariant *
+terminal_metrics_get_snapshot (TerminalApp *app)
+{
+  GVariantBuilder builder, screens_builder, details_builder;
+  GList *l;
+  guint n_windows = 0, spawns_in_window = 0, i;
+
+  stall_probe_last_read_time = g_get_monotonic_time ();
+  if (stall_probe_source_id == 0) {
+    stall_probe_last_time = stall_probe_last_read_time;
+    stall_probe_source_id = g_timeout_add (STALL_PROBE_INTERVAL, stall_probe_cb, NULL);
+  }
+
+  for (l = gtk_application_get_windows (GTK_APPLICATION (app)); l != NULL; l = l->next)
+    if (TERMINAL_IS_WINDOW (l->data))
+      n_windows++;
+
+  g_variant_builder_init (&screens_builder, G_VARIANT_TYPE ("a{o(ut)}"));
+  g_variant_builder_init (&details_builder, G_VARIANT_TYPE ("a{o@a{sv}}"));
+  gs_free_list GList *screens = terminal_app_list_screens (app);
+  for (l = screens; l != NULL; l = l->next) {
+    gs_free char *object_path = terminal_app_dup_screen_object_path (app, l->data);
+
+    g_variant_builder_add (&screens_builder, "{o(ut)}", object_path,
+                           terminal_screen_get_contents_changes (l->data),
+                           (guint64) terminal_screen_get_scrollback_bytes (l->data));
+    g_variant_builder_add (&details_builder, "{o@a{sv}}", object_path,
+                           terminal_screen_get_stats (l->data));
+  }
+
+  spawn_rate_advance (g_get_monotonic_time () / G_USEC_PER_SEC);
+  for (i = 0; i < SPAWN_RATE_SECONDS; i++)
+    spawns_in_window += spawn_rate_buckets[i];
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "windows", g_variant_new_uint32 (n_windows));
+  g_variant_builder_add (&builder, "{sv}", "screens", g_variant_new_uint32 (g_list_length (screens)));
+  g_variant_builder_add (&builder, "{sv}", "screen-stats", g_variant_builder_end (&screens_builder));
+  g_variant_builder_add (&builder, "{sv}", "screen-details", g_variant_builder_end (&details_builder));
+  g_variant_builder_add (&builder, "{sv}", "rss", g_variant_new_uint64 (get_rss ()));
+
+  g_variant_builder_add (&builder, "{sv}", "spawns", g_variant_new_uint64 (n_spawns));
+  g_variant_builder_add (&builder, "{sv}", "spawn-failures", g_variant_new_uint64 (n_spawn_failures));
+  g_variant_builder_add (&builder, "{sv}", "spawns-per-second",
+                         g_variant_new_double ((double) spawns_in_window / SPAWN_RATE_SECONDS));
+  g_variant_builder_add (&builder, "{sv}", "spawn-latency-bounds",
+                         bounds_to_variant (spawn_latency_bounds, G_N_ELEMENTS (spawn_latency_bounds)));
+  g_variant_builder_add (&builder, "{sv}", "spawn-latency-histogram",
+                         histogram_to_variant (spawn_latency_histogram, G_N_ELEMENTS (spawn_latency_histogram)));
+
+  g_variant_builder_add (&builder, "{sv}", "stalls", g_variant_new_uint64 (n_stalls));
+  g_variant_builder_add (&builder, "{sv}", "stall-total-time", g_variant_new_uint64 (stall_total_time));
+  g_variant_builder_add (&builder, "{sv}", "stall-max-time", g_variant_new_uint64 (stall_max_time));
+  g_variant_builder_add (&builder, "{sv}", "stall-bounds",
+                         bounds_to_variant (stall_bounds, G_N_ELEMENTS (stall_bounds)));
+  g_variant_builder_add (&builder, "{sv}", "stall-histogram",
+                         histogram_to_variant (stall_histogram, G_N_ELEMENTS (stall_histogram)));
+
+  return g_variant_builder_end (&builder);
+}
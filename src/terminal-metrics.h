@@ -0,0 +1,34 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_METRICS_H
+#define TERMINAL_METRICS_H
+
+#include <glib.h>
+
+#include "terminal-app.h"
+
+G_BEGIN_DECLS
+
+void terminal_metrics_record_spawn (gint64 begin,
+                                    gboolean success);
+
+GVariant *terminal_metrics_get_snapshot (TerminalApp *app);
+
+G_END_DECLS
+
+#endif /* TERMINAL_METRICS_H */
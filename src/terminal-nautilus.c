@@ -53,7 +53,18 @@ struct _TerminalNautilus {
         GObject parent_instance;
 
         GSettings *lockdown_prefs;
+        gboolean locked_down;
         gboolean have_mc;
+
+        /* URI -> UriContext, for the menu items */
+        GHashTable *uri_contexts;
+        GVolumeMonitor *volume_monitor;
+
+        /* The factory proxy is kept across invocations */
+        TerminalFactory *factory;
+        gboolean factory_pending;
+        GSList *pending_execs; /* ExecData waiting for the factory */
+        GCancellable *cancellable;
 };
 
 struct _TerminalNautilusClass {
@@ -292,8 +303,7 @@ mc_argv (int *argcp)
 static gboolean
 terminal_locked_down (TerminalNautilus *nautilus)
 {
-  return g_settings_get_boolean (nautilus->lockdown_prefs,
-                                 "disable-command-line");
+  return nautilus->locked_down;
 }
 
 /* used to determine for remote URIs whether GVFS is capable of mapping them to ~/.gvfs */
@@ -315,6 +325,64 @@ uri_has_local_path (const char *uri)
   return ret;
 }
 
+/* What the menu items for an URI depend on. Getting these may need GVfs
+ * round trips for remote URIs, so they are cached per URI, until the
+ * lockdown settings or the mounts change.
+ */
+typedef struct {
+  TerminalFileInfo info;
+  gboolean has_local_path;
+} UriContext;
+
+/* Don't let the cache grow without bounds when browsing around */
+#define URI_CONTEXTS_MAX (256)
+
+static const UriContext *
+get_uri_context (TerminalNautilus *nautilus,
+                 const char *uri)
+{
+  UriContext *context;
+
+  context = g_hash_table_lookup (nautilus->uri_contexts, uri);
+  if (context != NULL)
+    return context;
+
+  if (g_hash_table_size (nautilus->uri_contexts) >= URI_CONTEXTS_MAX)
+    g_hash_table_remove_all (nautilus->uri_contexts);
+
+  context = g_new (UriContext, 1);
+  context->info = get_terminal_file_info_from_uri (uri);
+  context->has_local_path = context->info == FILE_INFO_DESKTOP ? FALSE
+                                                              : uri_has_local_path (uri);
+
+  g_hash_table_insert (nautilus->uri_contexts, g_strdup (uri), context);
+
+  return context;
+}
+
+static void
+invalidate_uri_contexts (TerminalNautilus *nautilus)
+{
+  g_hash_table_remove_all (nautilus->uri_contexts);
+}
+
+static void
+lockdown_prefs_changed_cb (GSettings *settings,
+                           const char *key,
+                           TerminalNautilus *nautilus)
+{
+  nautilus->locked_down = g_settings_get_boolean (settings, "disable-command-line");
+  invalidate_uri_contexts (nautilus);
+}
+
+static void
+mounts_changed_cb (GVolumeMonitor *monitor,
+                   GMount *mount,
+                   TerminalNautilus *nautilus)
+{
+  invalidate_uri_contexts (nautilus);
+}
+
 /* Nautilus menu item class */
 
 typedef struct {
@@ -337,36 +405,98 @@ exec_data_free (ExecData *data)
   g_free (data);
 }
 
-/* FIXME: make this async */
-static gboolean
-create_terminal (ExecData *data /* transfer full */)
+/* Opening the terminal is done asynchronously in three steps, so that
+ * nautilus isn't blocked while the server is started or busy: get the
+ * factory proxy (usually cached already), create the terminal instance,
+ * and exec the child in it.
+ */
+
+static void
+exec_done_cb (GObject *source,
+              GAsyncResult *result,
+              gpointer user_data)
 {
-  TerminalFactory *factory;
-  TerminalReceiver *receiver;
+  ExecData *data = user_data;
+  GVariant *ret;
+  GError *error = NULL;
+
+  ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result, &error);
+  if (ret == NULL) {
+    g_dbus_error_strip_remote_error (error);
+    g_printerr ("Error: %s\n", error->message);
+    g_error_free (error);
+  } else {
+    g_variant_unref (ret);
+  }
+
+  exec_data_free (data);
+}
+
+static void
+create_instance_done_cb (GObject *source,
+                         GAsyncResult *result,
+                         gpointer user_data)
+{
+  TerminalFactory *factory = TERMINAL_FACTORY (source);
+  ExecData *data = user_data;
   GError *error = NULL;
   GVariantBuilder builder;
   char *object_path;
-  char startup_id[32];
   char **argv;
   int argc;
 
-  factory = terminal_factory_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                                     G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
-                                                     TERMINAL_APPLICATION_ID,
-                                                     TERMINAL_FACTORY_OBJECT_PATH,
-                                                     NULL /* cancellable */,
-                                                     &error);
-  if (factory == NULL) {
+  if (!terminal_factory_call_create_instance_finish (factory, &object_path, result, &error)) {
     g_dbus_error_strip_remote_error (error);
-    g_printerr ("Error constructing proxy for %s:%s: %s\n",
-                TERMINAL_APPLICATION_ID, TERMINAL_FACTORY_OBJECT_PATH,
-                error->message);
+    g_printerr ("Error creating terminal: %s\n", error->message);
     g_error_free (error);
     exec_data_free (data);
-    return FALSE;
+    return;
   }
 
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  terminal_client_append_exec_options (&builder,
+                                       NULL /* environment ID */,
+                                       data->path,
+                                       NULL, 0, /* FD array */
+                                       TRUE /* shell */);
+
+  if (data->info == FILE_INFO_SFTP &&
+      data->remote) {
+    argv = ssh_argv (data->uri, data->run_in_mc, &argc);
+  } else if (data->run_in_mc) {
+    argv = mc_argv (&argc);
+  } else {
+    argv = NULL; argc = 0;
+  }
+
+  /* Call Exec directly, instead of creating a receiver proxy first */
+  g_dbus_connection_call (g_dbus_proxy_get_connection (G_DBUS_PROXY (factory)),
+                          TERMINAL_APPLICATION_ID,
+                          object_path,
+                          TEMRINAL_RECEIVER_INTERFACE_NAME,
+                          "Exec",
+                          g_variant_new ("(@a{sv}@aay)",
+                                         g_variant_builder_end (&builder),
+                                         g_variant_new_bytestring_array ((const char * const *) argv, argc)),
+                          G_VARIANT_TYPE ("()"),
+                          G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                          -1 /* default timeout */,
+                          data->nautilus->cancellable,
+                          exec_done_cb,
+                          data);
+
+  g_strfreev (argv);
+  g_free (object_path);
+}
+
+static void
+create_instance (TerminalFactory *factory,
+                 ExecData *data /* transfer full */)
+{
+  GVariantBuilder builder;
+  char startup_id[32];
+
   g_snprintf (startup_id, sizeof (startup_id), "_TIME%u", data->timestamp);
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
@@ -383,79 +513,86 @@ create_terminal (ExecData *data /* transfer full */)
                                                   FALSE /* maximised */,
                                                   FALSE /* fullscreen */);
 
-  if (!terminal_factory_call_create_instance_sync
-         (factory,
-          g_variant_builder_end (&builder),
-          &object_path,
-          NULL /* cancellable */,
-          &error)) {
-    g_dbus_error_strip_remote_error (error);
-    g_printerr ("Error creating terminal: %s\n", error->message);
+  terminal_factory_call_create_instance (factory,
+                                         g_variant_builder_end (&builder),
+                                         data->nautilus->cancellable,
+                                         create_instance_done_cb,
+                                         data);
+}
+
+static void
+factory_proxy_ready_cb (GObject *source,
+                        GAsyncResult *result,
+                        gpointer user_data)
+{
+  TerminalNautilus *nautilus;
+  TerminalFactory *factory;
+  GError *error = NULL;
+  GSList *pending, *l;
+
+  factory = terminal_factory_proxy_new_for_bus_finish (result, &error);
+  if (factory == NULL &&
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    /* The extension is being disposed */
     g_error_free (error);
-    g_object_unref (factory);
-    exec_data_free (data);
-    return FALSE;
+    return;
   }
 
-  g_object_unref (factory);
+  nautilus = TERMINAL_NAUTILUS (user_data);
+  nautilus->factory_pending = FALSE;
 
-  receiver = terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                                       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                                       G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
-                                                       TERMINAL_APPLICATION_ID,
-                                                       object_path,
-                                                       NULL /* cancellable */,
-                                                       &error);
-  if (receiver == NULL) {
+  if (factory == NULL) {
     g_dbus_error_strip_remote_error (error);
-    g_printerr ("Failed to create proxy for terminal: %s\n", error->message);
+    g_printerr ("Error constructing proxy for %s:%s: %s\n",
+                TERMINAL_APPLICATION_ID, TERMINAL_FACTORY_OBJECT_PATH,
+                error->message);
     g_error_free (error);
-    g_free (object_path);
-    exec_data_free (data);
-    return FALSE;
+  } else {
+    nautilus->factory = factory;
   }
 
-  g_free (object_path);
-
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
-
-  terminal_client_append_exec_options (&builder,
-                                       data->path,
-                                       NULL, 0, /* FD array */
-                                       TRUE /* shell */);
+  pending = g_slist_reverse (nautilus->pending_execs);
+  nautilus->pending_execs = NULL;
 
-  if (data->info == FILE_INFO_SFTP &&
-      data->remote) {
-    argv = ssh_argv (data->uri, data->run_in_mc, &argc);
-  } else if (data->run_in_mc) {
-    argv = mc_argv (&argc);
-  } else {
-    argv = NULL; argc = 0;
+  for (l = pending; l != NULL; l = l->next) {
+    if (factory != NULL)
+      create_instance (factory, l->data);
+    else
+      exec_data_free (l->data);
   }
+  g_slist_free (pending);
+}
 
-  if (!terminal_receiver_call_exec_sync (receiver,
-                                         g_variant_builder_end (&builder),
-                                         g_variant_new_bytestring_array ((const char * const *) argv, argc),
-                                         NULL /* in FD list */,
-                                         NULL /* out FD list */,
-                                         NULL /* cancellable */,
-                                         &error)) {
-    g_dbus_error_strip_remote_error (error);
-    g_printerr ("Error: %s\n", error->message);
-    g_error_free (error);
-    g_strfreev (argv);
-    g_object_unref (receiver);
-    exec_data_free (data);
-    return FALSE;
-  }
+static void
+ensure_factory (TerminalNautilus *nautilus)
+{
+  if (nautilus->factory != NULL || nautilus->factory_pending)
+    return;
 
-  g_strfreev (argv);
+  nautilus->factory_pending = TRUE;
+  terminal_factory_proxy_new_for_bus (G_BUS_TYPE_SESSION,
+                                      G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                      G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                      TERMINAL_APPLICATION_ID,
+                                      TERMINAL_FACTORY_OBJECT_PATH,
+                                      nautilus->cancellable,
+                                      factory_proxy_ready_cb,
+                                      nautilus);
+}
 
-  exec_data_free (data);
+static void
+create_terminal (ExecData *data /* transfer full */)
+{
+  TerminalNautilus *nautilus = data->nautilus;
 
-  g_object_unref (receiver);
+  if (nautilus->factory != NULL) {
+    create_instance (nautilus->factory, data);
+    return;
+  }
 
-  return TRUE;
+  /* Constructing the proxy failed before, or it's still in progress */
+  nautilus->pending_execs = g_slist_prepend (nautilus->pending_execs, data);
+  ensure_factory (nautilus);
 }
 
 static void
@@ -682,6 +819,7 @@ terminal_nautilus_get_background_items (NautilusMenuProvider *provider,
   gchar *uri;
   GList *items;
   NautilusMenuItem *item;
+  const UriContext *context;
   TerminalFileInfo terminal_file_info;
 
   if (terminal_locked_down (nautilus))
@@ -693,8 +831,8 @@ terminal_nautilus_get_background_items (NautilusMenuProvider *provider,
 
   items = NULL;
 
-  terminal_file_info = get_terminal_file_info_from_uri (uri);
-
+  context = get_uri_context (nautilus, uri);
+  terminal_file_info = context->info;
 
   if (terminal_file_info == FILE_INFO_SFTP) {
     /* remote SSH location */
@@ -708,7 +846,7 @@ terminal_nautilus_get_background_items (NautilusMenuProvider *provider,
   }
 
   if (terminal_file_info == FILE_INFO_DESKTOP ||
-      uri_has_local_path (uri)) {
+      context->has_local_path) {
     /* local locations and remote locations that offer local back-mapping */
     item = terminal_nautilus_menu_item_new (nautilus,
                                             file_info, 
@@ -723,7 +861,7 @@ terminal_nautilus_get_background_items (NautilusMenuProvider *provider,
       nautilus->have_mc &&
       ((terminal_file_info == FILE_INFO_DESKTOP &&
        (desktop_is_home_dir (nautilus) || desktop_opens_home_dir (nautilus))) ||
-       uri_has_local_path (uri))) {
+       context->has_local_path)) {
     item = terminal_nautilus_menu_item_new (nautilus,
                                             file_info, 
                                             terminal_file_info,
@@ -749,13 +887,16 @@ terminal_nautilus_get_file_items (NautilusMenuProvider *provider,
   NautilusMenuItem *item;
   NautilusFileInfo *file_info;
   GFileType file_type;
+  const UriContext *context;
   TerminalFileInfo terminal_file_info;
 
-  if (terminal_locked_down (nautilus))
+  /* Only add items when passed exactly one file; check this first, so
+   * large selections return right away.
+   */
+  if (files == NULL || files->next != NULL)
     return NULL;
 
-  /* Only add items when passed exactly one file */
-  if (files == NULL || files->next != NULL)
+  if (terminal_locked_down (nautilus))
     return NULL;
 
   file_info = (NautilusFileInfo *) files->data;
@@ -771,14 +912,15 @@ terminal_nautilus_get_file_items (NautilusMenuProvider *provider,
 
   items = NULL;
 
-  terminal_file_info = get_terminal_file_info_from_uri (uri);
+  context = get_uri_context (nautilus, uri);
+  terminal_file_info = context->info;
 
   switch (terminal_file_info) {
     case FILE_INFO_LOCAL:
     case FILE_INFO_SFTP:
     case FILE_INFO_OTHER:
       if (terminal_file_info == FILE_INFO_SFTP || 
-          uri_has_local_path (uri)) {
+          context->has_local_path) {
         item = terminal_nautilus_menu_item_new (nautilus,
                                                 file_info,
                                                 terminal_file_info,
@@ -789,7 +931,7 @@ terminal_nautilus_get_file_items (NautilusMenuProvider *provider,
       }
 
       if (terminal_file_info == FILE_INFO_SFTP &&
-          uri_has_local_path (uri)) {
+          context->has_local_path) {
         item = terminal_nautilus_menu_item_new (nautilus,
                                                 file_info, 
                                                 terminal_file_info,
@@ -801,7 +943,7 @@ terminal_nautilus_get_file_items (NautilusMenuProvider *provider,
 
       if (display_mc_item (nautilus) &&
           nautilus->have_mc &&
-          uri_has_local_path (uri)) {
+          context->has_local_path) {
         item = terminal_nautilus_menu_item_new (nautilus,
                                                 file_info, 
                                                 terminal_file_info,
@@ -841,10 +983,28 @@ terminal_nautilus_init (TerminalNautilus *nautilus)
   char *path;
 
   nautilus->lockdown_prefs = g_settings_new (GNOME_DESKTOP_LOCKDOWN_SETTINGS_SCHEMA);
+  nautilus->locked_down = g_settings_get_boolean (nautilus->lockdown_prefs,
+                                                  "disable-command-line");
+  g_signal_connect (nautilus->lockdown_prefs, "changed",
+                    G_CALLBACK (lockdown_prefs_changed_cb), nautilus);
+
+  nautilus->uri_contexts = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, g_free);
+  nautilus->volume_monitor = g_volume_monitor_get ();
+  g_signal_connect (nautilus->volume_monitor, "mount-added",
+                    G_CALLBACK (mounts_changed_cb), nautilus);
+  g_signal_connect (nautilus->volume_monitor, "mount-removed",
+                    G_CALLBACK (mounts_changed_cb), nautilus);
 
   path = g_find_program_in_path ("mc");
   nautilus->have_mc = (path != NULL);
   g_free (path);
+
+  /* Prefetch the factory proxy, so the first "Open in Terminal" doesn't
+   * have to wait for the session bus connection.
+   */
+  nautilus->cancellable = g_cancellable_new ();
+  ensure_factory (nautilus);
 }
 
 static void
@@ -852,8 +1012,26 @@ terminal_nautilus_dispose (GObject *object)
 {
   TerminalNautilus *nautilus = TERMINAL_NAUTILUS (object);
 
+  if (nautilus->lockdown_prefs != NULL)
+    g_signal_handlers_disconnect_by_func (nautilus->lockdown_prefs,
+                                          G_CALLBACK (lockdown_prefs_changed_cb),
+                                          nautilus);
   g_clear_object (&nautilus->lockdown_prefs);
 
+  if (nautilus->volume_monitor != NULL)
+    g_signal_handlers_disconnect_by_func (nautilus->volume_monitor,
+                                          G_CALLBACK (mounts_changed_cb),
+                                          nautilus);
+  g_clear_object (&nautilus->volume_monitor);
+  g_clear_pointer (&nautilus->uri_contexts, g_hash_table_unref);
+
+  if (nautilus->cancellable != NULL)
+    g_cancellable_cancel (nautilus->cancellable);
+  g_clear_object (&nautilus->cancellable);
+  g_clear_object (&nautilus->factory);
+  g_slist_free_full (nautilus->pending_execs, (GDestroyNotify) exec_data_free);
+  nautilus->pending_execs = NULL;
+
   G_OBJECT_CLASS (terminal_nautilus_parent_class)->dispose (object);
 }
 
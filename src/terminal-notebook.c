@@ -30,6 +30,7 @@
 #include "terminal-screen-container.h"
 #include "terminal-tab-label.h"
 #include "terminal-schemas.h"
+#include "terminal-trace.h"
 #include "terminal-libgsystem.h"
 
 #define TERMINAL_NOTEBOOK_GET_PRIVATE(notebook)(G_TYPE_INSTANCE_GET_PRIVATE ((notebook), TERMINAL_TYPE_NOTEBOOK, TerminalNotebookPrivate))
@@ -38,13 +39,15 @@ struct _TerminalNotebookPrivate
 {
   TerminalScreen *active_screen;
   GtkPolicyType policy;
+  gboolean lazy_pages;
 };
 
 enum
 {
   PROP_0,
   PROP_ACTIVE_SCREEN,
-  PROP_TAB_POLICY
+  PROP_TAB_POLICY,
+  PROP_LAZY_PAGES
 };
 
 #define ACTION_AREA_BORDER_WIDTH (2)
@@ -121,16 +124,33 @@ remove_reorder_bindings (GtkBindingSet    *binding_set,
 
 static void
 terminal_notebook_add_screen (TerminalMdiContainer *container,
-                              TerminalScreen *screen)
+                              TerminalScreen *screen,
+                              int position)
 {
   TerminalNotebook *notebook = TERMINAL_NOTEBOOK (container);
   GtkNotebook *gtk_notebook = GTK_NOTEBOOK (notebook);
   GtkWidget *screen_container, *tab_label;
-  const int position = -1;
+  gboolean lazy;
+  gint64 trace_begin = _terminal_trace_begin ();
 
-  g_warn_if_fail (gtk_widget_get_parent (GTK_WIDGET (screen)) == NULL);
-
-  screen_container = terminal_screen_container_new (screen);
+  /* A screen moved from another window comes in its old container, see
+   * terminal_window_move_screens(), so the scrollbars and overlays
+   * don't have to be made again.
+   */
+  screen_container = GTK_WIDGET (terminal_screen_container_get_from_screen (screen));
+  g_warn_if_fail (screen_container != NULL ?
+                  gtk_widget_get_parent (screen_container) == NULL :
+                  gtk_widget_get_parent (GTK_WIDGET (screen)) == NULL);
+
+  /* Only pages added in the background can be lazy */
+  lazy = notebook->priv->lazy_pages && gtk_notebook_get_n_pages (gtk_notebook) > 0;
+  if (lazy)
+    terminal_screen_set_lazy (screen, TRUE);
+  if (gtk_notebook_get_n_pages (gtk_notebook) > 0)
+    terminal_screen_set_background (screen, TRUE);
+
+  if (screen_container == NULL)
+    screen_container = terminal_screen_container_new (screen);
   gtk_widget_show (screen_container);
 
   update_tab_visibility (notebook, +1);
@@ -152,6 +172,12 @@ terminal_notebook_add_screen (TerminalMdiContainer *container,
 #if 0
   gtk_notebook_set_tab_detachable (gtk_notebook, screen_container, TRUE);
 #endif
+
+  /* Hidden until switched to; see terminal_notebook_switch_page() */
+  if (lazy)
+    gtk_widget_hide (GTK_WIDGET (screen));
+
+  _terminal_trace_end ("terminal_notebook_add_screen", trace_begin);
 }
 
 static void
@@ -160,6 +186,7 @@ terminal_notebook_remove_screen (TerminalMdiContainer *container,
 {
   TerminalNotebook *notebook = TERMINAL_NOTEBOOK (container);
   TerminalScreenContainer *screen_container;
+  gint64 trace_begin = _terminal_trace_begin ();
 
   g_warn_if_fail (gtk_widget_is_ancestor (GTK_WIDGET (screen), GTK_WIDGET (notebook)));
 
@@ -168,6 +195,8 @@ terminal_notebook_remove_screen (TerminalMdiContainer *container,
   screen_container = terminal_screen_container_get_from_screen (screen);
   gtk_container_remove (GTK_CONTAINER (notebook),
                         GTK_WIDGET (screen_container));
+
+  _terminal_trace_end ("terminal_notebook_remove_screen", trace_begin);
 }
 
 static TerminalScreen *
@@ -304,10 +333,14 @@ terminal_notebook_switch_page (GtkNotebook     *gtk_notebook,
   /* Make sure that the widget is no longer hidden due to the workaround */
 //   if (child)
 //     gtk_widget_show (child);
-  if (old_active_screen)
+  if (old_active_screen) {
     gtk_widget_hide (GTK_WIDGET (old_active_screen));
-  if (screen)
+    terminal_screen_set_background (old_active_screen, TRUE);
+  }
+  if (screen) {
+    terminal_screen_set_background (screen, FALSE);
     gtk_widget_show (GTK_WIDGET (screen));
+  }
 
   priv->active_screen = screen;
 
@@ -491,6 +524,12 @@ terminal_notebook_constructed (GObject *object)
                    "tab-pos",
                    G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
 
+  g_settings_bind (settings,
+                   TERMINAL_SETTING_LAZY_BACKGROUND_TABS_KEY,
+                   object,
+                   "lazy-pages",
+                   G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+
   gtk_notebook_set_scrollable (notebook, TRUE);
   gtk_notebook_set_show_border (notebook, FALSE);
   gtk_notebook_set_group_name (notebook, I_("gnome-terminal-window"));
@@ -514,6 +553,9 @@ terminal_notebook_get_property (GObject *object,
     case PROP_TAB_POLICY:
       g_value_set_enum (value, terminal_notebook_get_tab_policy (TERMINAL_NOTEBOOK (mdi_container)));
       break;
+    case PROP_LAZY_PAGES:
+      g_value_set_boolean (value, TERMINAL_NOTEBOOK (mdi_container)->priv->lazy_pages);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -535,6 +577,9 @@ terminal_notebook_set_property (GObject *object,
     case PROP_TAB_POLICY:
       terminal_notebook_set_tab_policy (TERMINAL_NOTEBOOK (mdi_container), g_value_get_enum (value));
       break;
+    case PROP_LAZY_PAGES:
+      TERMINAL_NOTEBOOK (mdi_container)->priv->lazy_pages = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -573,6 +618,13 @@ terminal_notebook_class_init (TerminalNotebookClass *klass)
                         GTK_POLICY_AUTOMATIC,
                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property
+    (gobject_class,
+     PROP_LAZY_PAGES,
+     g_param_spec_boolean ("lazy-pages", NULL, NULL,
+                           FALSE,
+                           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* Remove unwanted and interfering keybindings */
   GtkBindingSet *binding_set = gtk_binding_set_by_class (terminal_notebook_parent_class);
   gtk_binding_entry_skip (binding_set, GDK_KEY_Page_Up, GDK_CONTROL_MASK);
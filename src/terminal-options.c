@@ -780,6 +780,20 @@ option_wait_cb (const gchar *option_name,
   return TRUE;
 }
 
+static gboolean
+option_headless_cb (const gchar *option_name,
+                    const gchar *value,
+                    gpointer     data,
+                    GError     **error)
+{
+  TerminalOptions *options = data;
+
+  InitialTab *it = ensure_top_tab (options);
+  it->headless = TRUE;
+
+  return TRUE;
+}
+
 static gboolean
 option_pass_fd_cb (const gchar *option_name,
                    const gchar *value,
@@ -1246,6 +1260,7 @@ terminal_options_free (TerminalOptions *options)
   g_free (options->display_name);
   g_free (options->startup_id);
   g_free (options->server_app_id);
+  g_free (options->environment_id);
 
   g_free (options->sm_client_id);
   g_free (options->sm_config_prefix);
@@ -1303,6 +1318,15 @@ get_goption_context (TerminalOptions *options)
       N_("Show preferences window"),
       NULL
     },
+    {
+      "restore-snapshot",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &options->restore_snapshot,
+      N_("Restore the windows and tabs of the last session snapshot"),
+      NULL
+    },
     {
       "print-environment",
       'p',
@@ -1477,6 +1501,15 @@ get_goption_context (TerminalOptions *options)
       N_("Wait until the child exits"),
       NULL
     },
+    {
+      "headless",
+      0,
+      G_OPTION_FLAG_NO_ARG,
+      G_OPTION_ARG_CALLBACK,
+      option_headless_cb,
+      N_("Run the command without showing the terminal in a window"),
+      NULL
+    },
     {
       "fd",
       0,
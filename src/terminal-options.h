@@ -71,9 +71,12 @@ typedef struct
   char    *parent_screen_object_path;
 
   char    *server_app_id;
+  char    *environment_id; /* the ID of the environment, or NULL to pass it along */
+  gboolean environment_registered;
   char    *startup_id;
   char    *display_name;
   gboolean show_preferences;
+  gboolean restore_snapshot;
   GList   *initial_windows;
   gboolean default_window_menubar_forced;
   gboolean default_window_menubar_state;
@@ -111,6 +114,7 @@ typedef struct
   guint zoom_set : 1;
   guint active : 1;
   guint wait : 1;
+  guint headless : 1;
 } InitialTab;
 
 typedef struct
@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <uuid.h>
@@ -47,6 +48,22 @@ typedef struct {
   GtkWidget *manage_profiles_clone_button;
   GtkWidget *manage_profiles_delete_button;
   GtkWidget *profiles_default_combo;
+
+  /* The shortcuts and profiles pages are built when first shown */
+  GtkWidget *accels_tree_view;
+  GtkWidget *disable_shortcuts_button;
+  GtkWidget *profiles_tree_view_container;
+  GtkWidget *default_profile_hbox;
+  GtkWidget *default_profile_label;
+  gboolean shortcuts_page_built;
+  gboolean profiles_page_built;
+
+  /* The profile list is filled a chunk at a time */
+  guint profile_list_fill_source_id;
+  GPtrArray *profile_list_fill;
+  guint profile_list_fill_pos;
+  GSettings *profile_list_fill_selected;
+  gboolean profile_list_fill_selected_found;
 } PrefData;
 
 static GtkWidget *prefs_dialog = NULL;
@@ -97,19 +114,62 @@ profile_cell_data_func (GtkTreeViewColumn *tree_column,
   g_value_unset (&value);
 }
 
+typedef struct {
+  GSettings *profile;
+  char *collate_key;
+  char *path;
+} ProfileSortItem;
+
 static int
-profile_sort_func (GtkTreeModel *model,
-                   GtkTreeIter *a,
-                   GtkTreeIter *b,
-                   gpointer user_data)
+profile_sort_item_compare (gconstpointer pa,
+                           gconstpointer pb)
 {
-  gs_unref_object GSettings *profile_a;
-  gs_unref_object GSettings *profile_b;
+  const ProfileSortItem *a = pa;
+  const ProfileSortItem *b = pb;
+  int result;
 
-  gtk_tree_model_get (model, a, (int) COL_PROFILE, &profile_a, (int) -1);
-  gtk_tree_model_get (model, b, (int) COL_PROFILE, &profile_b, (int) -1);
+  result = strcmp (a->collate_key, b->collate_key);
+  if (result != 0)
+    return result;
+
+  return strcmp (a->path, b->path);
+}
+
+/* Returns the profiles in the order of terminal_profiles_compare(), but
+ * reads the name of each profile only once instead of for each comparison.
+ */
+static /* ref */ GPtrArray *
+profiles_list_ref_sorted (PrefData *data)
+{
+  GPtrArray *profiles;
+  ProfileSortItem *items;
+  guint i, n_children;
+
+  n_children = terminal_settings_list_get_n_children (data->profiles_list);
+  items = g_new (ProfileSortItem, n_children);
+
+  for (i = 0; i < n_children; i++)
+    {
+      gs_free char *name;
+
+      items[i].profile = terminal_settings_list_ref_nth_child (data->profiles_list, i);
+      name = g_settings_get_string (items[i].profile, TERMINAL_PROFILE_VISIBLE_NAME_KEY);
+      items[i].collate_key = g_utf8_collate_key (name, -1);
+      g_object_get (items[i].profile, "path", &items[i].path, NULL);
+    }
+
+  qsort (items, n_children, sizeof (ProfileSortItem), profile_sort_item_compare);
+
+  profiles = g_ptr_array_new_full (n_children, g_object_unref);
+  for (i = 0; i < n_children; i++)
+    {
+      g_ptr_array_add (profiles, items[i].profile); /* adopts */
+      g_free (items[i].collate_key);
+      g_free (items[i].path);
+    }
+  g_free (items);
 
-  return terminal_profiles_compare (profile_a, profile_b);
+  return profiles;
 }
 
 static /* ref */ GtkTreeModel *
@@ -120,7 +180,8 @@ profile_liststore_new (PrefData *data,
 {
   GtkListStore *store;
   GtkTreeIter iter;
-  GList *list, *l;
+  gs_unref_ptrarray GPtrArray *profiles;
+  guint i;
 
   G_STATIC_ASSERT (NUM_PROFILE_COLUMNS == 1);
   store = gtk_list_store_new (NUM_PROFILE_COLUMNS, G_TYPE_SETTINGS);
@@ -128,12 +189,12 @@ profile_liststore_new (PrefData *data,
   if (selected_profile_iter)
     *selected_profile_iter_set = FALSE;
 
-  list = terminal_settings_list_ref_children (data->profiles_list);
-  for (l = list; l != NULL; l = l->next)
+  profiles = profiles_list_ref_sorted (data);
+  for (i = 0; i < profiles->len; i++)
     {
-      GSettings *profile = (GSettings *) l->data;
+      GSettings *profile = g_ptr_array_index (profiles, i);
 
-      gtk_list_store_insert_with_values (store, &iter, 0,
+      gtk_list_store_insert_with_values (store, &iter, -1,
                                          (int) COL_PROFILE, profile,
                                          (int) -1);
 
@@ -144,16 +205,6 @@ profile_liststore_new (PrefData *data,
         }
     }
 
-  g_list_free_full (list, (GDestroyNotify) g_object_unref);
-
-  /* Now turn on sorting */
-  gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (store),
-                                   COL_PROFILE,
-                                   profile_sort_func,
-                                   NULL, NULL);
-  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (store),
-                                        COL_PROFILE, GTK_SORT_ASCENDING);
-
   return GTK_TREE_MODEL (store);
 }
 
@@ -260,27 +311,83 @@ profile_list_ref_selected (PrefData *data)
   return selected_profile;
 }
 
+#define PROFILE_LIST_FILL_CHUNK (50)
+
 static void
-profile_list_treeview_refill (PrefData *data)
+profile_list_fill_stop (PrefData *data)
+{
+  if (data->profile_list_fill_source_id != 0)
+    {
+      g_source_remove (data->profile_list_fill_source_id);
+      data->profile_list_fill_source_id = 0;
+    }
+
+  g_clear_pointer (&data->profile_list_fill, g_ptr_array_unref);
+  g_clear_object (&data->profile_list_fill_selected);
+}
+
+static gboolean
+profile_list_fill_cb (PrefData *data)
 {
   GtkTreeView *tree_view = data->manage_profiles_list;
+  GtkListStore *store = GTK_LIST_STORE (gtk_tree_view_get_model (tree_view));
   GtkTreeIter iter;
-  gboolean iter_set;
-  gs_unref_object GSettings *selected_profile;
-  gs_unref_object GtkTreeModel *model;
+  guint end;
 
-  selected_profile = profile_list_ref_selected (data);
-  model = profile_liststore_new (data,
-                                 selected_profile,
-                                 &iter,
-                                 &iter_set);
-  gtk_tree_view_set_model (tree_view, model);
+  end = MIN (data->profile_list_fill_pos + PROFILE_LIST_FILL_CHUNK,
+             data->profile_list_fill->len);
+  for ( ; data->profile_list_fill_pos < end; data->profile_list_fill_pos++)
+    {
+      GSettings *profile = g_ptr_array_index (data->profile_list_fill,
+                                              data->profile_list_fill_pos);
 
-  if (!iter_set)
-    iter_set = gtk_tree_model_get_iter_first (model, &iter);
+      gtk_list_store_insert_with_values (store, &iter, -1,
+                                         (int) COL_PROFILE, profile,
+                                         (int) -1);
 
-  if (iter_set)
+      if (profile == data->profile_list_fill_selected)
+        {
+          gtk_tree_selection_select_iter (gtk_tree_view_get_selection (tree_view), &iter);
+          data->profile_list_fill_selected_found = TRUE;
+        }
+    }
+
+  if (data->profile_list_fill_pos < data->profile_list_fill->len)
+    return G_SOURCE_CONTINUE;
+
+  if (!data->profile_list_fill_selected_found &&
+      gtk_tree_model_get_iter_first (GTK_TREE_MODEL (store), &iter))
     gtk_tree_selection_select_iter (gtk_tree_view_get_selection (tree_view), &iter);
+
+  data->profile_list_fill_source_id = 0; /* removed by returning */
+  profile_list_fill_stop (data);
+  return G_SOURCE_REMOVE;
+}
+
+/* Refills the profile list; the first rows are added right away, the
+ * others from idle, so the dialog stays responsive with many profiles.
+ */
+static void
+profile_list_treeview_refill (PrefData *data)
+{
+  GtkTreeView *tree_view = data->manage_profiles_list;
+  GSettings *selected_profile;
+  gs_unref_object GtkListStore *store;
+
+  selected_profile = profile_list_ref_selected (data);
+
+  profile_list_fill_stop (data);
+  data->profile_list_fill = profiles_list_ref_sorted (data);
+  data->profile_list_fill_pos = 0;
+  data->profile_list_fill_selected = selected_profile; /* adopts */
+  data->profile_list_fill_selected_found = FALSE;
+
+  store = gtk_list_store_new (NUM_PROFILE_COLUMNS, G_TYPE_SETTINGS);
+  gtk_tree_view_set_model (tree_view, GTK_TREE_MODEL (store));
+
+  if (profile_list_fill_cb (data))
+    data->profile_list_fill_source_id =
+      g_idle_add ((GSourceFunc) profile_list_fill_cb, data);
 }
 
 static void
@@ -323,6 +430,12 @@ profile_list_treeview_new (PrefData *data)
   gtk_tree_view_append_column (GTK_TREE_VIEW (tree_view),
                                GTK_TREE_VIEW_COLUMN (column));
 
+  /* All rows have the same height, so only the visible rows need to be
+   * measured; this keeps long profile lists cheap.
+   */
+  gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (tree_view), TRUE);
+
   g_signal_connect (tree_view, "row-activated",
                     G_CALLBACK (profile_list_row_activated_cb), data);
 
@@ -444,14 +557,95 @@ shortcuts_button_toggled_cb (GtkWidget *widget,
   gtk_widget_queue_draw (GTK_WIDGET (tree_view));
 }
 
+static void
+shortcuts_page_build (PrefData *data)
+{
+  terminal_accels_fill_treeview (data->accels_tree_view, data->disable_shortcuts_button);
+}
+
+/* Profiles tab */
+
+static void
+profiles_page_build (PrefData *data)
+{
+  GtkTreeSelection *selection;
+
+  data->manage_profiles_list = profile_list_treeview_new (data);
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (data->manage_profiles_list));
+  g_signal_connect (selection, "changed", G_CALLBACK (profile_list_selection_changed_cb), data);
+
+  profile_list_treeview_refill (data);
+  g_signal_connect_swapped (data->profiles_list, "children-changed",
+                            G_CALLBACK (profile_list_treeview_refill), data);
+
+  gtk_container_add (GTK_CONTAINER (data->profiles_tree_view_container), GTK_WIDGET (data->manage_profiles_list));
+  gtk_widget_show (GTK_WIDGET (data->manage_profiles_list));
+
+  g_signal_connect (data->manage_profiles_new_button, "clicked",
+                    G_CALLBACK (profile_list_new_button_clicked_cb),
+                    data);
+  g_signal_connect (data->manage_profiles_edit_button, "clicked",
+                    G_CALLBACK (profile_list_edit_button_clicked_cb),
+                    data);
+  g_signal_connect (data->manage_profiles_clone_button, "clicked",
+                    G_CALLBACK (profile_list_clone_button_clicked_cb),
+                    data);
+  g_signal_connect (data->manage_profiles_delete_button, "clicked",
+                    G_CALLBACK (profile_list_delete_button_clicked_cb),
+                    data);
+
+  data->profiles_default_combo = profile_combo_box_new (data);
+  g_signal_connect_swapped (data->profiles_list, "children-changed",
+                            G_CALLBACK (profile_combo_box_refill), data);
+  g_signal_connect (data->profiles_default_combo, "changed",
+                    G_CALLBACK (profile_combo_box_changed_cb), data);
+
+  gtk_box_pack_start (GTK_BOX (data->default_profile_hbox), data->profiles_default_combo, FALSE, FALSE, 0);
+  gtk_widget_show (data->profiles_default_combo);
+
+  // FIXMEchpe
+  gtk_label_set_mnemonic_widget (GTK_LABEL (data->default_profile_label), data->profiles_default_combo);
+}
+
 /* Encodings tab */
 
 /* misc */
 
+static void
+prefs_dialog_ensure_page (PrefData *data,
+                          GtkWidget *page)
+{
+  if (page == NULL)
+    return;
+
+  if (!data->shortcuts_page_built &&
+      (page == data->accels_tree_view || gtk_widget_is_ancestor (data->accels_tree_view, page))) {
+    data->shortcuts_page_built = TRUE;
+    shortcuts_page_build (data);
+  }
+
+  if (!data->profiles_page_built &&
+      gtk_widget_is_ancestor (data->profiles_tree_view_container, page)) {
+    data->profiles_page_built = TRUE;
+    profiles_page_build (data);
+  }
+}
+
+static void
+prefs_dialog_notebook_switch_page_cb (GtkNotebook *notebook,
+                                      GtkWidget *page,
+                                      guint page_num,
+                                      PrefData *data)
+{
+  prefs_dialog_ensure_page (data, page);
+}
+
 static void
 prefs_dialog_destroy_cb (GtkWidget *widget,
                          PrefData *data)
 {
+  profile_list_fill_stop (data);
+
   g_signal_handlers_disconnect_by_func (data->profiles_list, G_CALLBACK (profile_combo_box_refill), data);
   g_signal_handlers_disconnect_by_func (data->profiles_list, G_CALLBACK (profile_list_treeview_refill), data);
 
@@ -473,7 +667,7 @@ terminal_prefs_show_preferences (const char *page)
   GtkWidget *new_terminal_mode_label, *new_terminal_mode_combo;
   GtkWidget *default_hbox, *default_label;
   GtkWidget *close_button, *help_button;
-  GtkTreeSelection *selection;
+  GtkWidget *notebook;
   GSettings *settings;
 
   if (prefs_dialog != NULL)
@@ -503,6 +697,7 @@ terminal_prefs_show_preferences (const char *page)
                                        "delete-profile-button", &remove_button,
                                        "default-profile-hbox", &default_hbox,
                                        "default-profile-label", &default_label,
+                                       "notebook1", &notebook,
                                        NULL);
 
   data->dialog = dialog;
@@ -572,50 +767,22 @@ terminal_prefs_show_preferences (const char *page)
   g_signal_connect (disable_shortcuts_button, "toggled",
                     G_CALLBACK (shortcuts_button_toggled_cb), tree_view);
 
-  terminal_accels_fill_treeview (tree_view, disable_shortcuts_button);
-
-  /* Profiles tab */
-
+  /* The shortcuts and profiles pages are built when first shown */
+  data->accels_tree_view = tree_view;
+  data->disable_shortcuts_button = disable_shortcuts_button;
+  data->profiles_tree_view_container = tree_view_container;
   data->manage_profiles_new_button = GTK_WIDGET (new_button);
   data->manage_profiles_edit_button = GTK_WIDGET (edit_button);
   data->manage_profiles_clone_button = GTK_WIDGET (clone_button);
   data->manage_profiles_delete_button  = GTK_WIDGET (remove_button);
-
-  data->manage_profiles_list = profile_list_treeview_new (data);
-  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (data->manage_profiles_list));
-  g_signal_connect (selection, "changed", G_CALLBACK (profile_list_selection_changed_cb), data);
-
-  profile_list_treeview_refill (data);
-  g_signal_connect_swapped (data->profiles_list, "children-changed",
-                            G_CALLBACK (profile_list_treeview_refill), data);
-
-  gtk_container_add (GTK_CONTAINER (tree_view_container), GTK_WIDGET (data->manage_profiles_list));
-  gtk_widget_show (GTK_WIDGET (data->manage_profiles_list));
-
-  g_signal_connect (new_button, "clicked",
-                    G_CALLBACK (profile_list_new_button_clicked_cb),
-                    data);
-  g_signal_connect (edit_button, "clicked",
-                    G_CALLBACK (profile_list_edit_button_clicked_cb),
-                    data);
-  g_signal_connect (clone_button, "clicked",
-                    G_CALLBACK (profile_list_clone_button_clicked_cb),
-                    data);
-  g_signal_connect (remove_button, "clicked",
-                    G_CALLBACK (profile_list_delete_button_clicked_cb),
-                    data);
-
-  data->profiles_default_combo = profile_combo_box_new (data);
-  g_signal_connect_swapped (data->profiles_list, "children-changed",
-                            G_CALLBACK (profile_combo_box_refill), data);
-  g_signal_connect (data->profiles_default_combo, "changed",
-                    G_CALLBACK (profile_combo_box_changed_cb), data);
-
-  gtk_box_pack_start (GTK_BOX (default_hbox), data->profiles_default_combo, FALSE, FALSE, 0);
-  gtk_widget_show (data->profiles_default_combo);
-
-  // FIXMEchpe
-  gtk_label_set_mnemonic_widget (GTK_LABEL (default_label), data->profiles_default_combo);
+  data->default_profile_hbox = default_hbox;
+  data->default_profile_label = default_label;
+
+  g_signal_connect (notebook, "switch-page",
+                    G_CALLBACK (prefs_dialog_notebook_switch_page_cb), data);
+  prefs_dialog_ensure_page (data,
+                            gtk_notebook_get_nth_page (GTK_NOTEBOOK (notebook),
+                                                       gtk_notebook_get_current_page (GTK_NOTEBOOK (notebook))));
 
   /* misc */
 
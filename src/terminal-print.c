@@ -0,0 +1,451 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "terminal-print.h"
+#include "terminal-intl.h"
+#include "terminal-util.h"
+#include "terminal-libgsystem.h"
+
+/*
+ * Printing
+ *
+ * The text is copied from the terminal once, on idle, before the print
+ * dialogue is shown, so what gets printed is what was there when the user
+ * asked for it. Once the page size is known, the text is broken into
+ * printed lines and pages on a worker thread, and each page is drawn
+ * separately when the print operation asks for it, so neither a huge
+ * scrollback nor a slow printer blocks the main loop for long.
+ */
+
+#define DEFAULT_LAST_LINES (1000)
+
+typedef enum {
+  PRINT_SCOPE_ALL,
+  PRINT_SCOPE_SCREEN,
+  PRINT_SCOPE_LAST_LINES
+} PrintScope;
+
+typedef struct {
+  gsize offset;
+  gsize length;
+} PrintLine;
+
+typedef struct {
+  TerminalScreen *screen;
+  GtkWindow *parent;
+  guint n_pending; /* snapshots being taken */
+  gboolean failed;
+
+  GBytes *all_text; /* the scrollback and the screen */
+  GBytes *screen_text; /* the visible rows only */
+
+  PrintScope scope;
+  int n_last_lines;
+  GtkWidget *scope_all_radio;
+  GtkWidget *scope_screen_radio;
+  GtkWidget *scope_last_lines_radio;
+  GtkWidget *last_lines_spin;
+
+  PangoFontDescription *font_desc;
+  int columns;
+  int lines_per_page;
+  double line_height;
+  GArray *lines; /* PrintLine, into text; NULL until paginated */
+  GBytes *text; /* the text being printed */
+  gboolean paginated;
+} PrintData;
+
+static void
+print_data_free (PrintData *data)
+{
+  g_object_unref (data->screen);
+  g_clear_object (&data->parent);
+  g_clear_pointer (&data->all_text, g_bytes_unref);
+  g_clear_pointer (&data->screen_text, g_bytes_unref);
+  g_clear_pointer (&data->text, g_bytes_unref);
+  g_clear_pointer (&data->lines, g_array_unref);
+  if (data->font_desc)
+    pango_font_description_free (data->font_desc);
+  g_slice_free (PrintData, data);
+}
+
+/* Returns where the last @n_lines lines of @text start */
+static const char *
+last_lines_start (const char *text,
+                  const char *end,
+                  int n_lines)
+{
+  const char *p;
+
+  for (p = end; p > text; p--) {
+    if (p[-1] == '\n' && --n_lines == 0)
+      break;
+  }
+
+  return p;
+}
+
+static void
+paginate_thread_func (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+  PrintData *data = task_data;
+  gsize len;
+  const char *text = g_bytes_get_data (data->text, &len);
+  const char *end = text + len;
+  const char *p = text;
+  GArray *lines;
+
+  /* Trailing empty rows are not worth a page */
+  while (end > text && end[-1] == '\n')
+    end--;
+
+  if (data->scope == PRINT_SCOPE_LAST_LINES)
+    p = last_lines_start (text, end, data->n_last_lines);
+
+  lines = g_array_new (FALSE, FALSE, sizeof (PrintLine));
+
+  while (p < end) {
+    PrintLine line;
+    const char *q = p;
+    int width = 0;
+
+    /* Break the line where it no longer fits, counting cells like the terminal */
+    while (q < end && *q != '\n') {
+      gunichar c = g_utf8_get_char (q);
+      int w = g_unichar_iszerowidth (c) ? 0 : g_unichar_iswide (c) ? 2 : 1;
+
+      if (width > 0 && width + w > data->columns)
+        break;
+
+      width += w;
+      q = g_utf8_next_char (q);
+    }
+
+    line.offset = p - text;
+    line.length = q - p;
+    g_array_append_val (lines, line);
+
+    p = (q < end && *q == '\n') ? q + 1 : q;
+  }
+
+  g_task_return_pointer (task, lines, (GDestroyNotify) g_array_unref);
+}
+
+static void
+paginate_done_cb (GObject *source_object,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+  PrintData *data = user_data;
+
+  data->lines = g_task_propagate_pointer (G_TASK (result), NULL);
+  data->paginated = TRUE;
+}
+
+static GObject *
+print_create_custom_widget_cb (GtkPrintOperation *op,
+                               PrintData *data)
+{
+  GtkWidget *grid, *label;
+
+  grid = gtk_grid_new ();
+  gtk_container_set_border_width (GTK_CONTAINER (grid), 12);
+  gtk_grid_set_row_spacing (GTK_GRID (grid), 6);
+  gtk_grid_set_column_spacing (GTK_GRID (grid), 6);
+
+  data->scope_all_radio = gtk_radio_button_new_with_mnemonic (NULL, _("_Whole scrollback"));
+  gtk_grid_attach (GTK_GRID (grid), data->scope_all_radio, 0, 0, 3, 1);
+
+  data->scope_screen_radio =
+    gtk_radio_button_new_with_mnemonic_from_widget (GTK_RADIO_BUTTON (data->scope_all_radio),
+                                                    _("_Visible screen"));
+  gtk_grid_attach (GTK_GRID (grid), data->scope_screen_radio, 0, 1, 3, 1);
+
+  data->scope_last_lines_radio =
+    gtk_radio_button_new_with_mnemonic_from_widget (GTK_RADIO_BUTTON (data->scope_all_radio),
+                                                    _("_Last"));
+  gtk_grid_attach (GTK_GRID (grid), data->scope_last_lines_radio, 0, 2, 1, 1);
+
+  data->last_lines_spin = gtk_spin_button_new_with_range (1, G_MAXINT, 100);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (data->last_lines_spin), data->n_last_lines);
+  gtk_grid_attach (GTK_GRID (grid), data->last_lines_spin, 1, 2, 1, 1);
+
+  label = gtk_label_new (_("lines"));
+  gtk_grid_attach (GTK_GRID (grid), label, 2, 2, 1, 1);
+
+  switch (data->scope) {
+  case PRINT_SCOPE_ALL:
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (data->scope_all_radio), TRUE);
+    break;
+  case PRINT_SCOPE_SCREEN:
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (data->scope_screen_radio), TRUE);
+    break;
+  case PRINT_SCOPE_LAST_LINES:
+    gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (data->scope_last_lines_radio), TRUE);
+    break;
+  }
+
+  gtk_widget_show_all (grid);
+
+  return G_OBJECT (grid);
+}
+
+static void
+print_custom_widget_apply_cb (GtkPrintOperation *op,
+                              GtkWidget *widget,
+                              PrintData *data)
+{
+  if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->scope_screen_radio)))
+    data->scope = PRINT_SCOPE_SCREEN;
+  else if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->scope_last_lines_radio)))
+    data->scope = PRINT_SCOPE_LAST_LINES;
+  else
+    data->scope = PRINT_SCOPE_ALL;
+
+  data->n_last_lines = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (data->last_lines_spin));
+}
+
+static void
+print_begin_cb (GtkPrintOperation *op,
+                GtkPrintContext *context,
+                PrintData *data)
+{
+  GtkPrintSettings *settings;
+  GtkPageSetup *page_setup;
+  gs_unref_object PangoLayout *layout = NULL;
+  int width, height;
+
+  /* Don't save if the print dialogue was cancelled */
+  if (gtk_print_operation_get_status(op) == GTK_PRINT_STATUS_FINISHED_ABORTED)
+    return;
+
+  settings = gtk_print_operation_get_print_settings (op);
+  page_setup = gtk_print_operation_get_default_page_setup (op);
+  terminal_util_save_print_settings (settings, page_setup);
+
+  /* The terminal font is monospace, so one cell tells the size of all */
+  layout = gtk_print_context_create_pango_layout (context);
+  pango_layout_set_font_description (layout, data->font_desc);
+  pango_layout_set_text (layout, "M", 1);
+  pango_layout_get_size (layout, &width, &height);
+
+  data->line_height = (double) height / PANGO_SCALE;
+  data->columns = MAX (1, (int) (gtk_print_context_get_width (context) * PANGO_SCALE / width));
+  data->lines_per_page = MAX (1, (int) (gtk_print_context_get_height (context) / data->line_height));
+
+  data->text = g_bytes_ref (data->scope == PRINT_SCOPE_SCREEN ? data->screen_text : data->all_text);
+}
+
+/* GTK+ emits "paginate" from an idle for as long as the handler returns
+ * %FALSE, which would keep the main loop spinning while the worker runs.
+ * So the handler waits for the worker instead, dispatching the other
+ * events meanwhile; the idle isn't dispatched again while it is running.
+ */
+static gboolean
+print_paginate_cb (GtkPrintOperation *op,
+                   GtkPrintContext *context,
+                   PrintData *data)
+{
+  GTask *task;
+
+  /* The task keeps @op, and with it @data, alive */
+  task = g_task_new (op, NULL, paginate_done_cb, data);
+  g_task_set_task_data (task, data, NULL);
+  g_task_run_in_thread (task, paginate_thread_func);
+  g_object_unref (task);
+
+  while (!data->paginated)
+    g_main_context_iteration (NULL, TRUE);
+
+  gtk_print_operation_set_n_pages (op, MAX (1, (data->lines->len + data->lines_per_page - 1) /
+                                               data->lines_per_page));
+  return TRUE;
+}
+
+static void
+print_draw_page_cb (GtkPrintOperation *op,
+                    GtkPrintContext *context,
+                    int page_nr,
+                    PrintData *data)
+{
+  cairo_t *cr = gtk_print_context_get_cairo_context (context);
+  gs_unref_object PangoLayout *layout = NULL;
+  const char *text = g_bytes_get_data (data->text, NULL);
+  guint i, first, last;
+
+  layout = gtk_print_context_create_pango_layout (context);
+  pango_layout_set_font_description (layout, data->font_desc);
+
+  first = page_nr * data->lines_per_page;
+  last = MIN (first + data->lines_per_page, data->lines->len);
+
+  for (i = first; i < last; i++) {
+    const PrintLine *line = &g_array_index (data->lines, PrintLine, i);
+
+    pango_layout_set_text (layout, text + line->offset, line->length);
+    cairo_move_to (cr, 0, (i - first) * data->line_height);
+    pango_cairo_show_layout (cr, layout);
+  }
+}
+
+static void
+print_done_cb (GtkPrintOperation *op,
+               GtkPrintOperationResult result,
+               PrintData *data)
+{
+  gs_free_error GError *error = NULL;
+
+  if (result != GTK_PRINT_OPERATION_RESULT_ERROR)
+    return;
+
+  gtk_print_operation_get_error (op, &error);
+  terminal_util_show_error_dialog (data->parent, NULL, error,
+                                   "%s", _("Could not print"));
+}
+
+static void
+print_run (PrintData *data /* adopted */)
+{
+  gs_unref_object GtkPrintSettings *settings = NULL;
+  gs_unref_object GtkPageSetup *page_setup = NULL;
+  gs_unref_object GtkPrintOperation *op = NULL;
+  gs_free_error GError *error = NULL;
+  GtkPrintOperationResult result;
+
+  if (data->parent != NULL && gtk_widget_in_destruction (GTK_WIDGET (data->parent)))
+    g_clear_object (&data->parent);
+
+  op = gtk_print_operation_new ();
+  g_object_set_data_full (G_OBJECT (op), "terminal-print-data",
+                          data, (GDestroyNotify) print_data_free);
+
+  terminal_util_load_print_settings (&settings, &page_setup);
+  if (settings != NULL)
+    gtk_print_operation_set_print_settings (op, settings);
+  if (page_setup != NULL)
+    gtk_print_operation_set_default_page_setup (op, page_setup);
+
+  gtk_print_operation_set_allow_async (op, TRUE);
+  gtk_print_operation_set_show_progress (op, TRUE);
+  gtk_print_operation_set_custom_tab_label (op, _("Terminal"));
+
+  g_signal_connect (op, "create-custom-widget", G_CALLBACK (print_create_custom_widget_cb), data);
+  g_signal_connect (op, "custom-widget-apply", G_CALLBACK (print_custom_widget_apply_cb), data);
+  g_signal_connect (op, "begin-print", G_CALLBACK (print_begin_cb), data);
+  g_signal_connect (op, "paginate", G_CALLBACK (print_paginate_cb), data);
+  g_signal_connect (op, "draw-page", G_CALLBACK (print_draw_page_cb), data);
+  g_signal_connect (op, "done", G_CALLBACK (print_done_cb), data);
+
+  result = gtk_print_operation_run (op, GTK_PRINT_OPERATION_ACTION_PRINT_DIALOG,
+                                    data->parent, &error);
+  if (result == GTK_PRINT_OPERATION_RESULT_ERROR)
+    terminal_util_show_error_dialog (data->parent, NULL, error,
+                                     "%s", _("Could not print"));
+}
+
+static void
+print_snapshot_done (PrintData *data,
+                     GError *error)
+{
+  if (error != NULL) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to copy the terminal contents for printing: %s", error->message);
+    data->failed = TRUE;
+  }
+
+  if (--data->n_pending > 0)
+    return;
+
+  if (data->failed)
+    print_data_free (data);
+  else
+    print_run (data);
+}
+
+static void
+print_all_text_cb (GObject *source_object,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+  PrintData *data = user_data;
+  gs_free_error GError *error = NULL;
+
+  data->all_text = terminal_screen_snapshot_text_finish (TERMINAL_SCREEN (source_object),
+                                                         result, &error);
+  print_snapshot_done (data, error);
+}
+
+static void
+print_screen_text_cb (GObject *source_object,
+                      GAsyncResult *result,
+                      gpointer user_data)
+{
+  PrintData *data = user_data;
+  gs_free_error GError *error = NULL;
+
+  data->screen_text = terminal_screen_snapshot_text_finish (TERMINAL_SCREEN (source_object),
+                                                            result, &error);
+  print_snapshot_done (data, error);
+}
+
+/**
+ * terminal_print_screen:
+ * @screen: a #TerminalScreen
+ * @parent: (allow-none): the parent window for the print dialogue
+ *
+ * Copies the contents of @screen, then shows the print dialogue, which
+ * lets the user print all of the scrollback, only the visible screen,
+ * or the last lines.
+ */
+void
+terminal_print_screen (TerminalScreen *screen,
+                       GtkWindow *parent)
+{
+  GtkAdjustment *adjustment;
+  PrintData *data;
+  glong value;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  data = g_slice_new0 (PrintData);
+  data->screen = g_object_ref (screen);
+  data->parent = parent ? g_object_ref (parent) : NULL;
+  data->scope = PRINT_SCOPE_ALL;
+  data->n_last_lines = DEFAULT_LAST_LINES;
+  data->font_desc = pango_font_description_copy (vte_terminal_get_font (VTE_TERMINAL (screen)));
+
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  value = (glong) gtk_adjustment_get_value (adjustment);
+
+  /* The visible rows are copied on their own, since the text of the
+   * whole scrollback does not tell where each row starts.
+   */
+  data->n_pending = 2;
+  terminal_screen_snapshot_text_async (screen, -1, -1, NULL,
+                                       print_all_text_cb, data);
+  terminal_screen_snapshot_text_async (screen,
+                                       value, value + (glong) gtk_adjustment_get_page_size (adjustment),
+                                       NULL,
+                                       print_screen_text_cb, data);
+}
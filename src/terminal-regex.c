@@ -19,7 +19,9 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "terminal-pcre2.h"
 #include "terminal-regex.h"
 
 #ifdef TERMINAL_REGEX_MAIN
@@ -60,9 +62,354 @@ get_match (const char *pattern, const char *string, GRegexMatchFlags match_flags
   g_free (__actual_match); \
 } while (0)
 
+/* Benchmark mode
+ *
+ * Run as "terminal-regex --benchmark [--iterations=N] [FILE...]" to scan
+ * some synthetic corpora, and the given FILEs, with each of the patterns.
+ */
+
+#define BENCHMARK_DEFAULT_ITERATIONS (10)
+
+typedef struct {
+  const char *name;
+  const char *pattern;
+} BenchmarkPattern;
+
+static const BenchmarkPattern benchmark_patterns[] = {
+  { "REGEX_URL_AS_IS",    REGEX_URL_AS_IS },
+  { "REGEX_URL_HTTP",     REGEX_URL_HTTP },
+  { "REGEX_URL_FILE",     REGEX_URL_FILE },
+  { "REGEX_URL_VOIP",     REGEX_URL_VOIP },
+  { "REGEX_EMAIL",        REGEX_EMAIL },
+  { "REGEX_NEWS_MAN",     REGEX_NEWS_MAN },
+  { "REGEX_URL_COMBINED", REGEX_URL_COMBINED },
+};
+
+typedef struct {
+  char *name;
+  char *text;
+  gsize len;
+} BenchmarkCorpus;
+
+static void
+benchmark_corpus_add (GPtrArray *corpora,
+                      const char *name,
+                      GString *text /* consumed */)
+{
+  BenchmarkCorpus *corpus = g_new (BenchmarkCorpus, 1);
+
+  corpus->name = g_strdup (name);
+  corpus->len = text->len;
+  corpus->text = g_string_free (text, FALSE);
+  g_ptr_array_add (corpora, corpus);
+}
+
+static void
+benchmark_corpus_free (BenchmarkCorpus *corpus)
+{
+  g_free (corpus->name);
+  g_free (corpus->text);
+  g_free (corpus);
+}
+
+static void
+benchmark_add_synthetic_corpora (GPtrArray *corpora)
+{
+  GString *text;
+  guint i, j;
+
+  /* Log lines with very long paths, in and out of URLs */
+  text = g_string_new (NULL);
+  for (i = 0; i < 1000; i++)
+    {
+      g_string_append (text, "2017-01-01 12:00:00 GET http://www.example.com");
+      for (j = 0; j < 40; j++)
+        g_string_append_printf (text, "/segment-%u", j);
+      g_string_append (text, "?q=1 from file:///usr/share");
+      for (j = 0; j < 40; j++)
+        g_string_append_printf (text, "/dir%u", j);
+      g_string_append (text, " /var/lib/");
+      for (j = 0; j < 40; j++)
+        g_string_append (text, "no-url-here/");
+      g_string_append_c (text, '\n');
+    }
+  benchmark_corpus_add (corpora, "long-paths", text);
+
+  /* Lots of IPv6 addresses, valid and invalid */
+  text = g_string_new (NULL);
+  for (i = 0; i < 1000; i++)
+    {
+      g_string_append_printf (text,
+                              "fe80::%x:%x dead:beef::192.168.%u.%u 11:22::33:44::55 "
+                              "http://[2001:db8:85a3::8a2e:370:%x]:%u/ sip:alice@[::1]:5060 "
+                              "foo@[1::%x] 11:22:33:44:55:66:77:87654\n",
+                              i, i * 7, i % 256, (i * 3) % 256,
+                              i, 1024 + i, i);
+    }
+  benchmark_corpus_add (corpora, "ipv6", text);
+
+  /* Deeply nested, and unbalanced, parentheses exercising PATH_INNER_DEF */
+  text = g_string_new (NULL);
+  for (i = 0; i < 100; i++)
+    {
+      g_string_append (text, "http://example.com/");
+      for (j = 0; j < 32; j++)
+        g_string_append (text, "(a[b");
+      for (j = 0; j < 32; j++)
+        g_string_append (text, "]c)");
+      g_string_append (text, " http://example.com/");
+      for (j = 0; j < 64; j++)
+        g_string_append (text, "((x");
+      g_string_append (text, " file:///");
+      for (j = 0; j < 64; j++)
+        g_string_append (text, "a(b[c)d]");
+      g_string_append_c (text, '\n');
+    }
+  benchmark_corpus_add (corpora, "balanced-parens", text);
+
+  /* Ordinary text without any matches */
+  text = g_string_new (NULL);
+  for (i = 0; i < 2000; i++)
+    g_string_append (text, "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+                           "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.\n");
+  benchmark_corpus_add (corpora, "no-match", text);
+}
+
+/* Returns the offset of the character after the one at @offset, so
+ * searches never start inside a UTF-8 sequence, which PCRE2 doesn't allow
+ * with PCRE2_NO_UTF_CHECK.
+ */
+static PCRE2_SIZE
+benchmark_next_char (const BenchmarkCorpus *corpus,
+                     PCRE2_SIZE offset)
+{
+  if (offset >= corpus->len)
+    return offset + 1; /* ends the scan */
+
+  return g_utf8_next_char (corpus->text + offset) - corpus->text;
+}
+
+/*
+ * benchmark_scan:
+ *
+ * Finds all matches in @corpus like VTE would, and returns their number.
+ * Searches aborted by hitting the match limit are counted in @n_limit_hits.
+ */
+static gsize
+benchmark_scan (pcre2_code_8 *code,
+                pcre2_match_data_8 *match_data,
+                pcre2_match_context_8 *match_context,
+                const BenchmarkCorpus *corpus,
+                guint32 options,
+                gsize *n_limit_hits)
+{
+  PCRE2_SIZE *ovector;
+  PCRE2_SIZE offset = 0;
+  gsize n_matches = 0;
+  int r;
+
+  ovector = pcre2_get_ovector_pointer_8 (match_data);
+  while (offset <= corpus->len)
+    {
+      r = pcre2_match_8 (code, (PCRE2_SPTR8) corpus->text, corpus->len, offset,
+                         options | PCRE2_NO_UTF_CHECK, match_data, match_context);
+      if (r == PCRE2_ERROR_MATCHLIMIT)
+        {
+          if (n_limit_hits)
+            (*n_limit_hits)++;
+          offset = benchmark_next_char (corpus, offset);
+          continue;
+        }
+      if (r < 0)
+        break;
+
+      n_matches++;
+      offset = ovector[1] > ovector[0] ? ovector[1] : benchmark_next_char (corpus, ovector[0]);
+    }
+
+  return n_matches;
+}
+
+/*
+ * benchmark_worst_case_backtracking:
+ *
+ * Returns: the largest match limit needed by any single search in @corpus,
+ *   i.e. the worst-case amount of backtracking the interpreter does
+ */
+static guint32
+benchmark_worst_case_backtracking (pcre2_code_8 *code,
+                                   pcre2_match_data_8 *match_data,
+                                   const BenchmarkCorpus *corpus)
+{
+  pcre2_match_context_8 *match_context;
+  PCRE2_SIZE *ovector;
+  PCRE2_SIZE offset = 0;
+  guint32 worst = 0;
+  int r;
+
+  match_context = pcre2_match_context_create_8 (NULL);
+  ovector = pcre2_get_ovector_pointer_8 (match_data);
+
+  while (offset <= corpus->len)
+    {
+      guint32 lo, hi, limit;
+
+      /* Find the smallest limit the search succeeds with by doubling, then bisecting */
+      for (hi = 1; ; hi *= 2)
+        {
+          pcre2_set_match_limit_8 (match_context, hi);
+          r = pcre2_match_8 (code, (PCRE2_SPTR8) corpus->text, corpus->len, offset,
+                             PCRE2_NO_JIT | PCRE2_NO_UTF_CHECK, match_data, match_context);
+          if (r != PCRE2_ERROR_MATCHLIMIT || hi >= G_MAXUINT32 / 2)
+            break;
+        }
+
+      lo = hi / 2 + 1;
+      while (lo < hi)
+        {
+          limit = lo + (hi - lo) / 2;
+          pcre2_set_match_limit_8 (match_context, limit);
+          if (pcre2_match_8 (code, (PCRE2_SPTR8) corpus->text, corpus->len, offset,
+                             PCRE2_NO_JIT | PCRE2_NO_UTF_CHECK, match_data, match_context) == PCRE2_ERROR_MATCHLIMIT)
+            lo = limit + 1;
+          else
+            hi = limit;
+        }
+
+      worst = MAX (worst, hi);
+
+      /* Re-run with the limit found to get the match position back */
+      pcre2_set_match_limit_8 (match_context, hi);
+      r = pcre2_match_8 (code, (PCRE2_SPTR8) corpus->text, corpus->len, offset,
+                         PCRE2_NO_JIT | PCRE2_NO_UTF_CHECK, match_data, match_context);
+      if (r < 0)
+        break;
+
+      offset = ovector[1] > ovector[0] ? ovector[1] : benchmark_next_char (corpus, ovector[0]);
+    }
+
+  pcre2_match_context_free_8 (match_context);
+  return worst;
+}
+
+static void
+benchmark_run (const BenchmarkPattern *pattern,
+               const BenchmarkCorpus *corpus,
+               guint iterations)
+{
+  pcre2_code_8 *code;
+  pcre2_match_data_8 *match_data;
+  PCRE2_SIZE error_offset;
+  int error_code;
+  gboolean have_jit;
+  guint pass, i;
+
+  code = pcre2_compile_8 ((PCRE2_SPTR8) pattern->pattern, PCRE2_ZERO_TERMINATED,
+                          PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_MULTILINE,
+                          &error_code, &error_offset, NULL);
+  g_assert (code != NULL);
+
+  have_jit = pcre2_jit_compile_8 (code, PCRE2_JIT_COMPLETE) == 0;
+  match_data = pcre2_match_data_create_from_pattern_8 (code, NULL);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      gboolean jit = pass == 1;
+      gsize n_matches = 0, n_limit_hits = 0;
+      gint64 start, elapsed;
+      double seconds;
+
+      if (jit && !have_jit)
+        {
+          printf ("%-20s %-16s jit    unavailable\n", pattern->name, corpus->name);
+          continue;
+        }
+
+      start = g_get_monotonic_time ();
+      for (i = 0; i < iterations; i++)
+        n_matches += benchmark_scan (code, match_data, NULL, corpus,
+                                     jit ? 0 : PCRE2_NO_JIT,
+                                     i == 0 ? &n_limit_hits : NULL);
+      elapsed = g_get_monotonic_time () - start;
+      seconds = MAX (elapsed, 1) / (double) G_USEC_PER_SEC;
+
+      printf ("%-20s %-16s %-6s %8" G_GSIZE_FORMAT " matches %12.0f matches/s %8.2f MB/s",
+              pattern->name, corpus->name, jit ? "jit" : "nojit",
+              n_matches / iterations,
+              n_matches / seconds,
+              corpus->len * (double) iterations / seconds / (1024 * 1024));
+      if (!jit)
+        printf (" worst-case backtracking %u",
+                benchmark_worst_case_backtracking (code, match_data, corpus));
+      if (n_limit_hits)
+        printf (" (%" G_GSIZE_FORMAT " searches hit the match limit)", n_limit_hits);
+      printf ("\n");
+    }
+
+  pcre2_match_data_free_8 (match_data);
+  pcre2_code_free_8 (code);
+}
+
+static int
+benchmark (int argc,
+           char **argv)
+{
+  GPtrArray *corpora;
+  guint iterations = BENCHMARK_DEFAULT_ITERATIONS;
+  guint i, j;
+  int k;
+
+  corpora = g_ptr_array_new_with_free_func ((GDestroyNotify) benchmark_corpus_free);
+  benchmark_add_synthetic_corpora (corpora);
+
+  for (k = 2; k < argc; k++)
+    {
+      GString *text;
+      char *contents;
+      gsize len;
+      GError *error = NULL;
+
+      if (g_str_has_prefix (argv[k], "--iterations="))
+        {
+          iterations = MAX (1, (guint) g_ascii_strtoull (argv[k] + strlen ("--iterations="), NULL, 10));
+          continue;
+        }
+
+      if (!g_file_get_contents (argv[k], &contents, &len, &error))
+        {
+          g_printerr ("Failed to load corpus: %s\n", error->message);
+          g_error_free (error);
+          g_ptr_array_unref (corpora);
+          return 1;
+        }
+
+      /* The patterns are matched with PCRE2_NO_UTF_CHECK, just like VTE does */
+      if (!g_utf8_validate (contents, len, NULL))
+        {
+          g_printerr ("Skipping corpus %s: not valid UTF-8\n", argv[k]);
+          g_free (contents);
+          continue;
+        }
+
+      text = g_string_new_len (contents, len);
+      g_free (contents);
+      benchmark_corpus_add (corpora, argv[k], text);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (benchmark_patterns); i++)
+    for (j = 0; j < corpora->len; j++)
+      benchmark_run (&benchmark_patterns[i], g_ptr_array_index (corpora, j), iterations);
+
+  g_ptr_array_unref (corpora);
+  return 0;
+}
+
 int
 main (int argc, char **argv)
 {
+  if (argc > 1 && g_str_equal (argv[1], "--benchmark"))
+    return benchmark (argc, argv);
+
   /* SCHEME is case insensitive */
   assert_match_anchored (SCHEME, "http",  ENTIRE);
   assert_match_anchored (SCHEME, "HTTPS", ENTIRE);
@@ -354,6 +701,15 @@ main (int argc, char **argv)
   assert_match (REGEX_URL_VOIP, "SIP:alice;day=tuesday@atlanta.com",                          ENTIRE);
   assert_match (REGEX_URL_VOIP, "Dial sip:alice@192.0.2.4.",                                  "sip:alice@192.0.2.4");
 
+  /* All of the above combined into one */
+  assert_match (REGEX_URL_COMBINED, "See http://example.com/foo.", "http://example.com/foo");
+  assert_match (REGEX_URL_COMBINED, "Go to www.gnome.org now",     "www.gnome.org");
+  assert_match (REGEX_URL_COMBINED, "See file:///etc/passwd.",     "file:///etc/passwd");
+  assert_match (REGEX_URL_COMBINED, "Dial sip:alice@192.0.2.4.",   "sip:alice@192.0.2.4");
+  assert_match (REGEX_URL_COMBINED, "Write to foo@bar.com.",       "foo@bar.com");
+  assert_match (REGEX_URL_COMBINED, "See man:ls(1)",               "man:ls(1)");
+  assert_match (REGEX_URL_COMBINED, "foo.bar/baz",                 NULL);
+
   /* Extremely long match, bug 770147 */
   assert_match (REGEX_URL_AS_IS, "http://www.example.com/ThisPathConsistsOfMoreThan1024Characters"
                                  "1234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890"
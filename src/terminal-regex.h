@@ -142,13 +142,38 @@
 
 #define DEFS APOS_START_DEF IP_DEF PATH_INNER_DEF PATH_DEF
 
-#define REGEX_URL_AS_IS  DEFS SCHEME "://" USERPASS URL_HOST PORT URLPATH
+#define URL_AS_IS_BODY   SCHEME "://" USERPASS URL_HOST PORT URLPATH
 /* TODO: also support file:/etc/passwd */
-#define REGEX_URL_FILE   DEFS "(?ix: file:/ (?: / (?: " HOSTNAME1 " )? / )? (?! / ) )(?&PATH)"
+#define URL_FILE_BODY    "(?ix: file:/ (?: / (?: " HOSTNAME1 " )? / )? (?! / ) )(?&PATH)"
 /* Lookbehind so that we don't catch "abc.www.foo.bar", bug 739757. Lookahead for www/ftp for convenience (so that we can reuse HOSTNAME1). */
-#define REGEX_URL_HTTP   DEFS "(?<!(?:" HOSTNAMESEGMENTCHARS_CLASS "|[.]))(?=(?i:www|ftp))" HOSTNAME1 PORT URLPATH
-#define REGEX_URL_VOIP   DEFS "(?i:h323:|sips?:)" USERPASS URL_HOST PORT VOIP_PATH
-#define REGEX_EMAIL      DEFS "(?i:mailto:)?" USER "@" EMAIL_HOST
-#define REGEX_NEWS_MAN   "(?i:news:|man:|info:)[-[:alnum:]\\Q^_{|}~!\"#$%&'()*+,./;:=?`\\E]+"
+#define URL_HTTP_BODY    "(?<!(?:" HOSTNAMESEGMENTCHARS_CLASS "|[.]))(?=(?i:www|ftp))" HOSTNAME1 PORT URLPATH
+#define URL_VOIP_BODY    "(?i:h323:|sips?:)" USERPASS URL_HOST PORT VOIP_PATH
+#define EMAIL_BODY       "(?i:mailto:)?" USER "@" EMAIL_HOST
+#define NEWS_MAN_BODY    "(?i:news:|man:|info:)[-[:alnum:]\\Q^_{|}~!\"#$%&'()*+,./;:=?`\\E]+"
+
+#define REGEX_URL_AS_IS  DEFS URL_AS_IS_BODY
+#define REGEX_URL_FILE   DEFS URL_FILE_BODY
+#define REGEX_URL_HTTP   DEFS URL_HTTP_BODY
+#define REGEX_URL_VOIP   DEFS URL_VOIP_BODY
+#define REGEX_EMAIL      DEFS EMAIL_BODY
+#define REGEX_NEWS_MAN   NEWS_MAN_BODY
+
+/* All of the above in one pattern, so that a single scan finds any of them.
+ * The named group that participated in the match tells which one it was.
+ */
+#define REGEX_URL_COMBINED_GROUP_AS_IS    "URL_AS_IS"
+#define REGEX_URL_COMBINED_GROUP_HTTP     "URL_HTTP"
+#define REGEX_URL_COMBINED_GROUP_FILE     "URL_FILE"
+#define REGEX_URL_COMBINED_GROUP_VOIP     "URL_VOIP"
+#define REGEX_URL_COMBINED_GROUP_EMAIL    "EMAIL"
+#define REGEX_URL_COMBINED_GROUP_NEWS_MAN "NEWS_MAN"
+
+#define REGEX_URL_COMBINED DEFS "(?:" \
+  "(?<" REGEX_URL_COMBINED_GROUP_AS_IS ">" URL_AS_IS_BODY ")|" \
+  "(?<" REGEX_URL_COMBINED_GROUP_HTTP ">" URL_HTTP_BODY ")|" \
+  "(?<" REGEX_URL_COMBINED_GROUP_FILE ">" URL_FILE_BODY ")|" \
+  "(?<" REGEX_URL_COMBINED_GROUP_VOIP ">" URL_VOIP_BODY ")|" \
+  "(?<" REGEX_URL_COMBINED_GROUP_EMAIL ">" EMAIL_BODY ")|" \
+  "(?<" REGEX_URL_COMBINED_GROUP_NEWS_MAN ">" NEWS_MAN_BODY "))"
 
 #endif /* !TERMINAL_REGEX_H */
@@ -53,12 +53,14 @@ G_BEGIN_DECLS
 #define TERMINAL_PROFILE_EXIT_ACTION_KEY                "exit-action"
 #define TERMINAL_PROFILE_FONT_KEY                       "font"
 #define TERMINAL_PROFILE_FOREGROUND_COLOR_KEY           "foreground-color"
+#define TERMINAL_PROFILE_HIBERNATE_TIMEOUT_KEY          "hibernate-timeout"
 #define TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY       "highlight-colors-set"
 #define TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY "highlight-background-color"
 #define TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY "highlight-foreground-color"
 #define TERMINAL_PROFILE_LOGIN_SHELL_KEY                "login-shell"
 #define TERMINAL_PROFILE_NAME_KEY                       "name"
 #define TERMINAL_PROFILE_PALETTE_KEY                    "palette"
+#define TERMINAL_PROFILE_PREWARM_KEY                    "prewarm"
 #define TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY           "rewrap-on-resize"
 #define TERMINAL_PROFILE_SCROLLBACK_LINES_KEY           "scrollback-lines"
 #define TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY       "scrollback-unlimited"
@@ -73,16 +75,26 @@ G_BEGIN_DECLS
 #define TERMINAL_PROFILE_VISIBLE_NAME_KEY               "visible-name"
 #define TERMINAL_PROFILE_WORD_CHAR_EXCEPTIONS_KEY       "word-char-exceptions"
 
+#define TERMINAL_SETTING_BACKGROUND_OUTPUT_BACKLOG_KEY  "background-output-backlog"
 #define TERMINAL_SETTING_CONFIRM_CLOSE_KEY              "confirm-close"
 #define TERMINAL_SETTING_DEFAULT_SHOW_MENUBAR_KEY       "default-show-menubar"
 #define TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY      "menu-accelerator-enabled"
 #define TERMINAL_SETTING_ENABLE_MNEMONICS_KEY           "mnemonics-enabled"
 #define TERMINAL_SETTING_ENABLE_SHORTCUTS_KEY           "shortcuts-enabled"
+#define TERMINAL_SETTING_LAZY_BACKGROUND_TABS_KEY       "lazy-background-tabs"
 #define TERMINAL_SETTING_NEW_TERMINAL_MODE_KEY          "new-terminal-mode"
 #define TERMINAL_SETTING_SCHEMA_VERSION                 "schema-version"
+#define TERMINAL_SETTING_SCROLLBACK_MEMORY_BUDGET_KEY   "scrollback-memory-budget"
+#define TERMINAL_SETTING_SESSION_SNAPSHOT_INTERVAL_KEY   "session-snapshot-interval"
+#define TERMINAL_SETTING_SESSION_SNAPSHOT_SCROLLBACK_KEY "session-snapshot-scrollback"
+#define TERMINAL_SETTING_SERVER_INACTIVITY_TIMEOUT_KEY  "server-inactivity-timeout"
+#define TERMINAL_SETTING_SERVER_SHARDING_KEY            "server-sharding"
+#define TERMINAL_SETTING_SERVER_SHARD_MAX_SCREENS_KEY   "server-shard-max-screens"
+#define TERMINAL_SETTING_SERVER_STANDBY_KEY             "server-standby"
 #define TERMINAL_SETTING_SHELL_INTEGRATION_KEY          "shell-integration-enabled"
 #define TERMINAL_SETTING_TAB_POLICY_KEY                 "tab-policy"
 #define TERMINAL_SETTING_TAB_POSITION_KEY               "tab-position"
+#define TERMINAL_SETTING_THROTTLE_BACKGROUND_OUTPUT_KEY "throttle-background-output"
 #define TERMINAL_SETTING_THEME_VARIANT_KEY              "theme-variant"
 
 #define TERMINAL_SETTINGS_LIST_LIST_KEY                 "list"
@@ -38,6 +38,7 @@
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
+#include <glib-unix.h>
 
 #include <gtk/gtk.h>
 
@@ -53,11 +54,14 @@
 #include "terminal-enums.h"
 #include "terminal-intl.h"
 #include "terminal-marshal.h"
+#include "terminal-metrics.h"
 #include "terminal-schemas.h"
 #include "terminal-screen-container.h"
 #include "terminal-util.h"
 #include "terminal-window.h"
 #include "terminal-info-bar.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 #include "eggshell.h"
@@ -66,11 +70,60 @@
 
 #define SPAWN_TIMEOUT (30 * 1000 /* 30s */)
 
+/* The PTY, its reader and the pipes of the spawn */
+#define FDS_PER_CHILD (8)
+
+/* Rough size of a cell in VTE's scrollback ring */
+#define SCROLLBACK_BYTES_PER_CELL (8)
+
+/* Pastes larger than this are fed to the child in chunks */
+#define PASTE_CHUNKED_THRESHOLD (256 * 1024)
+#define PASTE_CHUNK_SIZE (4096)
+/* How long to wait for the clipboard before letting VTE write the paste itself */
+#define PASTE_CAPTURE_TIMEOUT (2 * 1000 /* 2s */)
+
+/* A throttled background screen reads from its PTY for the first
+ * BACKGROUND_READ_SLICE ms of every BACKGROUND_THROTTLE_PERIOD ms
+ */
+#define BACKGROUND_THROTTLE_PERIOD (250)
+#define BACKGROUND_READ_SLICE (25)
+
+/* The output and rendering statistics cover the last this many seconds */
+#define STATS_SECONDS (10)
+
+/* A screen is hot while, over the last HOT_SECONDS seconds, it output more
+ * than HOT_OUTPUT_ROWS rows or took more than HOT_DRAW_TIME to draw per second
+ */
+#define HOT_SECONDS (3)
+#define HOT_OUTPUT_ROWS (2000)
+#define HOT_DRAW_TIME (200000 /* µs, a fifth of the time */)
+
+/* Title changes are passed on at most once per this many ms */
+#define TITLE_NOTIFY_INTERVAL (16 /* ms, about a frame */)
+
+enum {
+  TITLE_NOTIFY_TITLE      = 1 << 0,
+  TITLE_NOTIFY_ICON_TITLE = 1 << 1
+};
+
+typedef enum {
+  FD_SETUP_STEP_DUP,        /* dup fds[idx] onto target_fd */
+  FD_SETUP_STEP_INHERIT,    /* fds[idx] already is target_fd; clear FD_CLOEXEC */
+  FD_SETUP_STEP_MOVE_ASIDE  /* move fds[idx] above all the target FDs */
+} FDSetupStepType;
+
+typedef struct {
+  FDSetupStepType type;
+  int idx;
+  int target_fd;
+} FDSetupStep;
+
 typedef struct {
   int *fd_list;
   int fd_list_len;
-  const int *fd_array;
-  gsize fd_array_len;
+  FDSetupStep *steps;
+  guint n_steps;
+  int aside_fd_min;
 } FDSetupData;
 
 typedef struct
@@ -79,13 +132,51 @@ typedef struct
   TerminalURLFlavor flavor;
 } TagData;
 
+/* What a screen did during one second */
+typedef struct
+{
+  guint output_rows;
+  guint contents_changes;
+  guint draws;
+  guint64 draw_time; /* µs */
+} StatsBucket;
+
+typedef struct
+{
+  StatsBucket buckets[STATS_SECONDS]; /* indexed by second % STATS_SECONDS */
+  gint64 second; /* of the newest bucket */
+  gboolean last_row_valid;
+  glong last_row; /* of the cursor, absolute */
+  gboolean last_alternate; /* whether last_row was on the alternate screen */
+  guint64 output_rows;
+  guint64 draw_time; /* µs */
+  guint draws;
+  guint child_exits;
+} ScreenStats;
+
+/* The last classified cell, valid while contents_serial is unchanged */
+typedef struct
+{
+  gboolean valid;
+  guint contents_serial;
+  glong row; /* absolute, counting the scrollback */
+  glong column;
+  gboolean extra; /* whether the extra regexes were checked */
+  char *url;
+  int url_flavor;
+  char *number;
+} MatchCache;
+
+typedef struct _ProfileColors ProfileColors;
+
 struct _TerminalScreenPrivate
 {
   char *uuid;
+  gboolean has_slot; /* has a handle, see terminal_app_reserve_screen_slot() */
   gboolean registered; /* D-Bus interface is registered */
+  guint handle;
 
   GSettings *profile; /* never NULL */
-  guint profile_changed_id;
   guint profile_forgotten_id;
   char *initial_working_directory;
   char **initial_env;
@@ -93,7 +184,62 @@ struct _TerminalScreenPrivate
   gboolean shell;
   int child_pid;
   GSList *match_tags;
+  MatchCache match_cache;
   guint launch_child_source_id;
+
+  gboolean lazy; /* style and child launch wait for the first map */
+  gboolean style_pending;
+  gboolean launch_pending;
+
+  /* The theme colours the colour scheme was last computed from */
+  GdkRGBA theme_fg;
+  GdkRGBA theme_bg;
+  gboolean theme_colors_valid;
+  ProfileColors *colors; /* the profile colours last applied */
+
+  guint hibernate_source_id;
+  GCancellable *hibernate_cancellable;
+  GFile *hibernate_file; /* the scrollback moved to disk, or NULL */
+  gboolean hibernate_failed; /* the last attempt failed */
+  guint contents_serial;
+  GtkWidget *hibernate_info_bar;
+  gint64 last_focus_time;
+
+  GQueue paste_queue; /* PasteSegment */
+  GByteArray *paste_pending; /* converted, but not written to the PTY yet */
+  GByteArray *paste_capture; /* what VTE pastes from the clipboard, or NULL */
+  guint paste_capture_source_id;
+  gsize paste_total;
+  gsize paste_done;
+  guint paste_source_id;
+  GtkWidget *paste_info_bar;
+  GtkWidget *paste_progress;
+  GCancellable *drop_cancellable; /* of converting dropped URIs */
+
+  gint64 spawn_trace_begin;
+  gint64 spawn_begin; /* for the spawn latency metrics */
+
+  gboolean background; /* not the visible page of its notebook */
+  gboolean throttle_background;
+  guint background_backlog; /* rows, or 0 */
+  glong background_start_row;
+  VtePty *detached_pty; /* not being read while throttled or suspended */
+  gboolean suspended;
+  guint throttle_source_id;
+  guint throttle_serial;
+
+  guint pending_title_notify; /* TITLE_NOTIFY_* */
+  guint title_notify_source_id;
+  gint64 title_notify_time;
+  char *notified_title;
+
+  struct _SearchSnapshot *search_snapshot; /* of the last search, or NULL */
+  guint search_snapshot_source_id; /* drops search_snapshot when unused */
+  GSList *search_tasks; /* GTask taking a snapshot */
+
+  ScreenStats stats;
+  gboolean hot; /* outputting or drawing a lot, see HOT_SECONDS */
+  guint hot_source_id;
 };
 
 enum
@@ -111,7 +257,8 @@ enum {
   PROP_ICON_TITLE,
   PROP_ICON_TITLE_SET,
   PROP_TITLE,
-  PROP_INITIAL_ENVIRONMENT
+  PROP_INITIAL_ENVIRONMENT,
+  PROP_HOT
 };
 
 enum
@@ -125,6 +272,14 @@ enum
 };
 
 static void terminal_screen_constructed (GObject             *object);
+typedef struct _SearchSnapshot SearchSnapshot;
+static void search_snapshot_unref (SearchSnapshot *snapshot);
+static void search_snapshot_cache (TerminalScreen *screen,
+                                   SearchSnapshot *snapshot);
+static gsize search_snapshot_get_size (SearchSnapshot *snapshot);
+static void search_tasks_cancel (TerminalScreen *screen);
+static void match_cache_clear (MatchCache *cache);
+
 static void terminal_screen_dispose     (GObject             *object);
 static void terminal_screen_finalize    (GObject             *object);
 static void terminal_screen_drag_data_received (GtkWidget        *widget,
@@ -135,15 +290,19 @@ static void terminal_screen_drag_data_received (GtkWidget        *widget,
                                                 guint             info,
                                                 guint             time);
 static void terminal_screen_set_font (TerminalScreen *screen);
-static void terminal_screen_system_font_changed_cb (GSettings *,
-                                                    const char*,
-                                                    TerminalScreen *screen);
 static gboolean terminal_screen_popup_menu (GtkWidget *widget);
+static gboolean terminal_screen_draw (GtkWidget *widget,
+                                      cairo_t *cr);
 static gboolean terminal_screen_button_press (GtkWidget *widget,
                                               GdkEventButton *event);
 static gboolean terminal_screen_do_exec (TerminalScreen *screen,
                                          FDSetupData    *data,
                                          GError **error);
+static void terminal_screen_commit (VteTerminal *terminal,
+                                    const char *text,
+                                    guint size);
+static void paste_capture_finish (TerminalScreen *screen);
+static gboolean paste_capture_cb (TerminalScreen *screen);
 static void terminal_screen_child_exited  (VteTerminal *terminal,
                                            int status);
 
@@ -152,16 +311,25 @@ static void terminal_screen_window_title_changed      (VteTerminal *vte_terminal
 static void terminal_screen_icon_title_changed        (VteTerminal *vte_terminal,
                                                        TerminalScreen *screen);
 
+static void profile_colors_unref (ProfileColors *colors);
 static void update_color_scheme                      (TerminalScreen *screen);
+static void update_scrollback_lines                  (TerminalScreen *screen);
+
+static gboolean terminal_screen_focus_in  (GtkWidget     *widget,
+                                           GdkEventFocus *event);
+static gboolean terminal_screen_focus_out (GtkWidget     *widget,
+                                           GdkEventFocus *event);
+static void terminal_screen_contents_changed_cb (VteTerminal    *terminal,
+                                                 TerminalScreen *screen);
 
 static char* terminal_screen_check_hyperlink   (TerminalScreen            *screen,
                                                 GdkEvent                  *event);
-static void terminal_screen_check_extra (TerminalScreen *screen,
-                                         GdkEvent       *event,
-                                         char           **number_info);
-static char* terminal_screen_check_match       (TerminalScreen            *screen,
-                                                GdkEvent                  *event,
-                                                int                  *flavor);
+static void terminal_screen_check_matches (TerminalScreen *screen,
+                                           GdkEvent       *event,
+                                           gboolean        check_extra,
+                                           char          **url,
+                                           int            *url_flavor,
+                                           char          **number);
 
 static void terminal_screen_set_override_command (TerminalScreen  *screen,
                                                   char           **argv,
@@ -174,15 +342,30 @@ typedef struct {
   TerminalURLFlavor flavor;
 } TerminalRegexPattern;
 
+/* A single match tag for all URL flavors; the flavor is determined from the
+ * named group that matched, see url_regex_combined_groups below.
+ */
 static const TerminalRegexPattern url_regex_patterns[] = {
-  { REGEX_URL_AS_IS, FLAVOR_AS_IS },
-  { REGEX_URL_HTTP,  FLAVOR_DEFAULT_TO_HTTP },
-  { REGEX_URL_FILE,  FLAVOR_AS_IS },
-  { REGEX_URL_VOIP,  FLAVOR_VOIP_CALL },
-  { REGEX_EMAIL,     FLAVOR_EMAIL },
-  { REGEX_NEWS_MAN,  FLAVOR_AS_IS },
+  { REGEX_URL_COMBINED, FLAVOR_AS_IS },
+};
+
+typedef struct {
+  const char *name;
+  TerminalURLFlavor flavor;
+} TerminalRegexGroup;
+
+static const TerminalRegexGroup url_regex_combined_groups[] = {
+  { REGEX_URL_COMBINED_GROUP_AS_IS,    FLAVOR_AS_IS },
+  { REGEX_URL_COMBINED_GROUP_HTTP,     FLAVOR_DEFAULT_TO_HTTP },
+  { REGEX_URL_COMBINED_GROUP_FILE,     FLAVOR_AS_IS },
+  { REGEX_URL_COMBINED_GROUP_VOIP,     FLAVOR_VOIP_CALL },
+  { REGEX_URL_COMBINED_GROUP_EMAIL,    FLAVOR_EMAIL },
+  { REGEX_URL_COMBINED_GROUP_NEWS_MAN, FLAVOR_AS_IS },
 };
 
+/* Only used to classify a match that VTE already found, so compiled on first use */
+static pcre2_code_8 *url_regex_combined_code;
+
 static const TerminalRegexPattern extra_regex_patterns[] = {
   { "(0[Xx][[:xdigit:]]+|[[:digit:]]+)", FLAVOR_NUMBER },
 };
@@ -193,6 +376,13 @@ static TerminalURLFlavor *url_regex_flavors;
 static TerminalURLFlavor *extra_regex_flavors;
 static guint n_url_regexes;
 static guint n_extra_regexes;
+/* The URL regexes followed by the extra regexes, so that a click is
+ * classified with a single pass over the text under the pointer.
+ */
+static VteRegex **click_regexes;
+static guint n_jitted_regexes;
+static guint jit_regexes_source_id;
+static gboolean jit_regexes_wanted;
 
 /* See bug #697024 */
 #ifndef __linux__
@@ -224,6 +414,7 @@ precompile_regexes (const TerminalRegexPattern *regex_patterns,
                     VteRegex ***regexes,
                     TerminalURLFlavor **regex_flavors)
 {
+  gint64 trace_begin = _terminal_trace_begin ();
   guint i;
 
   *regexes = g_new0 (VteRegex*, n_regexes);
@@ -238,14 +429,59 @@ precompile_regexes (const TerminalRegexPattern *regex_patterns,
                                                &error);
       g_assert_no_error (error);
 
-      if (!vte_regex_jit ((*regexes)[i], PCRE2_JIT_COMPLETE, &error) ||
-          !vte_regex_jit ((*regexes)[i], PCRE2_JIT_PARTIAL_SOFT, &error)) {
-        g_printerr ("Failed to JIT regex '%s': %s\n", regex_patterns[i].pattern, error->message);
-        g_clear_error (&error);
-      }
-
       (*regex_flavors)[i] = regex_patterns[i].flavor;
     }
+
+  _terminal_trace_end ("precompile_regexes", trace_begin);
+}
+
+static void
+jit_regex (VteRegex *regex,
+           const char *pattern)
+{
+  GError *error = NULL;
+
+  if (!vte_regex_jit (regex, PCRE2_JIT_COMPLETE, &error) ||
+      !vte_regex_jit (regex, PCRE2_JIT_PARTIAL_SOFT, &error)) {
+    g_printerr ("Failed to JIT regex '%s': %s\n", pattern, error->message);
+    g_clear_error (&error);
+  }
+}
+
+/*
+ * jit_next_regex:
+ *
+ * JITs the next regex that isn't JITed yet, the URL regexes first.
+ *
+ * Returns: %TRUE iff there are more regexes left to JIT
+ */
+static gboolean
+jit_next_regex (void)
+{
+  guint i = n_jitted_regexes;
+
+  if (i < n_url_regexes)
+    jit_regex (url_regexes[i], url_regex_patterns[i].pattern);
+  else if (i < n_url_regexes + n_extra_regexes)
+    jit_regex (extra_regexes[i - n_url_regexes],
+               extra_regex_patterns[i - n_url_regexes].pattern);
+  else
+    return FALSE;
+
+  n_jitted_regexes++;
+  return n_jitted_regexes < n_url_regexes + n_extra_regexes;
+}
+
+static gboolean
+jit_regexes_idle_cb (gpointer user_data)
+{
+  if (jit_next_regex ())
+    return G_SOURCE_CONTINUE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER, "All regexes JITed\n");
+
+  jit_regexes_source_id = 0;
+  return G_SOURCE_REMOVE;
 }
 
 static void
@@ -285,6 +521,21 @@ terminal_screen_get_window (TerminalScreen *screen)
   return TERMINAL_WINDOW (toplevel);
 }
 
+/* A lazy screen that isn't shown does not need its colours and font yet;
+ * e.g. background tabs of a restored session.
+ */
+static gboolean
+terminal_screen_defer_style (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (!priv->lazy || gtk_widget_get_visible (GTK_WIDGET (screen)))
+    return FALSE;
+
+  priv->style_pending = TRUE;
+  return TRUE;
+}
+
 static void
 terminal_screen_realize (GtkWidget *widget)
 {
@@ -306,10 +557,53 @@ static void
 terminal_screen_style_updated (GtkWidget *widget)
 {
   TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPrivate *priv = screen->priv;
+  GtkStyleContext *context;
+  GdkRGBA theme_fg, theme_bg;
+  const char *section;
 
+  section = _terminal_watchdog_enter ("style-updated");
   GTK_WIDGET_CLASS (terminal_screen_parent_class)->style_updated (widget);
 
-  terminal_screen_update_style (screen);
+  /* Most style changes (e.g. of the theme CSS on other widgets) don't
+   * change the colours the scheme depends on; only recompute it if they do.
+   */
+  context = gtk_widget_get_style_context (widget);
+  gtk_style_context_get_color (context, gtk_style_context_get_state (context), &theme_fg);
+  gtk_style_context_get_background_color (context, gtk_style_context_get_state (context), &theme_bg);
+  if (priv->theme_colors_valid &&
+      gdk_rgba_equal (&theme_fg, &priv->theme_fg) &&
+      gdk_rgba_equal (&theme_bg, &priv->theme_bg)) {
+    terminal_screen_set_font (screen);
+  } else {
+    terminal_screen_update_style (screen);
+  }
+
+  _terminal_watchdog_leave (section);
+}
+
+static void
+terminal_screen_show (GtkWidget *widget)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPrivate *priv = screen->priv;
+
+  GTK_WIDGET_CLASS (terminal_screen_parent_class)->show (widget);
+
+  if (priv->style_pending) {
+    priv->style_pending = FALSE;
+    terminal_screen_update_style (screen);
+  }
+}
+
+static void
+terminal_screen_map (GtkWidget *widget)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+
+  GTK_WIDGET_CLASS (terminal_screen_parent_class)->map (widget);
+
+  terminal_screen_set_lazy (screen, FALSE);
 }
 
 #ifdef ENABLE_DEBUG
@@ -344,7 +638,6 @@ terminal_screen_init (TerminalScreen *screen)
   };
   VteTerminal *terminal = VTE_TERMINAL (screen);
   TerminalScreenPrivate *priv;
-  TerminalApp *app;
   GtkTargetList *target_list;
   GtkTargetEntry *targets;
   int n_targets;
@@ -361,6 +654,7 @@ terminal_screen_init (TerminalScreen *screen)
   vte_terminal_set_mouse_autohide (terminal, TRUE);
 
   priv->child_pid = -1;
+  priv->last_focus_time = g_get_monotonic_time ();
 
   vte_terminal_set_allow_hyperlink (terminal, TRUE);
 
@@ -394,6 +688,9 @@ terminal_screen_init (TerminalScreen *screen)
   gtk_target_table_free (targets, n_targets);
   gtk_target_list_unref (target_list);
 
+  g_signal_connect (screen, "contents-changed",
+                    G_CALLBACK (terminal_screen_contents_changed_cb),
+                    screen);
   g_signal_connect (screen, "window-title-changed",
                     G_CALLBACK (terminal_screen_window_title_changed),
                     screen);
@@ -401,10 +698,6 @@ terminal_screen_init (TerminalScreen *screen)
                     G_CALLBACK (terminal_screen_icon_title_changed),
                     screen);
 
-  app = terminal_app_get ();
-  g_signal_connect (terminal_app_get_desktop_interface_settings (app), "changed::" MONOSPACE_FONT_KEY_NAME,
-                    G_CALLBACK (terminal_screen_system_font_changed_cb), screen);
-
 #ifdef ENABLE_DEBUG
   _TERMINAL_DEBUG_IF (TERMINAL_DEBUG_GEOMETRY)
     {
@@ -439,6 +732,9 @@ terminal_screen_get_property (GObject *object,
       case PROP_TITLE:
         g_value_set_string (value, terminal_screen_get_title (screen));
         break;
+      case PROP_HOT:
+        g_value_set_boolean (value, terminal_screen_is_hot (screen));
+        break;
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -464,6 +760,7 @@ terminal_screen_set_property (GObject *object,
       case PROP_ICON_TITLE:
       case PROP_ICON_TITLE_SET:
       case PROP_TITLE:
+      case PROP_HOT:
         /* not writable */
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -486,12 +783,18 @@ terminal_screen_class_init (TerminalScreenClass *klass)
   object_class->set_property = terminal_screen_set_property;
 
   widget_class->realize = terminal_screen_realize;
+  widget_class->show = terminal_screen_show;
+  widget_class->map = terminal_screen_map;
+  widget_class->draw = terminal_screen_draw;
+  widget_class->focus_in_event = terminal_screen_focus_in;
+  widget_class->focus_out_event = terminal_screen_focus_out;
   widget_class->style_updated = terminal_screen_style_updated;
   widget_class->drag_data_received = terminal_screen_drag_data_received;
   widget_class->button_press_event = terminal_screen_button_press;
   widget_class->popup_menu = terminal_screen_popup_menu;
 
   terminal_class->child_exited = terminal_screen_child_exited;
+  terminal_class->commit = terminal_screen_commit;
 
   signals[PROFILE_SET] =
     g_signal_new (I_("profile-set"),
@@ -569,12 +872,28 @@ terminal_screen_class_init (TerminalScreenClass *klass)
                          G_TYPE_STRV,
                          G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
 
+  g_object_class_install_property
+    (object_class,
+     PROP_HOT,
+     g_param_spec_boolean ("hot", NULL, NULL,
+                           FALSE,
+                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
   g_type_class_add_private (object_class, sizeof (TerminalScreenPrivate));
 
   n_url_regexes = G_N_ELEMENTS (url_regex_patterns);
   precompile_regexes (url_regex_patterns, n_url_regexes, &url_regexes, &url_regex_flavors);
   n_extra_regexes = G_N_ELEMENTS (extra_regex_patterns);
   precompile_regexes (extra_regex_patterns, n_extra_regexes, &extra_regexes, &extra_regex_flavors);
+  click_regexes = g_new (VteRegex *, n_url_regexes + n_extra_regexes);
+  memcpy (click_regexes, url_regexes, n_url_regexes * sizeof (VteRegex *));
+  memcpy (click_regexes + n_url_regexes, extra_regexes, n_extra_regexes * sizeof (VteRegex *));
+
+  /* JITing is expensive and matching works fine without it, so keep it
+   * off the path to the first window; see terminal_screen_jit_regexes().
+   */
+  if (jit_regexes_wanted)
+    jit_regexes_source_id = g_idle_add_full (G_PRIORITY_LOW, jit_regexes_idle_cb, NULL, NULL);
 
   /* This fixes bug #329827 */
   settings = terminal_app_get_global_settings (terminal_app_get ());
@@ -586,13 +905,12 @@ terminal_screen_class_init (TerminalScreenClass *klass)
 static void
 terminal_screen_constructed (GObject *object)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (object);
-  TerminalScreenPrivate *priv = screen->priv;
-
   G_OBJECT_CLASS (terminal_screen_parent_class)->constructed (object);
 
-  terminal_app_register_screen (terminal_app_get (), screen);
-  priv->registered = TRUE;
+  /* Registering with the app is left to terminal_screen_new_full(), since
+   * a spare screen is only registered once it is taken; see
+   * _terminal_screen_new_spare().
+   */
 }
 
 static void
@@ -613,9 +931,45 @@ terminal_screen_dispose (GObject *object)
       priv->launch_child_source_id = 0;
     }
 
-  if (priv->registered) {
+  if (priv->hibernate_source_id != 0)
+    {
+      g_source_remove (priv->hibernate_source_id);
+      priv->hibernate_source_id = 0;
+    }
+
+  if (priv->hibernate_cancellable)
+    {
+      g_cancellable_cancel (priv->hibernate_cancellable);
+      g_clear_object (&priv->hibernate_cancellable);
+    }
+
+  if (priv->drop_cancellable)
+    {
+      g_cancellable_cancel (priv->drop_cancellable);
+      g_clear_object (&priv->drop_cancellable);
+    }
+
+  paste_capture_finish (screen);
+  terminal_screen_cancel_paste (screen);
+  terminal_screen_set_background (screen, FALSE);
+  search_tasks_cancel (screen);
+  search_snapshot_cache (screen, NULL);
+
+  if (priv->title_notify_source_id != 0)
+    {
+      g_source_remove (priv->title_notify_source_id);
+      priv->title_notify_source_id = 0;
+    }
+
+  if (priv->hot_source_id != 0)
+    {
+      g_source_remove (priv->hot_source_id);
+      priv->hot_source_id = 0;
+    }
+
+  if (priv->has_slot) {
     terminal_app_unregister_screen (terminal_app_get (), screen);
-    priv->registered = FALSE;
+    priv->has_slot = priv->registered = FALSE;
   }
 
   G_OBJECT_CLASS (terminal_screen_parent_class)->dispose (object);
@@ -627,32 +981,43 @@ terminal_screen_finalize (GObject *object)
   TerminalScreen *screen = TERMINAL_SCREEN (object);
   TerminalScreenPrivate *priv = screen->priv;
 
-  g_signal_handlers_disconnect_by_func (terminal_app_get_desktop_interface_settings (terminal_app_get ()),
-                                        G_CALLBACK (terminal_screen_system_font_changed_cb),
-                                        screen);
-
   terminal_screen_set_profile (screen, NULL);
 
   g_free (priv->initial_working_directory);
   g_strfreev (priv->override_command);
-  g_strfreev (priv->initial_env);
+  terminal_app_release_environment (terminal_app_get (), priv->initial_env);
+  if (priv->colors)
+    profile_colors_unref (priv->colors);
+  if (priv->paste_pending)
+    g_byte_array_unref (priv->paste_pending);
+  g_free (priv->notified_title);
+  if (priv->search_snapshot)
+    search_snapshot_unref (priv->search_snapshot);
 
   g_slist_foreach (priv->match_tags, (GFunc) free_tag_data, NULL);
   g_slist_free (priv->match_tags);
+  match_cache_clear (&priv->match_cache);
+
+  /* Nobody can get at the hibernated scrollback anymore */
+  if (priv->hibernate_file) {
+    g_file_delete (priv->hibernate_file, NULL, NULL);
+    g_object_unref (priv->hibernate_file);
+  }
 
   g_free (priv->uuid);
 
   G_OBJECT_CLASS (terminal_screen_parent_class)->finalize (object);
 }
 
-TerminalScreen *
-terminal_screen_new (GSettings       *profile,
-                     const char      *charset,
-                     char           **override_command,
-                     const char      *title,
-                     const char      *working_dir,
-                     char           **child_env,
-                     double           zoom)
+static TerminalScreen *
+terminal_screen_new_full (GSettings       *profile,
+                          const char      *charset,
+                          char           **override_command,
+                          const char      *title,
+                          const char      *working_dir,
+                          char           **child_env,
+                          double           zoom,
+                          gboolean         registered)
 {
   TerminalScreen *screen;
   TerminalScreenPrivate *priv;
@@ -662,6 +1027,14 @@ terminal_screen_new (GSettings       *profile,
   screen = g_object_new (TERMINAL_TYPE_SCREEN, NULL);
   priv = screen->priv;
 
+  /* The handle is fixed now, so that a spare screen's child gets the
+   * object path the screen is exported at once it's taken.
+   */
+  priv->handle = terminal_app_reserve_screen_slot (terminal_app_get (), screen);
+  priv->has_slot = TRUE;
+  if (registered)
+    _terminal_screen_register (screen);
+
   terminal_screen_set_profile (screen, profile);
 
   /* If we got an encoding together with an override command,
@@ -719,6 +1092,174 @@ terminal_screen_new (GSettings       *profile,
   return screen;
 }
 
+TerminalScreen *
+terminal_screen_new (GSettings       *profile,
+                     const char      *charset,
+                     char           **override_command,
+                     const char      *title,
+                     const char      *working_dir,
+                     char           **child_env,
+                     double           zoom)
+{
+  return terminal_screen_new_full (profile, charset, override_command, title,
+                                   working_dir, child_env, zoom, TRUE);
+}
+
+/**
+ * _terminal_screen_new_spare:
+ * @profile: the profile
+ * @working_dir: (allow-none): the working directory
+ * @child_env: (allow-none): the environment
+ *
+ * Like terminal_screen_new(), but the screen is not exported on the bus,
+ * searched or counted until _terminal_screen_register() is called, when
+ * it's put into a window. Its object path is already assigned though,
+ * so that its child's environment has it.
+ *
+ * Returns: (transfer floating): a new #TerminalScreen
+ */
+TerminalScreen *
+_terminal_screen_new_spare (GSettings  *profile,
+                            const char *working_dir,
+                            char      **child_env)
+{
+  return terminal_screen_new_full (profile, NULL, NULL, NULL,
+                                   working_dir, child_env, 1.0, FALSE);
+}
+
+/**
+ * _terminal_screen_register:
+ * @screen: a #TerminalScreen
+ *
+ * Registers @screen with the app, see terminal_app_register_screen(),
+ * unless it is already.
+ */
+void
+_terminal_screen_register (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (priv->registered)
+    return;
+
+  terminal_app_register_screen (terminal_app_get (), screen);
+  priv->registered = TRUE;
+}
+
+/* Plans moving the passed FDs to their target FDs in the child, so that
+ * the child setup only has to run the steps, with one syscall per step.
+ * Each dup is ordered after all the moves reading from its target FD; a
+ * cycle of moves is broken by moving one of its FDs out of the way first,
+ * above all the FDs involved so it can't be hit by a later dup.
+ *
+ * If several entries of @fd_array have the same target FD, the last one wins.
+ */
+static FDSetupData *
+fd_setup_data_new (const int *fds,
+                   int n_fds,
+                   const int *fd_array,
+                   gsize fd_array_len)
+{
+  FDSetupData *data;
+  gs_unref_hashtable GHashTable *targets = NULL; /* target FD -> index into fd_array */
+  gs_unref_hashtable GHashTable *readers = NULL; /* FD -> number of pending moves reading it */
+  gs_free int *cur = NULL; /* current FD of each fds[] entry in the child, -1 if moved aside */
+  gs_free gsize *pending = NULL;
+  GArray *steps;
+  gsize n_pending, i, j;
+  int max_fd = 2;
+
+  data = g_new (FDSetupData, 1);
+  data->fd_list = g_memdup (fds, (n_fds + 1) * sizeof (int));
+  data->fd_list_len = n_fds;
+
+  targets = g_hash_table_new (NULL, NULL);
+  readers = g_hash_table_new (NULL, NULL);
+  cur = g_memdup (fds, (n_fds + 1) * sizeof (int));
+  pending = g_new (gsize, fd_array_len + 1);
+
+  for (i = 0; i < (gsize) n_fds; i++)
+    max_fd = MAX (max_fd, fds[i]);
+  for (i = 0; i < fd_array_len; i++) {
+    max_fd = MAX (max_fd, fd_array[2 * i]);
+    g_hash_table_insert (targets, GINT_TO_POINTER (fd_array[2 * i]), GSIZE_TO_POINTER (i));
+  }
+
+  n_pending = 0;
+  for (i = 0; i < fd_array_len; i++) {
+    int idx = fd_array[2 * i + 1];
+
+    g_assert (idx >= 0 && idx < n_fds);
+
+    if (GPOINTER_TO_SIZE (g_hash_table_lookup (targets, GINT_TO_POINTER (fd_array[2 * i]))) != i)
+      continue;
+
+    pending[n_pending++] = i;
+    g_hash_table_insert (readers, GINT_TO_POINTER (cur[idx]),
+                         GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (readers, GINT_TO_POINTER (cur[idx]))) + 1));
+  }
+
+  data->aside_fd_min = max_fd + 1;
+  steps = g_array_sized_new (FALSE, FALSE, sizeof (FDSetupStep), n_pending);
+
+  while (n_pending > 0) {
+    gboolean progress = FALSE;
+
+    for (j = 0; j < n_pending; ) {
+      int target_fd = fd_array[2 * pending[j]];
+      int idx = fd_array[2 * pending[j] + 1];
+      FDSetupStep step = { FD_SETUP_STEP_DUP, idx, target_fd };
+      guint n_readers;
+
+      if (cur[idx] == target_fd) {
+        step.type = FD_SETUP_STEP_INHERIT;
+      } else if (g_hash_table_lookup (readers, GINT_TO_POINTER (target_fd)) != NULL) {
+        /* Still needed by another move */
+        j++;
+        continue;
+      }
+
+      g_array_append_val (steps, step);
+      progress = TRUE;
+
+      /* FDs moved aside aren't tracked, since nothing can overwrite them */
+      if (cur[idx] != -1) {
+        n_readers = GPOINTER_TO_UINT (g_hash_table_lookup (readers, GINT_TO_POINTER (cur[idx]))) - 1;
+        if (n_readers > 0)
+          g_hash_table_insert (readers, GINT_TO_POINTER (cur[idx]), GUINT_TO_POINTER (n_readers));
+        else
+          g_hash_table_remove (readers, GINT_TO_POINTER (cur[idx]));
+      }
+
+      pending[j] = pending[--n_pending];
+    }
+
+    if (progress || n_pending == 0)
+      continue;
+
+    /* Only cycles are left. Move the FDs blocking the first pending
+     * move out of the way; the moves reading them then can't block
+     * anything anymore.
+     */
+    int blocked_fd = fd_array[2 * pending[0]];
+    for (i = 0; i < (gsize) n_fds; i++) {
+      FDSetupStep step = { FD_SETUP_STEP_MOVE_ASIDE, (int) i, -1 };
+
+      if (cur[i] != blocked_fd)
+        continue;
+
+      g_array_append_val (steps, step);
+      cur[i] = -1;
+    }
+    g_hash_table_remove (readers, GINT_TO_POINTER (blocked_fd));
+  }
+
+  data->n_steps = steps->len;
+  data->steps = (FDSetupStep *) g_array_free (steps, FALSE);
+
+  return data;
+}
+
 gboolean 
 terminal_screen_exec (TerminalScreen *screen,
                       char          **argv,
@@ -743,68 +1284,390 @@ terminal_screen_exec (TerminalScreen *screen,
   g_free (priv->initial_working_directory);
   priv->initial_working_directory = g_strdup (cwd);
 
-  if (fd_list) {
-    const int *fds;
-
-    data = g_new (FDSetupData, 1);
-    fds = g_unix_fd_list_peek_fds (fd_list, &data->fd_list_len);
-    data->fd_list = g_memdup (fds, (data->fd_list_len + 1) * sizeof (int));
-    data->fd_array = g_variant_get_fixed_array (fd_array, &data->fd_array_len, 2 * sizeof (int));
+  /* The FD list may also carry FDs not meant for the child, like the
+   * exit status FD; only set up the child's FDs if there's an fd-set.
+   */
+  if (fd_list != NULL && fd_array != NULL) {
+    const int *fds, *fd_array_data;
+    int n_fds;
+    gsize fd_array_len;
+
+    fds = g_unix_fd_list_peek_fds (fd_list, &n_fds);
+    fd_array_data = g_variant_get_fixed_array (fd_array, &fd_array_len, 2 * sizeof (int));
+    data = fd_setup_data_new (fds, n_fds, fd_array_data, fd_array_len);
   } else
     data = NULL;
 
   return terminal_screen_do_exec (screen, data, error);
 }
 
-const char*
-terminal_screen_get_title (TerminalScreen *screen)
+/**
+ * terminal_screen_set_lazy:
+ * @screen: a #TerminalScreen
+ * @lazy: whether to be lazy
+ *
+ * While @screen is lazy and hidden, it does not update its colours and
+ * font, and it defers launching the child process until it is first mapped.
+ */
+void
+terminal_screen_set_lazy (TerminalScreen *screen,
+                          gboolean lazy)
 {
-  return vte_terminal_get_window_title (VTE_TERMINAL (screen));
-}
+  TerminalScreenPrivate *priv;
 
-const char*
-terminal_screen_get_icon_title (TerminalScreen *screen)
-{
-  return vte_terminal_get_icon_title (VTE_TERMINAL (screen));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  lazy = lazy != FALSE;
+  if (priv->lazy == lazy)
+    return;
+
+  priv->lazy = lazy;
+  if (lazy)
+    return;
+
+  if (priv->style_pending) {
+    priv->style_pending = FALSE;
+    terminal_screen_update_style (screen);
+  }
+  if (priv->launch_pending) {
+    priv->launch_pending = FALSE;
+    terminal_screen_do_exec (screen, NULL, NULL /* don't care */);
+  }
 }
 
-gboolean
-terminal_screen_get_icon_title_set (TerminalScreen *screen)
+static void
+terminal_screen_detach_pty (TerminalScreen *screen)
 {
-  return vte_terminal_get_icon_title (VTE_TERMINAL (screen)) != NULL;
+  TerminalScreenPrivate *priv = screen->priv;
+  VtePty *pty;
+
+  /* The paste engine writes to the PTY itself */
+  if (priv->detached_pty != NULL ||
+      priv->child_pid == -1 ||
+      !g_queue_is_empty (&priv->paste_queue))
+    return;
+
+  pty = vte_terminal_get_pty (VTE_TERMINAL (screen));
+  if (pty == NULL)
+    return;
+
+  /* VTE has no way to read a PTY at a lower rate or priority, but without
+   * a PTY it stops reading, and the child blocks once the kernel buffer
+   * fills up. Input for the child reattaches it, see terminal_screen_commit().
+   */
+  priv->detached_pty = g_object_ref (pty);
+  vte_terminal_set_pty (VTE_TERMINAL (screen), NULL);
 }
 
 static void
-terminal_screen_profile_changed_cb (GSettings     *profile,
-                                    const char    *prop_name,
-                                    TerminalScreen *screen)
+terminal_screen_attach_pty (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  GObject *object = G_OBJECT (screen);
-  VteTerminal *vte_terminal = VTE_TERMINAL (screen);
-  TerminalWindow *window;
 
-  g_object_freeze_notify (object);
+  if (priv->detached_pty == NULL)
+    return;
 
-  if ((window = terminal_screen_get_window (screen)))
-    {
-      /* We need these in line for the set_size in
+  vte_terminal_set_pty (VTE_TERMINAL (screen), priv->detached_pty);
+  g_clear_object (&priv->detached_pty);
+}
+
+static gboolean
+background_throttle_cb (gpointer user_data)
+{
+  TerminalScreen *screen = user_data;
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (priv->detached_pty != NULL) {
+    terminal_screen_attach_pty (screen);
+    priv->throttle_serial = priv->contents_serial;
+    priv->throttle_source_id = g_timeout_add (BACKGROUND_READ_SLICE, background_throttle_cb, screen);
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Nothing arrived during the slice, so stop until the child writes again */
+  if (priv->contents_serial == priv->throttle_serial) {
+    priv->throttle_source_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  terminal_screen_detach_pty (screen);
+  priv->throttle_source_id = g_timeout_add (BACKGROUND_THROTTLE_PERIOD - BACKGROUND_READ_SLICE,
+                                            background_throttle_cb, screen);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+background_throttle_stop (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  /* Reattaching the PTY ends a paste capture, so write that out first */
+  paste_capture_finish (screen);
+
+  if (priv->throttle_source_id != 0) {
+    g_source_remove (priv->throttle_source_id);
+    priv->throttle_source_id = 0;
+  }
+
+  priv->suspended = FALSE;
+  terminal_screen_attach_pty (screen);
+}
+
+static void
+background_output_cb (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  glong row;
+
+  if (priv->suspended)
+    return;
+
+  if (priv->background_backlog > 0) {
+    vte_terminal_get_cursor_position (VTE_TERMINAL (screen), NULL, &row);
+    if (row < priv->background_start_row)
+      priv->background_start_row = row; /* reset or cleared */
+    else if (row - priv->background_start_row >= (glong) priv->background_backlog) {
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "[screen %p] suspending output after %ld rows in the background\n",
+                             screen, row - priv->background_start_row);
+
+      background_throttle_stop (screen);
+      priv->suspended = TRUE;
+      terminal_screen_detach_pty (screen);
+      return;
+    }
+  }
+
+  /* A hot screen is throttled even without the setting, since keeping up
+   * with it in the background mostly takes time from the visible screens.
+   */
+  if ((priv->throttle_background || terminal_screen_is_hot (screen)) &&
+      priv->throttle_source_id == 0) {
+    terminal_screen_detach_pty (screen);
+    priv->throttle_serial = priv->contents_serial;
+    priv->throttle_source_id = g_timeout_add (BACKGROUND_THROTTLE_PERIOD - BACKGROUND_READ_SLICE,
+                                              background_throttle_cb, screen);
+  }
+}
+
+/* VTE drops the input for the child while it has no PTY, but emits
+ * "commit" before it looks, so reattach the PTY and let VTE write it.
+ * Input in the background is rare enough (a broadcast, or a feed over
+ * D-Bus) that it just ends the throttling; it starts again with the
+ * next output, and the backlog is counted from here.
+ */
+static void
+terminal_screen_commit (VteTerminal *terminal,
+                        const char *text,
+                        guint size)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (VTE_TERMINAL_CLASS (terminal_screen_parent_class)->commit)
+    VTE_TERMINAL_CLASS (terminal_screen_parent_class)->commit (terminal, text, size);
+
+  if (priv->detached_pty == NULL)
+    return;
+
+  if (priv->paste_capture != NULL) {
+    g_byte_array_append (priv->paste_capture, (const guint8 *) text, size);
+
+    /* VTE commits all of a paste at once, so it's complete once idle */
+    if (priv->paste_capture->len == size) {
+      g_source_remove (priv->paste_capture_source_id);
+      priv->paste_capture_source_id =
+        _terminal_watchdog_idle_add ("paste capture",
+                                     (GSourceFunc) paste_capture_cb, screen);
+    }
+    return;
+  }
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] resuming reading for input in the background\n",
+                         screen);
+
+  background_throttle_stop (screen);
+  vte_terminal_get_cursor_position (terminal, NULL, &priv->background_start_row);
+}
+
+/**
+ * terminal_screen_set_background:
+ * @screen: a #TerminalScreen
+ * @background: whether @screen is not visible
+ *
+ * While @screen is in the background, it reads from its PTY only part of
+ * the time if the "throttle-background-output" setting is set or if it
+ * is hot (see terminal_screen_is_hot()), and stops
+ * reading altogether once "background-output-backlog" rows were output.
+ * Reading resumes at full speed when @screen goes back to the foreground.
+ */
+void
+terminal_screen_set_background (TerminalScreen *screen,
+                                gboolean background)
+{
+  TerminalScreenPrivate *priv;
+  GSettings *settings;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  background = background != FALSE;
+  if (priv->background == background)
+    return;
+
+  priv->background = background;
+  if (!background) {
+    background_throttle_stop (screen);
+    return;
+  }
+
+  settings = terminal_app_get_global_settings (terminal_app_get ());
+  priv->throttle_background = g_settings_get_boolean (settings, TERMINAL_SETTING_THROTTLE_BACKGROUND_OUTPUT_KEY);
+  priv->background_backlog = g_settings_get_uint (settings, TERMINAL_SETTING_BACKGROUND_OUTPUT_BACKLOG_KEY);
+  vte_terminal_get_cursor_position (VTE_TERMINAL (screen), NULL, &priv->background_start_row);
+}
+
+const char*
+terminal_screen_get_title (TerminalScreen *screen)
+{
+  return vte_terminal_get_window_title (VTE_TERMINAL (screen));
+}
+
+const char*
+terminal_screen_get_icon_title (TerminalScreen *screen)
+{
+  return vte_terminal_get_icon_title (VTE_TERMINAL (screen));
+}
+
+gboolean
+terminal_screen_get_icon_title_set (TerminalScreen *screen)
+{
+  return vte_terminal_get_icon_title (VTE_TERMINAL (screen)) != NULL;
+}
+
+/* Profile change dispatch
+ *
+ * Each profile has a single "changed" handler, which maps the key to the
+ * part of the screens that needs updating and accumulates these in a mask.
+ * The mask is applied to all the profile's screens once per frame, so that
+ * bursts of changes (e.g. switching colour schemes, which changes a dozen
+ * keys at once) only update every screen once.
+ */
+
+enum {
+  PROFILE_UPDATE_SCROLLBAR           = 1 << 0,
+  PROFILE_UPDATE_ENCODING            = 1 << 1,
+  PROFILE_UPDATE_CJK_WIDTH           = 1 << 2,
+  PROFILE_UPDATE_FONT                = 1 << 3,
+  PROFILE_UPDATE_COLORS              = 1 << 4,
+  PROFILE_UPDATE_AUDIBLE_BELL        = 1 << 5,
+  PROFILE_UPDATE_SCROLL_ON_KEYSTROKE = 1 << 6,
+  PROFILE_UPDATE_SCROLL_ON_OUTPUT    = 1 << 7,
+  PROFILE_UPDATE_SCROLLBACK          = 1 << 8,
+  PROFILE_UPDATE_BACKSPACE           = 1 << 9,
+  PROFILE_UPDATE_DELETE              = 1 << 10,
+  PROFILE_UPDATE_ALLOW_BOLD          = 1 << 11,
+  PROFILE_UPDATE_BOLD_IS_BRIGHT      = 1 << 12,
+  PROFILE_UPDATE_CURSOR_BLINK        = 1 << 13,
+  PROFILE_UPDATE_CURSOR_SHAPE        = 1 << 14,
+  PROFILE_UPDATE_REWRAP              = 1 << 15,
+  PROFILE_UPDATE_TEXT_BLINK          = 1 << 16,
+  PROFILE_UPDATE_WORD_CHARS          = 1 << 17,
+
+  PROFILE_UPDATE_ALL                 = (1 << 18) - 1
+};
+
+static const struct {
+  const char *key;
+  guint update;
+} profile_update_keys[] = {
+  { TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY,             PROFILE_UPDATE_SCROLLBAR },
+  { TERMINAL_PROFILE_ENCODING_KEY,                     PROFILE_UPDATE_ENCODING },
+  { TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY,     PROFILE_UPDATE_CJK_WIDTH },
+  { TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY,              PROFILE_UPDATE_FONT },
+  { TERMINAL_PROFILE_FONT_KEY,                         PROFILE_UPDATE_FONT },
+  { TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY,             PROFILE_UPDATE_FONT },
+  { TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY,            PROFILE_UPDATE_FONT },
+  { TERMINAL_PROFILE_USE_THEME_COLORS_KEY,             PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_FOREGROUND_COLOR_KEY,             PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,             PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY,        PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_BOLD_COLOR_KEY,                   PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY,            PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY,      PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY,      PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY,         PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY,   PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY,   PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_PALETTE_KEY,                      PROFILE_UPDATE_COLORS },
+  { TERMINAL_PROFILE_AUDIBLE_BELL_KEY,                 PROFILE_UPDATE_AUDIBLE_BELL },
+  { TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY,          PROFILE_UPDATE_SCROLL_ON_KEYSTROKE },
+  { TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY,             PROFILE_UPDATE_SCROLL_ON_OUTPUT },
+  { TERMINAL_PROFILE_SCROLLBACK_LINES_KEY,             PROFILE_UPDATE_SCROLLBACK },
+  { TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY,         PROFILE_UPDATE_SCROLLBACK },
+  { TERMINAL_PROFILE_BACKSPACE_BINDING_KEY,            PROFILE_UPDATE_BACKSPACE },
+  { TERMINAL_PROFILE_DELETE_BINDING_KEY,               PROFILE_UPDATE_DELETE },
+  { TERMINAL_PROFILE_ALLOW_BOLD_KEY,                   PROFILE_UPDATE_ALLOW_BOLD },
+  { TERMINAL_PROFILE_BOLD_IS_BRIGHT_KEY,               PROFILE_UPDATE_BOLD_IS_BRIGHT },
+  { TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY,            PROFILE_UPDATE_CURSOR_BLINK },
+  { TERMINAL_PROFILE_CURSOR_SHAPE_KEY,                 PROFILE_UPDATE_CURSOR_SHAPE },
+  { TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY,             PROFILE_UPDATE_REWRAP },
+  { TERMINAL_PROFILE_TEXT_BLINK_MODE_KEY,              PROFILE_UPDATE_TEXT_BLINK },
+  { TERMINAL_PROFILE_WORD_CHAR_EXCEPTIONS_KEY,         PROFILE_UPDATE_WORD_CHARS },
+};
+
+/* Maps the interned key name to its update bit */
+static guint
+profile_update_for_key (const char *key)
+{
+  static GHashTable *keys = NULL;
+
+  if (G_UNLIKELY (keys == NULL)) {
+    guint i;
+
+    keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+    for (i = 0; i < G_N_ELEMENTS (profile_update_keys); i++)
+      g_hash_table_insert (keys,
+                           (gpointer) I_(profile_update_keys[i].key),
+                           GUINT_TO_POINTER (profile_update_keys[i].update));
+  }
+
+  return GPOINTER_TO_UINT (g_hash_table_lookup (keys, key));
+}
+
+static void
+terminal_screen_apply_profile_updates (TerminalScreen *screen,
+                                       guint           mask)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  GObject *object = G_OBJECT (screen);
+  VteTerminal *vte_terminal = VTE_TERMINAL (screen);
+  TerminalWindow *window;
+
+  g_object_freeze_notify (object);
+
+  if ((window = terminal_screen_get_window (screen)))
+    {
+      /* We need these in line for the set_size in
        * update_on_realize
        */
       terminal_window_update_geometry (window);
     }
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY))
+  if (mask & PROFILE_UPDATE_SCROLLBAR)
     _terminal_screen_update_scrollbar (screen);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ENCODING_KEY))
+  if (mask & PROFILE_UPDATE_ENCODING)
     {
       gs_free char *charset = g_settings_get_string (profile, TERMINAL_PROFILE_ENCODING_KEY);
       g_warn_if_fail (terminal_encodings_is_known_charset (charset));
       vte_terminal_set_encoding (vte_terminal, charset, NULL);
     }
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CJK_UTF8_AMBIGUOUS_WIDTH_KEY))
+  if (mask & PROFILE_UPDATE_CJK_WIDTH)
     {
       TerminalCJKWidth width;
 
@@ -812,79 +1675,56 @@ terminal_screen_profile_changed_cb (GSettings     *profile,
       vte_terminal_set_cjk_ambiguous_width (vte_terminal, (int) width);
     }
 
-  if (gtk_widget_get_realized (GTK_WIDGET (screen)) &&
-      (!prop_name ||
-       prop_name == I_(TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY) ||
-       prop_name == I_(TERMINAL_PROFILE_FONT_KEY) ||
-       prop_name == I_(TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY) ||
-       prop_name == I_(TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY)))
+  if ((mask & PROFILE_UPDATE_FONT) && gtk_widget_get_realized (GTK_WIDGET (screen)))
     terminal_screen_set_font (screen);
 
-  if (!prop_name ||
-      prop_name == I_(TERMINAL_PROFILE_USE_THEME_COLORS_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_FOREGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BACKGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_PALETTE_KEY))
+  if (mask & PROFILE_UPDATE_COLORS)
     update_color_scheme (screen);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_AUDIBLE_BELL_KEY))
+  if (mask & PROFILE_UPDATE_AUDIBLE_BELL)
       vte_terminal_set_audible_bell (vte_terminal, g_settings_get_boolean (profile, TERMINAL_PROFILE_AUDIBLE_BELL_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY))
+  if (mask & PROFILE_UPDATE_SCROLL_ON_KEYSTROKE)
     vte_terminal_set_scroll_on_keystroke (vte_terminal,
                                           g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY));
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY))
+  if (mask & PROFILE_UPDATE_SCROLL_ON_OUTPUT)
     vte_terminal_set_scroll_on_output (vte_terminal,
                                        g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY));
-  if (!prop_name ||
-      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_LINES_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY))
-    {
-      glong lines = g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY) ?
-		    -1 : g_settings_get_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY);
-      vte_terminal_set_scrollback_lines (vte_terminal, lines);
-    }
+  if (mask & PROFILE_UPDATE_SCROLLBACK)
+    update_scrollback_lines (screen);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BACKSPACE_BINDING_KEY))
+  if (mask & PROFILE_UPDATE_BACKSPACE)
   vte_terminal_set_backspace_binding (vte_terminal,
                                       g_settings_get_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY));
   
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_DELETE_BINDING_KEY))
+  if (mask & PROFILE_UPDATE_DELETE)
   vte_terminal_set_delete_binding (vte_terminal,
                                    g_settings_get_enum (profile, TERMINAL_PROFILE_DELETE_BINDING_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ALLOW_BOLD_KEY))
+  if (mask & PROFILE_UPDATE_ALLOW_BOLD)
     vte_terminal_set_allow_bold (vte_terminal,
                                  g_settings_get_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD_KEY));
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BOLD_IS_BRIGHT_KEY))
+  if (mask & PROFILE_UPDATE_BOLD_IS_BRIGHT)
     vte_terminal_set_bold_is_bright (vte_terminal,
                                      g_settings_get_boolean (profile, TERMINAL_PROFILE_BOLD_IS_BRIGHT_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY))
+  if (mask & PROFILE_UPDATE_CURSOR_BLINK)
     vte_terminal_set_cursor_blink_mode (vte_terminal,
                                         g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_SHAPE_KEY))
+  if (mask & PROFILE_UPDATE_CURSOR_SHAPE)
     vte_terminal_set_cursor_shape (vte_terminal,
                                    g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_SHAPE_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY))
+  if (mask & PROFILE_UPDATE_REWRAP)
     vte_terminal_set_rewrap_on_resize (vte_terminal,
                                        g_settings_get_boolean (profile, TERMINAL_PROFILE_REWRAP_ON_RESIZE_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_TEXT_BLINK_MODE_KEY))
+  if (mask & PROFILE_UPDATE_TEXT_BLINK)
     vte_terminal_set_text_blink_mode (vte_terminal,
                                       g_settings_get_enum (profile, TERMINAL_PROFILE_TEXT_BLINK_MODE_KEY));
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_WORD_CHAR_EXCEPTIONS_KEY))
+  if (mask & PROFILE_UPDATE_WORD_CHARS)
     {
       gs_free char *word_char_exceptions;
       g_settings_get (profile, TERMINAL_PROFILE_WORD_CHAR_EXCEPTIONS_KEY, "ms", &word_char_exceptions);
@@ -895,79 +1735,70 @@ terminal_screen_profile_changed_cb (GSettings     *profile,
 }
 
 static void
-update_color_scheme (TerminalScreen *screen)
+update_scrollback_lines (TerminalScreen *screen)
 {
-  GtkWidget *widget = GTK_WIDGET (screen);
-  TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
-  gs_free GdkRGBA *colors;
-  gsize n_colors;
-  GdkRGBA fg, bg, bold, theme_fg, theme_bg;
-  GdkRGBA cursor_bg, cursor_fg;
-  GdkRGBA highlight_bg, highlight_fg;
-  GdkRGBA *boldp;
-  GdkRGBA *cursor_bgp = NULL, *cursor_fgp = NULL;
-  GdkRGBA *highlight_bgp = NULL, *highlight_fgp = NULL;
-  GtkStyleContext *context;
-  gboolean use_theme_colors;
+  GSettings *profile = screen->priv->profile;
+  glong lines = g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY) ?
+                -1 : g_settings_get_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY);
 
-  context = gtk_widget_get_style_context (widget);
-  gtk_style_context_get_color (context, gtk_style_context_get_state (context), &theme_fg);
-  gtk_style_context_get_background_color (context, gtk_style_context_get_state (context), &theme_bg);
-
-  use_theme_colors = g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY);
-  if (use_theme_colors ||
-      (!terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &fg) ||
-       !terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &bg)))
-    {
-      fg = theme_fg;
-      bg = theme_bg;
-    }
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), lines);
+}
 
-  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) &&
-      !use_theme_colors &&
-      terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BOLD_COLOR_KEY, &bold))
-    boldp = &bold;
-  else
-    boldp = NULL;
+/* Per-profile data
+ *
+ * All screens using a profile share its resolved font and its parsed
+ * colours, so that changing the font, the system font or a colour only
+ * resolves it once per profile; and the profile's change notifications
+ * are dispatched from here, see above.
+ *
+ * The colours are kept in an immutable, refcounted block, rebuilt
+ * lazily whenever the profile's colours generation is bumped; each
+ * screen keeps a ref to the block it last applied, so it can tell
+ * cheaply whether there is anything to apply.
+ */
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY) &&
-      !use_theme_colors)
-    {
-      if (terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY, &cursor_bg))
-        cursor_bgp = &cursor_bg;
-      if (terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY, &cursor_fg))
-        cursor_fgp = &cursor_fg;
-    }
+struct _ProfileColors {
+  int ref_count;
+  guint generation;
+  gboolean use_theme_colors;
+  gboolean fg_bg_set;
+  GdkRGBA fg, bg;
+  gboolean bold_set;
+  GdkRGBA bold;
+  gboolean cursor_bg_set, cursor_fg_set;
+  GdkRGBA cursor_bg, cursor_fg;
+  gboolean highlight_bg_set, highlight_fg_set;
+  GdkRGBA highlight_bg, highlight_fg;
+  GdkRGBA *palette;
+  gsize n_palette;
+};
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY) &&
-      !use_theme_colors)
-    {
-      if (terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY, &highlight_bg))
-        highlight_bgp = &highlight_bg;
-      if (terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY, &highlight_fg))
-        highlight_fgp = &highlight_fg;
-    }
+#define PROFILE_UPDATE_DELAY (16 /* ms, about a frame */)
 
-  colors = terminal_g_settings_get_rgba_palette (priv->profile, TERMINAL_PROFILE_PALETTE_KEY, &n_colors);
-  vte_terminal_set_colors (VTE_TERMINAL (screen), &fg, &bg,
-                           colors, n_colors);
-  vte_terminal_set_color_bold (VTE_TERMINAL (screen), boldp);
-  vte_terminal_set_color_cursor (VTE_TERMINAL (screen), cursor_bgp);
-  vte_terminal_set_color_cursor_foreground (VTE_TERMINAL (screen), cursor_fgp);
-  vte_terminal_set_color_highlight (VTE_TERMINAL (screen), highlight_bgp);
-  vte_terminal_set_color_highlight_foreground (VTE_TERMINAL (screen), highlight_fgp);
-}
+typedef struct {
+  GSettings *profile; /* unowned */
+  PangoFontDescription *font_desc;
+  double cell_width_scale;
+  double cell_height_scale;
+  gboolean use_system_font;
+  GSList *screens; /* unowned */
+  guint pending_updates;
+  guint dispatch_source_id;
+  guint colors_generation;
+  ProfileColors *colors; /* built for colors_generation, or NULL */
+} ProfileData;
+
+static GSList *profile_data_list; /* unowned */
 
 static void
-terminal_screen_set_font (TerminalScreen *screen)
+profile_data_resolve (ProfileData *pd)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
+  GSettings *profile = pd->profile;
   PangoFontDescription *desc;
   int size;
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
+  pd->use_system_font = g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY);
+  if (pd->use_system_font)
     {
       desc = terminal_app_get_system_font (terminal_app_get ());
     }
@@ -987,153 +1818,395 @@ terminal_screen_set_font (TerminalScreen *screen)
       pango_font_description_set_size (desc, 10);
   }
 
-  vte_terminal_set_font (VTE_TERMINAL (screen), desc);
+  if (pd->font_desc)
+    pango_font_description_free (pd->font_desc);
+  pd->font_desc = desc;
 
-  pango_font_description_free (desc);
+  pd->cell_width_scale = g_settings_get_double (profile, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY);
+  pd->cell_height_scale = g_settings_get_double (profile, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY);
+}
 
-  vte_terminal_set_cell_width_scale (VTE_TERMINAL (screen),
-                                     g_settings_get_double (profile, TERMINAL_PROFILE_CELL_WIDTH_SCALE_KEY));
-  vte_terminal_set_cell_height_scale (VTE_TERMINAL (screen),
-                                      g_settings_get_double (profile, TERMINAL_PROFILE_CELL_HEIGHT_SCALE_KEY));
+static ProfileColors *
+profile_colors_ref (ProfileColors *colors)
+{
+  colors->ref_count++;
+  return colors;
 }
 
 static void
-terminal_screen_system_font_changed_cb (GSettings      *settings,
-                                        const char     *key,
-                                        TerminalScreen *screen)
+profile_colors_unref (ProfileColors *colors)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-
-  if (!gtk_widget_get_realized (GTK_WIDGET (screen)))
+  if (--colors->ref_count > 0)
     return;
 
-  if (!g_settings_get_boolean (priv->profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
-    return;
-
-  terminal_screen_set_font (screen);
+  g_free (colors->palette);
+  g_slice_free (ProfileColors, colors);
 }
 
-void
-terminal_screen_set_profile (TerminalScreen *screen,
-                             GSettings *profile)
+static ProfileColors *
+profile_colors_new (GSettings *profile,
+                    guint generation)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSettings*old_profile;
+  ProfileColors *colors;
+  gboolean use_theme_colors;
 
-  old_profile = priv->profile;
-  if (profile == old_profile)
-    return;
+  colors = g_slice_new0 (ProfileColors);
+  colors->ref_count = 1;
+  colors->generation = generation;
 
-  if (priv->profile_changed_id)
+  colors->use_theme_colors = use_theme_colors =
+    g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY);
+  colors->fg_bg_set =
+    !use_theme_colors &&
+    terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &colors->fg) &&
+    terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &colors->bg);
+
+  colors->bold_set =
+    !g_settings_get_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) &&
+    !use_theme_colors &&
+    terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BOLD_COLOR_KEY, &colors->bold);
+
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_CURSOR_COLORS_SET_KEY) &&
+      !use_theme_colors)
     {
-      g_signal_handler_disconnect (G_OBJECT (priv->profile),
-                                   priv->profile_changed_id);
-      priv->profile_changed_id = 0;
+      colors->cursor_bg_set = terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_CURSOR_BACKGROUND_COLOR_KEY, &colors->cursor_bg);
+      colors->cursor_fg_set = terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_CURSOR_FOREGROUND_COLOR_KEY, &colors->cursor_fg);
     }
 
-  priv->profile = profile;
-  if (profile)
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_HIGHLIGHT_COLORS_SET_KEY) &&
+      !use_theme_colors)
     {
-      g_object_ref (profile);
-      priv->profile_changed_id =
-        g_signal_connect (profile, "changed",
-                          G_CALLBACK (terminal_screen_profile_changed_cb),
-                          screen);
-      terminal_screen_profile_changed_cb (profile, NULL, screen);
-
-      g_signal_emit (G_OBJECT (screen), signals[PROFILE_SET], 0, old_profile);
+      colors->highlight_bg_set = terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_HIGHLIGHT_BACKGROUND_COLOR_KEY, &colors->highlight_bg);
+      colors->highlight_fg_set = terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_HIGHLIGHT_FOREGROUND_COLOR_KEY, &colors->highlight_fg);
     }
 
-  if (old_profile)
-    g_object_unref (old_profile);
+  colors->palette = terminal_g_settings_get_rgba_palette (profile, TERMINAL_PROFILE_PALETTE_KEY, &colors->n_palette);
 
-  g_object_notify (G_OBJECT (screen), "profile");
+  return colors;
 }
 
-GSettings*
-terminal_screen_get_profile (TerminalScreen *screen)
+static gboolean
+profile_data_dispatch_cb (ProfileData *pd)
 {
-  TerminalScreenPrivate *priv = screen->priv;
+  guint mask = pd->pending_updates;
+  GSList *l;
 
-  return priv->profile;
+  pd->dispatch_source_id = 0;
+  pd->pending_updates = 0;
+
+  if (mask & PROFILE_UPDATE_FONT)
+    profile_data_resolve (pd);
+  if (mask & PROFILE_UPDATE_COLORS)
+    pd->colors_generation++;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+                         "Applying profile updates %x to %u screens\n",
+                         mask, g_slist_length (pd->screens));
+
+  for (l = pd->screens; l != NULL; l = l->next)
+    terminal_screen_apply_profile_updates (l->data, mask);
+
+  return G_SOURCE_REMOVE;
 }
 
-GSettings*
-terminal_screen_ref_profile (TerminalScreen *screen)
+static void
+profile_data_queue_updates (ProfileData *pd,
+                            guint mask)
 {
-  TerminalScreenPrivate *priv = screen->priv;
+  pd->pending_updates |= mask;
 
-  if (priv->profile != NULL)
-    return g_object_ref (priv->profile);
-  return NULL;
+  if (pd->dispatch_source_id != 0)
+    return;
+
+  pd->dispatch_source_id = _terminal_watchdog_timeout_add (PROFILE_UPDATE_DELAY, "profile update",
+                                                           (GSourceFunc) profile_data_dispatch_cb,
+                                                           pd);
 }
 
 static void
-terminal_screen_set_override_command (TerminalScreen *screen,
-                                      char          **argv,
-                                      gboolean        shell)
+profile_data_changed_cb (GSettings *profile,
+                         const char *prop_name,
+                         ProfileData *pd)
 {
-  TerminalScreenPrivate *priv;
+  guint mask;
 
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
-
-  priv = screen->priv;
-  g_strfreev (priv->override_command);
-  if (argv)
-    priv->override_command = g_strdupv (argv);
-  else
-    priv->override_command = NULL;
-  priv->shell = shell;
+  mask = profile_update_for_key (prop_name);
+  if (mask != 0)
+    profile_data_queue_updates (pd, mask);
 }
 
-void
-terminal_screen_set_initial_environment (TerminalScreen *screen,
-                                         char          **argv)
+static void
+profile_data_system_font_changed_cb (GSettings *settings,
+                                     const char *key,
+                                     gpointer user_data)
 {
-  TerminalScreenPrivate *priv;
+  GSList *l;
 
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  for (l = profile_data_list; l != NULL; l = l->next) {
+    ProfileData *pd = l->data;
 
-  priv = screen->priv;
-  g_assert (priv->initial_env == NULL);
-  priv->initial_env = g_strdupv (argv);
+    if (pd->use_system_font)
+      profile_data_queue_updates (pd, PROFILE_UPDATE_FONT);
+  }
 }
 
-char**
-terminal_screen_get_initial_environment (TerminalScreen *screen)
+static void
+profile_data_free (ProfileData *pd)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  profile_data_list = g_slist_remove (profile_data_list, pd);
 
-  return screen->priv->initial_env;
+  if (pd->dispatch_source_id != 0)
+    g_source_remove (pd->dispatch_source_id);
+
+  if (pd->font_desc)
+    pango_font_description_free (pd->font_desc);
+  if (pd->colors)
+    profile_colors_unref (pd->colors);
+  g_slist_free (pd->screens);
+  g_slice_free (ProfileData, pd);
 }
 
-static gboolean
-get_child_command (TerminalScreen *screen,
-                   const char     *shell_env,
-                   GSpawnFlags    *spawn_flags_p,
-                   char         ***argv_p,
-                   GError        **err)
+static ProfileData *
+profile_data_get (GSettings *profile)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
-  char **argv;
+  static gboolean system_font_monitored = FALSE;
+  ProfileData *pd;
+
+  pd = g_object_get_data (G_OBJECT (profile), "terminal-profile-data");
+  if (pd != NULL)
+    return pd;
+
+  if (!system_font_monitored) {
+    g_signal_connect (terminal_app_get_desktop_interface_settings (terminal_app_get ()),
+                      "changed::" MONOSPACE_FONT_KEY_NAME,
+                      G_CALLBACK (profile_data_system_font_changed_cb),
+                      NULL);
+    system_font_monitored = TRUE;
+  }
 
-  g_assert (spawn_flags_p != NULL && argv_p != NULL);
+  pd = g_slice_new0 (ProfileData);
+  pd->profile = profile;
+  profile_data_resolve (pd);
 
-  *argv_p = argv = NULL;
+  /* The profile owns it, so the handler goes away together with it */
+  g_object_set_data_full (G_OBJECT (profile), "terminal-profile-data",
+                          pd, (GDestroyNotify) profile_data_free);
+  g_signal_connect (profile, "changed",
+                    G_CALLBACK (profile_data_changed_cb), pd);
+  profile_data_list = g_slist_prepend (profile_data_list, pd);
 
-  if (priv->override_command)
-    {
-      argv = g_strdupv (priv->override_command);
+  return pd;
+}
 
-      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
-    }
-  else if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY))
-    {
-      gs_free char *argv_str;
+static ProfileColors *
+profile_data_get_colors (ProfileData *pd)
+{
+  if (pd->colors != NULL && pd->colors->generation == pd->colors_generation)
+    return pd->colors;
 
-      argv_str = g_settings_get_string (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY);
-      if (!g_shell_parse_argv (argv_str, NULL, &argv, err))
+  if (pd->colors)
+    profile_colors_unref (pd->colors);
+  pd->colors = profile_colors_new (pd->profile, pd->colors_generation);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROFILE,
+                         "Parsed colours of generation %u\n",
+                         pd->colors_generation);
+
+  return pd->colors;
+}
+
+static void
+terminal_screen_set_font (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  ProfileData *pd;
+
+  if (terminal_screen_defer_style (screen))
+    return;
+
+  pd = profile_data_get (priv->profile);
+
+  vte_terminal_set_font (VTE_TERMINAL (screen), pd->font_desc);
+  vte_terminal_set_cell_width_scale (VTE_TERMINAL (screen), pd->cell_width_scale);
+  vte_terminal_set_cell_height_scale (VTE_TERMINAL (screen), pd->cell_height_scale);
+}
+
+static void
+update_color_scheme (TerminalScreen *screen)
+{
+  GtkWidget *widget = GTK_WIDGET (screen);
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *vte_terminal = VTE_TERMINAL (screen);
+  ProfileColors *colors;
+  GdkRGBA theme_fg, theme_bg;
+  const GdkRGBA *fg, *bg;
+  GtkStyleContext *context;
+
+  if (terminal_screen_defer_style (screen))
+    return;
+
+  context = gtk_widget_get_style_context (widget);
+  gtk_style_context_get_color (context, gtk_style_context_get_state (context), &theme_fg);
+  gtk_style_context_get_background_color (context, gtk_style_context_get_state (context), &theme_bg);
+
+  colors = profile_data_get_colors (profile_data_get (priv->profile));
+
+  /* Nothing to do if neither the profile's colours nor the theme changed */
+  if (colors == priv->colors &&
+      priv->theme_colors_valid &&
+      gdk_rgba_equal (&theme_fg, &priv->theme_fg) &&
+      gdk_rgba_equal (&theme_bg, &priv->theme_bg))
+    return;
+
+  priv->theme_fg = theme_fg;
+  priv->theme_bg = theme_bg;
+  priv->theme_colors_valid = TRUE;
+
+  profile_colors_ref (colors);
+  if (priv->colors)
+    profile_colors_unref (priv->colors);
+  priv->colors = colors;
+
+  if (colors->fg_bg_set)
+    {
+      fg = &colors->fg;
+      bg = &colors->bg;
+    }
+  else
+    {
+      fg = &theme_fg;
+      bg = &theme_bg;
+    }
+
+  vte_terminal_set_colors (vte_terminal, fg, bg,
+                           colors->palette, colors->n_palette);
+  vte_terminal_set_color_bold (vte_terminal, colors->bold_set ? &colors->bold : NULL);
+  vte_terminal_set_color_cursor (vte_terminal, colors->cursor_bg_set ? &colors->cursor_bg : NULL);
+  vte_terminal_set_color_cursor_foreground (vte_terminal, colors->cursor_fg_set ? &colors->cursor_fg : NULL);
+  vte_terminal_set_color_highlight (vte_terminal, colors->highlight_bg_set ? &colors->highlight_bg : NULL);
+  vte_terminal_set_color_highlight_foreground (vte_terminal, colors->highlight_fg_set ? &colors->highlight_fg : NULL);
+}
+
+void
+terminal_screen_set_profile (TerminalScreen *screen,
+                             GSettings *profile)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings*old_profile;
+
+  old_profile = priv->profile;
+  if (profile == old_profile)
+    return;
+
+  if (old_profile)
+    {
+      ProfileData *pd = profile_data_get (old_profile);
+      pd->screens = g_slist_remove (pd->screens, screen);
+    }
+
+  priv->profile = profile;
+  if (profile)
+    {
+      ProfileData *pd = profile_data_get (profile);
+      pd->screens = g_slist_prepend (pd->screens, screen);
+
+      g_object_ref (profile);
+      terminal_screen_apply_profile_updates (screen, PROFILE_UPDATE_ALL);
+
+      g_signal_emit (G_OBJECT (screen), signals[PROFILE_SET], 0, old_profile);
+    }
+
+  if (old_profile)
+    g_object_unref (old_profile);
+
+  terminal_app_mark_session_dirty (terminal_app_get ());
+  g_object_notify (G_OBJECT (screen), "profile");
+}
+
+GSettings*
+terminal_screen_get_profile (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  return priv->profile;
+}
+
+GSettings*
+terminal_screen_ref_profile (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (priv->profile != NULL)
+    return g_object_ref (priv->profile);
+  return NULL;
+}
+
+static void
+terminal_screen_set_override_command (TerminalScreen *screen,
+                                      char          **argv,
+                                      gboolean        shell)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  g_strfreev (priv->override_command);
+  if (argv)
+    priv->override_command = g_strdupv (argv);
+  else
+    priv->override_command = NULL;
+  priv->shell = shell;
+}
+
+void
+terminal_screen_set_initial_environment (TerminalScreen *screen,
+                                         char          **argv)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  g_assert (priv->initial_env == NULL);
+  priv->initial_env = terminal_app_intern_environment (terminal_app_get (), argv);
+}
+
+char**
+terminal_screen_get_initial_environment (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+
+  return screen->priv->initial_env;
+}
+
+static gboolean
+get_child_command (TerminalScreen *screen,
+                   const char     *shell_env,
+                   GSpawnFlags    *spawn_flags_p,
+                   char         ***argv_p,
+                   GError        **err)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  char **argv;
+
+  g_assert (spawn_flags_p != NULL && argv_p != NULL);
+
+  *argv_p = argv = NULL;
+
+  if (priv->override_command)
+    {
+      argv = g_strdupv (priv->override_command);
+
+      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
+    }
+  else if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY))
+    {
+      gs_free char *argv_str;
+
+      argv_str = g_settings_get_string (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY);
+      if (!g_shell_parse_argv (argv_str, NULL, &argv, err))
         return FALSE;
 
       *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
@@ -1178,32 +2251,65 @@ get_child_command (TerminalScreen *screen,
   return TRUE;
 }
 
-static char**
-get_child_environment (TerminalScreen *screen,
-                       const char *cwd,
-                       char **shell)
+/* The environment only differs in the per-screen variables between
+ * screens created with the same initial environment, e.g. when a
+ * client opens many tabs at once; so cache the rest of it.
+ */
+static struct {
+  char **initial_env;
+  guint proxy_env_serial;
+  char **base_env; /* without PWD and TERMINAL_ENV_SCREEN */
+  char *shell;
+  gboolean valid;
+} child_env_cache;
+
+static gboolean
+initial_env_equal (char **a,
+                   char **b)
+{
+  guint i;
+
+  if (a == b) /* the same shared copy */
+    return TRUE;
+  if (a == NULL || b == NULL)
+    return FALSE;
+
+  for (i = 0; a[i] != NULL && b[i] != NULL; i++)
+    if (!g_str_equal (a[i], b[i]))
+      return FALSE;
+
+  return a[i] == NULL && b[i] == NULL;
+}
+
+static void
+update_child_env_cache (char **initial_env)
 {
   TerminalApp *app = terminal_app_get ();
-  TerminalScreenPrivate *priv = screen->priv;
-  char **env;
   char *e, *v;
   GHashTable *env_table;
   GHashTableIter iter;
-  GPtrArray *retval;
+  GPtrArray *base_env;
   guint i;
 
+  if (child_env_cache.valid &&
+      child_env_cache.proxy_env_serial == terminal_util_get_proxy_env_serial () &&
+      initial_env_equal (child_env_cache.initial_env, initial_env))
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Computing the base child environment\n");
+
   env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
-  env = priv->initial_env;
-  if (env)
+  if (initial_env)
     {
-      for (i = 0; env[i]; ++i)
+      for (i = 0; initial_env[i]; ++i)
         {
-          v = strchr (env[i], '=');
+          v = strchr (initial_env[i], '=');
           if (v)
-             g_hash_table_replace (env_table, g_strndup (env[i], v - env[i]), g_strdup (v + 1));
+             g_hash_table_replace (env_table, g_strndup (initial_env[i], v - initial_env[i]), g_strdup (v + 1));
            else
-             g_hash_table_replace (env_table, g_strdup (env[i]), NULL);
+             g_hash_table_replace (env_table, g_strdup (initial_env[i]), NULL);
         }
     }
 
@@ -1222,12 +2328,14 @@ get_child_environment (TerminalScreen *screen,
    */
   g_hash_table_remove (env_table, "WINDOWID");
 
-  /* We need to put the working directory also in PWD, so that
-   * e.g. bash starts in the right directory if @cwd is a symlink.
-   * See bug #502146.
-   */
-  g_hash_table_replace (env_table, g_strdup ("PWD"), g_strdup (cwd));
+  /* PWD and TERMINAL_ENV_SCREEN are per screen, see get_child_environment() */
+  g_hash_table_remove (env_table, "PWD");
+  g_hash_table_remove (env_table, TERMINAL_ENV_SCREEN);
 
+  /* Read the serial before, so a change while we're adding the variables
+   * makes the next call recompute them.
+   */
+  child_env_cache.proxy_env_serial = terminal_util_get_proxy_env_serial ();
   terminal_util_add_proxy_env (env_table);
 
   /* Add gnome-terminal private env vars used to communicate back to g-t-server */
@@ -1235,25 +2343,61 @@ get_child_environment (TerminalScreen *screen,
   g_hash_table_replace (env_table, g_strdup (TERMINAL_ENV_SERVICE_NAME),
                         g_strdup (g_dbus_connection_get_unique_name (connection)));
 
-  g_hash_table_replace (env_table, g_strdup (TERMINAL_ENV_SCREEN),
-                        terminal_app_dup_screen_object_path (app, screen));
-
   /* Convert to strv */
-  retval = g_ptr_array_sized_new (g_hash_table_size (env_table));
+  base_env = g_ptr_array_sized_new (g_hash_table_size (env_table) + 1);
   g_hash_table_iter_init (&iter, env_table);
   while (g_hash_table_iter_next (&iter, (gpointer *) &e, (gpointer *) &v))
-    g_ptr_array_add (retval, g_strdup_printf ("%s=%s", e, v ? v : ""));
-  g_ptr_array_add (retval, NULL);
+    g_ptr_array_add (base_env, g_strdup_printf ("%s=%s", e, v ? v : ""));
+  g_ptr_array_add (base_env, NULL);
 
-  *shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
+  terminal_app_release_environment (app, child_env_cache.initial_env);
+  child_env_cache.initial_env = terminal_app_intern_environment (app, initial_env);
+  g_strfreev (child_env_cache.base_env);
+  child_env_cache.base_env = (char **) g_ptr_array_free (base_env, FALSE);
+  g_free (child_env_cache.shell);
+  child_env_cache.shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
+  child_env_cache.valid = TRUE;
 
   g_hash_table_destroy (env_table);
+}
+
+static char**
+get_child_environment (TerminalScreen *screen,
+                       const char *cwd,
+                       char **shell)
+{
+  TerminalApp *app = terminal_app_get ();
+  TerminalScreenPrivate *priv = screen->priv;
+  GPtrArray *retval;
+  guint i, n;
+
+  update_child_env_cache (priv->initial_env);
+
+  n = g_strv_length (child_env_cache.base_env);
+  retval = g_ptr_array_sized_new (n + 3);
+  for (i = 0; i < n; i++)
+    g_ptr_array_add (retval, g_strdup (child_env_cache.base_env[i]));
+
+  /* We need to put the working directory also in PWD, so that
+   * e.g. bash starts in the right directory if @cwd is a symlink.
+   * See bug #502146.
+   */
+  g_ptr_array_add (retval, g_strdup_printf ("PWD=%s", cwd));
+
+  gs_free char *object_path = terminal_app_dup_screen_object_path (app, screen);
+  g_ptr_array_add (retval, g_strdup_printf ("%s=%s", TERMINAL_ENV_SCREEN, object_path));
+  g_ptr_array_add (retval, NULL);
+
+  *shell = g_strdup (child_env_cache.shell);
+
   return (char **) g_ptr_array_free (retval, FALSE);
 }
 
 enum {
   RESPONSE_RELAUNCH,
-  RESPONSE_EDIT_PROFILE
+  RESPONSE_EDIT_PROFILE,
+  RESPONSE_SHOW_HIBERNATED,
+  RESPONSE_CANCEL_PASTE
 };
 
 static void
@@ -1277,6 +2421,18 @@ info_bar_response_cb (GtkWidget *info_bar,
                                  terminal_screen_get_profile (screen),
                                  "custom-command-entry");
       break;
+    case RESPONSE_SHOW_HIBERNATED: {
+      gs_free char *uri = g_file_get_uri (screen->priv->hibernate_file);
+
+      gtk_widget_destroy (info_bar);
+      terminal_util_open_url (gtk_widget_get_toplevel (GTK_WIDGET (screen)),
+                              uri, FLAVOR_AS_IS,
+                              gtk_get_current_event_time ());
+      break;
+    }
+    case RESPONSE_CANCEL_PASTE:
+      terminal_screen_cancel_paste (screen);
+      break;
     default:
       gtk_widget_destroy (info_bar);
       break;
@@ -1290,6 +2446,7 @@ free_fd_setup_data (FDSetupData *data)
     return;
 
   g_free (data->fd_list);
+  g_free (data->steps);
   g_free (data);
 }
 
@@ -1297,73 +2454,79 @@ static void
 terminal_screen_child_setup (FDSetupData *data)
 {
   int *fds = data->fd_list;
-  int n_fds = data->fd_list_len;
-  const int *fd_array = data->fd_array;
-  gsize fd_array_len = data->fd_array_len;
-  gsize i;
+  guint i;
 
   /* At this point, vte_pty_child_setup() has been called,
-   * so all FDs are FD_CLOEXEC.
+   * so all FDs are FD_CLOEXEC. Only the target FDs need to be
+   * made inheritable, and nothing needs to be closed.
    */
 
-  if (fd_array_len == 0)
-    return;
-
-  for (i = 0; i < fd_array_len; i++) {
-    int target_fd = fd_array[2 * i];
-    int idx = fd_array[2 * i + 1];
+  for (i = 0; i < data->n_steps; i++) {
+    const FDSetupStep *step = &data->steps[i];
     int fd, r;
 
-    g_assert (idx >= 0 && idx < n_fds);
+    switch (step->type) {
+      case FD_SETUP_STEP_DUP:
+        do {
+          fd = dup3 (fds[step->idx], step->target_fd, 0 /* no FD_CLOEXEC */);
+        } while (fd == -1 && errno == EINTR);
+        if (fd != step->target_fd)
+          _exit (127);
+        break;
 
-    /* We want to move fds[idx] to target_fd */
+      case FD_SETUP_STEP_INHERIT:
+        /* FD_CLOEXEC is the only FD flag there is */
+        do {
+          r = fcntl (step->target_fd, F_SETFD, 0);
+        } while (r == -1 && errno == EINTR);
+        if (r == -1)
+          _exit (127);
+        break;
 
-    if (target_fd != fds[idx]) {
-      int j;
+      case FD_SETUP_STEP_MOVE_ASIDE:
+        do {
+          fd = fcntl (fds[step->idx], F_DUPFD_CLOEXEC, data->aside_fd_min);
+        } while (fd == -1 && errno == EINTR);
+        if (fd == -1)
+          _exit (127);
 
-      /* Need to check if @target_fd is one of the FDs in the FD list! */
-      for (j = 0; j < n_fds; j++) {
-        if (fds[j] == target_fd) {
-          do {
-            fd = fcntl (fds[j], F_DUPFD_CLOEXEC, 3);
-          } while (fd == -1 && errno == EINTR);
-          if (fd == -1)
-            _exit (127);
+        /* Don't need to close the old FD since it's FD_CLOEXEC */
+        fds[step->idx] = fd;
+        break;
 
-          fds[j] = fd;
-          break;
-        }
-      }
+      default:
+        _exit (127);
     }
+  }
+}
 
-    if (target_fd == fds[idx]) {
-      /* Remove FD_CLOEXEC from target_fd */
-      int flags;
-
-      do {
-        flags = fcntl (target_fd, F_GETFD);
-      } while (flags == -1 && errno == EINTR);
-      if (flags == -1)
-        _exit (127);
+static void
+show_spawn_error (TerminalScreen *screen,
+                  const GError *error)
+{
+  TerminalScreenContainer *container;
+  GtkWidget *info_bar;
 
-      do {
-        r = fcntl (target_fd, F_SETFD, flags & ~FD_CLOEXEC);
-      } while (r == -1 && errno == EINTR);
-      if (r == -1)
-        _exit (127);
-    } else {
-      /* Now we know that target_fd can be safely overwritten. */
-      errno = 0;
-      do {
-        fd = dup3 (fds[idx], target_fd, 0 /* no FD_CLOEXEC */);
-      } while (fd == -1 && errno == EINTR);
-      if (fd != target_fd)
-        _exit (127);
-    }
+  container = terminal_screen_container_get_from_screen (screen);
+  if (container == NULL)
+    return;
 
-    /* Don't need to close it here since it's FD_CLOEXEC or consumed */
-    fds[idx] = -1;
-  }
+  info_bar = terminal_info_bar_new (GTK_MESSAGE_ERROR,
+                                    _("_Profile Preferences"), RESPONSE_EDIT_PROFILE,
+                                    _("_Relaunch"), RESPONSE_RELAUNCH,
+                                    NULL);
+  terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                 _("There was an error creating the child process for this terminal"));
+  terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                 "%s", error->message);
+  g_signal_connect (info_bar, "response",
+                    G_CALLBACK (info_bar_response_cb), screen);
+
+  gtk_widget_set_halign (info_bar, GTK_ALIGN_FILL);
+  gtk_widget_set_valign (info_bar, GTK_ALIGN_START);
+  gtk_overlay_add_overlay (GTK_OVERLAY (container), info_bar);
+  gtk_info_bar_set_default_response (GTK_INFO_BAR (info_bar), GTK_RESPONSE_CANCEL);
+  gtk_widget_show (info_bar);
 }
 
 static void
@@ -1382,33 +2545,17 @@ spawn_result_cb (VteTerminal *terminal,
   screen = TERMINAL_SCREEN (terminal);
   priv = screen->priv;
 
+  _terminal_trace_end ("spawn", priv->spawn_trace_begin);
+  terminal_metrics_record_spawn (priv->spawn_begin, error == NULL);
+
   priv->child_pid = pid;
 
   if (error) {
-    GtkWidget *info_bar;
-
     vte_terminal_set_pty (terminal, NULL);
-    info_bar = terminal_info_bar_new (GTK_MESSAGE_ERROR,
-                                      _("_Profile Preferences"), RESPONSE_EDIT_PROFILE,
-                                      _("_Relaunch"), RESPONSE_RELAUNCH,
-                                      NULL);
-    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                   _("There was an error creating the child process for this terminal"));
-    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                   "%s", error->message);
-    g_signal_connect (info_bar, "response",
-                      G_CALLBACK (info_bar_response_cb), screen);
-
-    gtk_widget_set_halign (info_bar, GTK_ALIGN_FILL);
-    gtk_widget_set_valign (info_bar, GTK_ALIGN_START);
-    gtk_overlay_add_overlay (GTK_OVERLAY (terminal_screen_container_get_from_screen (screen)),
-                             info_bar);
-    gtk_info_bar_set_default_response (GTK_INFO_BAR (info_bar), GTK_RESPONSE_CANCEL);
-    gtk_widget_show (info_bar);
-
-    return;
-  }
-}
+    terminal_app_unreserve_fds (terminal_app_get (), FDS_PER_CHILD);
+    show_spawn_error (screen, error);
+  }
+}
 
 static gboolean
 terminal_screen_do_exec (TerminalScreen *screen,
@@ -1425,6 +2572,9 @@ terminal_screen_do_exec (TerminalScreen *screen,
   GSpawnFlags spawn_flags = G_SPAWN_SEARCH_PATH_FROM_ENVP |
                             VTE_SPAWN_NO_PARENT_ENVV;
   GCancellable *cancellable = NULL;
+  gint64 trace_begin;
+  const char *section;
+  GError *err = NULL;
 
   if (priv->child_pid != -1) {
     g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
@@ -1434,10 +2584,33 @@ terminal_screen_do_exec (TerminalScreen *screen,
 
   priv->launch_child_source_id = 0;
 
+  /* The passed FDs only live as long as the D-Bus call, so we can't
+   * defer launching the child when there are any.
+   */
+  if (priv->lazy && data == NULL && !gtk_widget_get_mapped (GTK_WIDGET (screen))) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] deferring launching the child process until mapped\n",
+                           screen);
+
+    priv->launch_pending = TRUE;
+    return TRUE;
+  }
+
+  /* Better to say so now than to fail somewhere in the spawn */
+  if (!terminal_app_reserve_fds (terminal_app_get (), FDS_PER_CHILD, &err)) {
+    show_spawn_error (screen, err);
+    g_propagate_error (error, err);
+    if (data != NULL)
+      free_fd_setup_data (data);
+    return FALSE;
+  }
+
   _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
                          "[screen %p] now launching the child process\n",
                          screen);
 
+  trace_begin = _terminal_trace_begin ();
+  section = _terminal_watchdog_enter ("terminal_screen_do_exec");
   profile = priv->profile;
 
   if (priv->initial_working_directory &&
@@ -1449,9 +2622,16 @@ terminal_screen_do_exec (TerminalScreen *screen,
   env = get_child_environment (screen, working_dir, &shell);
 
   argv = NULL;
-  if (!get_child_command (screen, shell, &spawn_flags, &argv, error))
+  if (!get_child_command (screen, shell, &spawn_flags, &argv, error)) {
+    terminal_app_unreserve_fds (terminal_app_get (), FDS_PER_CHILD);
+    g_free (shell);
+    g_strfreev (env);
+    _terminal_watchdog_leave (section);
     return FALSE;
+  }
 
+  priv->spawn_trace_begin = _terminal_trace_begin ();
+  priv->spawn_begin = g_get_monotonic_time ();
   vte_terminal_spawn_async (terminal,
                             pty_flags,
                             working_dir,
@@ -1469,6 +2649,9 @@ terminal_screen_do_exec (TerminalScreen *screen,
   g_strfreev (argv);
   g_strfreev (env);
 
+  _terminal_watchdog_leave (section);
+  _terminal_trace_end ("terminal_screen_do_exec", trace_begin);
+
   return TRUE; /* can't report any more errors since they only occur async */
 }
 
@@ -1491,7 +2674,9 @@ _terminal_screen_launch_child_on_idle (TerminalScreen *screen)
                          "[screen %p] scheduling launching the child process on idle\n",
                          screen);
 
-  priv->launch_child_source_id = g_idle_add ((GSourceFunc) terminal_screen_launch_child_cb, screen);
+  priv->launch_child_source_id = _terminal_watchdog_idle_add ("launch child",
+                                                              (GSourceFunc) terminal_screen_launch_child_cb,
+                                                              screen);
 }
 
 static TerminalScreenPopupInfo *
@@ -1524,10 +2709,31 @@ terminal_screen_popup_info_unref (TerminalScreenPopupInfo *info)
 
   g_free (info->hyperlink);
   g_free (info->url);
+  g_free (info->number);
   g_free (info->number_info);
   g_slice_free (TerminalScreenPopupInfo, info);
 }
 
+/**
+ * terminal_screen_popup_info_get_number_info:
+ * @info: a #TerminalScreenPopupInfo
+ *
+ * Formats the number under the pointer on first use, so that this only
+ * happens when the context menu is actually built.
+ *
+ * Returns: (transfer none): a description of the number, or %NULL
+ */
+const char *
+terminal_screen_popup_info_get_number_info (TerminalScreenPopupInfo *info)
+{
+  g_return_val_if_fail (info != NULL, NULL);
+
+  if (info->number_info == NULL && info->number != NULL)
+    info->number_info = terminal_util_number_info (info->number);
+
+  return info->number_info;
+}
+
 static gboolean
 terminal_screen_popup_menu (GtkWidget *widget)
 {
@@ -1550,7 +2756,7 @@ terminal_screen_do_popup (TerminalScreen *screen,
                           char *hyperlink,
                           char *url,
                           int url_flavor,
-                          char *number_info)
+                          char *number)
 {
   TerminalScreenPopupInfo *info;
 
@@ -1561,7 +2767,7 @@ terminal_screen_do_popup (TerminalScreen *screen,
   info->hyperlink = hyperlink; /* adopted */
   info->url = url; /* adopted */
   info->url_flavor = url_flavor;
-  info->number_info = number_info; /* adopted */
+  info->number = number; /* adopted */
 
   g_signal_emit (screen, signals[SHOW_POPUP_MENU], 0, info);
   terminal_screen_popup_info_unref (info);
@@ -1577,71 +2783,64 @@ terminal_screen_button_press (GtkWidget      *widget,
   gs_free char *hyperlink = NULL;
   gs_free char *url = NULL;
   int url_flavor = 0;
-  gs_free char *number_info = NULL;
+  gs_free char *number = NULL;
   guint state;
 
   state = event->state & gtk_accelerator_get_default_mod_mask ();
 
-  hyperlink = terminal_screen_check_hyperlink (screen, (GdkEvent*)event);
-  url = terminal_screen_check_match (screen, (GdkEvent*)event, &url_flavor);
-  terminal_screen_check_extra (screen, (GdkEvent*)event, &number_info);
-
-  if (hyperlink != NULL &&
-      (event->button == 1 || event->button == 2) &&
-      (state & GDK_CONTROL_MASK))
-    {
-      gboolean handled = FALSE;
-
-      g_signal_emit (screen, signals[MATCH_CLICKED], 0,
-                     hyperlink,
-                     FLAVOR_AS_IS,
-                     state,
-                     &handled);
-      if (handled)
-        return TRUE; /* don't do anything else such as select with the click */
-    }
-
-  if (url != NULL &&
-      (event->button == 1 || event->button == 2) &&
+  /* Only look at the text under the pointer when the click can use it */
+  if ((event->button == 1 || event->button == 2) &&
       (state & GDK_CONTROL_MASK))
     {
       gboolean handled = FALSE;
 
-      g_signal_emit (screen, signals[MATCH_CLICKED], 0,
-                     url,
-                     url_flavor,
-                     state,
-                     &handled);
-      if (handled)
-        return TRUE; /* don't do anything else such as select with the click */
-    }
-
-  if (event->type == GDK_BUTTON_PRESS && event->button == 3)
-    {
-      if (!(event->state & (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK)))
+      hyperlink = terminal_screen_check_hyperlink (screen, (GdkEvent*)event);
+      if (hyperlink != NULL)
         {
-          /* on right-click, we should first try to send the mouse event to
-           * the client, and popup only if that's not handled. */
-          if (button_press_event && button_press_event (widget, event))
-            return TRUE;
-
-          terminal_screen_do_popup (screen, event, hyperlink, url, url_flavor, number_info);
-          hyperlink = NULL; /* adopted to the popup info */
-          url = NULL; /* ditto */
-          number_info = NULL; /* ditto */
-          return TRUE;
+          g_signal_emit (screen, signals[MATCH_CLICKED], 0,
+                         hyperlink,
+                         FLAVOR_AS_IS,
+                         state,
+                         &handled);
+          if (handled)
+            return TRUE; /* don't do anything else such as select with the click */
         }
-      else if (!(event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)))
+
+      terminal_screen_check_matches (screen, (GdkEvent*)event, FALSE,
+                                     &url, &url_flavor, NULL);
+      if (url != NULL)
         {
-          /* do popup on shift+right-click */
-          terminal_screen_do_popup (screen, event, hyperlink, url, url_flavor, number_info);
-          hyperlink = NULL; /* adopted to the popup info */
-          url = NULL; /* ditto */
-          number_info = NULL; /* ditto */
-          return TRUE;
+          g_signal_emit (screen, signals[MATCH_CLICKED], 0,
+                         url,
+                         url_flavor,
+                         state,
+                         &handled);
+          if (handled)
+            return TRUE; /* don't do anything else such as select with the click */
         }
     }
 
+  if (event->type == GDK_BUTTON_PRESS && event->button == 3 &&
+      !(event->state & (GDK_CONTROL_MASK | GDK_MOD1_MASK)))
+    {
+      /* on right-click, we should first try to send the mouse event to
+       * the client, and popup only if that's not handled; but always
+       * popup on shift+right-click. */
+      if (!(event->state & GDK_SHIFT_MASK) &&
+          button_press_event && button_press_event (widget, event))
+        return TRUE;
+
+      hyperlink = terminal_screen_check_hyperlink (screen, (GdkEvent*)event);
+      terminal_screen_check_matches (screen, (GdkEvent*)event, TRUE,
+                                     &url, &url_flavor, &number);
+
+      terminal_screen_do_popup (screen, event, hyperlink, url, url_flavor, number);
+      hyperlink = NULL; /* adopted to the popup info */
+      url = NULL; /* ditto */
+      number = NULL; /* ditto */
+      return TRUE;
+    }
+
   /* default behavior is to let the terminal widget deal with it */
   if (button_press_event)
     return button_press_event (widget, event);
@@ -1675,19 +2874,86 @@ terminal_screen_get_current_dir (TerminalScreen *screen)
   return NULL;
 }
 
+static void
+terminal_screen_notify_titles (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  guint pending;
+  const char *title;
+
+  pending = priv->pending_title_notify;
+  priv->pending_title_notify = 0;
+  priv->title_notify_time = g_get_monotonic_time ();
+
+  if (pending & TITLE_NOTIFY_ICON_TITLE) {
+    g_object_notify (G_OBJECT (screen), "icon-title");
+    g_object_notify (G_OBJECT (screen), "icon-title-set");
+  }
+
+  if (pending & TITLE_NOTIFY_TITLE) {
+    title = terminal_screen_get_title (screen);
+
+    /* Shells tend to set the same title on every prompt. The window
+     * relies on notify::title after a change of the icon title, though.
+     */
+    if (g_strcmp0 (title, priv->notified_title) == 0 &&
+        !(pending & TITLE_NOTIFY_ICON_TITLE))
+      return;
+
+    g_free (priv->notified_title);
+    priv->notified_title = g_strdup (title);
+    terminal_app_mark_session_dirty (terminal_app_get ());
+    g_object_notify (G_OBJECT (screen), "title");
+  }
+}
+
+static gboolean
+terminal_screen_title_notify_cb (gpointer user_data)
+{
+  TerminalScreen *screen = user_data;
+
+  screen->priv->title_notify_source_id = 0;
+  terminal_screen_notify_titles (screen);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+terminal_screen_queue_title_notify (TerminalScreen *screen,
+                                    guint what)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  gint64 elapsed;
+
+  priv->pending_title_notify |= what;
+  if (priv->title_notify_source_id != 0)
+    return;
+
+  /* Pass the first change on right away, and coalesce the ones following it */
+  elapsed = (g_get_monotonic_time () - priv->title_notify_time) / 1000;
+  if (elapsed >= TITLE_NOTIFY_INTERVAL) {
+    terminal_screen_notify_titles (screen);
+    return;
+  }
+
+  priv->title_notify_source_id = _terminal_watchdog_timeout_add (TITLE_NOTIFY_INTERVAL - elapsed,
+                                                                 "title notify",
+                                                                 terminal_screen_title_notify_cb,
+                                                                 screen);
+}
+
 static void
 terminal_screen_window_title_changed (VteTerminal *vte_terminal,
                                       TerminalScreen *screen)
 {
-  g_object_notify (G_OBJECT (screen), "title");
+  terminal_screen_queue_title_notify (screen, TITLE_NOTIFY_TITLE);
 }
 
 static void
 terminal_screen_icon_title_changed (VteTerminal *vte_terminal,
                                     TerminalScreen *screen)
 {
-  g_object_notify (G_OBJECT (screen), "icon-title");
-  g_object_notify (G_OBJECT (screen), "icon-title-set");
+  terminal_screen_queue_title_notify (screen, TITLE_NOTIFY_ICON_TITLE);
 }
 
 static void
@@ -1705,6 +2971,10 @@ terminal_screen_child_exited (VteTerminal *terminal,
                          screen);
 
   priv->child_pid = -1;
+  priv->stats.child_exits++;
+
+  /* Let VTE read what the child wrote before exiting */
+  background_throttle_stop (screen);
   
   action = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_EXIT_ACTION_KEY);
   
@@ -1749,422 +3019,2541 @@ terminal_screen_child_exited (VteTerminal *terminal,
     }
 }
 
+/* Scrollback hibernation */
+
+typedef struct {
+  GFile *old_file; /* the previously hibernated scrollback, or NULL */
+  GFile *file; /* only written by this task */
+  char *text;
+  gsize len;
+  guint contents_serial;
+} HibernateData;
+
 static void
-terminal_screen_drag_data_received (GtkWidget        *widget,
-                                    GdkDragContext   *context,
-                                    gint              x,
-                                    gint              y,
-                                    GtkSelectionData *selection_data,
-                                    guint             info,
-                                    guint             timestamp)
+hibernate_data_free (HibernateData *data)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (widget);
-  TerminalScreenPrivate *priv = screen->priv;
-  const guchar *selection_data_data;
-  GdkAtom selection_data_target;
-  gint selection_data_length, selection_data_format;
+  if (data->old_file)
+    g_object_unref (data->old_file);
+  g_object_unref (data->file);
+  g_free (data->text);
+  g_slice_free (HibernateData, data);
+}
 
-  selection_data_data = gtk_selection_data_get_data (selection_data);
-  selection_data_target = gtk_selection_data_get_target (selection_data);
-  selection_data_length = gtk_selection_data_get_length (selection_data);
-  selection_data_format = gtk_selection_data_get_format (selection_data);
+/* Deletes a hibernation file without blocking the main loop */
+static void
+hibernate_file_delete (GFile *file)
+{
+  g_file_delete_async (file, G_PRIORITY_LOW, NULL, NULL, NULL);
+}
 
-#if 0
-  {
-    GList *tmp;
+/* Runs in a worker thread. Writes the previously hibernated scrollback
+ * plus the new text to a new file of this task's own, so the old one
+ * stays valid until the screen decides to use the new one, and a
+ * cancelled task can't get in the way of a newer one. Like all the file
+ * operations, creating the directory is done here too.
+ */
+static void
+hibernate_thread_func (GTask *task,
+                       gpointer source_object,
+                       gpointer task_data,
+                       GCancellable *cancellable)
+{
+  HibernateData *data = task_data;
+  GError *error = NULL;
 
-    g_print ("info: %d\n", info);
-    tmp = context->targets;
-    while (tmp != NULL)
-      {
-        GdkAtom atom = GDK_POINTER_TO_ATOM (tmp->data);
+  gs_unref_object GFile *dir = g_file_get_parent (data->file);
+  gs_free char *dir_path = g_file_get_path (dir);
+  if (g_mkdir_with_parents (dir_path, 0700) != 0) {
+    int errsv = errno;
 
-        g_print ("Target: %s\n", gdk_atom_name (atom));        
-        
-        tmp = tmp->next;
-      }
+    g_task_return_new_error (task, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             "Failed to create %s: %s", dir_path, g_strerror (errsv));
+    return;
+  }
 
-    g_print ("Chosen target: %s\n", gdk_atom_name (selection_data->target));
+  gs_unref_object GFileOutputStream *file_stream =
+    g_file_replace (data->file, NULL, FALSE,
+                    G_FILE_CREATE_PRIVATE,
+                    cancellable, &error);
+  if (file_stream == NULL) {
+    g_task_return_error (task, error);
+    return;
   }
-#endif
 
-  if (gtk_targets_include_uri (&selection_data_target, 1))
-    {
-      gs_strfreev char **uris;
-      gs_free char *text = NULL;
-      gsize len;
+  gs_unref_object GConverter *compressor =
+    G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  gs_unref_object GOutputStream *stream =
+    g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream), compressor);
+
+  gs_unref_object GFileInputStream *old_stream =
+    data->old_file ? g_file_read (data->old_file, cancellable, NULL) : NULL;
+  if (old_stream != NULL) {
+    gs_unref_object GConverter *decompressor =
+      G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+    gs_unref_object GInputStream *old_text_stream =
+      g_converter_input_stream_new (G_INPUT_STREAM (old_stream), decompressor);
+
+    if (g_output_stream_splice (stream, old_text_stream,
+                                G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+                                cancellable, &error) < 0)
+      goto out;
+  }
 
-      uris = gtk_selection_data_get_uris (selection_data);
-      if (!uris)
-        return;
+  if (!g_output_stream_write_all (stream, data->text, data->len, NULL, cancellable, &error))
+    goto out;
 
-      terminal_util_transform_uris_to_quoted_fuse_paths (uris);
+  g_output_stream_close (stream, cancellable, &error);
 
-      text = terminal_util_concat_uris (uris, &len);
-      vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-    }
-  else if (gtk_targets_include_text (&selection_data_target, 1))
-    {
-      gs_free char *text;
+ out:
+  if (error != NULL) {
+    g_file_delete (data->file, NULL, NULL);
+    g_task_return_error (task, error);
+  } else
+    g_task_return_boolean (task, TRUE);
+}
 
-      text = (char *) gtk_selection_data_get_text (selection_data);
-      if (text && text[0])
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, strlen (text));
+static void
+hibernate_done_cb (GObject *source_object,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (source_object);
+  TerminalScreenPrivate *priv = screen->priv;
+  HibernateData *data = g_task_get_task_data (G_TASK (result));
+  gs_free_error GError *error = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (result), &error)) {
+    /* Cancelled means the screen got the focus or went away, and the
+     * cancellable is already gone.
+     */
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      hibernate_file_delete (data->file);
+      return;
     }
-  else switch (info)
-    {
-    case TARGET_COLOR:
-      {
-        guint16 *data = (guint16 *)selection_data_data;
-        GdkRGBA color;
-
-        /* We accept drops with the wrong format, since the KDE color
-         * chooser incorrectly drops application/x-color with format 8.
-         * So just check for the data length.
-         */
-        if (selection_data_length != 8)
-          return;
 
-        color.red = (double) data[0] / 65535.;
-        color.green = (double) data[1] / 65535.;
-        color.blue = (double) data[2] / 65535.;
-        color.alpha = 1.;
-        /* FIXME: use opacity from data[3] */
+    g_clear_object (&priv->hibernate_cancellable);
+    priv->hibernate_failed = TRUE;
+    g_printerr ("Failed to move the scrollback to disk: %s\n", error->message);
+    return;
+  }
 
-        terminal_g_settings_set_rgba (priv->profile,
-                                      TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
-                                      &color);
-        g_settings_set_boolean (priv->profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY, FALSE);
-      }
-      break;
+  g_clear_object (&priv->hibernate_cancellable);
+  priv->hibernate_failed = FALSE;
 
-    case TARGET_MOZ_URL:
-      {
-        char *utf8_data, *newline, *text;
-        char *uris[2];
-        gsize len;
-        
-        /* MOZ_URL is in UCS-2 but in format 8. BROKEN!
-         *
-         * The data contains the URL, a \n, then the
-         * title of the web page.
-         */
-        if (selection_data_format != 8 ||
-            selection_data_length == 0 ||
-            (selection_data_length % 2) != 0)
-          return;
+  /* If there was new output meanwhile, the text we wrote and the
+   * scrollback don't match anymore; try again next time.
+   */
+  if (data->contents_serial != priv->contents_serial) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] contents changed while hibernating, keeping scrollback\n",
+                           screen);
+    hibernate_file_delete (data->file);
+    return;
+  }
 
-        utf8_data = g_utf16_to_utf8 ((const gunichar2*) selection_data_data,
-                                     selection_data_length / 2,
-                                     NULL, NULL, NULL);
-        if (!utf8_data)
-          return;
+  /* The new file has everything the old one had */
+  if (priv->hibernate_file) {
+    hibernate_file_delete (priv->hibernate_file);
+    g_object_unref (priv->hibernate_file);
+  }
+  priv->hibernate_file = g_object_ref (data->file);
 
-        newline = strchr (utf8_data, '\n');
-        if (newline)
-          *newline = '\0';
+  /* Drop the scrollback */
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), 0);
+  update_scrollback_lines (screen);
 
-        uris[0] = utf8_data;
-        uris[1] = NULL;
-        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] hibernated %" G_GSIZE_FORMAT " bytes of scrollback\n",
+                         screen, data->len);
+}
 
-        text = terminal_util_concat_uris (uris, &len);
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-        g_free (text);
-        g_free (uris[0]);
-      }
-      break;
+/* Returns: %TRUE if the scrollback is being moved to disk */
+static gboolean
+terminal_screen_hibernate (TerminalScreen *screen)
+{
+  static guint hibernate_task_count = 0;
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GtkAdjustment *adjustment;
+  HibernateData *data;
+  long first_row, last_row;
+  char *text;
+  GTask *task;
 
-    case TARGET_NETSCAPE_URL:
-      {
-        char *utf8_data, *newline, *text;
-        char *uris[2];
-        gsize len;
-        
-        /* The data contains the URL, a \n, then the
-         * title of the web page.
-         */
-        if (selection_data_length < 0 || selection_data_format != 8)
-          return;
+  if (priv->hibernate_cancellable != NULL)
+    return TRUE;
 
-        utf8_data = g_strndup ((char *) selection_data_data, selection_data_length);
-        newline = strchr (utf8_data, '\n');
-        if (newline)
-          *newline = '\0';
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  first_row = (long) gtk_adjustment_get_lower (adjustment);
+  last_row = (long) gtk_adjustment_get_upper (adjustment) - vte_terminal_get_row_count (terminal) - 1;
+  if (last_row < first_row)
+    return FALSE;
 
-        uris[0] = utf8_data;
-        uris[1] = NULL;
-        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+  text = vte_terminal_get_text_range (terminal,
+                                      first_row, 0,
+                                      last_row, vte_terminal_get_column_count (terminal) - 1,
+                                      NULL, NULL, NULL);
+  if (text == NULL)
+    return FALSE;
 
-        text = terminal_util_concat_uris (uris, &len);
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-        g_free (text);
-        g_free (uris[0]);
-      }
-      break;
+  gs_free char *name = g_strdup_printf ("%s.%u.scrollback.gz", priv->uuid, ++hibernate_task_count);
+  gs_free char *path = g_build_filename (g_get_user_runtime_dir (), "gnome-terminal", name, NULL);
 
-    case TARGET_RESET_BG:
-      g_settings_reset (priv->profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY);
-      break;
+  data = g_slice_new (HibernateData);
+  data->old_file = priv->hibernate_file ? g_object_ref (priv->hibernate_file) : NULL;
+  data->file = g_file_new_for_path (path);
+  data->text = text;
+  data->len = strlen (text);
+  data->contents_serial = priv->contents_serial;
 
-    case TARGET_TAB:
-      {
-        GtkWidget *container;
-        TerminalScreen *moving_screen;
-        TerminalWindow *source_window;
-        TerminalWindow *dest_window;
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] hibernating rows %ld to %ld\n",
+                         screen, first_row, last_row);
 
-        container = *(GtkWidget**) selection_data_data;
-        if (!GTK_IS_WIDGET (container))
-          return;
+  priv->hibernate_cancellable = g_cancellable_new ();
+  task = g_task_new (screen, priv->hibernate_cancellable, hibernate_done_cb, NULL);
+  g_task_set_task_data (task, data, (GDestroyNotify) hibernate_data_free);
+  g_task_run_in_thread (task, hibernate_thread_func);
+  g_object_unref (task);
 
-        moving_screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (container));
-        g_warn_if_fail (TERMINAL_IS_SCREEN (moving_screen));
-        if (!TERMINAL_IS_SCREEN (moving_screen))
-          return;
+  return TRUE;
+}
 
-        source_window = terminal_screen_get_window (moving_screen);
-        dest_window = terminal_screen_get_window (screen);
-        terminal_window_move_screen (source_window, dest_window, moving_screen, -1);
+static gboolean
+hibernate_timeout_cb (TerminalScreen *screen)
+{
+  screen->priv->hibernate_source_id = 0;
 
-        gtk_drag_finish (context, TRUE, TRUE, timestamp);
-      }
-      break;
+  terminal_screen_hibernate (screen);
+
+  return FALSE; /* don't run again */
+}
+
+/* Moves the statistics window forward to @second, dropping what fell out of it */
+static gboolean
+stats_advance (ScreenStats *stats,
+               gint64 second)
+{
+  gint64 s;
+
+  if (second <= stats->second)
+    return FALSE;
+
+  if (second - stats->second >= STATS_SECONDS) {
+    memset (stats->buckets, 0, sizeof (stats->buckets));
+  } else {
+    for (s = stats->second + 1; s <= second; s++)
+      memset (&stats->buckets[s % STATS_SECONDS], 0, sizeof (StatsBucket));
+  }
+
+  stats->second = second;
+  return TRUE;
+}
+
+static gboolean hot_check_cb (gpointer user_data);
+
+/* Checks the seconds before the current one for whether @screen is hot */
+static void
+terminal_screen_update_hot (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  ScreenStats *stats = &priv->stats;
+  guint64 output_rows = 0, draw_time = 0;
+  gboolean hot;
+  gint64 s;
+
+  for (s = stats->second - HOT_SECONDS; s < stats->second; s++) {
+    output_rows += stats->buckets[s % STATS_SECONDS].output_rows;
+    draw_time += stats->buckets[s % STATS_SECONDS].draw_time;
+  }
+
+  hot = output_rows > HOT_OUTPUT_ROWS * HOT_SECONDS ||
+        draw_time > HOT_DRAW_TIME * HOT_SECONDS;
+  if (hot == priv->hot)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] %s hot, %" G_GUINT64_FORMAT " rows and %" G_GUINT64_FORMAT " µs drawing in %d s\n",
+                         screen, hot ? "now" : "no longer",
+                         output_rows, draw_time, HOT_SECONDS);
+
+  priv->hot = hot;
+  if (hot && priv->hot_source_id == 0)
+    priv->hot_source_id = _terminal_watchdog_timeout_add_seconds (1, "hot check", hot_check_cb, screen);
+
+  g_object_notify (G_OBJECT (screen), "hot");
+}
+
+/* Cools a hot screen down once it goes quiet */
+static gboolean
+hot_check_cb (gpointer user_data)
+{
+  TerminalScreen *screen = user_data;
+  TerminalScreenPrivate *priv = screen->priv;
+
+  stats_advance (&priv->stats, g_get_monotonic_time () / G_USEC_PER_SEC);
+  terminal_screen_update_hot (screen);
+
+  if (priv->hot)
+    return G_SOURCE_CONTINUE;
+
+  priv->hot_source_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Returns the bucket for the current second */
+static StatsBucket *
+stats_get_bucket (TerminalScreen *screen)
+{
+  ScreenStats *stats = &screen->priv->stats;
+  gint64 second = g_get_monotonic_time () / G_USEC_PER_SEC;
+
+  if (stats_advance (stats, second))
+    terminal_screen_update_hot (screen);
+
+  return &stats->buckets[second % STATS_SECONDS];
+}
+
+static void
+stats_record_output (TerminalScreen *screen)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  ScreenStats *stats = &screen->priv->stats;
+  StatsBucket *bucket;
+  GtkAdjustment *adjustment;
+  glong row, rows, visible_rows;
+  gboolean alternate;
+
+  /* VTE reads the PTY itself and does not tell how much it read; the
+   * rows the cursor advanced, counting the scrollback, stand in for it.
+   */
+  vte_terminal_get_cursor_position (terminal, NULL, &row);
+  visible_rows = vte_terminal_get_row_count (terminal);
+
+  /* VTE doesn't say which screen is shown either; the alternate screen
+   * is the one without scrollback. Switching screens makes the cursor
+   * row jump, so start over without counting then.
+   */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (terminal));
+  alternate = gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_lower (adjustment) <= visible_rows;
+
+  if (stats->last_row_valid && alternate == stats->last_alternate && row > stats->last_row)
+    rows = MIN (row - stats->last_row, visible_rows); /* e.g. a restored scrollback */
+  else
+    rows = 0; /* the first sample, a screen switch, or reset or cleared */
+
+  stats->last_row = row;
+  stats->last_row_valid = TRUE;
+  stats->last_alternate = alternate;
+
+  bucket = stats_get_bucket (screen);
+  bucket->output_rows += rows;
+  bucket->contents_changes++;
+  stats->output_rows += rows;
+}
+
+static gboolean
+terminal_screen_draw (GtkWidget *widget,
+                      cairo_t *cr)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  ScreenStats *stats = &screen->priv->stats;
+  StatsBucket *bucket;
+  gint64 begin, duration;
+  gboolean rv;
+
+  begin = g_get_monotonic_time ();
+  rv = GTK_WIDGET_CLASS (terminal_screen_parent_class)->draw (widget, cr);
+  duration = g_get_monotonic_time () - begin;
+
+  bucket = stats_get_bucket (screen);
+  bucket->draws++;
+  bucket->draw_time += duration;
+  stats->draws++;
+  stats->draw_time += duration;
+
+  return rv;
+}
+
+static void
+terminal_screen_contents_changed_cb (VteTerminal *terminal,
+                                     TerminalScreen *screen)
+{
+  static gboolean first_contents_changed = TRUE;
+
+  if (G_UNLIKELY (first_contents_changed)) {
+    _terminal_trace_mark ("first contents-changed");
+    first_contents_changed = FALSE;
+    terminal_app_first_output (terminal_app_get ());
+  }
+
+  screen->priv->contents_serial++;
+  search_snapshot_cache (screen, NULL); /* it's stale now */
+  stats_record_output (screen);
+  terminal_app_mark_session_dirty (terminal_app_get ()); /* this covers resizes too */
+
+  if (screen->priv->background)
+    background_output_cb (screen);
+}
+
+static void
+hibernate_info_bar_destroy_cb (GtkWidget *info_bar,
+                               TerminalScreen *screen)
+{
+  screen->priv->hibernate_info_bar = NULL;
+}
+
+static gboolean
+terminal_screen_focus_in (GtkWidget *widget,
+                          GdkEventFocus *event)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPrivate *priv = screen->priv;
+
+  priv->last_focus_time = g_get_monotonic_time ();
+
+  if (priv->hibernate_source_id != 0) {
+    g_source_remove (priv->hibernate_source_id);
+    priv->hibernate_source_id = 0;
+  }
+
+  if (priv->hibernate_cancellable != NULL) {
+    g_cancellable_cancel (priv->hibernate_cancellable);
+    g_clear_object (&priv->hibernate_cancellable);
+  }
+
+  /* VTE cannot take the scrollback back, so offer to show it instead */
+  if (priv->hibernate_file != NULL && priv->hibernate_info_bar == NULL) {
+    GtkWidget *info_bar;
+
+    info_bar = terminal_info_bar_new (GTK_MESSAGE_INFO,
+                                      _("_Show"), RESPONSE_SHOW_HIBERNATED,
+                                      _("_Close"), GTK_RESPONSE_CLOSE,
+                                      NULL);
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                   _("Older output of this terminal was moved to disk to save memory."));
+    g_signal_connect (info_bar, "response",
+                      G_CALLBACK (info_bar_response_cb), screen);
+    g_signal_connect (info_bar, "destroy",
+                      G_CALLBACK (hibernate_info_bar_destroy_cb), screen);
+
+    gtk_widget_set_halign (info_bar, GTK_ALIGN_FILL);
+    gtk_widget_set_valign (info_bar, GTK_ALIGN_START);
+    gtk_overlay_add_overlay (GTK_OVERLAY (terminal_screen_container_get_from_screen (screen)),
+                             info_bar);
+    gtk_widget_show (info_bar);
+    priv->hibernate_info_bar = info_bar;
+  }
+
+  return GTK_WIDGET_CLASS (terminal_screen_parent_class)->focus_in_event (widget, event);
+}
+
+static gboolean
+terminal_screen_focus_out (GtkWidget *widget,
+                           GdkEventFocus *event)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPrivate *priv = screen->priv;
+  int timeout;
+
+  priv->last_focus_time = g_get_monotonic_time ();
+
+  timeout = g_settings_get_int (priv->profile, TERMINAL_PROFILE_HIBERNATE_TIMEOUT_KEY);
+  if (timeout > 0 && priv->hibernate_source_id == 0)
+    priv->hibernate_source_id = _terminal_watchdog_timeout_add_seconds (timeout, "hibernate",
+                                                                        (GSourceFunc) hibernate_timeout_cb,
+                                                                        screen);
+
+  return GTK_WIDGET_CLASS (terminal_screen_parent_class)->focus_out_event (widget, event);
+}
+
+/* Converting the dropped URIs may need to look up each of them on a
+ * remote mount, so it is done on a worker thread, a batch at a time so
+ * it can stop early when the terminal goes away. The result goes through
+ * the chunked paste.
+ */
+#define DROP_URIS_BATCH_SIZE (256)
+
+static void
+drop_uris_thread_func (GTask *task,
+                       gpointer source_object,
+                       gpointer task_data,
+                       GCancellable *cancellable)
+{
+  char **uris = task_data;
+  guint i, n = g_strv_length (uris);
+
+  for (i = 0; i < n; i += DROP_URIS_BATCH_SIZE) {
+    guint end = MIN (i + DROP_URIS_BATCH_SIZE, n);
+    char *saved = uris[end];
+
+    if (g_task_return_error_if_cancelled (task))
+      return;
+
+    /* Terminate the batch for the util function, then restore the array */
+    uris[end] = NULL;
+    terminal_util_transform_uris_to_quoted_fuse_paths (uris + i);
+    uris[end] = saved;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+static void
+drop_uris_done_cb (GObject *source_object,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (source_object);
+  char **uris = g_task_get_task_data (G_TASK (result));
+  char *text;
+  gsize len;
+
+  if (!g_task_propagate_boolean (G_TASK (result), NULL))
+    return;
+
+  text = terminal_util_concat_uris (uris, &len);
+  terminal_screen_paste_text (screen, text /* adopted */, len, FALSE);
+}
+
+static void
+terminal_screen_drag_data_received (GtkWidget        *widget,
+                                    GdkDragContext   *context,
+                                    gint              x,
+                                    gint              y,
+                                    GtkSelectionData *selection_data,
+                                    guint             info,
+                                    guint             timestamp)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPrivate *priv = screen->priv;
+  const guchar *selection_data_data;
+  GdkAtom selection_data_target;
+  gint selection_data_length, selection_data_format;
+
+  selection_data_data = gtk_selection_data_get_data (selection_data);
+  selection_data_target = gtk_selection_data_get_target (selection_data);
+  selection_data_length = gtk_selection_data_get_length (selection_data);
+  selection_data_format = gtk_selection_data_get_format (selection_data);
+
+#if 0
+  {
+    GList *tmp;
+
+    g_print ("info: %d\n", info);
+    tmp = context->targets;
+    while (tmp != NULL)
+      {
+        GdkAtom atom = GDK_POINTER_TO_ATOM (tmp->data);
+
+        g_print ("Target: %s\n", gdk_atom_name (atom));        
+        
+        tmp = tmp->next;
+      }
+
+    g_print ("Chosen target: %s\n", gdk_atom_name (selection_data->target));
+  }
+#endif
+
+  if (gtk_targets_include_uri (&selection_data_target, 1))
+    {
+      char **uris;
+      GTask *task;
+
+      uris = gtk_selection_data_get_uris (selection_data);
+      if (!uris)
+        return;
+
+      if (priv->drop_cancellable == NULL)
+        priv->drop_cancellable = g_cancellable_new ();
+
+      task = g_task_new (screen, priv->drop_cancellable, drop_uris_done_cb, NULL);
+      g_task_set_task_data (task, uris /* adopted */, (GDestroyNotify) g_strfreev);
+      g_task_run_in_thread (task, drop_uris_thread_func);
+      g_object_unref (task);
+    }
+  else if (gtk_targets_include_text (&selection_data_target, 1))
+    {
+      gs_free char *text;
+
+      text = (char *) gtk_selection_data_get_text (selection_data);
+      if (text && text[0])
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, strlen (text));
+    }
+  else switch (info)
+    {
+    case TARGET_COLOR:
+      {
+        guint16 *data = (guint16 *)selection_data_data;
+        GdkRGBA color;
+
+        /* We accept drops with the wrong format, since the KDE color
+         * chooser incorrectly drops application/x-color with format 8.
+         * So just check for the data length.
+         */
+        if (selection_data_length != 8)
+          return;
+
+        color.red = (double) data[0] / 65535.;
+        color.green = (double) data[1] / 65535.;
+        color.blue = (double) data[2] / 65535.;
+        color.alpha = 1.;
+        /* FIXME: use opacity from data[3] */
+
+        terminal_g_settings_set_rgba (priv->profile,
+                                      TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
+                                      &color);
+        g_settings_set_boolean (priv->profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY, FALSE);
+      }
+      break;
+
+    case TARGET_MOZ_URL:
+      {
+        char *utf8_data, *newline, *text;
+        char *uris[2];
+        gsize len;
+        
+        /* MOZ_URL is in UCS-2 but in format 8. BROKEN!
+         *
+         * The data contains the URL, a \n, then the
+         * title of the web page.
+         */
+        if (selection_data_format != 8 ||
+            selection_data_length == 0 ||
+            (selection_data_length % 2) != 0)
+          return;
+
+        utf8_data = g_utf16_to_utf8 ((const gunichar2*) selection_data_data,
+                                     selection_data_length / 2,
+                                     NULL, NULL, NULL);
+        if (!utf8_data)
+          return;
+
+        newline = strchr (utf8_data, '\n');
+        if (newline)
+          *newline = '\0';
+
+        uris[0] = utf8_data;
+        uris[1] = NULL;
+        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+
+        text = terminal_util_concat_uris (uris, &len);
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+        g_free (text);
+        g_free (uris[0]);
+      }
+      break;
+
+    case TARGET_NETSCAPE_URL:
+      {
+        char *utf8_data, *newline, *text;
+        char *uris[2];
+        gsize len;
+        
+        /* The data contains the URL, a \n, then the
+         * title of the web page.
+         */
+        if (selection_data_length < 0 || selection_data_format != 8)
+          return;
+
+        utf8_data = g_strndup ((char *) selection_data_data, selection_data_length);
+        newline = strchr (utf8_data, '\n');
+        if (newline)
+          *newline = '\0';
+
+        uris[0] = utf8_data;
+        uris[1] = NULL;
+        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+
+        text = terminal_util_concat_uris (uris, &len);
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+        g_free (text);
+        g_free (uris[0]);
+      }
+      break;
+
+    case TARGET_RESET_BG:
+      g_settings_reset (priv->profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY);
+      break;
+
+    case TARGET_TAB:
+      {
+        GtkWidget *container;
+        TerminalScreen *moving_screen;
+        TerminalWindow *source_window;
+        TerminalWindow *dest_window;
+
+        container = *(GtkWidget**) selection_data_data;
+        if (!GTK_IS_WIDGET (container))
+          return;
+
+        moving_screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (container));
+        g_warn_if_fail (TERMINAL_IS_SCREEN (moving_screen));
+        if (!TERMINAL_IS_SCREEN (moving_screen))
+          return;
+
+        source_window = terminal_screen_get_window (moving_screen);
+        dest_window = terminal_screen_get_window (screen);
+        terminal_window_move_screen (source_window, dest_window, moving_screen, -1);
+
+        gtk_drag_finish (context, TRUE, TRUE, timestamp);
+      }
+      break;
 
     default:
       g_assert_not_reached ();
     }
 }
 
-void
-_terminal_screen_update_scrollbar (TerminalScreen *screen)
+void
+_terminal_screen_update_scrollbar (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalScreenContainer *container;
+  GtkPolicyType vpolicy;
+
+  container = terminal_screen_container_get_from_screen (screen);
+  if (container == NULL)
+    return;
+
+  vpolicy = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY);
+
+  terminal_screen_container_set_policy (container, GTK_POLICY_NEVER, vpolicy);
+}
+
+void
+terminal_screen_get_size (TerminalScreen *screen,
+			  int       *width_chars,
+			  int       *height_chars)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+
+  *width_chars = vte_terminal_get_column_count (terminal);
+  *height_chars = vte_terminal_get_row_count (terminal);
+}
+
+void
+terminal_screen_get_cell_size (TerminalScreen *screen,
+			       int                  *cell_width_pixels,
+			       int                  *cell_height_pixels)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+
+  *cell_width_pixels = vte_terminal_get_char_width (terminal);
+  *cell_height_pixels = vte_terminal_get_char_height (terminal);
+}
+
+static char*
+terminal_screen_check_hyperlink (TerminalScreen *screen,
+                                 GdkEvent       *event)
+{
+  return vte_terminal_hyperlink_check_event (VTE_TERMINAL (screen), event);
+}
+
+/*
+ * classify_url_match:
+ * @match: a string matched by %REGEX_URL_COMBINED
+ *
+ * Returns: the flavor of the named group in %REGEX_URL_COMBINED that matched @match
+ */
+static TerminalURLFlavor
+classify_url_match (const char *match)
+{
+  pcre2_match_data_8 *match_data;
+  PCRE2_SIZE *ovector;
+  TerminalURLFlavor flavor = FLAVOR_AS_IS;
+  guint i;
+  int r;
+
+  if (url_regex_combined_code == NULL)
+    {
+      PCRE2_SIZE error_offset;
+      int error_code;
+
+      url_regex_combined_code = pcre2_compile_8 ((PCRE2_SPTR8) REGEX_URL_COMBINED,
+                                                 PCRE2_ZERO_TERMINATED,
+                                                 PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_MULTILINE,
+                                                 &error_code, &error_offset,
+                                                 NULL);
+      g_assert (url_regex_combined_code != NULL);
+    }
+
+  match_data = pcre2_match_data_create_from_pattern_8 (url_regex_combined_code, NULL);
+  r = pcre2_match_8 (url_regex_combined_code,
+                     (PCRE2_SPTR8) match, strlen (match),
+                     0, PCRE2_ANCHORED | PCRE2_NO_UTF_CHECK,
+                     match_data, NULL);
+  if (r < 0)
+    goto out;
+
+  ovector = pcre2_get_ovector_pointer_8 (match_data);
+  for (i = 0; i < G_N_ELEMENTS (url_regex_combined_groups); i++)
+    {
+      int n = pcre2_substring_number_from_name_8 (url_regex_combined_code,
+                                                  (PCRE2_SPTR8) url_regex_combined_groups[i].name);
+      if (n > 0 && n < r && ovector[2 * n] != PCRE2_UNSET)
+        {
+          flavor = url_regex_combined_groups[i].flavor;
+          break;
+        }
+    }
+
+ out:
+  pcre2_match_data_free_8 (match_data);
+  return flavor;
+}
+
+static guint match_cache_hits;
+static guint match_cache_misses;
+
+static void
+match_cache_clear (MatchCache *cache)
+{
+  g_clear_pointer (&cache->url, g_free);
+  g_clear_pointer (&cache->number, g_free);
+  cache->valid = FALSE;
+}
+
+/*
+ * event_get_cell:
+ *
+ * Returns: %FALSE if @event is not over a cell
+ */
+static gboolean
+event_get_cell (TerminalScreen *screen,
+                GdkEvent       *event,
+                glong          *row,
+                glong          *column)
+{
+  GtkWidget *widget = GTK_WIDGET (screen);
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GtkAdjustment *adjustment;
+  GtkBorder padding;
+  glong char_width, char_height;
+  gdouble x, y;
+
+  if (!gdk_event_get_coords (event, &x, &y))
+    return FALSE;
+
+  char_width = vte_terminal_get_char_width (terminal);
+  char_height = vte_terminal_get_char_height (terminal);
+  if (char_width <= 0 || char_height <= 0)
+    return FALSE;
+
+  gtk_style_context_get_padding (gtk_widget_get_style_context (widget),
+                                 gtk_widget_get_state_flags (widget),
+                                 &padding);
+  x -= padding.left;
+  y -= padding.top;
+  if (x < 0 || y < 0)
+    return FALSE;
+
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  *column = (glong) x / char_width;
+  *row = (glong) y / char_height + (glong) gtk_adjustment_get_value (adjustment);
+
+  return *column < vte_terminal_get_column_count (terminal);
+}
+
+/*
+ * terminal_screen_check_matches:
+ * @screen:
+ * @event: the button event
+ * @check_extra: whether to look for the extra regexes too
+ * @url: (out): the URL under the pointer, or %NULL
+ * @url_flavor: (out): the flavor of @url
+ * @number: (out) (allow-none): the number under the pointer, or %NULL
+ *
+ * Classifies the text under the pointer with all the regexes at once,
+ * so VTE only extracts the text around the event once.
+ */
+static void
+terminal_screen_check_matches (TerminalScreen *screen,
+                               GdkEvent       *event,
+                               gboolean        check_extra,
+                               char          **url,
+                               int            *url_flavor,
+                               char          **number)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  MatchCache *cache = &priv->match_cache;
+  glong row = -1, column = -1;
+  gboolean cacheable;
+  guint i, n_regexes;
+  char **matches;
+
+  /* Pressing again on the same cell, e.g. a ctrl+click after the popup,
+   * gets the same answer as long as the contents did not change.
+   */
+  cacheable = event_get_cell (screen, event, &row, &column);
+  if (cacheable &&
+      cache->valid &&
+      cache->contents_serial == priv->contents_serial &&
+      cache->row == row &&
+      cache->column == column &&
+      (cache->extra || !check_extra))
+    {
+      match_cache_hits++;
+      _terminal_debug_print (TERMINAL_DEBUG_MATCHES,
+                             "Match cache hit at %ld,%ld (%u hits, %u misses)\n",
+                             row, column, match_cache_hits, match_cache_misses);
+
+      *url = g_strdup (cache->url);
+      *url_flavor = cache->url_flavor;
+      if (number != NULL)
+        *number = g_strdup (cache->number);
+      return;
+    }
+
+  match_cache_misses++;
+  _terminal_debug_print (TERMINAL_DEBUG_MATCHES,
+                         "Match cache miss at %ld,%ld (%u hits, %u misses)\n",
+                         row, column, match_cache_hits, match_cache_misses);
+
+  match_cache_clear (cache);
+
+  n_regexes = n_url_regexes + (check_extra ? n_extra_regexes : 0);
+  matches = g_newa (char *, n_regexes);
+  memset (matches, 0, sizeof (char *) * n_regexes);
+
+  if (!vte_terminal_event_check_regex_simple (VTE_TERMINAL (screen),
+                                              event,
+                                              click_regexes,
+                                              n_regexes,
+                                              0,
+                                              matches))
+    goto out;
+
+  /* Store the first match for each flavor, free all the others */
+  for (i = 0; i < n_regexes; i++)
+    {
+      if (matches[i] == NULL)
+        continue;
+
+      if (i < n_url_regexes)
+        {
+          if (*url == NULL)
+            {
+              *url = matches[i];
+              *url_flavor = classify_url_match (matches[i]);
+              continue;
+            }
+        }
+      else if (extra_regex_flavors[i - n_url_regexes] == FLAVOR_NUMBER &&
+               number != NULL && *number == NULL)
+        {
+          *number = matches[i];
+          continue;
+        }
+
+      g_free (matches[i]);
+    }
+
+ out:
+  if (cacheable)
+    {
+      cache->valid = TRUE;
+      cache->contents_serial = priv->contents_serial;
+      cache->row = row;
+      cache->column = column;
+      cache->extra = check_extra;
+      cache->url = g_strdup (*url);
+      cache->url_flavor = *url_flavor;
+      cache->number = number ? g_strdup (*number) : NULL;
+    }
+}
+
+/**
+ * terminal_screen_jit_regexes:
+ *
+ * Starts JITing the match regexes, one at a time when idle. If no screen
+ * was created yet, this happens once the regexes are compiled.
+ */
+void
+terminal_screen_jit_regexes (void)
+{
+  jit_regexes_wanted = TRUE;
+
+  if (url_regexes == NULL || jit_regexes_source_id != 0 ||
+      n_jitted_regexes == n_url_regexes + n_extra_regexes)
+    return;
+
+  jit_regexes_source_id = g_idle_add_full (G_PRIORITY_LOW, jit_regexes_idle_cb, NULL, NULL);
+}
+
+/**
+ * terminal_screen_get_foreground_pgrp:
+ * @screen:
+ *
+ * Returns: the process group ID of the foreground process running
+ *   in @screen, or -1 if there is none
+ */
+int
+terminal_screen_get_foreground_pgrp (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VtePty *pty;
+  int fd;
+  int fgpid;
+
+  if (priv->child_pid == -1)
+    return -1;
+
+  pty = priv->detached_pty;
+  if (pty == NULL)
+    pty = vte_terminal_get_pty (VTE_TERMINAL (screen));
+  if (pty == NULL)
+    return -1;
+
+  fd = vte_pty_get_fd (pty);
+  if (fd == -1)
+    return -1;
+
+  fgpid = tcgetpgrp (fd);
+  if (fgpid == -1 || fgpid == priv->child_pid)
+    return -1;
+
+  return fgpid;
+}
+
+/*
+ * get_process_cmdline:
+ * @pid: a process ID
+ * @process_name: (out) (allow-none): the basename of the program, or %NULL
+ * @cmdline: (out) (allow-none): the full command line, or %NULL
+ *
+ * Reads the command line of @pid. This may block on procfs, so it
+ * must not be called from the main thread when it can be avoided.
+ */
+static void
+get_process_cmdline (int    pid,
+                     char **process_name,
+                     char **cmdline)
+{
+  gs_free char *command = NULL;
+  gs_free char *data_buf = NULL;
+  gs_free char *basename = NULL;
+  gs_free char *name = NULL;
+#if defined(__FreeBSD__) || defined(__DragonFly__) || defined(__OpenBSD__)
+  int mib[4];
+#else
+  char filename[64];
+#endif
+  char *data;
+  gsize i;
+  gsize len;
+
+#if defined(__FreeBSD__) || defined(__DragonFly__)
+  mib[0] = CTL_KERN;
+  mib[1] = KERN_PROC;
+  mib[2] = KERN_PROC_ARGS;
+  mib[3] = pid;
+  if (sysctl (mib, G_N_ELEMENTS (mib), NULL, &len, NULL, 0) == -1)
+      return;
+
+  data_buf = g_malloc0 (len);
+  if (sysctl (mib, G_N_ELEMENTS (mib), data_buf, &len, NULL, 0) == -1)
+      return;
+  data = data_buf;
+#elif defined(__OpenBSD__)
+  mib[0] = CTL_KERN;
+  mib[1] = KERN_PROC_ARGS;
+  mib[2] = pid;
+  mib[3] = KERN_PROC_ARGV;
+  if (sysctl (mib, G_N_ELEMENTS (mib), NULL, &len, NULL, 0) == -1)
+      return;
+
+  data_buf = g_malloc0 (len);
+  if (sysctl (mib, G_N_ELEMENTS (mib), data_buf, &len, NULL, 0) == -1)
+      return;
+  data = ((char**)data_buf)[0];
+#else
+  g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", pid);
+  if (!g_file_get_contents (filename, &data_buf, &len, NULL))
+    return;
+  data = data_buf;
+#endif
+
+  basename = g_path_get_basename (data);
+  if (!basename)
+    return;
+
+  name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
+  if (!name)
+    return;
+
+  if (process_name)
+    gs_transfer_out_value (process_name, &name);
+
+  if (!cmdline)
+    return;
+
+  if (len > 0 && data[len - 1] == '\0')
+    len--;
+  for (i = 0; i < len; i++)
+    {
+      if (data[i] == '\0')
+        data[i] = ' ';
+    }
+
+  command = g_filename_to_utf8 (data, -1, NULL, NULL, NULL);
+  if (!command)
+    return;
+
+  gs_transfer_out_value (cmdline, &command);
+}
+
+/**
+ * terminal_screen_has_foreground_process:
+ * @screen:
+ * @process_name: (out) (allow-none): the basename of the program, or %NULL
+ * @cmdline: (out) (allow-none): the full command line, or %NULL
+ *
+ * Checks whether there's a foreground process running in
+ * this terminal.
+ *
+ * Note that when @process_name or @cmdline are non-%NULL, this reads
+ * the process' command line synchronously; use
+ * terminal_screen_get_foreground_process_async() from the main thread instead.
+ * 
+ * Returns: %TRUE iff there's a foreground process running in @screen
+ */
+gboolean
+terminal_screen_has_foreground_process (TerminalScreen *screen,
+                                        char           **process_name,
+                                        char           **cmdline)
+{
+  int fgpid;
+
+  fgpid = terminal_screen_get_foreground_pgrp (screen);
+  if (fgpid == -1)
+    return FALSE;
+
+  if (process_name || cmdline)
+    get_process_cmdline (fgpid, process_name, cmdline);
+
+  return TRUE;
+}
+
+/* Asynchronous foreground process inspection
+ *
+ * The command lines are read on a small dedicated thread pool. Results
+ * are cached by (process group ID, start time) so that a recycled PID
+ * is never mistaken for the process it replaced.
+ */
+
+#define FOREGROUND_PROCESS_MAX_THREADS     (2)
+#define FOREGROUND_PROCESS_CACHE_MAX_SIZE  (256)
+
+typedef struct {
+  int pgrp;
+  guint64 start_time;
+  char *process_name;
+  char *cmdline;
+} ForegroundProcessInfo;
+
+static GThreadPool *foreground_process_pool;
+static GHashTable *foreground_process_cache; /* pgrp -> ForegroundProcessInfo */
+G_LOCK_DEFINE_STATIC (foreground_process_cache);
+
+static void
+foreground_process_info_free (ForegroundProcessInfo *info)
+{
+  g_free (info->process_name);
+  g_free (info->cmdline);
+  g_slice_free (ForegroundProcessInfo, info);
+}
+
+static ForegroundProcessInfo *
+foreground_process_info_copy (const ForegroundProcessInfo *info)
+{
+  ForegroundProcessInfo *copy;
+
+  copy = g_slice_new (ForegroundProcessInfo);
+  copy->pgrp = info->pgrp;
+  copy->start_time = info->start_time;
+  copy->process_name = g_strdup (info->process_name);
+  copy->cmdline = g_strdup (info->cmdline);
+  return copy;
+}
+
+/*
+ * get_process_start_time:
+ * @pid: a process ID
+ *
+ * Returns: the start time of @pid in clock ticks since boot, or 0 if it
+ *   could not be determined, in which case the result must not be cached
+ */
+static guint64
+get_process_start_time (int pid)
+{
+#if defined(__linux__)
+  gs_free char *contents = NULL;
+  char filename[64];
+  char *p;
+  guint i;
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/stat", pid);
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return 0;
+
+  /* The comm field may contain spaces and parentheses; skip past its end.
+   * The start time is then the 20th field following it.
+   */
+  p = strrchr (contents, ')');
+  if (p == NULL)
+    return 0;
+
+  for (i = 0; i < 20 && p != NULL; i++)
+    p = strchr (p + 1, ' ');
+  if (p == NULL)
+    return 0;
+
+  return g_ascii_strtoull (p + 1, NULL, 10);
+#else
+  return 0;
+#endif
+}
+
+static void
+foreground_process_thread_func (GTask *task,
+                                gpointer user_data)
+{
+  ForegroundProcessInfo *info, *cached;
+  int pgrp = GPOINTER_TO_INT (g_task_get_task_data (task));
+
+  if (g_task_return_error_if_cancelled (task))
+    goto out;
+
+  info = g_slice_new0 (ForegroundProcessInfo);
+  info->pgrp = pgrp;
+  info->start_time = get_process_start_time (pgrp);
+
+  if (info->start_time != 0)
+    {
+      G_LOCK (foreground_process_cache);
+      cached = g_hash_table_lookup (foreground_process_cache, GINT_TO_POINTER (pgrp));
+      if (cached != NULL && cached->start_time == info->start_time)
+        {
+          foreground_process_info_free (info);
+          info = foreground_process_info_copy (cached);
+          G_UNLOCK (foreground_process_cache);
+
+          _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                                 "Foreground process %d found in cache\n", pgrp);
+          g_task_return_pointer (task, info, (GDestroyNotify) foreground_process_info_free);
+          goto out;
+        }
+      G_UNLOCK (foreground_process_cache);
+    }
+
+  get_process_cmdline (pgrp, &info->process_name, &info->cmdline);
+
+  if (info->start_time != 0)
+    {
+      G_LOCK (foreground_process_cache);
+      if (g_hash_table_size (foreground_process_cache) >= FOREGROUND_PROCESS_CACHE_MAX_SIZE)
+        g_hash_table_remove_all (foreground_process_cache);
+      g_hash_table_replace (foreground_process_cache, GINT_TO_POINTER (pgrp),
+                            foreground_process_info_copy (info));
+      G_UNLOCK (foreground_process_cache);
+    }
+
+  g_task_return_pointer (task, info, (GDestroyNotify) foreground_process_info_free);
+
+ out:
+  g_object_unref (task);
+}
+
+/**
+ * terminal_screen_get_foreground_process_async:
+ * @screen:
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
+ *
+ * Like terminal_screen_has_foreground_process(), but reads the
+ * foreground process' command line on a worker thread.
+ * Call terminal_screen_get_foreground_process_finish() from @callback
+ * to get the result.
+ */
+void
+terminal_screen_get_foreground_process_async (TerminalScreen *screen,
+                                               GCancellable *cancellable,
+                                               GAsyncReadyCallback callback,
+                                               gpointer user_data)
+{
+  GTask *task;
+  int pgrp;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  task = g_task_new (screen, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_screen_get_foreground_process_async);
+
+  pgrp = terminal_screen_get_foreground_pgrp (screen);
+  if (pgrp == -1)
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      g_object_unref (task);
+      return;
+    }
+
+  if (g_once_init_enter (&foreground_process_pool))
+    {
+      GThreadPool *pool;
+
+      foreground_process_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                        NULL,
+                                                        (GDestroyNotify) foreground_process_info_free);
+      pool = g_thread_pool_new ((GFunc) foreground_process_thread_func, NULL,
+                                FOREGROUND_PROCESS_MAX_THREADS, FALSE, NULL);
+      g_once_init_leave (&foreground_process_pool, pool);
+    }
+
+  g_task_set_task_data (task, GINT_TO_POINTER (pgrp), NULL);
+  g_thread_pool_push (foreground_process_pool, task /* adopted */, NULL);
+}
+
+/**
+ * terminal_screen_get_foreground_process_finish:
+ * @screen:
+ * @result: the #GAsyncResult
+ * @process_name: (out) (allow-none): the basename of the program, or %NULL
+ * @cmdline: (out) (allow-none): the full command line, or %NULL
+ * @error: a #GError location, or %NULL
+ *
+ * Returns: %TRUE iff there's a foreground process running in @screen; %FALSE
+ *   if there is none, or on error in which case @error is set
+ */
+gboolean
+terminal_screen_get_foreground_process_finish (TerminalScreen *screen,
+                                                GAsyncResult *result,
+                                                char **process_name,
+                                                char **cmdline,
+                                                GError **error)
+{
+  ForegroundProcessInfo *info;
+
+  g_return_val_if_fail (g_task_is_valid (result, screen), FALSE);
+
+  info = g_task_propagate_pointer (G_TASK (result), error);
+  if (info == NULL)
+    return FALSE;
+
+  if (process_name)
+    gs_transfer_out_value (process_name, &info->process_name);
+  if (cmdline)
+    gs_transfer_out_value (cmdline, &info->cmdline);
+
+  foreground_process_info_free (info);
+  return TRUE;
+}
+
+const char *
+terminal_screen_get_uuid (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+
+  return screen->priv->uuid;
+}
+
+/**
+ * terminal_screen_get_handle:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: the handle the #TerminalApp assigned to @screen
+ */
+guint
+terminal_screen_get_handle (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  return screen->priv->handle;
+}
+
+static long
+get_scrollback_rows (TerminalScreen *screen)
+{
+  GtkAdjustment *adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+
+  return MAX (0, (long) (gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_lower (adjustment))
+                 - vte_terminal_get_row_count (VTE_TERMINAL (screen)));
+}
+
+/**
+ * terminal_screen_get_scrollback_bytes:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: an estimate of the memory used by the scrollback of @screen,
+ *   including the copy kept from the last search
+ */
+gsize
+terminal_screen_get_scrollback_bytes (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv;
+  gsize bytes;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  priv = screen->priv;
+  bytes = (gsize) get_scrollback_rows (screen) *
+    vte_terminal_get_column_count (VTE_TERMINAL (screen)) *
+    SCROLLBACK_BYTES_PER_CELL;
+  if (priv->search_snapshot)
+    bytes += search_snapshot_get_size (priv->search_snapshot);
+
+  return bytes;
+}
+
+/**
+ * terminal_screen_get_contents_changes:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: how many times the contents of @screen changed, which counts
+ *   the batches of output VTE processed from the PTY
+ */
+guint
+terminal_screen_get_contents_changes (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  return screen->priv->contents_serial;
+}
+
+/**
+ * terminal_screen_is_hot:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: whether @screen has been outputting or drawing a lot during
+ *   the last few seconds; see the "hot" property
+ */
+gboolean
+terminal_screen_is_hot (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+
+  return screen->priv->hot;
+}
+
+/**
+ * terminal_screen_get_stats:
+ * @screen: a #TerminalScreen
+ *
+ * Returns the output and rendering statistics of @screen. The per-second
+ * "au" and "at" arrays cover the last few seconds, the oldest first; the
+ * current second, still in progress, comes last. Output is counted in
+ * rows, and durations are in microseconds.
+ *
+ * Returns: (transfer floating): an "a{sv}" #GVariant
+ */
+GVariant *
+terminal_screen_get_stats (TerminalScreen *screen)
+{
+  ScreenStats *stats;
+  GVariantBuilder builder, rows_builder, draw_time_builder;
+  gint64 s;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+
+  stats = &screen->priv->stats;
+  stats_get_bucket (screen); /* up to date */
+
+  g_variant_builder_init (&rows_builder, G_VARIANT_TYPE ("au"));
+  g_variant_builder_init (&draw_time_builder, G_VARIANT_TYPE ("at"));
+  for (s = stats->second - STATS_SECONDS + 1; s <= stats->second; s++) {
+    const StatsBucket *bucket = &stats->buckets[s % STATS_SECONDS];
+
+    g_variant_builder_add (&rows_builder, "u", bucket->output_rows);
+    g_variant_builder_add (&draw_time_builder, "t", bucket->draw_time);
+  }
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "output-rows", g_variant_new_uint64 (stats->output_rows));
+  g_variant_builder_add (&builder, "{sv}", "output-rows-per-second", g_variant_builder_end (&rows_builder));
+  g_variant_builder_add (&builder, "{sv}", "contents-changes", g_variant_new_uint32 (screen->priv->contents_serial));
+  g_variant_builder_add (&builder, "{sv}", "draws", g_variant_new_uint32 (stats->draws));
+  g_variant_builder_add (&builder, "{sv}", "draw-time", g_variant_new_uint64 (stats->draw_time));
+  g_variant_builder_add (&builder, "{sv}", "draw-time-per-second", g_variant_builder_end (&draw_time_builder));
+  g_variant_builder_add (&builder, "{sv}", "child-exits", g_variant_new_uint32 (stats->child_exits));
+  g_variant_builder_add (&builder, "{sv}", "hot", g_variant_new_boolean (screen->priv->hot));
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * terminal_screen_get_last_focus_time:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: the monotonic time @screen last gained or lost the focus,
+ *   or was created
+ */
+gint64
+terminal_screen_get_last_focus_time (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  if (gtk_widget_has_focus (GTK_WIDGET (screen)))
+    return g_get_monotonic_time ();
+
+  return screen->priv->last_focus_time;
+}
+
+/**
+ * terminal_screen_trim_scrollback:
+ * @screen: a #TerminalScreen
+ * @max_bytes: the memory the scrollback may keep if it can't be moved
+ *   to disk
+ *
+ * Frees the memory used by the scrollback of @screen. If the profile
+ * hibernates the scrollback, it is moved to disk; otherwise, or if that
+ * failed before, the oldest rows are discarded until the rest fits into
+ * @max_bytes.
+ *
+ * Returns: %TRUE if the scrollback is being moved to disk, in which case
+ *   its memory is only freed once that succeeded
+ */
+gboolean
+terminal_screen_trim_scrollback (TerminalScreen *screen,
+                                 gsize max_bytes)
+{
+  TerminalScreenPrivate *priv;
+  glong rows, max_rows;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+
+  priv = screen->priv;
+  search_snapshot_cache (screen, NULL);
+
+  if (g_settings_get_int (priv->profile, TERMINAL_PROFILE_HIBERNATE_TIMEOUT_KEY) > 0 &&
+      !priv->hibernate_failed &&
+      terminal_screen_hibernate (screen))
+    return TRUE;
+
+  rows = get_scrollback_rows (screen);
+  max_rows = max_bytes / ((gsize) vte_terminal_get_column_count (VTE_TERMINAL (screen)) *
+                          SCROLLBACK_BYTES_PER_CELL);
+  if (rows <= max_rows)
+    return FALSE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_MEMORY,
+                         "[screen %p] discarding %ld of %ld rows of scrollback\n",
+                         screen, rows - max_rows, rows);
+
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), max_rows);
+  update_scrollback_lines (screen);
+
+  return FALSE;
+}
+
+/* Chunked paste
+ *
+ * Large pastes are queued and written to the PTY a chunk at a time
+ * whenever it is writable, instead of all at once into VTE's unbounded
+ * write buffer, so they go at the pace the child reads them; an info bar
+ * shows the progress and allows to cancel the paste.
+ *
+ * Only VTE knows whether the application asked for bracketed paste, so
+ * text from the clipboard is still pasted by VTE, but with the PTY taken
+ * away: what VTE commits, brackets and all, is captured and written out
+ * here instead of into VTE's write buffer. See terminal_screen_paste_clipboard().
+ */
+
+typedef struct {
+  char *data;
+  gsize len;
+  gsize offset;
+  gboolean newlines_to_cr;
+  gboolean last_was_cr;
+} PasteSegment;
+
+static void
+paste_segment_free (PasteSegment *segment)
+{
+  g_free (segment->data);
+  g_slice_free (PasteSegment, segment);
+}
+
+/* Like VTE's own paste, turns "\r\n" and "\n" into "\r" */
+static gsize
+paste_segment_convert_chunk (PasteSegment *segment,
+                             char *out,
+                             gsize len)
+{
+  const char *in = segment->data + segment->offset;
+  gsize i, n = 0;
+
+  for (i = 0; i < len; i++) {
+    char c = in[i];
+
+    if (c == '\n') {
+      if (!segment->last_was_cr)
+        out[n++] = '\r';
+    } else {
+      out[n++] = c;
+    }
+    segment->last_was_cr = (c == '\r');
+  }
+
+  return n;
+}
+
+static void
+paste_feed (TerminalScreen *screen,
+            PasteSegment *segment,
+            gsize len)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+
+  if (segment->newlines_to_cr) {
+    char buf[PASTE_CHUNK_SIZE];
+    gsize done = 0;
+
+    while (done < len) {
+      gsize n = MIN (len - done, sizeof (buf));
+
+      vte_terminal_feed_child (terminal, buf, paste_segment_convert_chunk (segment, buf, n));
+      segment->offset += n;
+      done += n;
+    }
+  } else {
+    vte_terminal_feed_child (terminal, segment->data + segment->offset, len);
+    segment->offset += len;
+  }
+}
+
+static void paste_queue_segment (TerminalScreen *screen,
+                                 PasteSegment *segment,
+                                 VtePty *pty);
+
+static void
+paste_update_info_bar (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GtkWidget *info_bar;
+
+  /* Small pastes are only queued behind a large one, or captured */
+  if (priv->paste_info_bar == NULL && priv->paste_total < PASTE_CHUNKED_THRESHOLD)
+    return;
+
+  if (priv->paste_info_bar == NULL) {
+    info_bar = terminal_info_bar_new (GTK_MESSAGE_INFO,
+                                      _("_Cancel"), RESPONSE_CANCEL_PASTE,
+                                      NULL);
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                   _("Pasting…"));
+    priv->paste_progress = gtk_progress_bar_new ();
+    gtk_box_pack_start (GTK_BOX (gtk_info_bar_get_content_area (GTK_INFO_BAR (info_bar))),
+                        priv->paste_progress, FALSE, FALSE, 0);
+    gtk_widget_show (priv->paste_progress);
+
+    g_signal_connect (info_bar, "response",
+                      G_CALLBACK (info_bar_response_cb), screen);
+
+    gtk_widget_set_halign (info_bar, GTK_ALIGN_FILL);
+    gtk_widget_set_valign (info_bar, GTK_ALIGN_START);
+    gtk_overlay_add_overlay (GTK_OVERLAY (terminal_screen_container_get_from_screen (screen)),
+                             info_bar);
+    gtk_widget_show (info_bar);
+
+    priv->paste_info_bar = info_bar;
+    g_object_add_weak_pointer (G_OBJECT (info_bar), (gpointer *) &priv->paste_info_bar);
+  }
+
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (priv->paste_progress),
+                                 (double) priv->paste_done / (double) priv->paste_total);
+}
+
+static gboolean
+paste_pty_writable_cb (int fd,
+                       GIOCondition condition,
+                       TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GByteArray *pending = priv->paste_pending;
+  PasteSegment *segment;
+  gssize written;
+
+  if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] PTY went away during paste\n", screen);
+    priv->paste_source_id = 0;
+    terminal_screen_cancel_paste (screen);
+    return G_SOURCE_REMOVE;
+  }
+
+  segment = g_queue_peek_head (&priv->paste_queue);
+  if (pending->len == 0) {
+    gsize len = MIN (segment->len - segment->offset, PASTE_CHUNK_SIZE);
+
+    g_byte_array_set_size (pending, len);
+    if (segment->newlines_to_cr)
+      g_byte_array_set_size (pending, paste_segment_convert_chunk (segment, (char *) pending->data, len));
+    else
+      memcpy (pending->data, segment->data + segment->offset, len);
+    segment->offset += len;
+    priv->paste_done += len;
+  }
+
+  /* The PTY is non-blocking, so this only writes what fits */
+  written = write (fd, pending->data, pending->len);
+  if (written < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return G_SOURCE_CONTINUE;
+
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] writing the paste failed: %s\n",
+                           screen, g_strerror (errno));
+    priv->paste_source_id = 0;
+    terminal_screen_cancel_paste (screen);
+    return G_SOURCE_REMOVE;
+  }
+  g_byte_array_remove_range (pending, 0, written);
+  if (pending->len > 0)
+    return G_SOURCE_CONTINUE;
+
+  if (segment->offset == segment->len)
+    paste_segment_free (g_queue_pop_head (&priv->paste_queue));
+
+  if (g_queue_is_empty (&priv->paste_queue)) {
+    priv->paste_source_id = 0;
+    terminal_screen_cancel_paste (screen); /* done; tears down the info bar */
+    return G_SOURCE_REMOVE;
+  }
+
+  paste_update_info_bar (screen);
+  return G_SOURCE_CONTINUE;
+}
+
+/**
+ * terminal_screen_paste_text:
+ * @screen: a #TerminalScreen
+ * @text: (transfer full): the text to paste
+ * @len: the length of @text
+ * @newlines_to_cr: whether to convert newlines to carriage returns, like
+ *   vte_terminal_paste_clipboard() does
+ *
+ * Feeds @text to the child. Large pastes are written in chunks as the
+ * child reads them; any text pasted meanwhile is queued after them.
+ * This doesn't use bracketed paste, so @text mustn't come from the
+ * clipboard; see terminal_screen_paste_clipboard().
+ */
+void
+terminal_screen_paste_text (TerminalScreen *screen,
+                            char *text,
+                            gsize len,
+                            gboolean newlines_to_cr)
+{
+  TerminalScreenPrivate *priv;
+  PasteSegment *segment;
+  VtePty *pty;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+
+  segment = g_slice_new0 (PasteSegment);
+  segment->data = text;
+  segment->len = len;
+  segment->newlines_to_cr = newlines_to_cr;
+
+  /* The child is expecting input, so don't keep its output waiting */
+  background_throttle_stop (screen);
+
+  pty = vte_terminal_get_pty (VTE_TERMINAL (screen));
+
+  if (g_queue_is_empty (&priv->paste_queue) &&
+      (len < PASTE_CHUNKED_THRESHOLD || pty == NULL)) {
+    paste_feed (screen, segment, len);
+    paste_segment_free (segment);
+    return;
+  }
+
+  paste_queue_segment (screen, segment, pty);
+}
+
+static void
+paste_queue_segment (TerminalScreen *screen,
+                     PasteSegment *segment /* adopted */,
+                     VtePty *pty)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] queueing paste of %" G_GSIZE_FORMAT " bytes\n",
+                         screen, segment->len);
+
+  g_queue_push_tail (&priv->paste_queue, segment);
+  priv->paste_total += segment->len;
+  if (priv->paste_pending == NULL)
+    priv->paste_pending = g_byte_array_sized_new (PASTE_CHUNK_SIZE);
+
+  if (priv->paste_source_id == 0) {
+    /* Low priority, so what VTE writes itself, like keystrokes, gets out first */
+    priv->paste_source_id =
+      g_unix_fd_add_full (G_PRIORITY_LOW,
+                          vte_pty_get_fd (pty),
+                          G_IO_OUT | G_IO_ERR | G_IO_HUP,
+                          (GUnixFDSourceFunc) paste_pty_writable_cb,
+                          screen, NULL);
+  }
+
+  paste_update_info_bar (screen);
+}
+
+/* Ends capturing what VTE pastes, gives the PTY back to VTE, and queues
+ * the captured text for writing after any paste in progress.
+ */
+static void
+paste_capture_finish (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GByteArray *capture = priv->paste_capture;
+  PasteSegment *segment;
+  VtePty *pty;
+
+  if (capture == NULL)
+    return;
+
+  priv->paste_capture = NULL;
+  if (priv->paste_capture_source_id != 0) {
+    g_source_remove (priv->paste_capture_source_id);
+    priv->paste_capture_source_id = 0;
+  }
+
+  terminal_screen_attach_pty (screen);
+
+  pty = vte_terminal_get_pty (VTE_TERMINAL (screen));
+  if (pty == NULL) {
+    g_byte_array_unref (capture);
+    return;
+  }
+
+  /* Write what fits right away, so that keys typed after a small paste
+   * can't overtake it; the PTY is non-blocking.
+   */
+  if (g_queue_is_empty (&priv->paste_queue) && capture->len > 0) {
+    gssize written = write (vte_pty_get_fd (pty), capture->data, capture->len);
+
+    if (written > 0)
+      g_byte_array_remove_range (capture, 0, written);
+  }
+
+  if (capture->len == 0) {
+    g_byte_array_unref (capture);
+    return;
+  }
+
+  segment = g_slice_new0 (PasteSegment);
+  segment->len = capture->len;
+  segment->data = (char *) g_byte_array_free (capture, FALSE);
+  paste_queue_segment (screen, segment, pty);
+}
+
+static gboolean
+paste_capture_cb (TerminalScreen *screen)
+{
+  screen->priv->paste_capture_source_id = 0;
+  paste_capture_finish (screen);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * terminal_screen_paste_clipboard:
+ * @screen: a #TerminalScreen
+ *
+ * Pastes the text on the clipboard, like vte_terminal_paste_clipboard(),
+ * including its bracketed paste; but the text is then written with the
+ * chunked paste, so a large paste doesn't block the UI or pile up in
+ * VTE's write buffer.
+ */
+void
+terminal_screen_paste_clipboard (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv;
+  VteTerminal *terminal;
+  VtePty *pty;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  terminal = VTE_TERMINAL (screen);
+
+  /* The child is expecting input, so don't keep its output waiting */
+  background_throttle_stop (screen);
+
+  pty = vte_terminal_get_pty (terminal);
+  if (pty == NULL || priv->child_pid == -1) {
+    vte_terminal_paste_clipboard (terminal);
+    return;
+  }
+
+  /* Without a PTY, VTE only emits what it pastes as "commit", and the
+   * output stops until the capture ends; if the clipboard doesn't answer
+   * in time, VTE writes the paste itself.
+   */
+  priv->paste_capture = g_byte_array_new ();
+  priv->detached_pty = g_object_ref (pty);
+  vte_terminal_set_pty (terminal, NULL);
+  priv->paste_capture_source_id =
+    _terminal_watchdog_timeout_add (PASTE_CAPTURE_TIMEOUT, "paste capture",
+                                    (GSourceFunc) paste_capture_cb, screen);
+
+  vte_terminal_paste_clipboard (terminal);
+}
+
+/**
+ * terminal_screen_cancel_paste:
+ * @screen: a #TerminalScreen
+ *
+ * Drops the part of a chunked paste that hasn't been fed to the child yet.
+ */
+void
+terminal_screen_cancel_paste (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+
+  if (priv->paste_source_id != 0) {
+    g_source_remove (priv->paste_source_id);
+    priv->paste_source_id = 0;
+  }
+
+  g_queue_foreach (&priv->paste_queue, (GFunc) paste_segment_free, NULL);
+  g_queue_clear (&priv->paste_queue);
+  if (priv->paste_pending)
+    g_byte_array_set_size (priv->paste_pending, 0);
+  priv->paste_total = priv->paste_done = 0;
+
+  if (priv->paste_info_bar != NULL)
+    gtk_widget_destroy (priv->paste_info_bar);
+  priv->paste_progress = NULL;
+}
+
+/* Searching the scrollback */
+
+/* The scrollback is copied this many rows at a time, so even a huge
+ * scrollback does not block the main loop for long.
+ */
+#define SEARCH_SNAPSHOT_ROWS (2000)
+
+#define SEARCH_EXCERPT_CONTEXT (60)
+
+/* The copy of the scrollback is kept for later searches for this long */
+#define SEARCH_SNAPSHOT_TIMEOUT (30 /* s */)
+
+struct _SearchSnapshot {
+  volatile gint ref_count;
+  guint serial; /* priv->contents_serial when taken */
+  glong first_row;
+  GString *text;
+  GArray *row_offsets; /* gsize; where each row starts in text */
+};
+
+typedef struct {
+  char *pattern; /* NULL when only taking a snapshot */
+  guint32 compile_flags;
+  SearchSnapshot *snapshot;
+  gboolean cache; /* the snapshot has the whole scrollback */
+  glong next_row;
+  glong end_row;
+  guint idle_id;
+} SearchData;
+
+static SearchSnapshot *
+search_snapshot_ref (SearchSnapshot *snapshot)
+{
+  g_atomic_int_inc (&snapshot->ref_count);
+  return snapshot;
+}
+
+static void
+search_snapshot_unref (SearchSnapshot *snapshot)
+{
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  g_string_free (snapshot->text, TRUE);
+  g_array_unref (snapshot->row_offsets);
+  g_slice_free (SearchSnapshot, snapshot);
+}
+
+static gsize
+search_snapshot_get_size (SearchSnapshot *snapshot)
+{
+  return snapshot->text->allocated_len + snapshot->row_offsets->len * sizeof (gsize);
+}
+
+static gboolean
+search_snapshot_timeout_cb (gpointer user_data)
+{
+  TerminalScreen *screen = user_data;
+
+  screen->priv->search_snapshot_source_id = 0;
+  search_snapshot_cache (screen, NULL);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Keeps @snapshot for later searches, until SEARCH_SNAPSHOT_TIMEOUT has
+ * passed without it being used, or drops the kept one if it's %NULL.
+ */
+static void
+search_snapshot_cache (TerminalScreen *screen,
+                       SearchSnapshot *snapshot)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  TerminalScreenContainer *container;
-  GtkPolicyType vpolicy;
 
-  container = terminal_screen_container_get_from_screen (screen);
-  if (container == NULL)
-    return;
+  if (priv->search_snapshot_source_id != 0) {
+    g_source_remove (priv->search_snapshot_source_id);
+    priv->search_snapshot_source_id = 0;
+  }
 
-  vpolicy = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY);
+  if (snapshot != priv->search_snapshot) {
+    if (snapshot)
+      search_snapshot_ref (snapshot);
+    if (priv->search_snapshot)
+      search_snapshot_unref (priv->search_snapshot);
+    priv->search_snapshot = snapshot;
+  }
 
-  terminal_screen_container_set_policy (container, GTK_POLICY_NEVER, vpolicy);
+  if (snapshot)
+    priv->search_snapshot_source_id =
+      _terminal_watchdog_timeout_add_seconds (SEARCH_SNAPSHOT_TIMEOUT, "search snapshot timeout",
+                                              search_snapshot_timeout_cb, screen);
 }
 
-void
-terminal_screen_get_size (TerminalScreen *screen,
-			  int       *width_chars,
-			  int       *height_chars)
+static SearchSnapshot *
+search_snapshot_new (TerminalScreen *screen,
+                     glong first_row)
 {
-  VteTerminal *terminal = VTE_TERMINAL (screen);
+  SearchSnapshot *snapshot;
 
-  *width_chars = vte_terminal_get_column_count (terminal);
-  *height_chars = vte_terminal_get_row_count (terminal);
+  snapshot = g_slice_new0 (SearchSnapshot);
+  snapshot->ref_count = 1;
+  snapshot->serial = screen->priv->contents_serial;
+  snapshot->first_row = first_row;
+  snapshot->text = g_string_new (NULL);
+  snapshot->row_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+
+  return snapshot;
 }
 
-void
-terminal_screen_get_cell_size (TerminalScreen *screen,
-			       int                  *cell_width_pixels,
-			       int                  *cell_height_pixels)
+/* Returns the text of rows @start_row up to @end_row of @snapshot,
+ * without copying it.
+ */
+static GBytes *
+search_snapshot_get_bytes (SearchSnapshot *snapshot,
+                           glong start_row,
+                           glong end_row)
 {
-  VteTerminal *terminal = VTE_TERMINAL (screen);
+  gsize *row_offsets = (gsize *) snapshot->row_offsets->data;
+  gulong n_rows = snapshot->row_offsets->len;
+  gulong first = start_row - snapshot->first_row;
+  gulong last = end_row - snapshot->first_row;
+  gsize start, end;
+
+  start = first < n_rows ? row_offsets[first] : snapshot->text->len;
+  end = last < n_rows ? row_offsets[last] : snapshot->text->len;
+
+  return g_bytes_new_with_free_func (snapshot->text->str + start, end - start,
+                                     (GDestroyNotify) search_snapshot_unref,
+                                     search_snapshot_ref (snapshot));
+}
 
-  *cell_width_pixels = vte_terminal_get_char_width (terminal);
-  *cell_height_pixels = vte_terminal_get_char_height (terminal);
+static void
+search_data_free (SearchData *data)
+{
+  if (data->idle_id != 0)
+    g_source_remove (data->idle_id);
+  if (data->snapshot)
+    search_snapshot_unref (data->snapshot);
+  g_free (data->pattern);
+  g_slice_free (SearchData, data);
 }
 
-static char*
-terminal_screen_check_hyperlink (TerminalScreen *screen,
-                                 GdkEvent       *event)
+static void
+terminal_search_match_clear (TerminalSearchMatch *match)
 {
-  return vte_terminal_hyperlink_check_event (VTE_TERMINAL (screen), event);
+  g_free (match->excerpt);
 }
 
-static char*
-terminal_screen_check_match (TerminalScreen *screen,
-                             GdkEvent       *event,
-                             int       *flavor)
+static char *
+search_excerpt (const char *text,
+                gsize len,
+                gsize start,
+                gsize end)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSList *tags;
-  int tag;
-  char *match;
+  const char *p, *q;
+  glong n;
+
+  for (p = text + start, n = 0;
+       p > text && p[-1] != '\n' && n < SEARCH_EXCERPT_CONTEXT;
+       n++)
+    p = g_utf8_prev_char (p);
+  for (q = text + end, n = 0;
+       q < text + len && *q != '\n' && n < SEARCH_EXCERPT_CONTEXT;
+       n++)
+    q = g_utf8_next_char (q);
+
+  return g_strndup (p, q - p);
+}
 
-  match = vte_terminal_match_check_event (VTE_TERMINAL (screen), event, &tag);
-  for (tags = priv->match_tags; tags != NULL; tags = tags->next)
-    {
-      TagData *tag_data = (TagData*) tags->data;
-      if (tag_data->tag == tag)
-	{
-	  if (flavor)
-	    *flavor = tag_data->flavor;
-	  return match;
-	}
+static void
+search_thread_func (GTask *task,
+                    gpointer source_object,
+                    gpointer task_data,
+                    GCancellable *cancellable)
+{
+  SearchData *data = task_data;
+  SearchSnapshot *snapshot = data->snapshot;
+  const char *text = snapshot->text->str;
+  gsize len = snapshot->text->len;
+  gsize *row_offsets = (gsize *) snapshot->row_offsets->data;
+  guint n_rows = snapshot->row_offsets->len;
+  pcre2_code_8 *code;
+  pcre2_match_data_8 *match_data;
+  PCRE2_SIZE error_offset, offset;
+  int error_code;
+  GArray *matches;
+  guint row = 0;
+
+  code = pcre2_compile_8 ((PCRE2_SPTR8) data->pattern, PCRE2_ZERO_TERMINATED,
+                          data->compile_flags,
+                          &error_code, &error_offset,
+                          NULL);
+  if (code == NULL) {
+    PCRE2_UCHAR8 message[256];
+
+    pcre2_get_error_message_8 (error_code, message, sizeof (message));
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                             "%s", (const char *) message);
+    return;
+  }
+
+  /* Matching works fine without the JIT, only slower */
+  pcre2_jit_compile_8 (code, PCRE2_JIT_COMPLETE);
+
+  match_data = pcre2_match_data_create_from_pattern_8 (code, NULL);
+  matches = g_array_new (FALSE, FALSE, sizeof (TerminalSearchMatch));
+  g_array_set_clear_func (matches, (GDestroyNotify) terminal_search_match_clear);
+
+  offset = 0;
+  while (n_rows > 0 && offset <= len && matches->len < TERMINAL_SCREEN_SEARCH_MAX_MATCHES) {
+    TerminalSearchMatch match;
+    PCRE2_SIZE *ovector;
+    gsize start, end;
+
+    if (pcre2_match_8 (code, (PCRE2_SPTR8) text, len, offset,
+                       PCRE2_NO_UTF_CHECK, match_data, NULL) < 0)
+      break;
+
+    ovector = pcre2_get_ovector_pointer_8 (match_data);
+    start = ovector[0];
+    end = ovector[1];
+
+    /* Matches are found in order, so the row only ever moves forward */
+    while (row + 1 < n_rows && row_offsets[row + 1] <= start)
+      row++;
+
+    match.row = snapshot->first_row + row;
+    match.column = g_utf8_strlen (text + row_offsets[row], start - row_offsets[row]);
+    match.excerpt = search_excerpt (text, len, start, end);
+    g_array_append_val (matches, match);
+
+    if (end > start)
+      offset = end;
+    else if (start < len)
+      offset = g_utf8_next_char (text + start) - text;
+    else
+      break;
+
+    if ((matches->len % 256) == 0 && g_cancellable_is_cancelled (cancellable))
+      break;
+  }
+
+  pcre2_match_data_free_8 (match_data);
+  pcre2_code_free_8 (code);
+
+  if (g_task_return_error_if_cancelled (task)) {
+    g_array_unref (matches);
+    return;
+  }
+
+  g_task_return_pointer (task, matches, (GDestroyNotify) g_array_unref);
+}
+
+static gboolean
+search_snapshot_idle_cb (gpointer user_data)
+{
+  GTask *task = user_data;
+  TerminalScreen *screen = g_task_get_source_object (task);
+  TerminalScreenPrivate *priv = screen->priv;
+  SearchData *data = g_task_get_task_data (task);
+  SearchSnapshot *snapshot = data->snapshot;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  glong columns, end_row;
+
+  if (!g_task_return_error_if_cancelled (task)) {
+    columns = vte_terminal_get_column_count (terminal);
+    end_row = MIN (data->next_row + SEARCH_SNAPSHOT_ROWS, data->end_row);
+
+    /* Rows are copied one at a time to know where each one starts; a row
+     * only ends in a newline if it was not wrapped, so the text is the same
+     * as for the whole range.
+     */
+    for ( ; data->next_row < end_row; data->next_row++) {
+      gs_free char *row_text;
+
+      row_text = vte_terminal_get_text_range (terminal,
+                                              data->next_row, 0,
+                                              data->next_row, columns - 1,
+                                              NULL, NULL, NULL);
+      g_array_append_val (snapshot->row_offsets, snapshot->text->len);
+      if (row_text)
+        g_string_append (snapshot->text, row_text);
     }
 
-  g_free (match);
-  return NULL;
+    if (data->next_row < data->end_row)
+      return G_SOURCE_CONTINUE;
+
+    if (data->cache)
+      search_snapshot_cache (screen, snapshot);
+
+    if (data->pattern != NULL)
+      g_task_run_in_thread (task, search_thread_func);
+    else
+      g_task_return_pointer (task,
+                             search_snapshot_get_bytes (snapshot, snapshot->first_row, data->end_row),
+                             (GDestroyNotify) g_bytes_unref);
+  }
+
+  data->idle_id = 0;
+  priv->search_tasks = g_slist_remove (priv->search_tasks, task);
+  g_object_unref (task);
+
+  return G_SOURCE_REMOVE;
 }
 
 static void
-terminal_screen_check_extra (TerminalScreen *screen,
-                             GdkEvent       *event,
-                             char           **number_info)
+search_tasks_cancel (TerminalScreen *screen)
 {
-  guint i;
-  char **matches;
-  gboolean flavor_number_found = FALSE;
-
-  matches = g_newa (char *, n_extra_regexes);
-  memset(matches, 0, sizeof(char*) * n_extra_regexes);
-
-  if (
-      vte_terminal_event_check_regex_simple (VTE_TERMINAL (screen),
-                                             event,
-                                             extra_regexes,
-                                             n_extra_regexes,
-                                             0,
-                                             matches))
-    {
-      for (i = 0; i < n_extra_regexes; i++)
-        {
-          if (matches[i] != NULL)
-            {
-              /* Store the first match for each flavor, free all the others */
-              switch (extra_regex_flavors[i])
-                {
-                case FLAVOR_NUMBER:
-                  if (!flavor_number_found)
-                    {
-                      *number_info = terminal_util_number_info (matches[i]);
-                      flavor_number_found = TRUE;
-                    }
-                  g_free (matches[i]);
-                  break;
-                default:
-                  g_free (matches[i]);
-                }
-            }
-        }
-    }
+  TerminalScreenPrivate *priv = screen->priv;
+  GSList *tasks, *l;
+
+  tasks = priv->search_tasks;
+  priv->search_tasks = NULL;
+
+  for (l = tasks; l != NULL; l = l->next) {
+    GTask *task = l->data;
+    SearchData *data = g_task_get_task_data (task);
+
+    g_source_remove (data->idle_id);
+    data->idle_id = 0;
+
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                             "The terminal was closed");
+    g_object_unref (task);
+  }
+
+  g_slist_free (tasks);
 }
 
 /**
- * terminal_screen_has_foreground_process:
- * @screen:
- * @process_name: (out) (allow-none): the basename of the program, or %NULL
- * @cmdline: (out) (allow-none): the full command line, or %NULL
+ * terminal_screen_search_async:
+ * @screen: a #TerminalScreen
+ * @pattern: a PCRE2 pattern
+ * @compile_flags: the PCRE2 flags to compile @pattern with
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
  *
- * Checks whether there's a foreground process running in
- * this terminal.
- * 
- * Returns: %TRUE iff there's a foreground process running in @screen
+ * Finds the matches of @pattern in the scrollback and screen of @screen.
+ * The text is copied on idle and searched on a worker thread; the copy is
+ * reused by later searches until the contents of @screen change, or
+ * until it is dropped by terminal_screen_drop_search_snapshot() or for
+ * not being used for a while.
+ * Call terminal_screen_search_finish() from @callback to get the result.
  */
-gboolean
-terminal_screen_has_foreground_process (TerminalScreen *screen,
-                                        char           **process_name,
-                                        char           **cmdline)
+void
+terminal_screen_search_async (TerminalScreen *screen,
+                              const char *pattern,
+                              guint32 compile_flags,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  gs_free char *command = NULL;
-  gs_free char *data_buf = NULL;
-  gs_free char *basename = NULL;
-  gs_free char *name = NULL;
-  VtePty *pty;
-  int fd;
-#if defined(__FreeBSD__) || defined(__DragonFly__) || defined(__OpenBSD__)
-  int mib[4];
-#else
-  char filename[64];
-#endif
-  char *data;
-  gsize i;
-  gsize len;
-  int fgpid;
+  TerminalScreenPrivate *priv;
+  GtkAdjustment *adjustment;
+  SearchSnapshot *snapshot;
+  SearchData *data;
+  GTask *task;
 
-  if (priv->child_pid == -1)
-    return FALSE;
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  g_return_if_fail (pattern != NULL);
 
-  pty = vte_terminal_get_pty (VTE_TERMINAL (screen));
-  if (pty == NULL)
-    return FALSE;
+  priv = screen->priv;
 
-  fd = vte_pty_get_fd (pty);
-  if (fd == -1)
-    return FALSE;
+  task = g_task_new (screen, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_screen_search_async);
 
-  fgpid = tcgetpgrp (fd);
-  if (fgpid == -1 || fgpid == priv->child_pid)
-    return FALSE;
+  data = g_slice_new0 (SearchData);
+  data->pattern = g_strdup (pattern);
+  data->compile_flags = compile_flags;
+  g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
 
-#if defined(__FreeBSD__) || defined(__DragonFly__)
-  mib[0] = CTL_KERN;
-  mib[1] = KERN_PROC;
-  mib[2] = KERN_PROC_ARGS;
-  mib[3] = fgpid;
-  if (sysctl (mib, G_N_ELEMENTS (mib), NULL, &len, NULL, 0) == -1)
-      return TRUE;
+  if (priv->search_snapshot != NULL &&
+      priv->search_snapshot->serial == priv->contents_serial) {
+    data->snapshot = search_snapshot_ref (priv->search_snapshot);
+    search_snapshot_cache (screen, priv->search_snapshot); /* used, keep it longer */
+    g_task_run_in_thread (task, search_thread_func);
+    g_object_unref (task);
+    return;
+  }
 
-  data_buf = g_malloc0 (len);
-  if (sysctl (mib, G_N_ELEMENTS (mib), data_buf, &len, NULL, 0) == -1)
-      return TRUE;
-  data = data_buf;
-#elif defined(__OpenBSD__)
-  mib[0] = CTL_KERN;
-  mib[1] = KERN_PROC_ARGS;
-  mib[2] = fgpid;
-  mib[3] = KERN_PROC_ARGV;
-  if (sysctl (mib, G_N_ELEMENTS (mib), NULL, &len, NULL, 0) == -1)
-      return TRUE;
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
 
-  data_buf = g_malloc0 (len);
-  if (sysctl (mib, G_N_ELEMENTS (mib), data_buf, &len, NULL, 0) == -1)
-      return TRUE;
-  data = ((char**)data_buf)[0];
-#else
-  g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", fgpid);
-  if (!g_file_get_contents (filename, &data_buf, &len, NULL))
-    return TRUE;
-  data = data_buf;
-#endif
+  snapshot = search_snapshot_new (screen, (glong) gtk_adjustment_get_lower (adjustment));
+  data->snapshot = snapshot;
+  data->cache = TRUE;
+  data->next_row = snapshot->first_row;
+  data->end_row = (glong) gtk_adjustment_get_upper (adjustment);
 
-  basename = g_path_get_basename (data);
-  if (!basename)
-    return TRUE;
+  data->idle_id = _terminal_watchdog_idle_add_full (G_PRIORITY_LOW, "search snapshot",
+                                                    search_snapshot_idle_cb, task, NULL);
+  priv->search_tasks = g_slist_prepend (priv->search_tasks, task /* adopted */);
+}
 
-  name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
-  if (!name)
-    return TRUE;
+/**
+ * terminal_screen_search_tail_async:
+ * @screen: a #TerminalScreen
+ * @pattern: a PCRE2 pattern
+ * @compile_flags: the PCRE2 flags to compile @pattern with
+ * @n_rows: how many of the last rows to search
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
+ *
+ * Like terminal_screen_search_async(), but only searches the last @n_rows
+ * rows, and doesn't keep their copy. This is for searches much more
+ * frequent than the user's, like the shell's as the user types.
+ * Call terminal_screen_search_finish() from @callback to get the result.
+ */
+void
+terminal_screen_search_tail_async (TerminalScreen *screen,
+                                   const char *pattern,
+                                   guint32 compile_flags,
+                                   glong n_rows,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+  TerminalScreenPrivate *priv;
+  GtkAdjustment *adjustment;
+  SearchData *data;
+  GTask *task;
+  glong lower, upper;
 
-  if (!process_name && !cmdline)
-    return TRUE;
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  g_return_if_fail (pattern != NULL);
+  g_return_if_fail (n_rows > 0);
 
-  if (process_name)
-    gs_transfer_out_value (process_name, &name);
+  priv = screen->priv;
 
-  if (len > 0 && data[len - 1] == '\0')
-    len--;
-  for (i = 0; i < len; i++)
-    {
-      if (data[i] == '\0')
-        data[i] = ' ';
-    }
+  task = g_task_new (screen, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_screen_search_tail_async);
 
-  command = g_filename_to_utf8 (data, -1, NULL, NULL, NULL);
-  if (!command)
-    return TRUE;
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  lower = (glong) gtk_adjustment_get_lower (adjustment);
+  upper = (glong) gtk_adjustment_get_upper (adjustment);
 
-  if (cmdline)
-    gs_transfer_out_value (cmdline, &command);
+  data = g_slice_new0 (SearchData);
+  data->pattern = g_strdup (pattern);
+  data->compile_flags = compile_flags;
+  data->snapshot = search_snapshot_new (screen, MAX (lower, upper - n_rows));
+  data->next_row = data->snapshot->first_row;
+  data->end_row = upper;
+  g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
 
-  return TRUE;
+  data->idle_id = _terminal_watchdog_idle_add_full (G_PRIORITY_LOW, "search snapshot",
+                                                    search_snapshot_idle_cb, task, NULL);
+  priv->search_tasks = g_slist_prepend (priv->search_tasks, task /* adopted */);
 }
 
-const char *
-terminal_screen_get_uuid (TerminalScreen *screen)
+/**
+ * terminal_screen_search_finish:
+ * @screen: a #TerminalScreen
+ * @result: the #GAsyncResult
+ * @error: a #GError location, or %NULL
+ *
+ * Returns: (transfer full): a #GArray of #TerminalSearchMatch in the order
+ *   they appear in @screen, holding at most %TERMINAL_SCREEN_SEARCH_MAX_MATCHES,
+ *   or %NULL on error
+ */
+GArray *
+terminal_screen_search_finish (TerminalScreen *screen,
+                               GAsyncResult *result,
+                               GError **error)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, screen), NULL);
 
-  return screen->priv->uuid;
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * terminal_screen_snapshot_text_async:
+ * @screen: a #TerminalScreen
+ * @start_row: the first row, or -1 for the start of the scrollback
+ * @end_row: the row after the last one, or -1 for the end of the screen
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
+ *
+ * Copies the text of a range of rows of @screen, on idle like
+ * terminal_screen_search_async() does, so even the whole scrollback can be
+ * copied without blocking the main loop. The copy kept from the last
+ * search is reused if the contents of @screen have not changed since.
+ * Call terminal_screen_snapshot_text_finish() from @callback to get the text.
+ */
+void
+terminal_screen_snapshot_text_async (TerminalScreen *screen,
+                                     glong start_row,
+                                     glong end_row,
+                                     GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data)
+{
+  TerminalScreenPrivate *priv;
+  GtkAdjustment *adjustment;
+  SearchSnapshot *snapshot;
+  SearchData *data;
+  GTask *task;
+  glong lower, upper;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+
+  task = g_task_new (screen, cancellable, callback, user_data);
+  g_task_set_source_tag (task, terminal_screen_snapshot_text_async);
+
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  lower = (glong) gtk_adjustment_get_lower (adjustment);
+  upper = (glong) gtk_adjustment_get_upper (adjustment);
+  start_row = start_row < 0 ? lower : CLAMP (start_row, lower, upper);
+  end_row = end_row < 0 ? upper : CLAMP (end_row, start_row, upper);
+
+  snapshot = priv->search_snapshot;
+  if (snapshot != NULL &&
+      snapshot->serial == priv->contents_serial &&
+      start_row >= snapshot->first_row &&
+      end_row <= snapshot->first_row + (glong) snapshot->row_offsets->len) {
+    g_task_return_pointer (task,
+                           search_snapshot_get_bytes (snapshot, start_row, end_row),
+                           (GDestroyNotify) g_bytes_unref);
+    g_object_unref (task);
+    return;
+  }
+
+  /* The copy isn't kept for later; only searches keep theirs */
+  data = g_slice_new0 (SearchData);
+  data->snapshot = search_snapshot_new (screen, start_row);
+  data->next_row = start_row;
+  data->end_row = end_row;
+  g_task_set_task_data (task, data, (GDestroyNotify) search_data_free);
+
+  data->idle_id = _terminal_watchdog_idle_add_full (G_PRIORITY_LOW, "text snapshot",
+                                                    search_snapshot_idle_cb, task, NULL);
+  priv->search_tasks = g_slist_prepend (priv->search_tasks, task /* adopted */);
+}
+
+/**
+ * terminal_screen_snapshot_text_finish:
+ * @screen: a #TerminalScreen
+ * @result: the #GAsyncResult
+ * @error: a #GError location, or %NULL
+ *
+ * Returns: (transfer full): the UTF-8 text of the rows, with a newline
+ *   after each row that was not wrapped, or %NULL on error
+ */
+GBytes *
+terminal_screen_snapshot_text_finish (TerminalScreen *screen,
+                                      GAsyncResult *result,
+                                      GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, screen), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/**
+ * terminal_screen_drop_search_snapshot:
+ * @screen: a #TerminalScreen
+ *
+ * Frees the copy of the scrollback kept from the last search, e.g. when
+ * the search is over.
+ */
+void
+terminal_screen_drop_search_snapshot (TerminalScreen *screen)
+{
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  search_snapshot_cache (screen, NULL);
+}
+
+/**
+ * terminal_screen_show_search_match:
+ * @screen: a #TerminalScreen
+ * @matches: the result of terminal_screen_search_finish()
+ * @index: the match to show
+ *
+ * Scrolls to the match at @index in @matches and selects it, using VTE's own
+ * search with the same regex, which must be set on @screen.
+ *
+ * Returns: %FALSE if the match is no longer in the scrollback
+ */
+gboolean
+terminal_screen_show_search_match (TerminalScreen *screen,
+                                   GArray *matches,
+                                   guint index)
+{
+  VteTerminal *terminal;
+  GtkAdjustment *adjustment;
+  const TerminalSearchMatch *match;
+  double top;
+  guint i, n;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+  g_return_val_if_fail (index < matches->len, FALSE);
+
+  terminal = VTE_TERMINAL (screen);
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  match = &g_array_index (matches, TerminalSearchMatch, index);
+
+  if (match->row < gtk_adjustment_get_lower (adjustment))
+    return FALSE;
+
+  top = MIN (match->row, gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_page_size (adjustment));
+  top = MAX (top, gtk_adjustment_get_lower (adjustment));
+  gtk_adjustment_set_value (adjustment, top);
+
+  /* Without a selection, VTE searches forward from the first visible row,
+   * so skip the matches between it and this one. Each search starts after
+   * the match before, and all of these matches are on the screen, so none
+   * of them has to go through the scrollback.
+   */
+  for (i = index, n = 0;
+       i > 0 && g_array_index (matches, TerminalSearchMatch, i - 1).row >= (glong) top;
+       i--)
+    n++;
+
+  vte_terminal_unselect_all (terminal);
+  for (i = 0; i <= n; i++)
+    vte_terminal_search_find_next (terminal);
+
+  return TRUE;
 }
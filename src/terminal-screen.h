@@ -75,6 +75,8 @@ GType terminal_screen_get_type (void) G_GNUC_CONST;
 
 const char *terminal_screen_get_uuid (TerminalScreen *screen);
 
+guint terminal_screen_get_handle (TerminalScreen *screen);
+
 TerminalScreen *terminal_screen_new (GSettings       *profile,
                                      const char      *charset,
                                      char           **override_command,
@@ -83,6 +85,12 @@ TerminalScreen *terminal_screen_new (GSettings       *profile,
                                      char           **child_env,
                                      double           zoom);
 
+TerminalScreen *_terminal_screen_new_spare (GSettings  *profile,
+                                            const char *working_dir,
+                                            char      **child_env);
+
+void _terminal_screen_register (TerminalScreen *screen);
+
 gboolean terminal_screen_exec (TerminalScreen *screen,
                                char          **argv,
                                char          **envv,
@@ -94,6 +102,12 @@ gboolean terminal_screen_exec (TerminalScreen *screen,
 
 void _terminal_screen_launch_child_on_idle (TerminalScreen *screen);
 
+void terminal_screen_set_lazy (TerminalScreen *screen,
+                               gboolean        lazy);
+
+void terminal_screen_set_background (TerminalScreen *screen,
+                                     gboolean        background);
+
 void terminal_screen_set_profile (TerminalScreen *screen,
                                   GSettings      *profile);
 GSettings* terminal_screen_get_profile (TerminalScreen *screen);
@@ -122,10 +136,86 @@ void terminal_screen_save_config (TerminalScreen *screen,
                                   GKeyFile *key_file,
                                   const char *group);
 
+int terminal_screen_get_foreground_pgrp (TerminalScreen *screen);
+
+gsize  terminal_screen_get_scrollback_bytes (TerminalScreen *screen);
+guint  terminal_screen_get_contents_changes (TerminalScreen *screen);
+gboolean terminal_screen_is_hot             (TerminalScreen *screen);
+GVariant *terminal_screen_get_stats         (TerminalScreen *screen);
+gint64 terminal_screen_get_last_focus_time  (TerminalScreen *screen);
+gboolean terminal_screen_trim_scrollback    (TerminalScreen *screen,
+                                             gsize max_bytes);
+
+void terminal_screen_paste_text (TerminalScreen *screen,
+                                 char *text,
+                                 gsize len,
+                                 gboolean newlines_to_cr);
+
+void terminal_screen_paste_clipboard (TerminalScreen *screen);
+
+void terminal_screen_cancel_paste (TerminalScreen *screen);
+
+void terminal_screen_jit_regexes (void);
+
 gboolean terminal_screen_has_foreground_process (TerminalScreen *screen,
                                                  char           **process_name,
                                                  char           **cmdline);
 
+void terminal_screen_get_foreground_process_async (TerminalScreen *screen,
+                                                   GCancellable *cancellable,
+                                                   GAsyncReadyCallback callback,
+                                                   gpointer user_data);
+
+gboolean terminal_screen_get_foreground_process_finish (TerminalScreen *screen,
+                                                        GAsyncResult *result,
+                                                        char **process_name,
+                                                        char **cmdline,
+                                                        GError **error);
+
+#define TERMINAL_SCREEN_SEARCH_MAX_MATCHES (10000)
+
+typedef struct {
+  glong row;     /* absolute, like the vertical adjustment */
+  glong column;  /* in characters */
+  char *excerpt; /* the matching text with its context on the line */
+} TerminalSearchMatch;
+
+void terminal_screen_search_async (TerminalScreen *screen,
+                                   const char *pattern,
+                                   guint32 compile_flags,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data);
+
+void terminal_screen_search_tail_async (TerminalScreen *screen,
+                                        const char *pattern,
+                                        guint32 compile_flags,
+                                        glong n_rows,
+                                        GCancellable *cancellable,
+                                        GAsyncReadyCallback callback,
+                                        gpointer user_data);
+
+GArray *terminal_screen_search_finish (TerminalScreen *screen,
+                                       GAsyncResult *result,
+                                       GError **error);
+
+void terminal_screen_drop_search_snapshot (TerminalScreen *screen);
+
+gboolean terminal_screen_show_search_match (TerminalScreen *screen,
+                                            GArray *matches,
+                                            guint index);
+
+void terminal_screen_snapshot_text_async (TerminalScreen *screen,
+                                          glong start_row,
+                                          glong end_row,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data);
+
+GBytes *terminal_screen_snapshot_text_finish (TerminalScreen *screen,
+                                              GAsyncResult *result,
+                                              GError **error);
+
 /* Allow scales a bit smaller and a bit larger than the usual pango ranges */
 #define TERMINAL_SCALE_XXX_SMALL   (PANGO_SCALE_XX_SMALL/1.2)
 #define TERMINAL_SCALE_XXXX_SMALL  (TERMINAL_SCALE_XXX_SMALL/1.2)
@@ -141,7 +231,8 @@ struct _TerminalScreenPopupInfo {
   char *url;
   TerminalURLFlavor url_flavor;
   char *hyperlink;
-  char *number_info;
+  char *number; /* the matched text */
+  char *number_info; /* formatted lazily, see terminal_screen_popup_info_get_number_info() */
   guint button;
   guint state;
   guint32 timestamp;
@@ -151,6 +242,8 @@ TerminalScreenPopupInfo *terminal_screen_popup_info_ref (TerminalScreenPopupInfo
 
 void terminal_screen_popup_info_unref (TerminalScreenPopupInfo *info);
 
+const char *terminal_screen_popup_info_get_number_info (TerminalScreenPopupInfo *info);
+
 G_END_DECLS
 
 #endif /* TERMINAL_SCREEN_H */
@@ -19,6 +19,9 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <string.h>
+
 #include <glib.h>
 #include <glib/gi18n.h>
 #include <gtk/gtk.h>
@@ -44,6 +47,9 @@ struct _TerminalSearchPopoverClass
   /* Signals */
   void (* search) (TerminalSearchPopover *popover,
                    gboolean backward);
+  void (* result_activated) (TerminalSearchPopover *popover,
+                             const char *screen_uuid,
+                             glong row);
 };
 
 struct _TerminalSearchPopoverPrivate
@@ -53,11 +59,16 @@ struct _TerminalSearchPopoverPrivate
   GtkWidget *search_next_button;
   GtkWidget *reveal_button;
   GtkWidget *close_button;
+  GtkWidget *match_count_label;
   GtkWidget *revealer;
   GtkWidget *match_case_checkbutton;
   GtkWidget *entire_word_checkbutton;
   GtkWidget *regex_checkbutton;
   GtkWidget *wrap_around_checkbutton;
+  GtkWidget *all_tabs_checkbutton;
+  GtkWidget *results_scrolled_window;
+  GtkWidget *results_list_box;
+  guint n_results;
 
   gboolean search_text_changed;
 
@@ -71,11 +82,13 @@ enum {
   PROP_0,
   PROP_REGEX,
   PROP_WRAP_AROUND,
+  PROP_ALL_TABS,
   LAST_PROP
 };
 
 enum {
   SEARCH,
+  RESULT_ACTIVATED,
   LAST_SIGNAL
 };
 
@@ -89,9 +102,50 @@ G_DEFINE_TYPE_WITH_PRIVATE (TerminalSearchPopover, terminal_search_popover, GTK_
 
 /* history */
 
+/* Results of searching all tabs */
+
+#define RESULTS_MAX (1000)
+
+typedef struct {
+  char *screen_uuid;
+  glong row;
+} SearchResult;
+
+static void
+search_result_free (SearchResult *result)
+{
+  g_free (result->screen_uuid);
+  g_slice_free (SearchResult, result);
+}
+
 #define HISTORY_MIN_ITEM_LEN (3)
 #define HISTORY_LENGTH (10)
 
+/* The history is shared by all windows, and by all servers through a file
+ * that is read when the search popover is first opened and written back a
+ * little while after each change.
+ */
+#define HISTORY_SAVE_DELAY (2 /* s */)
+
+static GHashTable *history_index; /* text -> GtkTreeIter in history_store */
+static gboolean history_loaded;
+static guint history_save_source_id;
+
+static void history_save (void);
+
+static void
+history_free (gpointer data)
+{
+  if (history_save_source_id != 0) {
+    g_source_remove (history_save_source_id);
+    history_save_source_id = 0;
+    history_save ();
+  }
+
+  g_clear_pointer (&history_index, g_hash_table_unref);
+  g_clear_object (&history_store);
+}
+
 static gboolean
 history_enabled (void)
 {
@@ -104,51 +158,163 @@ history_enabled (void)
 
   if (history_store == NULL) {
     history_store = gtk_list_store_new (1, G_TYPE_STRING);
+    /* GtkListStore iters stay valid as long as their row exists */
+    history_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, (GDestroyNotify) gtk_tree_iter_free);
     g_object_set_data_full (G_OBJECT (terminal_app_get ()), "search-history-store",
-                            history_store, (GDestroyNotify) g_object_unref);
+                            history_store, history_free);
   }
 
   return TRUE;
 }
 
-static gboolean
-history_remove_item (const char  *text)
+static char *
+history_get_filename (void)
+{
+  return g_build_filename (g_get_user_data_dir (), "gnome-terminal", "search-history", NULL);
+}
+
+static void
+history_append_item (const char *text)
 {
-  GtkTreeModel *model = GTK_TREE_MODEL (history_store);
   GtkTreeIter iter;
 
-  if (!gtk_tree_model_get_iter_first (model, &iter))
-    return FALSE;
+  gtk_list_store_insert_with_values (history_store, &iter, -1,
+                                     0, text,
+                                     -1);
+  g_hash_table_insert (history_index, g_strdup (text), gtk_tree_iter_copy (&iter));
+}
 
-  do {
-    gs_free gchar *item_text;
+/* Adds the items of the history file that aren't in the store yet, after
+ * the ones that are.
+ */
+static void
+history_merge_file (void)
+{
+  gs_free char *filename = NULL;
+  gs_free char *contents = NULL;
+  gs_strfreev char **lines = NULL;
+  int n_items;
+  guint i;
+
+  filename = history_get_filename ();
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return;
 
-    gtk_tree_model_get (model, &iter, 0, &item_text, -1);
+  n_items = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (history_store), NULL);
+  lines = g_strsplit (contents, "\n", -1);
 
-    if (item_text != NULL && strcmp (item_text, text) == 0) {
-      gtk_list_store_remove (history_store, &iter);
-      return TRUE;
-    }
-  } while (gtk_tree_model_iter_next (model, &iter));
+  for (i = 0; lines[i] != NULL && n_items < HISTORY_LENGTH; i++) {
+    if (lines[i][0] == '\0' ||
+        !g_utf8_validate (lines[i], -1, NULL) ||
+        g_hash_table_contains (history_index, lines[i]))
+      continue;
 
-  return FALSE;
+    history_append_item (lines[i]);
+    n_items++;
+  }
+}
+
+static void
+history_load (void)
+{
+  if (history_loaded || !history_enabled ())
+    return;
+
+  history_loaded = TRUE;
+  history_merge_file ();
+}
+
+static void
+history_save (void)
+{
+  gs_free char *filename = NULL;
+  gs_free char *dirname = NULL;
+  gs_unref_object GFile *file = NULL;
+  gs_free_error GError *error = NULL;
+  GString *contents;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+
+  if (history_store == NULL)
+    return;
+
+  /* Keep what other servers added in the meantime */
+  history_merge_file ();
+
+  contents = g_string_new (NULL);
+  model = GTK_TREE_MODEL (history_store);
+  if (gtk_tree_model_get_iter_first (model, &iter)) {
+    do {
+      gs_free char *text = NULL;
+
+      gtk_tree_model_get (model, &iter, 0, &text, -1);
+      g_string_append (contents, text);
+      g_string_append_c (contents, '\n');
+    } while (gtk_tree_model_iter_next (model, &iter));
+  }
+
+  /* What was searched for may be as private as the output itself */
+  filename = history_get_filename ();
+  dirname = g_path_get_dirname (filename);
+  file = g_file_new_for_path (filename);
+  if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+      !g_file_replace_contents (file, contents->str, contents->len,
+                                NULL, FALSE, G_FILE_CREATE_PRIVATE,
+                                NULL, NULL, &error))
+    g_printerr ("Failed to save the search history: %s\n",
+                error ? error->message : g_strerror (errno));
+
+  g_string_free (contents, TRUE);
+}
+
+static gboolean
+history_save_timeout_cb (gpointer user_data)
+{
+  history_save_source_id = 0;
+  history_save ();
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+history_queue_save (void)
+{
+  if (history_save_source_id != 0)
+    return;
+
+  history_save_source_id = g_timeout_add_seconds (HISTORY_SAVE_DELAY, history_save_timeout_cb, NULL);
+}
+
+static gboolean
+history_remove_item (const char  *text)
+{
+  GtkTreeIter *iter;
+
+  iter = g_hash_table_lookup (history_index, text);
+  if (iter == NULL)
+    return FALSE;
+
+  gtk_list_store_remove (history_store, iter);
+  g_hash_table_remove (history_index, text);
+  return TRUE;
 }
 
 static void
 history_clamp (int max)
 {
-  GtkTreePath *path;
+  GtkTreeModel *model = GTK_TREE_MODEL (history_store);
   GtkTreeIter iter;
 
-  /* -1 because TreePath counts from 0 */
-  path = gtk_tree_path_new_from_indices (max - 1, -1);
+  if (!gtk_tree_model_iter_nth_child (model, &iter, NULL, max - 1))
+    return;
 
-  if (gtk_tree_model_get_iter (GTK_TREE_MODEL (history_store), &iter, path))
-    while (1)
-      if (!gtk_list_store_remove (history_store, &iter))
-	break;
+  do {
+    gs_free char *text = NULL;
 
-  gtk_tree_path_free (path);
+    gtk_tree_model_get (model, &iter, 0, &text, -1);
+    g_hash_table_remove (history_index, text);
+  } while (gtk_list_store_remove (history_store, &iter));
 }
 
 static void
@@ -159,9 +325,12 @@ history_insert_item (const char *text)
   if (!history_enabled () || text == NULL)
     return;
 
-  if (g_utf8_strlen (text, -1) <= HISTORY_MIN_ITEM_LEN)
+  if (g_utf8_strlen (text, -1) <= HISTORY_MIN_ITEM_LEN ||
+      strchr (text, '\n') != NULL)
     return;
 
+  history_load ();
+
   /* remove the text from the store if it was already
    * present. If it wasn't, clamp to max history - 1
    * before inserting the new row, otherwise appending
@@ -172,6 +341,9 @@ history_insert_item (const char *text)
   gtk_list_store_insert_with_values (history_store, &iter, 0,
                                      0, text,
                                      -1);
+  g_hash_table_insert (history_index, g_strdup (text), gtk_tree_iter_copy (&iter));
+
+  history_queue_save ();
 }
 
 /* helper functions */
@@ -254,6 +426,19 @@ key_press_cb (GtkWidget *popover,
   return FALSE;
 }
 
+/* The search regex, and the scrollback search, use the same flags */
+static guint32
+search_compile_flags (gboolean caseless)
+{
+  guint32 compile_flags;
+
+  compile_flags = PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_MULTILINE;
+  if (caseless)
+    compile_flags |= PCRE2_CASELESS;
+
+  return compile_flags;
+}
+
 static void
 update_regex (TerminalSearchPopover *popover)
 {
@@ -292,20 +477,16 @@ update_regex (TerminalSearchPopover *popover)
 
   /* FIXME: if comping the regex fails, show the error message somewhere */
   if (search_text[0] != '\0') {
-    guint32 compile_flags;
-
-    compile_flags = PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_MULTILINE;
-    if (caseless)
-      compile_flags |= PCRE2_CASELESS;
-
-    priv->regex = vte_regex_new_for_search (pattern, -1, compile_flags, &error);
+    priv->regex = vte_regex_new_for_search (pattern, -1, search_compile_flags (caseless), &error);
     if (priv->regex != NULL &&
         (!vte_regex_jit (priv->regex, PCRE2_JIT_COMPLETE, NULL) ||
          !vte_regex_jit (priv->regex, PCRE2_JIT_PARTIAL_SOFT, NULL))) {
     }
 
-    if (priv->regex != NULL)
+    if (priv->regex != NULL) {
       gs_transfer_out_value (&priv->regex_pattern, &pattern);
+      priv->regex_caseless = caseless;
+    }
   } else {
     priv->regex = NULL;
   }
@@ -339,6 +520,28 @@ wrap_around_toggled_cb (GtkToggleButton *button,
   g_object_notify_by_pspec (G_OBJECT (popover), pspecs[PROP_WRAP_AROUND]);
 }
 
+static void
+all_tabs_toggled_cb (GtkToggleButton *button,
+                     TerminalSearchPopover *popover)
+{
+  terminal_search_popover_clear_results (popover);
+  g_object_notify_by_pspec (G_OBJECT (popover), pspecs[PROP_ALL_TABS]);
+}
+
+static void
+result_row_activated_cb (GtkListBox *list_box,
+                         GtkListBoxRow *row,
+                         TerminalSearchPopover *popover)
+{
+  SearchResult *result;
+
+  result = g_object_get_data (G_OBJECT (row), "terminal-search-result");
+  if (result == NULL)
+    return;
+
+  g_signal_emit (popover, signals[RESULT_ACTIVATED], 0, result->screen_uuid, result->row);
+}
+
 /* public functions */
 
 /* Class implementation */
@@ -368,6 +571,8 @@ terminal_search_popover_init (TerminalSearchPopover *popover)
   if (history_enabled ()) {
     gs_unref_object GtkEntryCompletion *completion;
 
+    history_load ();
+
     completion = gtk_entry_completion_new ();
     gtk_entry_completion_set_model (completion, GTK_TREE_MODEL (history_store));
     gtk_entry_completion_set_text_column (completion, 0);
@@ -407,6 +612,8 @@ terminal_search_popover_init (TerminalSearchPopover *popover)
   g_signal_connect (priv->regex_checkbutton, "toggled", G_CALLBACK (search_parameters_changed_cb), popover);
 
   g_signal_connect (priv->wrap_around_checkbutton, "toggled", G_CALLBACK (wrap_around_toggled_cb), popover);
+  g_signal_connect (priv->all_tabs_checkbutton, "toggled", G_CALLBACK (all_tabs_toggled_cb), popover);
+  g_signal_connect (priv->results_list_box, "row-activated", G_CALLBACK (result_row_activated_cb), popover);
 
   g_signal_connect (popover, "key-press-event", G_CALLBACK (key_press_cb), NULL);
 }
@@ -441,6 +648,9 @@ terminal_search_popover_get_property (GObject *object,
   case PROP_WRAP_AROUND:
     g_value_set_boolean (value, terminal_search_popover_get_wrap_around (popover));
     break;
+  case PROP_ALL_TABS:
+    g_value_set_boolean (value, terminal_search_popover_get_all_tabs (popover));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     break;
@@ -456,6 +666,7 @@ terminal_search_popover_set_property (GObject *object,
   switch (prop_id) {
   case PROP_REGEX:
   case PROP_WRAP_AROUND:
+  case PROP_ALL_TABS:
     /* not writable */
     break;
   default:
@@ -485,6 +696,17 @@ terminal_search_popover_class_init (TerminalSearchPopoverClass *klass)
                   1,
                   G_TYPE_BOOLEAN);
 
+  signals[RESULT_ACTIVATED] =
+    g_signal_new (I_("result-activated"),
+                  G_OBJECT_CLASS_TYPE (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalSearchPopoverClass, result_activated),
+                  NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_STRING, G_TYPE_LONG);
+
   pspecs[PROP_REGEX] =
     g_param_spec_boxed ("regex", NULL, NULL,
                         VTE_TYPE_REGEX,
@@ -495,6 +717,11 @@ terminal_search_popover_class_init (TerminalSearchPopoverClass *klass)
                           FALSE,
                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB);
 
+  pspecs[PROP_ALL_TABS] =
+    g_param_spec_boolean ("all-tabs", NULL, NULL,
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB);
+
   g_object_class_install_properties (gobject_class, G_N_ELEMENTS (pspecs), pspecs);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/org/gnome/terminal/ui/search-popover.ui");
@@ -503,11 +730,15 @@ terminal_search_popover_class_init (TerminalSearchPopoverClass *klass)
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, search_next_button);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, reveal_button);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, close_button);
+  gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, match_count_label);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, revealer);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, match_case_checkbutton);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, entire_word_checkbutton);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, regex_checkbutton);
   gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, wrap_around_checkbutton);
+  gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, all_tabs_checkbutton);
+  gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, results_scrolled_window);
+  gtk_widget_class_bind_template_child_private (widget_class, TerminalSearchPopover, results_list_box);
 }
 
 /* public API */
@@ -556,3 +787,161 @@ terminal_search_popover_get_wrap_around (TerminalSearchPopover *popover)
 
   return gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (PRIV (popover)->wrap_around_checkbutton));
 }
+
+/**
+ * terminal_search_popover_get_regex_pattern:
+ * @popover: a #TerminalSearchPopover
+ * @compile_flags: (out) (allow-none): the PCRE2 flags the pattern is compiled with
+ *
+ * Returns: (transfer none): the pattern of the search regex, or %NULL
+ */
+const char *
+terminal_search_popover_get_regex_pattern (TerminalSearchPopover *popover,
+                                           guint32 *compile_flags)
+{
+  TerminalSearchPopoverPrivate *priv;
+
+  g_return_val_if_fail (TERMINAL_IS_SEARCH_POPOVER (popover), NULL);
+
+  priv = PRIV (popover);
+  if (priv->regex == NULL)
+    return NULL;
+
+  if (compile_flags)
+    *compile_flags = search_compile_flags (priv->regex_caseless);
+
+  return priv->regex_pattern;
+}
+
+/**
+ * terminal_search_popover_set_match_count:
+ * @popover: a #TerminalSearchPopover
+ * @n_matches: the number of matches, or -1 to hide the count
+ * @current: the index of the current match, or -1
+ * @more: whether there are more than @n_matches matches
+ */
+void
+terminal_search_popover_set_match_count (TerminalSearchPopover *popover,
+                                         int n_matches,
+                                         int current,
+                                         gboolean more)
+{
+  TerminalSearchPopoverPrivate *priv;
+  gs_free char *text = NULL;
+
+  g_return_if_fail (TERMINAL_IS_SEARCH_POPOVER (popover));
+
+  priv = PRIV (popover);
+  if (n_matches < 0) {
+    gtk_widget_hide (priv->match_count_label);
+    return;
+  }
+
+  if (n_matches == 0)
+    text = g_strdup (_("No matches"));
+  else if (current < 0)
+    text = g_strdup_printf (more ? _("%d+ matches") : ngettext ("%d match", "%d matches", n_matches),
+                            n_matches);
+  else
+    /* Translators: the first %d is the current match, the second one the number of matches */
+    text = g_strdup_printf (more ? _("%d of %d+") : _("%d of %d"), current + 1, n_matches);
+
+  gtk_label_set_text (GTK_LABEL (priv->match_count_label), text);
+  gtk_widget_show (priv->match_count_label);
+}
+
+/**
+ * terminal_search_popover_get_all_tabs:
+ * @popover: a #TerminalSearchPopover
+ *
+ * Returns: whether to search the scrollback of all terminals
+ */
+gboolean
+terminal_search_popover_get_all_tabs (TerminalSearchPopover *popover)
+{
+  g_return_val_if_fail (TERMINAL_IS_SEARCH_POPOVER (popover), FALSE);
+
+  return gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (PRIV (popover)->all_tabs_checkbutton));
+}
+
+/**
+ * terminal_search_popover_clear_results:
+ * @popover: a #TerminalSearchPopover
+ *
+ * Removes the results added with terminal_search_popover_add_results().
+ */
+void
+terminal_search_popover_clear_results (TerminalSearchPopover *popover)
+{
+  TerminalSearchPopoverPrivate *priv;
+  gs_free_list GList *rows = NULL;
+  GList *l;
+
+  g_return_if_fail (TERMINAL_IS_SEARCH_POPOVER (popover));
+
+  priv = PRIV (popover);
+
+  rows = gtk_container_get_children (GTK_CONTAINER (priv->results_list_box));
+  for (l = rows; l != NULL; l = l->next)
+    gtk_widget_destroy (l->data);
+
+  priv->n_results = 0;
+  gtk_widget_hide (priv->results_scrolled_window);
+}
+
+/**
+ * terminal_search_popover_add_results:
+ * @popover: a #TerminalSearchPopover
+ * @screen: a #TerminalScreen
+ * @matches: a #GArray of #TerminalSearchMatch in @screen
+ *
+ * Appends @matches to the list of results; activating one emits
+ * #TerminalSearchPopover::result-activated.
+ */
+void
+terminal_search_popover_add_results (TerminalSearchPopover *popover,
+                                     TerminalScreen *screen,
+                                     GArray *matches)
+{
+  TerminalSearchPopoverPrivate *priv;
+  const char *title;
+  guint i;
+
+  g_return_if_fail (TERMINAL_IS_SEARCH_POPOVER (popover));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = PRIV (popover);
+
+  title = terminal_screen_get_title (screen);
+  if (title == NULL || title[0] == '\0')
+    title = _("Terminal");
+
+  for (i = 0; i < matches->len && priv->n_results < RESULTS_MAX; i++, priv->n_results++) {
+    const TerminalSearchMatch *match = &g_array_index (matches, TerminalSearchMatch, i);
+    SearchResult *result;
+    GtkWidget *row, *label;
+    gs_free char *markup;
+
+    markup = g_markup_printf_escaped ("<b>%s</b>  %s", title, match->excerpt);
+    label = gtk_label_new (NULL);
+    gtk_label_set_markup (GTK_LABEL (label), markup);
+    gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_END);
+    gtk_misc_set_alignment (GTK_MISC (label), 0.0, 0.5);
+    gtk_widget_show (label);
+
+    row = gtk_list_box_row_new ();
+    gtk_container_add (GTK_CONTAINER (row), label);
+    gtk_widget_show (row);
+
+    result = g_slice_new (SearchResult);
+    result->screen_uuid = g_strdup (terminal_screen_get_uuid (screen));
+    result->row = match->row;
+    g_object_set_data_full (G_OBJECT (row), "terminal-search-result",
+                            result, (GDestroyNotify) search_result_free);
+
+    gtk_container_add (GTK_CONTAINER (priv->results_list_box), row);
+  }
+
+  if (priv->n_results > 0)
+    gtk_widget_show (priv->results_scrolled_window);
+}
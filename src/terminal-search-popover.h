@@ -44,6 +44,22 @@ VteRegex *
 
 gboolean terminal_search_popover_get_wrap_around (TerminalSearchPopover *popover);
 
+const char *terminal_search_popover_get_regex_pattern (TerminalSearchPopover *popover,
+                                                       guint32 *compile_flags);
+
+gboolean terminal_search_popover_get_all_tabs (TerminalSearchPopover *popover);
+
+void terminal_search_popover_clear_results (TerminalSearchPopover *popover);
+
+void terminal_search_popover_add_results (TerminalSearchPopover *popover,
+                                          TerminalScreen *screen,
+                                          GArray *matches);
+
+void terminal_search_popover_set_match_count (TerminalSearchPopover *popover,
+                                              int n_matches,
+                                              int current,
+                                              gboolean more);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_SEARCH_POPOVER_H */
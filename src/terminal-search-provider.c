@@ -17,12 +17,10 @@
 
 #include "config.h"
 
-#include <string.h>
-
+#include "terminal-pcre2.h"
 #include "terminal-app.h"
 #include "terminal-debug.h"
 #include "terminal-libgsystem.h"
-#include "terminal-screen-container.h"
 #include "terminal-search-provider.h"
 #include "terminal-search-provider-gdbus-generated.h"
 #include "terminal-window.h"
@@ -32,6 +30,8 @@ struct _TerminalSearchProvider
   GObject parent;
 
   TerminalSearchProvider2 *skeleton;
+
+  GHashTable *excerpts; /* screen UUID -> text of the last contents match */
 };
 
 struct _TerminalSearchProviderClass
@@ -41,65 +41,159 @@ struct _TerminalSearchProviderClass
 
 G_DEFINE_TYPE (TerminalSearchProvider, terminal_search_provider, G_TYPE_OBJECT)
 
-static char *
-normalize_casefold_and_unaccent (const char *str)
+/* The shell searches as the user types, so only the end of each screen,
+ * where what the user is looking for most likely is, gets searched.
+ */
+#define CONTENTS_SEARCH_ROWS (1000)
+
+/* Screens whose title or command line matches come first, followed by
+ * the ones where one of the last CONTENTS_SEARCH_ROWS lines contains all
+ * terms.
+ */
+typedef struct {
+  TerminalSearchProvider *provider;
+  GDBusMethodInvocation *invocation; /* consumed when completing */
+  gboolean subsearch;
+  GPtrArray *results; /* owned UUIDs */
+  GHashTable *seen; /* UUIDs in results */
+  char *pattern; /* for the contents */
+  char **previous_results;
+} ResultSetData;
+
+static void
+result_set_data_free (ResultSetData *data)
 {
-  gs_free char *casefolded = NULL, *normalized = NULL;
-  char *retval = NULL;
+  g_free (data->pattern);
+  g_strfreev (data->previous_results);
+  g_object_unref (data->provider);
+  g_hash_table_unref (data->seen);
+  g_ptr_array_unref (data->results);
+  g_slice_free (ResultSetData, data);
+}
 
-  if (str == NULL)
-    goto out;
+static void
+result_set_add (ResultSetData *data,
+                const char *uuid)
+{
+  char *copy;
 
-  normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL_COMPOSE);
-  casefolded = g_utf8_casefold (normalized, -1);
-  retval = g_str_to_ascii (casefolded, NULL);
+  if (g_hash_table_contains (data->seen, uuid))
+    return;
 
- out:
-  return retval;
+  copy = g_strdup (uuid);
+  g_ptr_array_add (data->results, copy);
+  g_hash_table_add (data->seen, copy);
 }
 
-static char **
-normalize_casefold_and_unaccent_terms (const char* const *terms)
+static char *
+contents_pattern_for_terms (const char *const *terms)
 {
-  char **casefolded_terms;
-  guint i, n;
+  GString *pattern;
+  guint i;
 
-  n = g_strv_length ((char **) terms);
-  casefolded_terms = g_new (char *, n + 1);
+  pattern = g_string_new ("^");
+  for (i = 0; terms[i] != NULL; i++) {
+    gs_free char *escaped = g_regex_escape_string (terms[i], -1);
 
-  for (i = 0; i < n; i++)
-    casefolded_terms[i] = normalize_casefold_and_unaccent (terms[i]);
-  casefolded_terms[n] = NULL;
+    g_string_append_printf (pattern, "(?=.*%s)", escaped);
+  }
 
-  return casefolded_terms;
+  return g_string_free (pattern, FALSE);
 }
 
-static gboolean
-match_terms (const char        *str,
-             const char* const *terms)
+static void
+contents_result_cb (TerminalScreen *screen,
+                    GArray *matches,
+                    gpointer user_data)
 {
-  gs_free char *casefolded_str = NULL;
-  gboolean matches = TRUE;
+  ResultSetData *data = user_data;
+  const char *uuid = terminal_screen_get_uuid (screen);
+
+  result_set_add (data, uuid);
+  if (data->provider->excerpts != NULL)
+    g_hash_table_replace (data->provider->excerpts, g_strdup (uuid),
+                        g_strdup (g_array_index (matches, TerminalSearchMatch, 0).excerpt));
+}
+
+static void
+contents_search_done_cb (GObject *source,
+                         GAsyncResult *result,
+                         gpointer user_data)
+{
+  ResultSetData *data = user_data;
+  TerminalSearchProvider2 *skeleton = data->provider->skeleton;
+  gs_free_error GError *error = NULL;
+
+  if (!terminal_app_search_contents_finish (TERMINAL_APP (source), result, &error))
+    _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "Searching the contents failed: %s\n",
+                           error->message);
+
+  _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "%s completed: %u hits\n",
+                         data->subsearch ? "GetSubsearchResultSet" : "GetInitialResultSet",
+                         data->results->len);
+
+  g_ptr_array_add (data->results, NULL);
+  if (skeleton == NULL)
+    g_dbus_method_invocation_return_error_literal (data->invocation, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                                                   "The search provider is gone");
+  else if (data->subsearch)
+    terminal_search_provider2_complete_get_subsearch_result_set (skeleton,
+                                                                 data->invocation,
+                                                                 (const char *const *) data->results->pdata);
+  else
+    terminal_search_provider2_complete_get_initial_result_set (skeleton,
+                                                               data->invocation,
+                                                               (const char *const *) data->results->pdata);
+
+  result_set_data_free (data);
+}
+
+static void
+screens_search_done_cb (GObject *source,
+                        GAsyncResult *result,
+                        gpointer user_data)
+{
+  ResultSetData *data = user_data;
+  gs_strfreev char **title_results = NULL;
   guint i;
 
-  if (str == NULL)
-    {
-      matches = FALSE;
-      goto out;
-    }
+  title_results = terminal_app_search_screens_finish (TERMINAL_APP (source), result, NULL);
+  for (i = 0; title_results != NULL && title_results[i] != NULL; i++)
+    result_set_add (data, title_results[i]);
 
-  casefolded_str = normalize_casefold_and_unaccent (str);
-  for (i = 0; terms[i] != NULL; i++)
-    {
-      if (strstr (casefolded_str, terms[i]) == NULL)
-        {
-          matches = FALSE;
-          break;
-        }
-    }
+  if (!data->subsearch && data->provider->excerpts != NULL)
+    g_hash_table_remove_all (data->provider->excerpts);
 
- out:
-  return matches;
+  terminal_app_search_contents_async (TERMINAL_APP (source), data->pattern,
+                                      PCRE2_UTF | PCRE2_NO_UTF_CHECK | PCRE2_MULTILINE | PCRE2_CASELESS,
+                                      (const char *const *) data->previous_results,
+                                      CONTENTS_SEARCH_ROWS,
+                                      contents_result_cb,
+                                      NULL,
+                                      contents_search_done_cb, data);
+}
+
+static void
+get_result_set (TerminalSearchProvider *provider,
+                GDBusMethodInvocation *invocation,
+                const char *const *terms,
+                const char *const *previous_results)
+{
+  ResultSetData *data;
+
+  data = g_slice_new0 (ResultSetData);
+  data->provider = g_object_ref (provider);
+  data->invocation = invocation; /* adopted */
+  data->subsearch = previous_results != NULL;
+  data->results = g_ptr_array_new_with_free_func (g_free);
+  data->seen = g_hash_table_new (g_str_hash, g_str_equal);
+  data->pattern = contents_pattern_for_terms (terms);
+  data->previous_results = g_strdupv ((char **) previous_results);
+
+  /* The title and process matches come first */
+  terminal_app_search_screens_async (terminal_app_get (), terms, previous_results,
+                                     NULL /* cancellable */,
+                                     screens_search_done_cb, data);
 }
 
 static gboolean
@@ -108,66 +202,9 @@ handle_get_initial_result_set_cb (TerminalSearchProvider2  *skeleton,
                                   const char *const        *terms,
                                   gpointer                  user_data)
 {
-  GList *l, *screens = NULL, *windows;
-  gs_unref_ptrarray GPtrArray *results;
-  TerminalApp *app;
-  gs_strfreev char **casefolded_terms = NULL;
-
   _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "GetInitialResultSet started\n");
 
-  app = terminal_app_get ();
-  windows = gtk_application_get_windows (GTK_APPLICATION (app));
-  for (l = windows; l != NULL; l = l->next)
-    {
-      TerminalWindow *window = (TerminalWindow*)(l->data);
-      GList *c, *containers;
-
-      if (!TERMINAL_IS_WINDOW (l->data))
-        continue;
-
-      containers = terminal_window_list_screen_containers (window);
-      for (c = containers; c != NULL; c = c->next)
-        {
-          TerminalScreenContainer *container = TERMINAL_SCREEN_CONTAINER (c->data);
-          TerminalScreen *screen;
-
-          screen = terminal_screen_container_get_screen (container);
-          screens = g_list_prepend (screens, screen);
-        }
-    }
-
-  casefolded_terms = normalize_casefold_and_unaccent_terms (terms);
-  results = g_ptr_array_new_with_free_func (g_free);
-
-  for (l = screens; l != NULL; l = l->next)
-    {
-      TerminalScreen *screen = TERMINAL_SCREEN (l->data);
-      gs_free char *cmdline = NULL, *process = NULL;
-      const char *cwd, *title;
-
-      cwd = vte_terminal_get_current_directory_uri (VTE_TERMINAL (screen));
-      title = terminal_screen_get_title (screen);
-      terminal_screen_has_foreground_process (screen, &process, &cmdline);
-      if (match_terms (cwd, (const char *const *) casefolded_terms) ||
-          match_terms (title, (const char *const *) casefolded_terms) ||
-          match_terms (process, (const char *const *) casefolded_terms) ||
-          match_terms (cmdline, (const char *const *) casefolded_terms))
-        {
-          const char *uuid;
-
-          uuid = terminal_screen_get_uuid (screen);
-          g_ptr_array_add (results, g_strdup (uuid));
-
-          _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "Search hit: %s\n", uuid);
-        }
-    }
-
-  g_ptr_array_add (results, NULL);
-  terminal_search_provider2_complete_get_initial_result_set (skeleton,
-                                                             invocation,
-                                                             (const char *const *) results->pdata);
-
-  _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "GetInitialResultSet completed\n");
+  get_result_set (user_data, invocation, terms, NULL);
   return TRUE;
 }
 
@@ -178,49 +215,9 @@ handle_get_subsearch_result_set_cb (TerminalSearchProvider2  *skeleton,
                                     const char *const        *terms,
                                     gpointer                  user_data)
 {
-  gs_unref_ptrarray GPtrArray *results;
-  TerminalApp *app;
-  gs_strfreev char **casefolded_terms = NULL;
-  guint i;
-
   _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "GetSubsearchResultSet started\n");
 
-  app = terminal_app_get ();
-  casefolded_terms = normalize_casefold_and_unaccent_terms (terms);
-  results = g_ptr_array_new_with_free_func (g_free);
-
-  for (i = 0; previous_results[i] != NULL; i++)
-    {
-      TerminalScreen *screen;
-      gs_free char *cmdline = NULL, *process = NULL;
-      const char *cwd, *title;
-
-      screen = terminal_app_get_screen_by_uuid (app, previous_results[i]);
-      if (screen == NULL)
-        {
-          _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "Not a screen: %s\n", previous_results[i]);
-          continue;
-        }
-
-      cwd = vte_terminal_get_current_directory_uri (VTE_TERMINAL (screen));
-      title = terminal_screen_get_title (screen);
-      terminal_screen_has_foreground_process (screen, &process, &cmdline);
-      if (match_terms (cwd, (const char *const *) casefolded_terms) ||
-          match_terms (title, (const char *const *) casefolded_terms) ||
-          match_terms (process, (const char *const *) casefolded_terms) ||
-          match_terms (cmdline, (const char *const *) casefolded_terms))
-        {
-          g_ptr_array_add (results, g_strdup (previous_results[i]));
-          _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "Search hit: %s\n", previous_results[i]);
-        }
-    }
-
-  g_ptr_array_add (results, NULL);
-  terminal_search_provider2_complete_get_subsearch_result_set (skeleton,
-                                                               invocation,
-                                                               (const char *const *) results->pdata);
-
-  _terminal_debug_print (TERMINAL_DEBUG_SEARCH, "GetSubsearchResultSet completed\n");
+  get_result_set (user_data, invocation, terms, previous_results);
   return TRUE;
 }
 
@@ -230,6 +227,7 @@ handle_get_result_metas_cb (TerminalSearchProvider2  *skeleton,
                             const char *const        *results,
                             gpointer                  user_data)
 {
+  TerminalSearchProvider *provider = user_data;
   GVariantBuilder builder;
   TerminalApp *app;
   guint i;
@@ -254,7 +252,8 @@ handle_get_result_metas_cb (TerminalSearchProvider2  *skeleton,
         }
 
       title = terminal_screen_get_title (screen);
-      if (terminal_screen_has_foreground_process (screen, NULL, NULL)) {
+      text = g_strdup (g_hash_table_lookup (provider->excerpts, results[i]));
+      if (text == NULL && terminal_screen_has_foreground_process (screen, NULL, NULL)) {
         VteTerminal *terminal = VTE_TERMINAL (screen);
         long cursor_row;
 
@@ -321,6 +320,7 @@ static void
 terminal_search_provider_init (TerminalSearchProvider *provider)
 {
   provider->skeleton = terminal_search_provider2_skeleton_new ();
+  provider->excerpts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 
   g_signal_connect (provider->skeleton, "handle-get-initial-result-set",
                     G_CALLBACK (handle_get_initial_result_set_cb), provider);
@@ -338,6 +338,7 @@ terminal_search_provider_dispose (GObject *object)
   TerminalSearchProvider *provider = TERMINAL_SEARCH_PROVIDER (object);
 
   g_clear_object (&provider->skeleton);
+  g_clear_pointer (&provider->excerpts, g_hash_table_unref);
 
   G_OBJECT_CLASS (terminal_search_provider_parent_class)->dispose (object);
 }
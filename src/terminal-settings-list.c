@@ -37,7 +37,12 @@ struct _TerminalSettingsList {
   char *path;
   char *child_schema_id;
 
+  /* The children, as an ordered set: @uuids keeps them in list order,
+   * and @uuid_index maps each UUID (owned by @uuids) to its position + 1.
+   */
   char **uuids;
+  guint n_uuids;
+  GHashTable *uuid_index;
   char *default_uuid;
 
   GHashTable *children;
@@ -86,6 +91,31 @@ strv_sort (char **strv)
   return strv;
 }
 
+/* Drops the repeated entries of @strv in place, keeping the first of each */
+static char **
+strv_uniq (char **strv)
+{
+  gs_unref_hashtable GHashTable *seen = NULL;
+  char **p, **q;
+
+  if (strv == NULL)
+    return NULL;
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  for (p = q = strv; *p; p++) {
+    if (g_hash_table_contains (seen, *p)) {
+      g_free (*p);
+      continue;
+    }
+
+    g_hash_table_add (seen, *p);
+    *q++ = *p;
+  }
+  *q = NULL;
+
+  return strv;
+}
+
 static gboolean
 strv_equal (char **a,
             char **b)
@@ -104,67 +134,82 @@ strv_equal (char **a,
 }
 
 static int
-strv_find (char **strv,
-           const char *str)
+uuids_find (TerminalSettingsList *list,
+            const char *uuid)
 {
-  int i;
-
-  if (strv == NULL || str == NULL)
+  if (uuid == NULL)
     return -1;
 
-  for (i = 0; strv[i]; i++) {
-    if (!g_str_equal (strv[i], str))
-      continue;
+  return GPOINTER_TO_UINT (g_hash_table_lookup (list->uuid_index, uuid)) - 1;
+}
 
-    return i;
-  }
+static void
+uuids_set (TerminalSettingsList *list,
+           char **uuids /* adopted */)
+{
+  guint i;
+
+  g_hash_table_remove_all (list->uuid_index);
+  g_strfreev (list->uuids);
+  list->uuids = uuids;
+  list->n_uuids = 0;
+
+  if (uuids == NULL)
+    return;
 
-  return -1;
+  for (i = 0; uuids[i]; i++)
+    g_hash_table_insert (list->uuid_index, uuids[i], GUINT_TO_POINTER (i + 1));
+  list->n_uuids = i;
 }
 
-static char **
-strv_dupv_insert (char **strv,
-                  const char *str)
+/* Returns the UUIDs with @uuids appended, or @uuid removed, without
+ * copying the strings; free with g_free() only. The list has no
+ * repeated UUIDs (see list_map_func()), and @uuids that are already
+ * on it are not added again.
+ */
+static const char **
+uuids_dupv_insert (TerminalSettingsList *list,
+                   char **uuids,
+                   guint n_uuids)
 {
-  char **nstrv, **p, **q;
+  gs_unref_hashtable GHashTable *added = NULL;
+  const char **nstrv;
+  guint i, n;
+
+  nstrv = g_new (const char *, list->n_uuids + n_uuids + 1);
+  if (list->n_uuids > 0)
+    memcpy (nstrv, list->uuids, list->n_uuids * sizeof (char *));
+
+  added = g_hash_table_new (g_str_hash, g_str_equal);
+  n = list->n_uuids;
+  for (i = 0; i < n_uuids; i++) {
+    if (uuids_find (list, uuids[i]) != -1 ||
+        g_hash_table_contains (added, uuids[i]))
+      continue;
 
-  if (strv == NULL) {
-    char *s[2] = { (char *) str, NULL };
-    return g_strdupv (s);
+    g_hash_table_add (added, uuids[i]);
+    nstrv[n++] = uuids[i];
   }
+  nstrv[n] = NULL;
 
-  /* Is it already in the list? */
-  for (p = strv; *p; p++)
-    if (g_str_equal (*p, str))
-      return g_strdupv (strv);
-
-  /* Not found; append */
-  nstrv = g_new (char *, (p - strv) + 2);
-  for (p = strv, q = nstrv; *p; p++, q++)
-    *q = g_strdup (*p);
-  *q++ = g_strdup (str);
-  *q = NULL;
-
-  return strv_sort (nstrv);
+  return (const char **) strv_sort ((char **) nstrv);
 }
 
-static char **
-strv_dupv_remove (char **strv,
-                  const char *str)
+static const char **
+uuids_dupv_remove (TerminalSettingsList *list,
+                   const char *uuid)
 {
-  char **nstrv, **p, **q;
+  const char **nstrv;
+  int pos;
 
-  if (strv == NULL)
-    return NULL;
+  pos = uuids_find (list, uuid);
+  nstrv = g_new (const char *, list->n_uuids + 1);
+  if (list->n_uuids > 0)
+    memcpy (nstrv, list->uuids, list->n_uuids * sizeof (char *));
+  nstrv[list->n_uuids] = NULL;
 
-  nstrv = g_strdupv (strv);
-  for (p = q = nstrv; *p; p++) {
-    if (!g_str_equal (*p, str))
-      *q++ = *p;
-    else
-      g_free (*p);
-  }
-  *q = NULL;
+  if (pos != -1)
+    memmove (&nstrv[pos], &nstrv[pos + 1], (list->n_uuids - pos) * sizeof (char *));
 
   return nstrv;
 }
@@ -228,7 +273,8 @@ list_map_func (GVariant *value,
   TerminalSettingsList *list = user_data;
   gs_strfreev char **entries;
 
-  entries = strv_sort (g_variant_dup_strv (value, NULL));
+  /* The UUIDs index the children, so each may only be there once */
+  entries = strv_sort (strv_uniq (g_variant_dup_strv (value, NULL)));
 
   if (validate_list (list, entries)) {
     gs_transfer_out_value(result, &entries);
@@ -252,7 +298,7 @@ terminal_settings_list_ref_child_internal (TerminalSettingsList *list,
   GSettings *child;
   gs_free char *path = NULL;
 
-  if (strv_find (list->uuids, uuid) == -1)
+  if (uuids_find (list, uuid) == -1)
     return NULL;
 
   _terminal_debug_print (TERMINAL_DEBUG_SETTINGS_LIST,
@@ -270,25 +316,23 @@ terminal_settings_list_ref_child_internal (TerminalSettingsList *list,
   return g_object_ref (child);
 }
 
-static char *
-clone_child (TerminalSettingsList *list,
-             const char *uuid)
+/* Copies all keys of @uuid to each of @new_uuids, in one dconf change */
+static void
+clone_children (TerminalSettingsList *list,
+                const char *uuid,
+                char **new_uuids,
+                guint n_new_uuids)
 {
-  char *new_uuid;
   gs_free char *path;
-  gs_free char *new_path;
-  char **keys;
-  guint i;
+  gs_strfreev char **keys = NULL;
+  guint i, j;
   gs_unref_object DConfClient *client;
   DConfChangeset *changeset;
 
-  new_uuid = new_list_entry ();
-
   _terminal_debug_print (TERMINAL_DEBUG_SETTINGS_LIST,
-                         "%s UUID %s NEW UUID %s \n", G_STRFUNC, uuid ? uuid : "(null)", new_uuid);
+                         "%s UUID %s NEW UUIDs %u\n", G_STRFUNC, uuid ? uuid : "(null)", n_new_uuids);
 
   path = path_new (list, uuid);
-  new_path = path_new (list, new_uuid);
 
   client = dconf_client_new ();
   changeset = dconf_changeset_new ();
@@ -305,39 +349,57 @@ clone_child (TerminalSettingsList *list,
 
     rkey = g_strconcat (path, keys[i], NULL);
     value = dconf_client_read (client, rkey);
+    if (value == NULL)
+      continue;
+
+    for (j = 0; j < n_new_uuids; j++) {
+      gs_free char *new_path = path_new (list, new_uuids[j]);
+      gs_free char *wkey = g_strconcat (new_path, keys[i], NULL);
 
-    if (value) {
-      gs_free char *wkey;
-      wkey = g_strconcat (new_path, keys[i], NULL);
       dconf_changeset_set (changeset, wkey, value);
     }
   }
 
   dconf_client_change_sync (client, changeset, NULL, NULL, NULL);
   dconf_changeset_unref (changeset);
+}
 
-  return new_uuid;
+static char **
+terminal_settings_list_add_children_internal (TerminalSettingsList *list,
+                                              const char *uuid,
+                                              guint n_children)
+{
+  char **new_uuids;
+  gs_free const char **list_uuids = NULL;
+  guint i;
+
+  new_uuids = g_new0 (char *, n_children + 1);
+  for (i = 0; i < n_children; i++) {
+    new_uuids[i] = new_list_entry ();
+
+    _terminal_debug_print (TERMINAL_DEBUG_SETTINGS_LIST,
+                           "%s NEW UUID %s\n", G_STRFUNC, new_uuids[i]);
+  }
+
+  /* The children's keys have to be there before they're on the list */
+  if (uuid && settings_backend_is_dconf ())
+    clone_children (list, uuid, new_uuids, n_children);
+
+  list_uuids = uuids_dupv_insert (list, new_uuids, n_children);
+  g_settings_set_strv (&list->parent, TERMINAL_SETTINGS_LIST_LIST_KEY,
+                       (const char * const *) list_uuids);
+
+  return new_uuids;
 }
 
 static char *
 terminal_settings_list_add_child_internal (TerminalSettingsList *list,
                                            const char *uuid)
 {
+  gs_strfreev char **new_uuids = terminal_settings_list_add_children_internal (list, uuid, 1);
   char *new_uuid;
-  gs_strfreev char **new_uuids;
-
-  if (uuid && settings_backend_is_dconf ())
-    new_uuid = clone_child (list, uuid);
-  else
-    new_uuid = new_list_entry ();
-
-  _terminal_debug_print (TERMINAL_DEBUG_SETTINGS_LIST,
-                         "%s NEW UUID %s\n", G_STRFUNC, new_uuid);
-
-  new_uuids = strv_dupv_insert (list->uuids, new_uuid);
-  g_settings_set_strv (&list->parent, TERMINAL_SETTINGS_LIST_LIST_KEY,
-                       (const char * const *) new_uuids);
 
+  gs_transfer_out_value (&new_uuid, &new_uuids[0]);
   return new_uuid;
 }
 
@@ -345,14 +407,17 @@ static void
 terminal_settings_list_remove_child_internal (TerminalSettingsList *list,
                                               const char *uuid)
 {
-  gs_strfreev char **new_uuids;
+  gs_free const char **new_uuids = NULL;
 
   _terminal_debug_print (TERMINAL_DEBUG_SETTINGS_LIST,
                          "%s UUID %s\n", G_STRFUNC, uuid);
 
-  new_uuids = strv_dupv_remove (list->uuids, uuid);
+  if (uuids_find (list, uuid) == -1)
+    return;
+
+  new_uuids = uuids_dupv_remove (list, uuid);
 
-  if ((new_uuids == NULL || new_uuids[0] == NULL) &&
+  if (new_uuids[0] == NULL &&
       (list->flags & TERMINAL_SETTINGS_LIST_FLAG_ALLOW_EMPTY) == 0)
     return;
 
@@ -396,7 +461,7 @@ terminal_settings_list_update_list (TerminalSettingsList *list)
 
   if (strv_equal (uuids, list->uuids) &&
       ((list->flags & TERMINAL_SETTINGS_LIST_FLAG_HAS_DEFAULT) == 0 ||
-       strv_find (list->uuids, list->default_uuid) != -1)) {
+       uuids_find (list, list->default_uuid) != -1)) {
     g_strfreev (uuids);
     return;
   }
@@ -426,8 +491,7 @@ terminal_settings_list_update_list (TerminalSettingsList *list)
   g_hash_table_unref (list->children);
   list->children = new_children;
 
-  g_strfreev (list->uuids);
-  list->uuids = uuids; /* adopts */
+  uuids_set (list, uuids /* adopted */);
 
   if (changed)
     g_signal_emit (list, signals[SIGNAL_CHILDREN_CHANGED], 0);
@@ -494,6 +558,7 @@ terminal_settings_list_constructed (GObject *object)
   list->children = g_hash_table_new_full (g_str_hash, g_str_equal,
                                           (GDestroyNotify) g_free,
                                           (GDestroyNotify) g_object_unref);
+  list->uuid_index = g_hash_table_new (g_str_hash, g_str_equal);
 
   terminal_settings_list_changed (&list->parent, NULL);
 }
@@ -505,6 +570,7 @@ terminal_settings_list_finalize (GObject *object)
 
   g_free (list->path);
   g_free (list->child_schema_id);
+  g_hash_table_unref (list->uuid_index);
   g_strfreev (list->uuids);
   g_free (list->default_uuid);
   g_hash_table_unref (list->children);
@@ -659,7 +725,7 @@ terminal_settings_list_dup_default_child (TerminalSettingsList *list)
   if ((list->flags & TERMINAL_SETTINGS_LIST_FLAG_HAS_DEFAULT) == 0)
     return NULL;
 
-  if ((strv_find (list->uuids, list->default_uuid)) != -1)
+  if (uuids_find (list, list->default_uuid) != -1)
     return g_strdup (list->default_uuid);
 
   /* Just randomly designate the first child as default, but don't write that
@@ -687,7 +753,7 @@ terminal_settings_list_has_child (TerminalSettingsList *list,
   g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), FALSE);
   g_return_val_if_fail (terminal_settings_list_valid_uuid (uuid), FALSE);
 
-  return strv_find (list->uuids, uuid) != -1;
+  return uuids_find (list, uuid) != -1;
 }
 
 /**
@@ -726,14 +792,11 @@ terminal_settings_list_ref_children (TerminalSettingsList *list)
 
   g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), NULL);
 
-  if (list->uuids == NULL)
-    return NULL;
-
   l = NULL;
-  for (i = 0; list->uuids[i]; i++)
-    l = g_list_prepend (l, terminal_settings_list_ref_child (list, list->uuids[i]));
+  for (i = list->n_uuids; i > 0; i--)
+    l = g_list_prepend (l, terminal_settings_list_ref_child_internal (list, list->uuids[i - 1]));
 
-  return g_list_reverse (l);
+  return l;
 }
 
 /**
@@ -795,6 +858,29 @@ terminal_settings_list_clone_child (TerminalSettingsList *list,
   return terminal_settings_list_add_child_internal (list, uuid);
 }
 
+/**
+ * terminal_settings_list_clone_children:
+ * @list: a #TerminalSettingsList
+ * @uuid: (allow-none): the UUID of the child to clone, or %NULL
+ * @n_children: the number of children to add
+ *
+ * Adds @n_children new children to the list with one update of the list,
+ * copying all of @uuid's keys to them in a single change. If @uuid is %NULL,
+ * the new children have default values.
+ *
+ * Returns: (transfer full): the UUIDs of the new children
+ */
+char **
+terminal_settings_list_clone_children (TerminalSettingsList *list,
+                                       const char *uuid,
+                                       guint n_children)
+{
+  g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), NULL);
+  g_return_val_if_fail (uuid == NULL || terminal_settings_list_valid_uuid (uuid), NULL);
+
+  return terminal_settings_list_add_children_internal (list, uuid, n_children);
+}
+
 /**
  * terminal_settings_list_remove_child:
  * @list: a #TerminalSettingsList
@@ -882,8 +968,8 @@ terminal_settings_list_foreach_child (TerminalSettingsList *list,
   g_return_if_fail (TERMINAL_IS_SETTINGS_LIST (list));
   g_return_if_fail (callback);
 
-  for (char **p = list->uuids; *p; p++) {
-    const char *uuid = *p;
+  for (guint i = 0; i < list->n_uuids; i++) {
+    const char *uuid = list->uuids[i];
     gs_unref_object GSettings *child = terminal_settings_list_ref_child_internal (list, uuid);
     if (child != NULL)
       callback (list, uuid, child, user_data);
@@ -891,7 +977,7 @@ terminal_settings_list_foreach_child (TerminalSettingsList *list,
 }
 
 /**
- * terminal_settings_list_foreach_child:
+ * terminal_settings_list_get_n_children:
  * @list: a #TerminalSettingsList
  *
  * Returns: the number of children of @list.
@@ -901,5 +987,57 @@ terminal_settings_list_get_n_children (TerminalSettingsList *list)
 {
   g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), 0);
 
-  return g_hash_table_size (list->children);
+  return list->n_uuids;
+}
+
+/**
+ * terminal_settings_list_get_nth_uuid:
+ * @list: a #TerminalSettingsList
+ * @index: the position of a child in the list
+ *
+ * Returns: (transfer none): the UUID of the child at @index. It is only
+ *   valid until @list changes.
+ */
+const char *
+terminal_settings_list_get_nth_uuid (TerminalSettingsList *list,
+                                     guint index)
+{
+  g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), NULL);
+  g_return_val_if_fail (index < list->n_uuids, NULL);
+
+  return list->uuids[index];
+}
+
+/**
+ * terminal_settings_list_ref_nth_child:
+ * @list: a #TerminalSettingsList
+ * @index: the position of a child in the list
+ *
+ * Returns: (transfer full): a reference to the #GSettings for the child at @index
+ */
+GSettings *
+terminal_settings_list_ref_nth_child (TerminalSettingsList *list,
+                                      guint index)
+{
+  g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), NULL);
+  g_return_val_if_fail (index < list->n_uuids, NULL);
+
+  return terminal_settings_list_ref_child_internal (list, list->uuids[index]);
+}
+
+/**
+ * terminal_settings_list_get_child_index:
+ * @list: a #TerminalSettingsList
+ * @uuid: the UUID of a list child
+ *
+ * Returns: the position of the child with @uuid in @list, or -1 if
+ *   @list has no such child
+ */
+int
+terminal_settings_list_get_child_index (TerminalSettingsList *list,
+                                        const char *uuid)
+{
+  g_return_val_if_fail (TERMINAL_IS_SETTINGS_LIST (list), -1);
+
+  return uuids_find (list, uuid);
 }
@@ -56,6 +56,10 @@ char *terminal_settings_list_add_child (TerminalSettingsList *list);
 char *terminal_settings_list_clone_child (TerminalSettingsList *list,
                                           const char *uuid);
 
+char **terminal_settings_list_clone_children (TerminalSettingsList *list,
+                                              const char *uuid,
+                                              guint n_children);
+
 void terminal_settings_list_remove_child (TerminalSettingsList *list,
                                           const char *uuid);
 
@@ -80,6 +84,15 @@ void terminal_settings_list_foreach_child (TerminalSettingsList *list,
 
 guint terminal_settings_list_get_n_children (TerminalSettingsList *list);
 
+const char *terminal_settings_list_get_nth_uuid (TerminalSettingsList *list,
+                                                 guint index);
+
+GSettings *terminal_settings_list_ref_nth_child (TerminalSettingsList *list,
+                                                 guint index);
+
+int terminal_settings_list_get_child_index (TerminalSettingsList *list,
+                                            const char *uuid);
+
 gboolean terminal_settings_list_valid_uuid (const char *str);
 
 G_END_DECLS
@@ -0,0 +1,682 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "terminal-snapshot.h"
+#include "terminal-debug.h"
+#include "terminal-profiles-list.h"
+#include "terminal-screen.h"
+#include "terminal-screen-container.h"
+#include "terminal-window.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
+#include "terminal-libgsystem.h"
+
+/* Session snapshots
+ *
+ * A snapshot is a single serialised GVariant, so restoring it only needs
+ * to map the file; nothing is parsed until a value is actually read.
+ * The format is
+ *
+ *   (u             version
+ *    a(s           window role
+ *      ii          columns and rows of the active tab
+ *      bb          maximized, fullscreen
+ *      i           index of the active tab
+ *      a(s         profile UUID
+ *        s         working directory, or ""
+ *        s         title, or ""
+ *        d         zoom
+ *        ay)))     gzipped recent output, or empty
+ *
+ * The windows are in stacking order, the topmost last.
+ *
+ * The app only saves a periodic snapshot when something changed since
+ * the last one, see terminal_app_mark_session_dirty(). The snapshot is
+ * still written as a whole, atomically, so that it stays one mappable
+ * value; but the compressed output of a terminal is kept from one
+ * snapshot to the next, and only taken and compressed again when the
+ * terminal's contents changed.
+ */
+
+#define SNAPSHOT_VERSION (1)
+#define SNAPSHOT_TYPE "(ua(siibbia(sssday)))"
+
+/* How many rows of output to keep for each terminal */
+#define SNAPSHOT_SCROLLBACK_ROWS (1000)
+
+typedef struct {
+  char *uuid; /* of the screen */
+  guint contents_serial;
+  char *profile_uuid;
+  char *cwd;
+  char *title;
+  double zoom;
+  char *text;
+  GVariant *compressed; /* the "ay" of text, or NULL until compressed */
+} SnapshotTab;
+
+typedef struct {
+  char *role;
+  int columns;
+  int rows;
+  gboolean maximized;
+  gboolean fullscreen;
+  int active;
+  GArray *tabs; /* SnapshotTab */
+} SnapshotWindow;
+
+typedef struct {
+  guint contents_serial;
+  GVariant *compressed;
+} CachedText;
+
+typedef struct {
+  GArray *windows; /* SnapshotWindow */
+  guint generation;
+} SnapshotData;
+
+/* The compressed output of the screens in the last snapshot, by screen UUID */
+static GHashTable *text_cache;
+
+/* Bumped on the main thread for each snapshot that is started; a worker
+ * only writes its snapshot while holding the lock, and only if no newer
+ * one was started, so that it can't replace a newer snapshot on disk.
+ */
+static GMutex snapshot_write_lock;
+static guint snapshot_generation;
+
+static void
+cached_text_free (CachedText *cached)
+{
+  g_variant_unref (cached->compressed);
+  g_slice_free (CachedText, cached);
+}
+
+static void
+snapshot_data_free (SnapshotData *data)
+{
+  g_array_unref (data->windows);
+  g_slice_free (SnapshotData, data);
+}
+
+/* Runs on the main thread when a snapshot is started */
+static guint
+snapshot_next_generation (void)
+{
+  guint generation;
+
+  g_mutex_lock (&snapshot_write_lock);
+  generation = ++snapshot_generation;
+  g_mutex_unlock (&snapshot_write_lock);
+
+  return generation;
+}
+
+static void
+snapshot_tab_clear (SnapshotTab *tab)
+{
+  g_free (tab->uuid);
+  if (tab->compressed != NULL)
+    g_variant_unref (tab->compressed);
+  g_free (tab->profile_uuid);
+  g_free (tab->cwd);
+  g_free (tab->title);
+  g_free (tab->text);
+}
+
+static void
+snapshot_window_clear (SnapshotWindow *sw)
+{
+  g_free (sw->role);
+  g_array_unref (sw->tabs);
+}
+
+static char *
+snapshot_get_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "gnome-terminal", "session.snapshot", NULL);
+}
+
+/* Returns the recent output of @screen, up to the line the cursor is on */
+static char *
+snapshot_get_screen_text (TerminalScreen *screen)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GtkAdjustment *adjustment;
+  long first_row, last_row, cursor_row;
+
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  vte_terminal_get_cursor_position (terminal, NULL, &cursor_row);
+  last_row = cursor_row - 1;
+  first_row = MAX ((long) gtk_adjustment_get_lower (adjustment),
+                   last_row - SNAPSHOT_SCROLLBACK_ROWS + 1);
+  if (last_row < first_row)
+    return NULL;
+
+  return vte_terminal_get_text_range (terminal,
+                                      first_row, 0,
+                                      last_row, vte_terminal_get_column_count (terminal) - 1,
+                                      NULL, NULL, NULL);
+}
+
+/* Runs on the main thread; collects everything that needs the widgets */
+static GArray *
+snapshot_collect (TerminalApp *app,
+                  gboolean with_scrollback)
+{
+  TerminalSettingsList *profiles_list = terminal_app_get_profiles_list (app);
+  GArray *windows;
+  GList *l;
+
+  windows = g_array_new (FALSE, TRUE, sizeof (SnapshotWindow));
+  g_array_set_clear_func (windows, (GDestroyNotify) snapshot_window_clear);
+
+  /* The application's list has the most recently focused window first */
+  for (l = g_list_last (gtk_application_get_windows (GTK_APPLICATION (app))); l != NULL; l = l->prev) {
+    TerminalWindow *window;
+    TerminalScreen *active_screen;
+    SnapshotWindow sw = { 0, };
+    GdkWindow *gdk_window;
+    GList *containers, *c;
+
+    if (!TERMINAL_IS_WINDOW (l->data))
+      continue;
+
+    window = TERMINAL_WINDOW (l->data);
+    active_screen = terminal_window_get_active (window);
+    if (active_screen == NULL)
+      continue;
+
+    sw.role = g_strdup (gtk_window_get_role (GTK_WINDOW (window)));
+    sw.columns = vte_terminal_get_column_count (VTE_TERMINAL (active_screen));
+    sw.rows = vte_terminal_get_row_count (VTE_TERMINAL (active_screen));
+    gdk_window = gtk_widget_get_window (GTK_WIDGET (window));
+    if (gdk_window != NULL) {
+      GdkWindowState state = gdk_window_get_state (gdk_window);
+
+      sw.maximized = (state & GDK_WINDOW_STATE_MAXIMIZED) != 0;
+      sw.fullscreen = (state & GDK_WINDOW_STATE_FULLSCREEN) != 0;
+    }
+    sw.tabs = g_array_new (FALSE, TRUE, sizeof (SnapshotTab));
+    g_array_set_clear_func (sw.tabs, (GDestroyNotify) snapshot_tab_clear);
+
+    containers = terminal_window_list_screen_containers (window);
+    for (c = containers; c != NULL; c = c->next) {
+      TerminalScreen *screen = terminal_screen_container_get_screen (c->data);
+      const char *title = terminal_screen_get_title (screen);
+      SnapshotTab tab = { 0, };
+
+      if (screen == active_screen)
+        sw.active = sw.tabs->len;
+
+      if (with_scrollback) {
+        CachedText *cached = NULL;
+
+        tab.uuid = g_strdup (terminal_screen_get_uuid (screen));
+        tab.contents_serial = terminal_screen_get_contents_changes (screen);
+        if (text_cache != NULL)
+          cached = g_hash_table_lookup (text_cache, tab.uuid);
+        if (cached != NULL && cached->contents_serial == tab.contents_serial)
+          tab.compressed = g_variant_ref (cached->compressed);
+        else
+          tab.text = snapshot_get_screen_text (screen);
+      }
+
+      tab.profile_uuid = terminal_settings_list_dup_uuid_from_child (profiles_list,
+                                                                     terminal_screen_get_profile (screen));
+      tab.cwd = terminal_screen_get_current_dir (screen);
+      tab.title = g_strdup (title);
+      tab.zoom = vte_terminal_get_font_scale (VTE_TERMINAL (screen));
+      g_array_append_val (sw.tabs, tab);
+    }
+    g_list_free (containers);
+
+    g_array_append_val (windows, sw);
+  }
+
+  return windows;
+}
+
+static GVariant *
+snapshot_compress (const char *text,
+                   GCancellable *cancellable)
+{
+  if (text == NULL || text[0] == '\0')
+    return g_variant_new_from_data (G_VARIANT_TYPE_BYTESTRING, "", 0, TRUE, NULL, NULL);
+
+  gs_unref_object GOutputStream *memory_stream = g_memory_output_stream_new_resizable ();
+  gs_unref_object GConverter *compressor =
+    G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  gs_unref_object GOutputStream *stream =
+    g_converter_output_stream_new (memory_stream, compressor);
+
+  if (!g_output_stream_write_all (stream, text, strlen (text), NULL, cancellable, NULL) ||
+      !g_output_stream_close (stream, cancellable, NULL))
+    return g_variant_new_from_data (G_VARIANT_TYPE_BYTESTRING, "", 0, TRUE, NULL, NULL);
+
+  gs_unref_bytes GBytes *bytes =
+    g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory_stream));
+  return g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, bytes, TRUE);
+}
+
+/* Runs in a worker thread, or on the main thread when saving synchronously */
+static gboolean
+snapshot_write (GArray *windows,
+                guint generation,
+                GCancellable *cancellable,
+                GError **error)
+{
+  GVariantBuilder builder;
+  guint i, j;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(siibbia(sssday))"));
+  for (i = 0; i < windows->len; i++) {
+    SnapshotWindow *sw = &g_array_index (windows, SnapshotWindow, i);
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("(siibbia(sssday))"));
+    g_variant_builder_add (&builder, "s", sw->role ? sw->role : "");
+    g_variant_builder_add (&builder, "i", sw->columns);
+    g_variant_builder_add (&builder, "i", sw->rows);
+    g_variant_builder_add (&builder, "b", sw->maximized);
+    g_variant_builder_add (&builder, "b", sw->fullscreen);
+    g_variant_builder_add (&builder, "i", sw->active);
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(sssday)"));
+    for (j = 0; j < sw->tabs->len; j++) {
+      SnapshotTab *tab = &g_array_index (sw->tabs, SnapshotTab, j);
+
+      if (tab->compressed == NULL)
+        tab->compressed = g_variant_ref_sink (snapshot_compress (tab->text, cancellable));
+
+      g_variant_builder_add (&builder, "(sssd@ay)",
+                             tab->profile_uuid ? tab->profile_uuid : "",
+                             tab->cwd ? tab->cwd : "",
+                             tab->title ? tab->title : "",
+                             tab->zoom,
+                             tab->compressed);
+    }
+    g_variant_builder_close (&builder);
+    g_variant_builder_close (&builder);
+  }
+
+  gs_unref_variant GVariant *snapshot =
+    g_variant_ref_sink (g_variant_new ("(ua(siibbia(sssday)))", SNAPSHOT_VERSION, &builder));
+
+  if (g_cancellable_set_error_if_cancelled (cancellable, error))
+    return FALSE;
+
+  gs_free char *path = snapshot_get_path ();
+  gs_free char *dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0700) != 0) {
+    int errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to create directory %s: %s", dir, g_strerror (errsv));
+    return FALSE;
+  }
+
+  /* The snapshot may have the output of the terminals, so keep it private */
+  gs_unref_object GFile *file = g_file_new_for_path (path);
+  gboolean rv;
+
+  g_mutex_lock (&snapshot_write_lock);
+  if (generation != snapshot_generation) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                         "A newer snapshot was started");
+    rv = FALSE;
+  } else
+    rv = g_file_replace_contents (file,
+                                  g_variant_get_data (snapshot),
+                                  g_variant_get_size (snapshot),
+                                  NULL, FALSE, G_FILE_CREATE_PRIVATE,
+                                  NULL, NULL, error);
+  g_mutex_unlock (&snapshot_write_lock);
+
+  return rv;
+}
+
+/* Runs on the main thread once @windows were written; keeps their
+ * compressed output for the next snapshot, and forgets that of the
+ * screens that are gone.
+ */
+static void
+snapshot_update_text_cache (GArray *windows)
+{
+  GHashTable *cache;
+  guint i, j;
+
+  cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) cached_text_free);
+  for (i = 0; i < windows->len; i++) {
+    SnapshotWindow *sw = &g_array_index (windows, SnapshotWindow, i);
+
+    for (j = 0; j < sw->tabs->len; j++) {
+      SnapshotTab *tab = &g_array_index (sw->tabs, SnapshotTab, j);
+      CachedText *cached;
+
+      if (tab->uuid == NULL || tab->compressed == NULL)
+        continue;
+
+      cached = g_slice_new (CachedText);
+      cached->contents_serial = tab->contents_serial;
+      cached->compressed = g_variant_ref (tab->compressed);
+      g_hash_table_replace (cache, g_strdup (tab->uuid), cached);
+    }
+  }
+
+  if (text_cache != NULL)
+    g_hash_table_unref (text_cache);
+  text_cache = cache;
+}
+
+static void
+snapshot_thread_func (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+  SnapshotData *data = task_data;
+  GError *error = NULL;
+
+  if (snapshot_write (data->windows, data->generation, cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+/**
+ * terminal_snapshot_save_async:
+ * @app: a #TerminalApp
+ * @with_scrollback: whether to include the recent output of each terminal
+ * @cancellable: (allow-none): a #GCancellable, or %NULL
+ * @callback: the callback
+ * @user_data: data for @callback
+ *
+ * Saves a snapshot of the open windows. The windows are looked at right
+ * away; compressing and writing the snapshot happens in a worker thread.
+ */
+void
+terminal_snapshot_save_async (TerminalApp *app,
+                              gboolean with_scrollback,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+  GTask *task;
+  SnapshotData *data;
+
+  g_return_if_fail (TERMINAL_IS_APP (app));
+
+  gint64 trace_begin = _terminal_trace_begin ();
+  task = g_task_new (app, cancellable, callback, user_data);
+  data = g_slice_new (SnapshotData);
+  data->windows = snapshot_collect (app, with_scrollback);
+  data->generation = snapshot_next_generation ();
+  g_task_set_task_data (task, data, (GDestroyNotify) snapshot_data_free);
+  _terminal_trace_end ("SnapshotCollect", trace_begin);
+
+  g_task_run_in_thread (task, snapshot_thread_func);
+  g_object_unref (task);
+}
+
+/**
+ * terminal_snapshot_save_finish:
+ * @app: a #TerminalApp
+ * @result: the #GAsyncResult
+ * @error: a #GError location
+ *
+ * Returns: %TRUE if the snapshot was saved
+ */
+gboolean
+terminal_snapshot_save_finish (TerminalApp *app,
+                               GAsyncResult *result,
+                               GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, app), FALSE);
+
+  if (!g_task_propagate_boolean (G_TASK (result), error))
+    return FALSE;
+
+  SnapshotData *data = g_task_get_task_data (G_TASK (result));
+  snapshot_update_text_cache (data->windows);
+  return TRUE;
+}
+
+/**
+ * terminal_snapshot_save:
+ * @app: a #TerminalApp
+ * @with_scrollback: whether to include the recent output of each terminal
+ * @error: a #GError location
+ *
+ * Like terminal_snapshot_save_async(), but blocks until the snapshot is written.
+ * A snapshot that is still being written in a worker thread is not
+ * written over this one.
+ *
+ * Returns: %TRUE if the snapshot was saved
+ */
+gboolean
+terminal_snapshot_save (TerminalApp *app,
+                        gboolean with_scrollback,
+                        GError **error)
+{
+  g_return_val_if_fail (TERMINAL_IS_APP (app), FALSE);
+
+  const char *section = _terminal_watchdog_enter ("terminal_snapshot_save");
+  GArray *windows = snapshot_collect (app, with_scrollback);
+  guint generation = snapshot_next_generation ();
+  gboolean rv = snapshot_write (windows, generation, NULL, error);
+  if (rv)
+    snapshot_update_text_cache (windows);
+  g_array_unref (windows);
+  _terminal_watchdog_leave (section);
+
+  return rv;
+}
+
+static char *
+snapshot_decompress (GVariant *value,
+                     gsize *len)
+{
+  gsize size;
+  gconstpointer data = g_variant_get_fixed_array (value, &size, 1);
+
+  if (size == 0)
+    return NULL;
+
+  gs_unref_object GInputStream *memory_stream =
+    g_memory_input_stream_new_from_data (data, size, NULL);
+  gs_unref_object GConverter *decompressor =
+    G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+  gs_unref_object GInputStream *stream =
+    g_converter_input_stream_new (memory_stream, decompressor);
+  gs_unref_object GOutputStream *text_stream = g_memory_output_stream_new_resizable ();
+
+  /* Add the terminating NUL */
+  if (g_output_stream_splice (text_stream, stream,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+                              NULL, NULL) < 0 ||
+      !g_output_stream_write_all (text_stream, "", 1, NULL, NULL, NULL) ||
+      !g_output_stream_close (text_stream, NULL, NULL))
+    return NULL;
+
+  *len = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (text_stream)) - 1;
+  return g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (text_stream));
+}
+
+/* Feeds the saved output of a tab, which has bare newlines, to its new screen */
+static void
+snapshot_feed_text (TerminalScreen *screen,
+                    GVariant *value)
+{
+  gs_free char *text = NULL;
+  gsize len = 0;
+  GString *str;
+  gsize i;
+
+  text = snapshot_decompress (value, &len);
+  if (text == NULL)
+    return;
+
+  str = g_string_sized_new (len + len / 16 + 2);
+  for (i = 0; i < len; i++) {
+    if (text[i] == '\n')
+      g_string_append_c (str, '\r');
+    g_string_append_c (str, text[i]);
+  }
+  if (str->len > 0 && str->str[str->len - 1] != '\n')
+    g_string_append (str, "\r\n");
+
+  vte_terminal_feed (VTE_TERMINAL (screen), str->str, str->len);
+  g_string_free (str, TRUE);
+}
+
+/**
+ * terminal_snapshot_restore:
+ * @app: a #TerminalApp
+ * @error: a #GError location
+ *
+ * Opens the windows and tabs saved in the last snapshot, each running
+ * its profile's command in the saved working directory.
+ *
+ * Returns: (transfer full): the object paths of the new screens, or %NULL
+ *   with @error filled in
+ */
+char **
+terminal_snapshot_restore (TerminalApp *app,
+                           GError **error)
+{
+  TerminalSettingsList *profiles_list;
+  GPtrArray *object_paths;
+  gs_free_variant_iter GVariantIter *windows_iter = NULL;
+  GVariantIter *tabs_iter;
+  const char *role;
+  int columns, rows, active;
+  gboolean maximized, fullscreen;
+  guint32 version;
+
+  g_return_val_if_fail (TERMINAL_IS_APP (app), NULL);
+
+  gint64 trace_begin = _terminal_trace_begin ();
+
+  gs_free char *path = snapshot_get_path ();
+  GMappedFile *file = g_mapped_file_new (path, FALSE, error);
+  if (file == NULL)
+    return NULL;
+
+  gs_unref_bytes GBytes *bytes = g_mapped_file_get_bytes (file);
+  g_mapped_file_unref (file);
+
+  gs_unref_variant GVariant *snapshot =
+    g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (SNAPSHOT_TYPE), bytes, FALSE));
+
+  g_variant_get_child (snapshot, 0, "u", &version);
+  if (version == GUINT32_SWAP_LE_BE (SNAPSHOT_VERSION)) {
+    GVariant *swapped = g_variant_byteswap (snapshot);
+
+    g_variant_unref (snapshot);
+    snapshot = g_variant_ref_sink (swapped);
+    version = SNAPSHOT_VERSION;
+  }
+  if (version != SNAPSHOT_VERSION) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                 "Unsupported snapshot version %u in %s", version, path);
+    return NULL;
+  }
+
+  profiles_list = terminal_app_get_profiles_list (app);
+  object_paths = g_ptr_array_new ();
+
+  g_variant_get (snapshot, "(ua(siibbia(sssday)))", NULL, &windows_iter);
+  while (g_variant_iter_next (windows_iter, "(&siibbia(sssday))",
+                              &role, &columns, &rows, &maximized, &fullscreen,
+                              &active, &tabs_iter)) {
+    TerminalWindow *window;
+    TerminalScreen *active_screen = NULL;
+    const char *profile_uuid, *cwd, *title;
+    double zoom;
+    GVariant *text;
+    int n = 0;
+
+    window = terminal_app_new_window (app, 0);
+    if (role[0] != '\0')
+      gtk_window_set_role (GTK_WINDOW (window), role);
+
+    while (g_variant_iter_next (tabs_iter, "(&s&s&sd@ay)",
+                                &profile_uuid, &cwd, &title, &zoom, &text)) {
+      TerminalScreen *screen;
+
+      gs_unref_object GSettings *profile =
+        terminal_profiles_list_ref_profile_by_uuid (profiles_list,
+                                                    profile_uuid[0] ? profile_uuid : NULL,
+                                                    NULL);
+      /* The profile is gone, use the default one */
+      if (profile == NULL)
+        profile = terminal_profiles_list_ref_profile_by_uuid (profiles_list, NULL, NULL);
+      if (profile == NULL) {
+        g_variant_unref (text);
+        continue;
+      }
+
+      screen = terminal_screen_new (profile, NULL, NULL,
+                                    title[0] ? title : NULL,
+                                    cwd[0] ? cwd : NULL,
+                                    NULL, zoom);
+      terminal_window_add_screen (window, screen, -1);
+      snapshot_feed_text (screen, text);
+      g_variant_unref (text);
+
+      _terminal_screen_launch_child_on_idle (screen);
+
+      if (n++ == active || active_screen == NULL)
+        active_screen = screen;
+
+      g_ptr_array_add (object_paths, terminal_app_dup_screen_object_path (app, screen));
+    }
+    g_variant_iter_free (tabs_iter);
+
+    if (active_screen == NULL) {
+      gtk_widget_destroy (GTK_WIDGET (window));
+      continue;
+    }
+
+    terminal_window_switch_screen (window, active_screen);
+    gtk_widget_grab_focus (GTK_WIDGET (active_screen));
+
+    gs_free char *geometry = g_strdup_printf ("%dx%d", columns, rows);
+    if (!terminal_window_parse_geometry (window, geometry))
+      _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                             "Invalid geometry string \"%s\"", geometry);
+
+    if (fullscreen)
+      gtk_window_fullscreen (GTK_WINDOW (window));
+    if (maximized)
+      gtk_window_maximize (GTK_WINDOW (window));
+
+    gtk_window_present (GTK_WINDOW (window));
+  }
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Restored %u terminals from %s\n",
+                         object_paths->len, path);
+  _terminal_trace_end ("SnapshotRestore", trace_begin);
+
+  g_ptr_array_add (object_paths, NULL);
+  return (char **) g_ptr_array_free (object_paths, FALSE);
+}
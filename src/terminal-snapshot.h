@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_SNAPSHOT_H
+#define TERMINAL_SNAPSHOT_H
+
+#include <gio/gio.h>
+
+#include "terminal-app.h"
+
+G_BEGIN_DECLS
+
+void terminal_snapshot_save_async (TerminalApp *app,
+                                   gboolean with_scrollback,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data);
+
+gboolean terminal_snapshot_save_finish (TerminalApp *app,
+                                        GAsyncResult *result,
+                                        GError **error);
+
+gboolean terminal_snapshot_save (TerminalApp *app,
+                                 gboolean with_scrollback,
+                                 GError **error);
+
+char **terminal_snapshot_restore (TerminalApp *app,
+                                  GError **error);
+
+G_END_DECLS
+
+#endif /* TERMINAL_SNAPSHOT_H */
@@ -26,17 +26,23 @@
 #include "terminal-tab-label.h"
 #include "terminal-icon-button.h"
 #include "terminal-window.h"
+#include "terminal-libgsystem.h"
 
 #define TERMINAL_TAB_LABEL_GET_PRIVATE(tab_label)(G_TYPE_INSTANCE_GET_PRIVATE ((tab_label), TERMINAL_TYPE_TAB_LABEL, TerminalTabLabelPrivate))
 
 #define SPACING (4)
 
+/* Bounds the size of width_cache */
+#define MAX_CACHED_WIDTHS (512)
+
 struct _TerminalTabLabelPrivate
 {
   TerminalScreen *screen;
   GtkWidget *label;
+  GtkWidget *hot_image;
   GtkWidget *close_button;
   gboolean bold;
+  gboolean hot;
   GtkPositionType tab_pos;
 };
 
@@ -54,10 +60,65 @@ enum
 
 static guint signals[LAST_SIGNAL];
 
+typedef struct {
+  int minimum_width;
+  int natural_width;
+} CachedWidth;
+
+/* Measured widths of horizontal tab labels, by title, font, weight and
+ * theme; most tabs share a handful of titles.
+ */
+static GHashTable *width_cache;
+
 G_DEFINE_TYPE (TerminalTabLabel, terminal_tab_label, GTK_TYPE_BOX);
 
 /* helper functions */
 
+static char *
+width_cache_key (TerminalTabLabel *tab_label)
+{
+  TerminalTabLabelPrivate *priv = tab_label->priv;
+  PangoContext *context;
+  gs_free char *font = NULL;
+  gs_free char *theme = NULL;
+
+  context = gtk_widget_get_pango_context (priv->label);
+  font = pango_font_description_to_string (pango_context_get_font_description (context));
+  g_object_get (gtk_widget_get_settings (GTK_WIDGET (tab_label)),
+                "gtk-theme-name", &theme,
+                NULL);
+
+  return g_strdup_printf ("%s\x1f%s\x1f%d\x1f%d\x1f%d\x1f%s",
+                          theme ? theme : "",
+                          font,
+                          priv->bold,
+                          priv->hot,
+                          gtk_widget_get_scale_factor (GTK_WIDGET (tab_label)),
+                          gtk_label_get_text (GTK_LABEL (priv->label)));
+}
+
+static CachedWidth *
+width_cache_lookup (TerminalTabLabel *tab_label)
+{
+  gs_free char *key = NULL;
+
+  if (width_cache == NULL)
+    return NULL;
+
+  key = width_cache_key (tab_label);
+  return g_hash_table_lookup (width_cache, key);
+}
+
+/* Whether the notebook shows the tab labels at all */
+static gboolean
+tab_label_is_shown (GtkWidget *label)
+{
+  GtkWidget *notebook;
+
+  notebook = gtk_widget_get_ancestor (label, GTK_TYPE_NOTEBOOK);
+  return notebook != NULL && gtk_notebook_get_show_tabs (GTK_NOTEBOOK (notebook));
+}
+
 static void
 close_button_clicked_cb (GtkWidget *widget,
                          TerminalTabLabel *tab_label)
@@ -70,18 +131,42 @@ sync_tab_label (TerminalScreen *screen,
                 GParamSpec *pspec,
                 GtkWidget *label)
 {
+  TerminalTabLabel *tab_label;
   GtkWidget *hbox;
-  const char *title;
+  const char *title, *text;
   TerminalWindow *window;
+  CachedWidth old_width = { -1, -1 }, *cached;
+  int minimum_width, natural_width;
 
   title = terminal_screen_get_title (screen);
+  text = title && title[0] ? title : _("Terminal");
   hbox = gtk_widget_get_parent (label);
-
-  gtk_label_set_text (GTK_LABEL (label),
-                      title && title[0] ? title : _("Terminal"));
+  tab_label = TERMINAL_TAB_LABEL (hbox);
 
   gtk_widget_set_tooltip_text (hbox, title);
 
+  if (g_strcmp0 (gtk_label_get_text (GTK_LABEL (label)), text) == 0)
+    return;
+
+  /* Nothing to measure when the tabs are hidden, or all of the same width */
+  if (!tab_label_is_shown (label) ||
+      tab_label->priv->tab_pos == GTK_POS_LEFT ||
+      tab_label->priv->tab_pos == GTK_POS_RIGHT) {
+    gtk_label_set_text (GTK_LABEL (label), text);
+    return;
+  }
+
+  cached = width_cache_lookup (tab_label);
+  if (cached != NULL)
+    old_width = *cached;
+
+  gtk_label_set_text (GTK_LABEL (label), text);
+
+  gtk_widget_get_preferred_width (hbox, &minimum_width, &natural_width);
+  if (minimum_width == old_width.minimum_width &&
+      natural_width == old_width.natural_width)
+    return;
+
   /* This call updates the window size: bug 732588.
    * FIXMEchpe: This is probably a GTK+ bug, should get them fix it.
    */
@@ -91,6 +176,14 @@ sync_tab_label (TerminalScreen *screen,
     terminal_window_update_size (window);
 }
 
+static void
+sync_hot (TerminalScreen *screen,
+          GParamSpec *pspec,
+          TerminalTabLabel *tab_label)
+{
+  terminal_tab_label_set_hot (tab_label, terminal_screen_is_hot (screen));
+}
+
 static void
 notify_tab_pos_cb (GtkNotebook *notebook,
                    GParamSpec *pspec G_GNUC_UNUSED,
@@ -152,6 +245,8 @@ terminal_tab_label_get_preferred_width (GtkWidget *widget,
 {
   TerminalTabLabel *tab_label = TERMINAL_TAB_LABEL (widget);
   TerminalTabLabelPrivate *priv = tab_label->priv;
+  CachedWidth *cached;
+  int minimum, natural;
 
   if (priv->tab_pos == GTK_POS_LEFT || 
       priv->tab_pos == GTK_POS_RIGHT) {
@@ -159,9 +254,31 @@ terminal_tab_label_get_preferred_width (GtkWidget *widget,
       *natural_width = 160;
     if (minimum_width)
       *minimum_width = 160;
+    return;
   }
-  else
-    GTK_WIDGET_CLASS (terminal_tab_label_parent_class)->get_preferred_width (widget, minimum_width, natural_width);
+
+  cached = width_cache_lookup (tab_label);
+  if (cached != NULL) {
+    minimum = cached->minimum_width;
+    natural = cached->natural_width;
+  } else {
+    GTK_WIDGET_CLASS (terminal_tab_label_parent_class)->get_preferred_width (widget, &minimum, &natural);
+
+    if (width_cache == NULL)
+      width_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    else if (g_hash_table_size (width_cache) >= MAX_CACHED_WIDTHS)
+      g_hash_table_remove_all (width_cache);
+
+    cached = g_new (CachedWidth, 1);
+    cached->minimum_width = minimum;
+    cached->natural_width = natural;
+    g_hash_table_insert (width_cache, width_cache_key (tab_label), cached);
+  }
+
+  if (minimum_width)
+    *minimum_width = minimum;
+  if (natural_width)
+    *natural_width = natural;
 }
 
 static void
@@ -202,6 +319,11 @@ terminal_tab_label_constructed (GObject *object)
   gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
 #endif
 
+  priv->hot_image = gtk_image_new_from_icon_name ("dialog-warning-symbolic", GTK_ICON_SIZE_MENU);
+  gtk_widget_set_tooltip_text (priv->hot_image, _("This terminal is producing a lot of output"));
+  gtk_widget_set_no_show_all (priv->hot_image, TRUE);
+  gtk_box_pack_start (GTK_BOX (hbox), priv->hot_image, FALSE, FALSE, 0);
+
   priv->close_button = close_button = terminal_close_button_new ();
   gtk_widget_set_tooltip_text (close_button, _("Close tab"));
   gtk_box_pack_end (GTK_BOX (hbox), close_button, FALSE, FALSE, 0);
@@ -210,6 +332,10 @@ terminal_tab_label_constructed (GObject *object)
   g_signal_connect (priv->screen, "notify::title",
                     G_CALLBACK (sync_tab_label), label);
 
+  sync_hot (priv->screen, NULL, tab_label);
+  g_signal_connect (priv->screen, "notify::hot",
+                    G_CALLBACK (sync_hot), tab_label);
+
   g_signal_connect (close_button, "clicked",
 		    G_CALLBACK (close_button_clicked_cb), tab_label);
 
@@ -226,6 +352,9 @@ terminal_tab_label_dispose (GObject *object)
     g_signal_handlers_disconnect_by_func (priv->screen,
                                           G_CALLBACK (sync_tab_label),
                                           priv->label);
+    g_signal_handlers_disconnect_by_func (priv->screen,
+                                          G_CALLBACK (sync_hot),
+                                          tab_label);
     g_object_unref (priv->screen);
     priv->screen = NULL;
   }
@@ -376,6 +505,28 @@ terminal_tab_label_set_bold (TerminalTabLabel *tab_label,
     pango_attr_list_unref (attr_list);
 }
 
+/**
+ * terminal_tab_label_set_hot:
+ * @tab_label: a #TerminalTabLabel
+ * @hot: whether to show the hot indicator
+ *
+ * Shows or hides the indicator for a terminal that keeps the server
+ * busy with its output.
+ */
+void
+terminal_tab_label_set_hot (TerminalTabLabel *tab_label,
+                            gboolean hot)
+{
+  TerminalTabLabelPrivate *priv = tab_label->priv;
+
+  hot = hot != FALSE;
+  if (priv->hot == hot)
+    return;
+
+  priv->hot = hot;
+  gtk_widget_set_visible (priv->hot_image, hot);
+}
+
 /**
  * terminal_tab_label_get_screen:
  * @tab_label: a #TerminalTabLabel
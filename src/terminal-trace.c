@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "terminal-trace.h"
+#include "terminal-libgsystem.h"
+
+/*
+ * Startup tracing
+ *
+ * When GNOME_TERMINAL_TRACE is set to a directory, each process writes
+ * its spans to <directory>/<process name>-<pid>.json in the Chrome trace
+ * event format, which can be loaded into chrome://tracing or Perfetto.
+ * All timestamps are from the monotonic clock, so the traces of the
+ * client and the server can be viewed together by concatenating the
+ * event arrays.
+ */
+
+gboolean _terminal_trace_enabled;
+
+static FILE *trace_file;
+static GMutex trace_mutex;
+static int trace_pid;
+
+void
+_terminal_trace_init (const char *process_name)
+{
+  const char *dir;
+  gs_free char *path = NULL;
+
+  dir = g_getenv ("GNOME_TERMINAL_TRACE");
+  if (dir == NULL || dir[0] == '\0')
+    return;
+
+  trace_pid = (int) getpid ();
+
+  path = g_strdup_printf ("%s/%s-%d.json", dir, process_name, trace_pid);
+  trace_file = g_fopen (path, "w");
+  if (trace_file == NULL) {
+    g_printerr ("Failed to open trace file \"%s\": %m\n", path);
+    return;
+  }
+
+  /* The closing bracket is optional in this format, so we never need
+   * to finish the file.
+   */
+  setvbuf (trace_file, NULL, _IOLBF, 0);
+  fputs ("[\n", trace_file);
+
+  _terminal_trace_enabled = TRUE;
+}
+
+static void
+trace_write_event (const char *name,
+                   const char *phase,
+                   gint64 ts,
+                   gint64 dur)
+{
+  g_mutex_lock (&trace_mutex);
+  if (dur >= 0)
+    fprintf (trace_file,
+             "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT
+             ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d},\n",
+             name, phase, ts, dur, trace_pid, trace_pid);
+  else
+    fprintf (trace_file,
+             "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT
+             ",\"s\":\"p\",\"pid\":%d,\"tid\":%d},\n",
+             name, phase, ts, trace_pid, trace_pid);
+  g_mutex_unlock (&trace_mutex);
+}
+
+/**
+ * _terminal_trace_span_real:
+ * @name: the name of the span
+ * @begin: the start time from _terminal_trace_begin()
+ *
+ * Writes a span from @begin until now.
+ */
+void
+_terminal_trace_span_real (const char *name,
+                           gint64 begin)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  /* Tracing wasn't enabled yet at the start */
+  if (begin == 0)
+    begin = now;
+
+  trace_write_event (name, "X", begin, now - begin);
+}
+
+/**
+ * _terminal_trace_mark_real:
+ * @name: the name of the mark
+ *
+ * Writes an instant event at the current time.
+ */
+void
+_terminal_trace_mark_real (const char *name)
+{
+  trace_write_event (name, "i", g_get_monotonic_time (), -1);
+}
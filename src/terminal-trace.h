@@ -0,0 +1,54 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The interfaces in this file are subject to change at any time. */
+
+#ifndef TERMINAL_TRACE_H
+#define TERMINAL_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _terminal_trace_init (const char *process_name);
+
+extern gboolean _terminal_trace_enabled;
+
+void _terminal_trace_span_real (const char *name,
+                                gint64 begin);
+
+void _terminal_trace_mark_real (const char *name);
+
+static inline gint64 _terminal_trace_begin (void) G_GNUC_UNUSED;
+
+/* Returns the start time for a span, to pass to _terminal_trace_end() */
+static inline gint64
+_terminal_trace_begin (void)
+{
+  return G_UNLIKELY (_terminal_trace_enabled) ? g_get_monotonic_time () : 0;
+}
+
+/* @name must be a string literal that needs no JSON escaping */
+#define _terminal_trace_end(name, begin) \
+  G_STMT_START { if (G_UNLIKELY (_terminal_trace_enabled)) _terminal_trace_span_real (name, begin); } G_STMT_END
+
+#define _terminal_trace_mark(name) \
+  G_STMT_START { if (G_UNLIKELY (_terminal_trace_enabled)) _terminal_trace_mark_real (name); } G_STMT_END
+
+G_END_DECLS
+
+#endif /* !TERMINAL_TRACE_H */
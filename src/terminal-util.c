@@ -668,20 +668,83 @@ setup_ignore_proxy_env (GSettings *proxy_settings,
   set_proxy_env (env_table, "no_proxy", g_string_free (buf, FALSE));
 }
 
-/**
- * terminal_util_add_proxy_env:
- * @env_table: a #GHashTable
- *
- * Adds the proxy env variables to @env_table.
+/* The proxy variables are only computed again after the proxy settings
+ * changed; in between, the cached values are replayed into each env table.
  */
-void
-terminal_util_add_proxy_env (GHashTable *env_table)
+
+typedef struct {
+  char *key;
+  char *value;
+} ProxyEnvEntry;
+
+static GArray *proxy_env_cache;
+static guint proxy_env_serial;
+static GSettings *proxy_child_settings[4];
+
+static void
+proxy_env_cache_clear (void)
 {
-  GSettings *proxy_settings;
-  GDesktopProxyMode mode;
+  guint i;
 
-  proxy_settings = terminal_app_get_proxy_settings (terminal_app_get ());
-  mode = g_settings_get_enum (proxy_settings, "mode");
+  if (proxy_env_cache == NULL)
+    return;
+
+  for (i = 0; i < proxy_env_cache->len; i++)
+    {
+      ProxyEnvEntry *entry = &g_array_index (proxy_env_cache, ProxyEnvEntry, i);
+
+      g_free (entry->key);
+      g_free (entry->value);
+    }
+
+  g_array_free (proxy_env_cache, TRUE);
+  proxy_env_cache = NULL;
+}
+
+static void
+proxy_settings_changed_cb (GSettings *settings,
+                           const char *key,
+                           gpointer user_data)
+{
+  proxy_env_cache_clear ();
+  proxy_env_serial++;
+}
+
+static void
+ensure_proxy_settings_monitored (GSettings *proxy_settings)
+{
+  static const char *const children[] = { "http", "https", "ftp", "socks" };
+  guint i;
+
+  if (proxy_child_settings[0] != NULL)
+    return;
+
+  g_signal_connect (proxy_settings, "changed",
+                    G_CALLBACK (proxy_settings_changed_cb), NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (children); i++)
+    {
+      proxy_child_settings[i] = g_settings_get_child (proxy_settings, children[i]);
+      g_signal_connect (proxy_child_settings[i], "changed",
+                        G_CALLBACK (proxy_settings_changed_cb), NULL);
+    }
+}
+
+static void
+proxy_env_cache_build (GSettings *proxy_settings)
+{
+  GHashTable *env_table;
+  GHashTableIter iter;
+  char *key, *value;
+
+  env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* Build as if the env table were empty, remembering the results under
+   * the names set_proxy_env() was called with.
+   */
+  proxy_env_cache = g_array_new (FALSE, FALSE, sizeof (ProxyEnvEntry));
+
+  GDesktopProxyMode mode = g_settings_get_enum (proxy_settings, "mode");
 
   if (mode == G_DESKTOP_PROXY_MODE_MANUAL)
     {
@@ -697,6 +760,64 @@ terminal_util_add_proxy_env (GHashTable *env_table)
     {
       setup_autoconfig_proxy_env (proxy_settings, env_table);
     }
+
+  g_hash_table_iter_init (&iter, env_table);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &key, (gpointer *) &value))
+    {
+      ProxyEnvEntry entry;
+
+      /* Only keep the lowercase names; set_proxy_env() adds the uppercase ones */
+      if (!g_str_equal (key, "http_proxy") &&
+          !g_str_equal (key, "https_proxy") &&
+          !g_str_equal (key, "ftp_proxy") &&
+          !g_str_equal (key, "all_proxy") &&
+          !g_str_equal (key, "no_proxy"))
+        continue;
+
+      entry.key = g_strdup (key);
+      entry.value = g_strdup (value);
+      g_array_append_val (proxy_env_cache, entry);
+    }
+
+  g_hash_table_destroy (env_table);
+}
+
+/**
+ * terminal_util_add_proxy_env:
+ * @env_table: a #GHashTable
+ *
+ * Adds the proxy env variables to @env_table.
+ */
+void
+terminal_util_add_proxy_env (GHashTable *env_table)
+{
+  GSettings *proxy_settings;
+  guint i;
+
+  proxy_settings = terminal_app_get_proxy_settings (terminal_app_get ());
+  ensure_proxy_settings_monitored (proxy_settings);
+
+  if (proxy_env_cache == NULL)
+    proxy_env_cache_build (proxy_settings);
+
+  for (i = 0; i < proxy_env_cache->len; i++)
+    {
+      ProxyEnvEntry *entry = &g_array_index (proxy_env_cache, ProxyEnvEntry, i);
+
+      set_proxy_env (env_table, entry->key, g_strdup (entry->value));
+    }
+}
+
+/**
+ * terminal_util_get_proxy_env_serial:
+ *
+ * Returns: a number that changes whenever the variables added by
+ *   terminal_util_add_proxy_env() may have changed
+ */
+guint
+terminal_util_get_proxy_env_serial (void)
+{
+  return proxy_env_serial;
 }
 
 /**
@@ -1201,6 +1322,49 @@ char *terminal_util_hyperlink_uri_label (const char *uri)
   return terminal_util_utf8_make_valid (unesc, -1);
 }
 
+/**
+ * terminal_util_normalize_casefold_and_unaccent:
+ * @str: (allow-none): a UTF-8 string
+ *
+ * Returns: (transfer full): @str normalized, casefolded and converted
+ *   to ASCII, or %NULL if @str is %NULL
+ */
+char *
+terminal_util_normalize_casefold_and_unaccent (const char *str)
+{
+  gs_free char *casefolded = NULL, *normalized = NULL;
+
+  if (str == NULL)
+    return NULL;
+
+  normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL_COMPOSE);
+  casefolded = g_utf8_casefold (normalized, -1);
+  return g_str_to_ascii (casefolded, NULL);
+}
+
+/**
+ * terminal_util_normalize_casefold_and_unaccent_terms:
+ * @terms: a %NULL-terminated string array
+ *
+ * Returns: (transfer full): a new string array containing each of @terms
+ *   passed through terminal_util_normalize_casefold_and_unaccent()
+ */
+char **
+terminal_util_normalize_casefold_and_unaccent_terms (const char * const *terms)
+{
+  char **casefolded_terms;
+  guint i, n;
+
+  n = g_strv_length ((char **) terms);
+  casefolded_terms = g_new (char *, n + 1);
+
+  for (i = 0; i < n; i++)
+    casefolded_terms[i] = terminal_util_normalize_casefold_and_unaccent (terms[i]);
+  casefolded_terms[n] = NULL;
+
+  return casefolded_terms;
+}
+
 /**
  * terminal_util_utf8_make_valid:
  *
@@ -67,6 +67,8 @@ gboolean terminal_util_dialog_response_on_delete (GtkWindow *widget);
 
 void terminal_util_add_proxy_env (GHashTable *env_table);
 
+guint terminal_util_get_proxy_env_serial (void);
+
 char **terminal_util_get_etc_shells (void);
 
 gboolean terminal_util_get_is_shell (const char *command);
@@ -99,6 +101,10 @@ char *terminal_util_uri_fixup (const char *uri,
 
 char *terminal_util_hyperlink_uri_label (const char *str);
 
+char *terminal_util_normalize_casefold_and_unaccent (const char *str) G_GNUC_MALLOC;
+
+char **terminal_util_normalize_casefold_and_unaccent_terms (const char * const *terms);
+
 gchar *terminal_util_utf8_make_valid (const gchar *str,
                                       gssize       len) G_GNUC_MALLOC;
 
@@ -0,0 +1,255 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "terminal-watchdog.h"
+#include "terminal-debug.h"
+
+/*
+ * Main loop watchdog
+ *
+ * With GNOME_TERMINAL_DEBUG=stalls, the main loop bumps a heartbeat
+ * regularly, and a watchdog thread reports when it has not done so for
+ * longer than GNOME_TERMINAL_STALL_THRESHOLD milliseconds (default 200).
+ * The report names the section the main thread was in, as marked by
+ * _terminal_watchdog_enter(), or the name of the source being dispatched
+ * if it was added with one of the _terminal_watchdog_*_add functions.
+ * When the main loop gets going again, the total duration is reported too.
+ */
+
+#define DEFAULT_STALL_THRESHOLD (200 /* ms */)
+
+gboolean _terminal_watchdog_enabled;
+const char * volatile _terminal_watchdog_section;
+
+static GMutex watchdog_mutex;
+static gint64 watchdog_heartbeat; /* protected by watchdog_mutex */
+static const char *watchdog_stalled_section; /* protected by watchdog_mutex */
+static gboolean watchdog_stalled; /* protected by watchdog_mutex */
+static gint64 watchdog_threshold; /* µs */
+
+static const char *
+section_name (const char *section)
+{
+  return section ? section : "(not instrumented)";
+}
+
+static gboolean
+heartbeat_cb (gpointer user_data)
+{
+  gint64 now = g_get_monotonic_time ();
+  const char *section = NULL;
+  gint64 stall = 0;
+
+  g_mutex_lock (&watchdog_mutex);
+  if (watchdog_stalled) {
+    stall = now - watchdog_heartbeat;
+    section = watchdog_stalled_section;
+    watchdog_stalled = FALSE;
+  }
+  watchdog_heartbeat = now;
+  g_mutex_unlock (&watchdog_mutex);
+
+  if (stall > 0)
+    _terminal_debug_print (TERMINAL_DEBUG_STALLS,
+                           "Main loop was stalled for %" G_GINT64_FORMAT " ms in %s\n",
+                           stall / 1000, section_name (section));
+
+  return TRUE; /* run again */
+}
+
+static gpointer
+watchdog_thread_func (gpointer data)
+{
+  for (;;) {
+    gint64 now, stall = 0;
+    const char *section = NULL;
+
+    g_usleep (watchdog_threshold / 4);
+
+    now = g_get_monotonic_time ();
+    g_mutex_lock (&watchdog_mutex);
+    if (!watchdog_stalled && now - watchdog_heartbeat > watchdog_threshold) {
+      section = watchdog_stalled_section = _terminal_watchdog_section;
+      watchdog_stalled = TRUE;
+      stall = now - watchdog_heartbeat;
+    }
+    g_mutex_unlock (&watchdog_mutex);
+
+    if (stall > 0)
+      _terminal_debug_print (TERMINAL_DEBUG_STALLS,
+                             "Main loop stalled for more than %" G_GINT64_FORMAT " ms in %s\n",
+                             stall / 1000, section_name (section));
+  }
+
+  return NULL;
+}
+
+/**
+ * _terminal_watchdog_init:
+ *
+ * Starts the watchdog if the "stalls" debug flag is set. Must be called
+ * on the main thread, after _terminal_debug_init().
+ */
+void
+_terminal_watchdog_init (void)
+{
+  const char *threshold;
+  GSource *source;
+
+  if (!_terminal_debug_on (TERMINAL_DEBUG_STALLS))
+    return;
+
+  threshold = g_getenv ("GNOME_TERMINAL_STALL_THRESHOLD");
+  watchdog_threshold = (threshold ? atoi (threshold) : 0) * 1000;
+  if (watchdog_threshold <= 0)
+    watchdog_threshold = DEFAULT_STALL_THRESHOLD * 1000;
+
+  watchdog_heartbeat = g_get_monotonic_time ();
+
+  /* Beat ahead of everything else, so only a running handler delays it */
+  source = g_timeout_source_new (watchdog_threshold / 2000);
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, heartbeat_cb, NULL, NULL);
+  g_source_set_name (source, "watchdog heartbeat");
+  g_source_attach (source, NULL);
+  g_source_unref (source);
+
+  g_thread_unref (g_thread_new ("watchdog", watchdog_thread_func, NULL));
+
+  _terminal_watchdog_enabled = TRUE;
+}
+
+typedef struct {
+  const char *name;
+  GSourceFunc func;
+  gpointer data;
+  GDestroyNotify notify;
+} WatchedSource;
+
+static gboolean
+watched_source_cb (gpointer user_data)
+{
+  WatchedSource *ws = user_data;
+  const char *previous;
+  gboolean rv;
+
+  previous = _terminal_watchdog_enter (ws->name);
+  rv = ws->func (ws->data);
+  _terminal_watchdog_leave (previous);
+
+  return rv;
+}
+
+static void
+watched_source_free (WatchedSource *ws)
+{
+  if (ws->notify)
+    ws->notify (ws->data);
+  g_slice_free (WatchedSource, ws);
+}
+
+static guint
+watched_source_attach (GSource *source,
+                       const char *name,
+                       GSourceFunc func,
+                       gpointer data,
+                       GDestroyNotify notify)
+{
+  guint id;
+
+  if (_terminal_watchdog_enabled) {
+    WatchedSource *ws = g_slice_new (WatchedSource);
+
+    ws->name = name;
+    ws->func = func;
+    ws->data = data;
+    ws->notify = notify;
+    g_source_set_callback (source, watched_source_cb, ws, (GDestroyNotify) watched_source_free);
+  } else {
+    g_source_set_callback (source, func, data, notify);
+  }
+
+  g_source_set_name (source, name);
+  id = g_source_attach (source, NULL);
+  g_source_unref (source);
+
+  return id;
+}
+
+/**
+ * _terminal_watchdog_idle_add_full:
+ * @priority: the priority
+ * @name: the name of the source, a string literal
+ * @func: the callback
+ * @data: data for @func
+ * @notify: (allow-none): a #GDestroyNotify for @data
+ *
+ * Like g_idle_add_full(), but names the source, so the watchdog can
+ * tell when it is the one stalling the main loop.
+ *
+ * Returns: the ID of the source
+ */
+guint
+_terminal_watchdog_idle_add_full (int priority,
+                                  const char *name,
+                                  GSourceFunc func,
+                                  gpointer data,
+                                  GDestroyNotify notify)
+{
+  GSource *source = g_idle_source_new ();
+
+  g_source_set_priority (source, priority);
+  return watched_source_attach (source, name, func, data, notify);
+}
+
+/**
+ * _terminal_watchdog_timeout_add_full:
+ * @priority: the priority
+ * @interval: the interval, in milliseconds, or in seconds if @seconds is %TRUE
+ * @seconds: whether @interval is in seconds
+ * @name: the name of the source, a string literal
+ * @func: the callback
+ * @data: data for @func
+ * @notify: (allow-none): a #GDestroyNotify for @data
+ *
+ * Like g_timeout_add_full() or g_timeout_add_seconds_full(), but names
+ * the source, so the watchdog can tell when it is the one stalling the
+ * main loop.
+ *
+ * Returns: the ID of the source
+ */
+guint
+_terminal_watchdog_timeout_add_full (int priority,
+                                     guint interval,
+                                     gboolean seconds,
+                                     const char *name,
+                                     GSourceFunc func,
+                                     gpointer data,
+                                     GDestroyNotify notify)
+{
+  GSource *source = seconds ? g_timeout_source_new_seconds (interval)
+                            : g_timeout_source_new (interval);
+
+  g_source_set_priority (source, priority);
+  return watched_source_attach (source, name, func, data, notify);
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2018 The GNOME Terminal authors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The interfaces in this file are subject to change at any time. */
+
+#ifndef TERMINAL_WATCHDOG_H
+#define TERMINAL_WATCHDOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void _terminal_watchdog_init (void);
+
+extern gboolean _terminal_watchdog_enabled;
+
+extern const char * volatile _terminal_watchdog_section;
+
+static inline const char *_terminal_watchdog_enter (const char *name) G_GNUC_UNUSED;
+
+/* Marks the main thread as running @name, a string literal, until
+ * _terminal_watchdog_leave() is called with the returned value.
+ */
+static inline const char *
+_terminal_watchdog_enter (const char *name)
+{
+  const char *previous = _terminal_watchdog_section;
+
+  if (G_UNLIKELY (_terminal_watchdog_enabled))
+    _terminal_watchdog_section = name;
+
+  return previous;
+}
+
+#define _terminal_watchdog_leave(previous) \
+  G_STMT_START { if (G_UNLIKELY (_terminal_watchdog_enabled)) _terminal_watchdog_section = (previous); } G_STMT_END
+
+guint _terminal_watchdog_idle_add_full (int priority,
+                                        const char *name,
+                                        GSourceFunc func,
+                                        gpointer data,
+                                        GDestroyNotify notify);
+
+guint _terminal_watchdog_timeout_add_full (int priority,
+                                           guint interval,
+                                           gboolean seconds,
+                                           const char *name,
+                                           GSourceFunc func,
+                                           gpointer data,
+                                           GDestroyNotify notify);
+
+#define _terminal_watchdog_idle_add(name, func, data) \
+  _terminal_watchdog_idle_add_full (G_PRIORITY_DEFAULT_IDLE, name, func, data, NULL)
+
+#define _terminal_watchdog_timeout_add(interval, name, func, data) \
+  _terminal_watchdog_timeout_add_full (G_PRIORITY_DEFAULT, interval, FALSE, name, func, data, NULL)
+
+#define _terminal_watchdog_timeout_add_seconds(interval, name, func, data) \
+  _terminal_watchdog_timeout_add_full (G_PRIORITY_DEFAULT, interval, TRUE, name, func, data, NULL)
+
+G_END_DECLS
+
+#endif /* !TERMINAL_WATCHDOG_H */
@@ -33,16 +33,20 @@
 #include "terminal-enums.h"
 #include "terminal-encoding.h"
 #include "terminal-icon-button.h"
+#include "terminal-info-bar.h"
 #include "terminal-intl.h"
 #include "terminal-mdi-container.h"
 #include "terminal-menu-button.h"
 #include "terminal-notebook.h"
+#include "terminal-print.h"
 #include "terminal-schemas.h"
 #include "terminal-screen-container.h"
 #include "terminal-search-popover.h"
 #include "terminal-tab-label.h"
 #include "terminal-util.h"
 #include "terminal-window.h"
+#include "terminal-trace.h"
+#include "terminal-watchdog.h"
 #include "terminal-libgsystem.h"
 
 struct _TerminalWindowPrivate
@@ -81,9 +85,33 @@ struct _TerminalWindowPrivate
 
   void *old_geometry_widget; /* only used for pointer value as it may be freed */
 
+  /* Size and geometry updates are coalesced to one per frame */
+  guint update_tick_id;
+  guint update_size_pending : 1;
+  guint update_geometry_pending : 1;
+
+  /* Zoom steps are applied to the active screen once per frame */
+  guint zoom_tick_id;
+  double pending_zoom;
+
+  /* Screens are being moved in or out, see terminal_window_move_screens() */
+  guint moving_screens : 1;
+
   GtkWidget *confirm_close_dialog;
   TerminalSearchPopover *search_popover;
 
+  /* Matches of the search regex in search_screen, found in the background */
+  GCancellable *search_cancellable;
+  TerminalScreen *search_screen;
+  GArray *search_matches;
+  int search_match; /* the current one, or -1 */
+  GCancellable *search_all_cancellable;
+  guint search_all_n_matches;
+
+  /* The tabs menu, created when first popped up; item i is for page i */
+  GMenu *tabs_menu;
+  GPtrArray *tabs_menu_screens; /* unowned TerminalScreen* */
+
   guint use_default_menubar_visibility : 1;
 
   guint disposed : 1;
@@ -427,14 +455,288 @@ action_new_profile_cb (GSimpleAction *action,
 
 #ifdef ENABLE_SAVE
 
+/* Saving is done in chunks of this many rows, writing each one asynchronously
+ * before fetching the next one, so the UI stays responsive even with a
+ * huge scrollback.
+ */
+#define SAVE_CONTENTS_CHUNK_ROWS (1024)
+
+enum {
+  RESPONSE_SAVE_CONTENTS_CANCEL = 1
+};
+
+typedef struct {
+  TerminalScreen *screen;
+  GtkWidget *info_bar;
+  GtkWidget *progress_bar;
+  GCancellable *cancellable;
+  GOutputStream *stream;
+  gboolean compress;
+  long start_row;
+  long end_row;
+  long row;
+  char *chunk;
+  gsize chunk_len;
+  gsize chunk_written;
+} SaveContentsData;
+
+static void save_contents_write_chunk (SaveContentsData *data);
+
+static gboolean
+save_contents_write_chunk_idle_cb (SaveContentsData *data)
+{
+  save_contents_write_chunk (data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+save_contents_data_free (SaveContentsData *data)
+{
+  g_signal_handlers_disconnect_matched (data->screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, data);
+  if (data->info_bar)
+    gtk_widget_destroy (data->info_bar);
+  g_object_unref (data->screen);
+  g_object_unref (data->cancellable);
+  g_clear_object (&data->stream);
+  g_free (data->chunk);
+  g_slice_free (SaveContentsData, data);
+}
+
+static void
+save_contents_finish (SaveContentsData *data,
+                      GError *error)
+{
+  if (error != NULL &&
+      !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      GtkWindow *parent;
+
+      parent = (GtkWindow*) gtk_widget_get_ancestor (GTK_WIDGET (data->screen), GTK_TYPE_WINDOW);
+      terminal_util_show_error_dialog (parent, NULL, error,
+				       "%s", _("Could not save contents"));
+    }
+
+  /* Closing with a cancelled cancellable discards the partially written file */
+  if (error != NULL && data->stream != NULL)
+    {
+      g_cancellable_cancel (data->cancellable);
+      g_output_stream_close (data->stream, data->cancellable, NULL);
+    }
+
+  save_contents_data_free (data);
+}
+
+static void
+save_contents_close_cb (GOutputStream *stream,
+                        GAsyncResult *result,
+                        SaveContentsData *data)
+{
+  gs_free_error GError *error = NULL;
+
+  if (!g_output_stream_close_finish (stream, result, &error))
+    {
+      g_clear_object (&data->stream);
+      save_contents_finish (data, error);
+      return;
+    }
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER, "Saved %ld rows\n",
+                         data->end_row - data->start_row);
+  save_contents_finish (data, NULL);
+}
+
+static void
+save_contents_write_cb (GOutputStream *stream,
+                        GAsyncResult *result,
+                        SaveContentsData *data)
+{
+  gs_free_error GError *error = NULL;
+  gssize written;
+
+  written = g_output_stream_write_finish (stream, result, &error);
+  if (written < 0)
+    {
+      save_contents_finish (data, error);
+      return;
+    }
+
+  data->chunk_written += written;
+  if (data->chunk_written < data->chunk_len)
+    {
+      g_output_stream_write_async (data->stream,
+                                   data->chunk + data->chunk_written,
+                                   data->chunk_len - data->chunk_written,
+                                   G_PRIORITY_DEFAULT_IDLE,
+                                   data->cancellable,
+                                   (GAsyncReadyCallback) save_contents_write_cb,
+                                   data);
+      return;
+    }
+
+  save_contents_write_chunk (data);
+}
+
+static void
+save_contents_write_chunk (SaveContentsData *data)
+{
+  VteTerminal *terminal = VTE_TERMINAL (data->screen);
+  GtkAdjustment *adjustment;
+  long last_row;
+
+  if (g_cancellable_is_cancelled (data->cancellable))
+    {
+      gs_free_error GError *error = NULL;
+
+      g_cancellable_set_error_if_cancelled (data->cancellable, &error);
+      save_contents_finish (data, error);
+      return;
+    }
+
+  if (data->row >= data->end_row)
+    {
+      g_output_stream_close_async (data->stream,
+                                   G_PRIORITY_DEFAULT_IDLE,
+                                   data->cancellable,
+                                   (GAsyncReadyCallback) save_contents_close_cb,
+                                   data);
+      return;
+    }
+
+  /* Rows may have scrolled out of the scrollback in the meantime */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (terminal));
+  data->row = MAX (data->row, (long) gtk_adjustment_get_lower (adjustment));
+
+  last_row = MIN (data->row + SAVE_CONTENTS_CHUNK_ROWS, data->end_row) - 1;
+
+  g_free (data->chunk);
+  data->chunk = vte_terminal_get_text_range (terminal,
+                                             data->row, 0,
+                                             last_row, vte_terminal_get_column_count (terminal) - 1,
+                                             NULL, NULL, NULL);
+  data->chunk_len = data->chunk ? strlen (data->chunk) : 0;
+  data->chunk_written = 0;
+  data->row = last_row + 1;
+
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (data->progress_bar),
+                                 (double) (data->row - data->start_row) /
+                                 MAX (data->end_row - data->start_row, 1));
+
+  if (data->chunk_len == 0)
+    {
+      /* Don't recurse; continue from the main loop */
+      _terminal_watchdog_idle_add ("save contents",
+                                   (GSourceFunc) save_contents_write_chunk_idle_cb,
+                                   data);
+      return;
+    }
+
+  g_output_stream_write_async (data->stream,
+                               data->chunk, data->chunk_len,
+                               G_PRIORITY_DEFAULT_IDLE,
+                               data->cancellable,
+                               (GAsyncReadyCallback) save_contents_write_cb,
+                               data);
+}
+
+static void
+save_contents_replace_cb (GFile *file,
+                          GAsyncResult *result,
+                          SaveContentsData *data)
+{
+  gs_free_error GError *error = NULL;
+  GFileOutputStream *file_stream;
+
+  file_stream = g_file_replace_finish (file, result, &error);
+  if (file_stream == NULL)
+    {
+      save_contents_finish (data, error);
+      return;
+    }
+
+  if (data->compress)
+    {
+      gs_unref_object GConverter *compressor;
+
+      compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+      data->stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream), compressor);
+      g_object_unref (file_stream);
+    }
+  else
+    data->stream = G_OUTPUT_STREAM (file_stream);
+
+  save_contents_write_chunk (data);
+}
+
+static void
+save_contents_info_bar_response_cb (GtkWidget *info_bar,
+                                    int response,
+                                    SaveContentsData *data)
+{
+  g_cancellable_cancel (data->cancellable);
+}
+
+static void
+save_contents_screen_destroy_cb (GtkWidget *widget,
+                                 SaveContentsData *data)
+{
+  /* The info bar goes away together with the screen */
+  data->info_bar = NULL;
+  g_cancellable_cancel (data->cancellable);
+}
+
+static void
+save_contents_start (TerminalScreen *screen,
+                     const char *uri)
+{
+  SaveContentsData *data;
+  gs_unref_object GFile *file;
+  GtkAdjustment *adjustment;
+  GtkWidget *content_area;
+
+  data = g_slice_new0 (SaveContentsData);
+  data->screen = g_object_ref (screen);
+  data->cancellable = g_cancellable_new ();
+  data->compress = g_str_has_suffix (uri, ".gz");
+
+  /* Save the contents as they are now; later output isn't included */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  data->start_row = data->row = (long) gtk_adjustment_get_lower (adjustment);
+  data->end_row = (long) gtk_adjustment_get_upper (adjustment);
+
+  data->info_bar = terminal_info_bar_new (GTK_MESSAGE_INFO,
+                                          _("_Cancel"), RESPONSE_SAVE_CONTENTS_CANCEL,
+                                          NULL);
+  terminal_info_bar_format_text (TERMINAL_INFO_BAR (data->info_bar),
+                                 "%s", _("Saving contents…"));
+  data->progress_bar = gtk_progress_bar_new ();
+  content_area = gtk_info_bar_get_content_area (GTK_INFO_BAR (data->info_bar));
+  gtk_box_pack_start (GTK_BOX (content_area), data->progress_bar, FALSE, FALSE, 0);
+  gtk_widget_set_valign (data->progress_bar, GTK_ALIGN_CENTER);
+  g_signal_connect (data->info_bar, "response",
+                    G_CALLBACK (save_contents_info_bar_response_cb), data);
+
+  gtk_widget_set_halign (data->info_bar, GTK_ALIGN_FILL);
+  gtk_widget_set_valign (data->info_bar, GTK_ALIGN_START);
+  gtk_overlay_add_overlay (GTK_OVERLAY (terminal_screen_container_get_from_screen (screen)),
+                           data->info_bar);
+  gtk_widget_show_all (data->info_bar);
+
+  g_signal_connect (screen, "destroy",
+                    G_CALLBACK (save_contents_screen_destroy_cb), data);
+
+  file = g_file_new_for_uri (uri);
+  g_file_replace_async (file, NULL, FALSE, G_FILE_CREATE_NONE,
+                        G_PRIORITY_DEFAULT,
+                        data->cancellable,
+                        (GAsyncReadyCallback) save_contents_replace_cb,
+                        data);
+}
+
 static void
 save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer terminal)
 {
-  GtkWindow *parent;
   gs_free gchar *filename_uri = NULL;
-  gs_unref_object GFile *file = NULL;
-  GOutputStream *stream;
-  gs_free_error GError *error = NULL;
 
   if (response_id != GTK_RESPONSE_ACCEPT)
     {
@@ -442,7 +744,6 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
       return;
     }
 
-  parent = (GtkWindow*) gtk_widget_get_ancestor (GTK_WIDGET (terminal), GTK_TYPE_WINDOW);
   filename_uri = gtk_file_chooser_get_uri (GTK_FILE_CHOOSER (dialog));
 
   gtk_widget_destroy (GTK_WIDGET (dialog));
@@ -450,27 +751,7 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
   if (filename_uri == NULL)
     return;
 
-  file = g_file_new_for_uri (filename_uri);
-  stream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
-
-  if (stream)
-    {
-      /* XXX
-       * FIXME
-       * This is a sync operation.
-       * Should be replaced with the async version when vte implements that.
-       */
-      vte_terminal_write_contents_sync (terminal, stream,
-					VTE_WRITE_DEFAULT,
-					NULL, &error);
-      g_object_unref (stream);
-    }
-
-  if (error)
-    {
-      terminal_util_show_error_dialog (parent, NULL, error,
-				       "%s", _("Could not save contents"));
-    }
+  save_contents_start (TERMINAL_SCREEN (terminal), filename_uri);
 }
 
 static void
@@ -489,6 +770,9 @@ action_save_contents_cb (GSimpleAction *action,
   terminal = VTE_TERMINAL (priv->active_screen);
   g_return_if_fail (VTE_IS_TERMINAL (terminal));
 
+  /* The dialog and the file need FDs even when the terminals took them all */
+  terminal_app_release_fd_reserve (terminal_app_get ());
+
   dialog = gtk_file_chooser_dialog_new (_("Save as…"),
                                         GTK_WINDOW(window),
                                         GTK_FILE_CHOOSER_ACTION_SAVE,
@@ -512,36 +796,6 @@ action_save_contents_cb (GSimpleAction *action,
 
 #endif /* ENABLE_SAVE */
 
-#ifdef ENABLE_PRINT
-
-static void
-print_begin_cb (GtkPrintOperation *op,
-                GtkPrintContext *context,
-                TerminalApp *app)
-{
-  GtkPrintSettings *settings;
-  GtkPageSetup *page_setup;
-
-  /* Don't save if the print dialogue was cancelled */
-  if (gtk_print_operation_get_status(op) == GTK_PRINT_STATUS_FINISHED_ABORTED)
-    return;
-
-  settings = gtk_print_operation_get_print_settings (op);
-  page_setup = gtk_print_operation_get_default_page_setup (op);
-  terminal_util_save_print_settings (settings, page_setup);
-}
-
-static void
-print_done_cb (GtkPrintOperation *op,
-               GtkPrintOperationResult result,
-               TerminalWindow *window)
-{
-  if (result != GTK_PRINT_OPERATION_RESULT_ERROR)
-    return;
-
-  /* FIXME: show error */
-}
-
 static void
 action_print_cb (GSimpleAction *action,
                  GVariant *parameter,
@@ -549,42 +803,13 @@ action_print_cb (GSimpleAction *action,
 {
   TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
-  gs_unref_object GtkPrintSettings *settings = NULL;
-  gs_unref_object GtkPageSetup *page_setup = NULL;
-  gs_unref_object GtkPrintOperation *op = NULL;
-  gs_free_error GError *error = NULL;
-  GtkPrintOperationResult result;
 
   if (priv->active_screen == NULL)
     return;
 
-  op = vte_print_operation_new (VTE_TERMINAL (priv->active_screen),
-                                VTE_PRINT_OPERATION_DEFAULT /* flags */);
-  if (op == NULL)
-    return;
-
-  terminal_util_load_print_settings (&settings, &page_setup);
-  if (settings != NULL)
-    gtk_print_operation_set_print_settings (op, settings);
-  if (page_setup != NULL)
-    gtk_print_operation_set_default_page_setup (op, page_setup);
-
-  g_signal_connect (op, "begin-print", G_CALLBACK (print_begin_cb), window);
-  g_signal_connect (op, "done", G_CALLBACK (print_done_cb), window);
-
-  /* FIXME: show progress better */
-
-  result = gtk_print_operation_run (op,
-                                    /* this is the only supported one: */
-                                    GTK_PRINT_OPERATION_ACTION_PRINT_DIALOG,
-                                    GTK_WINDOW (window),
-                                    &error);
-  /* VtePrintOperation always runs async */
-  g_assert_cmpint (result, ==, GTK_PRINT_OPERATION_RESULT_IN_PROGRESS);
+  terminal_print_screen (priv->active_screen, GTK_WINDOW (window));
 }
 
-#endif /* ENABLE_PRINT */
-
 #ifdef ENABLE_EXPORT
 
 static void
@@ -672,10 +897,56 @@ action_copy_cb (GSimpleAction *action,
 
 /* Clipboard helpers */
 
+/* Converting this many URIs may block on the fuse daemon for a while */
+#define PASTE_URIS_THREAD_THRESHOLD (32)
+
 typedef struct {
   GWeakRef screen_weak_ref;
 } PasteData;
 
+static void
+paste_data_free (PasteData *data)
+{
+  g_weak_ref_clear (&data->screen_weak_ref);
+  g_slice_free (PasteData, data);
+}
+
+static void
+paste_uris_thread_func (GTask *task,
+                        gpointer source_object,
+                        char **uris,
+                        GCancellable *cancellable)
+{
+  char *text;
+  gsize len;
+
+  terminal_util_transform_uris_to_quoted_fuse_paths (uris);
+  text = terminal_util_concat_uris (uris, &len);
+
+  g_task_return_pointer (task, g_string_new_len (text, len), NULL);
+  g_free (text);
+}
+
+static void
+paste_uris_done_cb (GObject *source_object,
+                    GAsyncResult *result,
+                    PasteData *data)
+{
+  gs_unref_object TerminalScreen *screen = NULL;
+  GString *text;
+
+  text = g_task_propagate_pointer (G_TASK (result), NULL);
+
+  if ((screen = g_weak_ref_get (&data->screen_weak_ref))) {
+    gsize len = text->len;
+    terminal_screen_paste_text (screen, g_string_free (text, FALSE), len, FALSE);
+  } else {
+    g_string_free (text, TRUE);
+  }
+
+  paste_data_free (data);
+}
+
 static void
 clipboard_uris_received_cb (GtkClipboard *clipboard,
                             /* const */ char **uris,
@@ -685,18 +956,27 @@ clipboard_uris_received_cb (GtkClipboard *clipboard,
 
   if (uris != NULL && uris[0] != NULL &&
       (screen = g_weak_ref_get (&data->screen_weak_ref))) {
-    gs_free char *text;
+    char *text;
     gsize len;
 
+    if (g_strv_length (uris) > PASTE_URIS_THREAD_THRESHOLD) {
+      GTask *task;
+
+      task = g_task_new (NULL, NULL, (GAsyncReadyCallback) paste_uris_done_cb, data);
+      g_task_set_task_data (task, g_strdupv (uris), (GDestroyNotify) g_strfreev);
+      g_task_run_in_thread (task, (GTaskThreadFunc) paste_uris_thread_func);
+      g_object_unref (task);
+      return;
+    }
+
     /* This potentially modifies the strings in |uris| but that's ok */
     terminal_util_transform_uris_to_quoted_fuse_paths (uris);
     text = terminal_util_concat_uris (uris, &len);
 
-    vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+    terminal_screen_paste_text (screen, text, len, FALSE);
   }
 
-  g_weak_ref_clear (&data->screen_weak_ref);
-  g_slice_free (PasteData, data);
+  paste_data_free (data);
 }
 
 static void
@@ -704,19 +984,14 @@ request_clipboard_contents_for_paste (TerminalWindow *window,
                                       gboolean paste_as_uris)
 {
   TerminalWindowPrivate *priv = window->priv;
-  GdkAtom *targets;
-  int n_targets;
+  guint flags;
 
   if (priv->active_screen == NULL)
     return;
 
-  targets = terminal_app_get_clipboard_targets (terminal_app_get (),
-                                                priv->clipboard,
-                                                &n_targets);
-  if (targets == NULL)
-    return;
+  flags = terminal_app_get_clipboard_flags (terminal_app_get (), priv->clipboard);
 
-  if (paste_as_uris && gtk_targets_include_uri (targets, n_targets)) {
+  if (paste_as_uris && (flags & TERMINAL_CLIPBOARD_CAN_PASTE_URIS)) {
     PasteData *data = g_slice_new (PasteData);
     g_weak_ref_init (&data->screen_weak_ref, priv->active_screen);
 
@@ -724,8 +999,8 @@ request_clipboard_contents_for_paste (TerminalWindow *window,
                                 (GtkClipboardURIReceivedFunc) clipboard_uris_received_cb,
                                 data);
     return;
-  } else if (gtk_targets_include_text (targets, n_targets)) {
-    vte_terminal_paste_clipboard (VTE_TERMINAL (priv->active_screen));
+  } else if (flags & TERMINAL_CLIPBOARD_CAN_PASTE_TEXT) {
+    terminal_screen_paste_clipboard (priv->active_screen);
   }
 }
 
@@ -865,6 +1140,72 @@ action_tab_move_right_cb (GSimpleAction *action,
                                          change);
 }
 
+/* Returns the zoom of the active screen, including a step not yet applied */
+static double
+terminal_window_get_zoom (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (priv->zoom_tick_id != 0)
+    return priv->pending_zoom;
+
+  return vte_terminal_get_font_scale (VTE_TERMINAL (priv->active_screen));
+}
+
+static void
+terminal_window_flush_zoom (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (priv->zoom_tick_id == 0)
+    return;
+
+  gtk_widget_remove_tick_callback (GTK_WIDGET (window), priv->zoom_tick_id);
+  priv->zoom_tick_id = 0;
+
+  if (priv->active_screen != NULL)
+    vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), priv->pending_zoom);
+}
+
+static gboolean
+zoom_tick_cb (GtkWidget *widget,
+              GdkFrameClock *frame_clock,
+              gpointer user_data)
+{
+  TerminalWindow *window = TERMINAL_WINDOW (widget);
+  TerminalWindowPrivate *priv = window->priv;
+
+  priv->zoom_tick_id = 0;
+
+  if (priv->active_screen != NULL)
+    vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), priv->pending_zoom);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Changing the font scale makes VTE reload the font and the window relayout,
+ * so when zooming repeatedly (e.g. with the accelerator held down) only the
+ * last step of each frame is applied.
+ */
+static void
+terminal_window_set_zoom (TerminalWindow *window,
+                          double zoom)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (!gtk_widget_get_mapped (GTK_WIDGET (window))) {
+    vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), zoom);
+  } else {
+    priv->pending_zoom = zoom;
+    if (priv->zoom_tick_id == 0)
+      priv->zoom_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (window),
+                                                         zoom_tick_cb,
+                                                         NULL, NULL);
+  }
+
+  terminal_window_update_zoom_sensitivity (window);
+}
+
 static void
 action_zoom_in_cb (GSimpleAction *action,
                    GVariant *parameter,
@@ -877,12 +1218,11 @@ action_zoom_in_cb (GSimpleAction *action,
   if (priv->active_screen == NULL)
     return;
 
-  zoom = vte_terminal_get_font_scale (VTE_TERMINAL (priv->active_screen));
+  zoom = terminal_window_get_zoom (window);
   if (!find_larger_zoom_factor (&zoom))
     return;
 
-  vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), zoom);
-  terminal_window_update_zoom_sensitivity (window);
+  terminal_window_set_zoom (window, zoom);
 }
 
 static void
@@ -897,12 +1237,11 @@ action_zoom_out_cb (GSimpleAction *action,
   if (priv->active_screen == NULL)
     return;
 
-  zoom = vte_terminal_get_font_scale (VTE_TERMINAL (priv->active_screen));
+  zoom = terminal_window_get_zoom (window);
   if (!find_smaller_zoom_factor (&zoom))
     return;
 
-  vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), zoom);
-  terminal_window_update_zoom_sensitivity (window);
+  terminal_window_set_zoom (window, zoom);
 }
 
 static void
@@ -916,39 +1255,70 @@ action_zoom_normal_cb (GSimpleAction *action,
   if (priv->active_screen == NULL)
     return;
 
-  vte_terminal_set_font_scale (VTE_TERMINAL (priv->active_screen), PANGO_SCALE_MEDIUM);
-  terminal_window_update_zoom_sensitivity (window);
+  terminal_window_set_zoom (window, PANGO_SCALE_MEDIUM);
 }
 
+/* Moves @screens to a new window, sized for the active screen */
 static void
-action_tab_detach_cb (GSimpleAction *action,
-                      GVariant *parameter,
-                      gpointer user_data)
+terminal_window_detach_screens (TerminalWindow *window,
+                                GList *screens)
 {
-  TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
   TerminalApp *app;
   TerminalWindow *new_window;
-  TerminalScreen *screen;
   char geometry[32];
   int width, height;
 
   app = terminal_app_get ();
 
-  screen = priv->active_screen;
-
-  terminal_screen_get_size (screen, &width, &height);
+  terminal_screen_get_size (priv->active_screen, &width, &height);
   g_snprintf (geometry, sizeof (geometry), "%dx%d", width, height);
 
   new_window = terminal_app_new_window (app, 0);
 
-  terminal_window_move_screen (window, new_window, screen, -1);
+  terminal_window_move_screens (window, new_window, screens, -1);
 
   terminal_window_parse_geometry (new_window, geometry);
 
   gtk_window_present_with_time (GTK_WINDOW (new_window), gtk_get_current_event_time ());
 }
 
+static void
+action_tab_detach_cb (GSimpleAction *action,
+                      GVariant *parameter,
+                      gpointer user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  GList screens = { priv->active_screen, NULL, NULL };
+
+  terminal_window_detach_screens (window, &screens);
+}
+
+static void
+action_tab_detach_right_cb (GSimpleAction *action,
+                            GVariant *parameter,
+                            gpointer user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  gs_free_list GList *screens = NULL;
+  GList *containers, *l;
+
+  /* The active screen and all after it, in one move */
+  containers = terminal_window_list_screen_containers (window);
+  for (l = containers; l != NULL; l = l->next) {
+    TerminalScreen *screen = terminal_screen_container_get_screen (l->data);
+
+    if (screen == priv->active_screen || screens != NULL)
+      screens = g_list_prepend (screens, screen);
+  }
+  g_list_free (containers);
+
+  screens = g_list_reverse (screens);
+  terminal_window_detach_screens (window, screens);
+}
+
 static void
 action_help_cb (GSimpleAction *action,
                 GVariant *parameter,
@@ -981,139 +1351,403 @@ action_edit_profile_cb (GSimpleAction *action,
   TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
 
-  terminal_app_edit_profile (terminal_app_get (),
-                             terminal_screen_get_profile (priv->active_screen),
-                             NULL);
+  terminal_app_edit_profile (terminal_app_get (),
+                             terminal_screen_get_profile (priv->active_screen),
+                             NULL);
+}
+
+static void
+action_size_to_cb (GSimpleAction *action,
+                   GVariant      *parameter,
+                   gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  guint width, height;
+
+  g_assert_nonnull (parameter);
+
+  if (priv->active_screen == NULL)
+    return;
+
+  g_variant_get (parameter, "(uu)", &width, &height);
+  if (width < MIN_WIDTH_CHARS || height < MIN_HEIGHT_CHARS ||
+      width > 256 || height > 256)
+    return;
+
+  vte_terminal_set_size (VTE_TERMINAL (priv->active_screen), width, height);
+  terminal_window_update_size (window);
+}
+
+static void
+action_open_match_cb (GSimpleAction *action,
+                      GVariant      *parameter,
+                      gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  TerminalScreenPopupInfo *info = priv->popup_info;
+
+  if (info == NULL)
+    return;
+  if (info->url == NULL)
+    return;
+
+  terminal_util_open_url (GTK_WIDGET (window), info->url, info->url_flavor,
+                          gtk_get_current_event_time ());
+}
+
+static void
+action_copy_match_cb (GSimpleAction *action,
+                      GVariant      *parameter,
+                      gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  TerminalScreenPopupInfo *info = priv->popup_info;
+
+  if (info == NULL)
+    return;
+  if (info->url == NULL)
+    return;
+
+  gtk_clipboard_set_text (priv->clipboard, info->url, -1);
+}
+
+static void
+action_open_hyperlink_cb (GSimpleAction *action,
+                          GVariant      *parameter,
+                          gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  TerminalScreenPopupInfo *info = priv->popup_info;
+
+  if (info == NULL)
+    return;
+  if (info->hyperlink == NULL)
+    return;
+
+  terminal_util_open_url (GTK_WIDGET (window), info->hyperlink, FLAVOR_AS_IS,
+                          gtk_get_current_event_time ());
+}
+
+static void
+action_copy_hyperlink_cb (GSimpleAction *action,
+                          GVariant      *parameter,
+                          gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+  TerminalWindowPrivate *priv = window->priv;
+  TerminalScreenPopupInfo *info = priv->popup_info;
+
+  if (info == NULL)
+    return;
+  if (info->hyperlink == NULL)
+    return;
+
+  gtk_clipboard_set_text (priv->clipboard, info->hyperlink, -1);
+}
+
+static void
+action_leave_fullscreen_cb (GSimpleAction *action,
+                            GVariant      *parameter,
+                            gpointer       user_data)
+{
+  TerminalWindow *window = user_data;
+
+  g_action_group_change_action_state (G_ACTION_GROUP (window), "fullscreen",
+                                      g_variant_new_boolean (FALSE));
+}
+
+static void
+action_inspector_cb (GSimpleAction *action,
+                     GVariant      *parameter,
+                     gpointer       user_data)
+{
+  gtk_window_set_interactive_debugging (TRUE);
+}
+
+static void
+terminal_window_update_search_match_count (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (priv->search_popover == NULL)
+    return;
+
+  if (terminal_search_popover_get_all_tabs (priv->search_popover)) {
+    terminal_search_popover_set_match_count (priv->search_popover,
+                                             priv->search_all_cancellable ? -1 : (int) priv->search_all_n_matches,
+                                             -1, FALSE);
+    return;
+  }
+
+  if (priv->search_matches == NULL) {
+    terminal_search_popover_set_match_count (priv->search_popover, -1, -1, FALSE);
+    return;
+  }
+
+  terminal_search_popover_set_match_count (priv->search_popover,
+                                           priv->search_matches->len,
+                                           priv->search_match,
+                                           priv->search_matches->len >= TERMINAL_SCREEN_SEARCH_MAX_MATCHES);
+}
+
+static void
+terminal_window_search_reset (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (priv->search_cancellable) {
+    g_cancellable_cancel (priv->search_cancellable);
+    g_clear_object (&priv->search_cancellable);
+  }
+
+  g_clear_pointer (&priv->search_matches, g_array_unref);
+  priv->search_screen = NULL;
+  priv->search_match = -1;
+
+  terminal_window_update_search_match_count (window);
+}
+
+static void
+search_done_cb (GObject *source,
+                GAsyncResult *result,
+                gpointer user_data)
+{
+  TerminalWindow *window;
+  TerminalWindowPrivate *priv;
+  gs_free_error GError *error = NULL;
+  GArray *matches;
+
+  matches = terminal_screen_search_finish (TERMINAL_SCREEN (source), result, &error);
+  if (matches == NULL) {
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return; /* the window may be gone */
+
+    _terminal_debug_print (TERMINAL_DEBUG_SEARCH,
+                           "Background search failed: %s\n", error->message);
+  }
+
+  window = user_data;
+  priv = window->priv;
+
+  g_clear_object (&priv->search_cancellable);
+  priv->search_matches = matches;
+  priv->search_match = -1;
+
+  terminal_window_update_search_match_count (window);
 }
 
 static void
-action_size_to_cb (GSimpleAction *action,
-                   GVariant      *parameter,
-                   gpointer       user_data)
+terminal_window_search_start (TerminalWindow *window)
 {
-  TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
-  guint width, height;
+  const char *pattern;
+  guint32 compile_flags;
 
-  g_assert_nonnull (parameter);
+  terminal_window_search_reset (window);
 
-  if (priv->active_screen == NULL)
+  if (priv->search_popover == NULL || priv->active_screen == NULL)
     return;
 
-  g_variant_get (parameter, "(uu)", &width, &height);
-  if (width < MIN_WIDTH_CHARS || height < MIN_HEIGHT_CHARS ||
-      width > 256 || height > 256)
+  pattern = terminal_search_popover_get_regex_pattern (priv->search_popover, &compile_flags);
+  if (pattern == NULL)
     return;
 
-  vte_terminal_set_size (VTE_TERMINAL (priv->active_screen), width, height);
-  terminal_window_update_size (window);
+  priv->search_cancellable = g_cancellable_new ();
+  priv->search_screen = priv->active_screen;
+  terminal_screen_search_async (priv->active_screen, pattern, compile_flags,
+                                priv->search_cancellable,
+                                search_done_cb, window);
 }
 
 static void
-action_open_match_cb (GSimpleAction *action,
-                      GVariant      *parameter,
-                      gpointer       user_data)
+terminal_window_search_all_cancel (TerminalWindow *window)
 {
-  TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
-  TerminalScreenPopupInfo *info = priv->popup_info;
 
-  if (info == NULL)
-    return;
-  if (info->url == NULL)
-    return;
-
-  terminal_util_open_url (GTK_WIDGET (window), info->url, info->url_flavor,
-                          gtk_get_current_event_time ());
+  if (priv->search_all_cancellable) {
+    g_cancellable_cancel (priv->search_all_cancellable);
+    g_clear_object (&priv->search_all_cancellable);
+  }
+  priv->search_all_n_matches = 0;
 }
 
 static void
-action_copy_match_cb (GSimpleAction *action,
-                      GVariant      *parameter,
-                      gpointer       user_data)
+search_all_result_cb (TerminalScreen *screen,
+                      GArray *matches,
+                      gpointer user_data)
 {
   TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
-  TerminalScreenPopupInfo *info = priv->popup_info;
 
-  if (info == NULL)
-    return;
-  if (info->url == NULL)
+  if (priv->search_popover == NULL)
     return;
 
-  gtk_clipboard_set_text (priv->clipboard, info->url, -1);
+  priv->search_all_n_matches += matches->len;
+  terminal_search_popover_add_results (priv->search_popover, screen, matches);
 }
 
 static void
-action_open_hyperlink_cb (GSimpleAction *action,
-                          GVariant      *parameter,
-                          gpointer       user_data)
+search_all_done_cb (GObject *source,
+                    GAsyncResult *result,
+                    gpointer user_data)
 {
-  TerminalWindow *window = user_data;
-  TerminalWindowPrivate *priv = window->priv;
-  TerminalScreenPopupInfo *info = priv->popup_info;
+  TerminalWindow *window;
+  gs_free_error GError *error = NULL;
 
-  if (info == NULL)
-    return;
-  if (info->hyperlink == NULL)
-    return;
+  if (!terminal_app_search_contents_finish (TERMINAL_APP (source), result, &error)) {
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return; /* the window may be gone */
 
-  terminal_util_open_url (GTK_WIDGET (window), info->hyperlink, FLAVOR_AS_IS,
-                          gtk_get_current_event_time ());
+    _terminal_debug_print (TERMINAL_DEBUG_SEARCH,
+                           "Searching all tabs failed: %s\n", error->message);
+  }
+
+  window = user_data;
+  g_clear_object (&window->priv->search_all_cancellable);
+  terminal_window_update_search_match_count (window);
 }
 
+/* Streams the matches in all terminals of the app into the popover */
 static void
-action_copy_hyperlink_cb (GSimpleAction *action,
-                          GVariant      *parameter,
-                          gpointer       user_data)
+terminal_window_search_all_start (TerminalWindow *window)
 {
-  TerminalWindow *window = user_data;
   TerminalWindowPrivate *priv = window->priv;
-  TerminalScreenPopupInfo *info = priv->popup_info;
+  const char *pattern;
+  guint32 compile_flags;
 
-  if (info == NULL)
+  terminal_window_search_all_cancel (window);
+
+  if (priv->search_popover == NULL)
     return;
-  if (info->hyperlink == NULL)
+
+  terminal_search_popover_clear_results (priv->search_popover);
+
+  pattern = terminal_search_popover_get_regex_pattern (priv->search_popover, &compile_flags);
+  if (pattern == NULL || !terminal_search_popover_get_all_tabs (priv->search_popover)) {
+    terminal_window_update_search_match_count (window);
     return;
+  }
 
-  gtk_clipboard_set_text (priv->clipboard, info->hyperlink, -1);
+  priv->search_all_cancellable = g_cancellable_new ();
+  terminal_app_search_contents_async (terminal_app_get (), pattern, compile_flags, NULL, -1,
+                                      search_all_result_cb,
+                                      priv->search_all_cancellable,
+                                      search_all_done_cb, window);
+  terminal_window_update_search_match_count (window);
 }
 
 static void
-action_leave_fullscreen_cb (GSimpleAction *action,
-                            GVariant      *parameter,
-                            gpointer       user_data)
+search_popover_result_activated_cb (TerminalSearchPopover *popover,
+                                    const char *screen_uuid,
+                                    glong row,
+                                    TerminalWindow *window)
 {
-  TerminalWindow *window = user_data;
+  TerminalScreen *screen;
+  GtkWidget *toplevel;
+  GtkAdjustment *adjustment;
+  double value;
 
-  g_action_group_change_action_state (G_ACTION_GROUP (window), "fullscreen",
-                                      g_variant_new_boolean (FALSE));
+  screen = terminal_app_get_screen_by_uuid (terminal_app_get (), screen_uuid);
+  if (screen == NULL)
+    return;
+
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (screen));
+  if (!gtk_widget_is_toplevel (toplevel))
+    return;
+
+  terminal_window_switch_screen (TERMINAL_WINDOW (toplevel), screen);
+  if (toplevel != GTK_WIDGET (window))
+    gtk_window_present_with_time (GTK_WINDOW (toplevel), gtk_get_current_event_time ());
+
+  /* Put the row in the middle, if it is still in the scrollback */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  value = row - gtk_adjustment_get_page_size (adjustment) / 2;
+  value = CLAMP (value,
+                 gtk_adjustment_get_lower (adjustment),
+                 gtk_adjustment_get_upper (adjustment) - gtk_adjustment_get_page_size (adjustment));
+  gtk_adjustment_set_value (adjustment, value);
 }
 
 static void
-action_inspector_cb (GSimpleAction *action,
-                     GVariant      *parameter,
-                     gpointer       user_data)
+search_popover_notify_all_tabs_cb (TerminalSearchPopover *popover,
+                                   GParamSpec *pspec G_GNUC_UNUSED,
+                                   TerminalWindow *window)
 {
-  gtk_window_set_interactive_debugging (TRUE);
+  terminal_window_search_all_start (window);
 }
 
+/* Uses the matches found in the background if there are any, and VTE's
+ * own search from the current position otherwise.
+ */
 static void
-search_popover_search_cb (TerminalSearchPopover *popover,
-                          gboolean backward,
-                          TerminalWindow *window)
+terminal_window_search (TerminalWindow *window,
+                        gboolean backward)
 {
   TerminalWindowPrivate *priv = window->priv;
+  GArray *matches = priv->search_matches;
+  int n, index;
 
   if (G_UNLIKELY (priv->active_screen == NULL))
     return;
 
+  if (matches == NULL || matches->len == 0 ||
+      priv->search_screen != priv->active_screen)
+    goto fallback;
+
+  n = matches->len;
+  if (priv->search_match < 0) {
+    GtkAdjustment *adjustment;
+    double top, bottom;
+
+    /* Start from what is visible */
+    adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (priv->active_screen));
+    top = gtk_adjustment_get_value (adjustment);
+    bottom = top + gtk_adjustment_get_page_size (adjustment);
+
+    if (backward) {
+      for (index = n - 1; index > 0; index--)
+        if (g_array_index (matches, TerminalSearchMatch, index).row < bottom)
+          break;
+    } else {
+      for (index = 0; index < n - 1; index++)
+        if (g_array_index (matches, TerminalSearchMatch, index).row >= top)
+          break;
+    }
+  } else {
+    index = priv->search_match + (backward ? -1 : 1);
+    if (index < 0 || index >= n) {
+      if (!terminal_search_popover_get_wrap_around (priv->search_popover))
+        return;
+      index = (index + n) % n;
+    }
+  }
+
+  if (!terminal_screen_show_search_match (priv->active_screen, matches, index))
+    goto fallback;
+
+  priv->search_match = index;
+  terminal_window_update_search_match_count (window);
+  return;
+
+ fallback:
   if (backward)
     vte_terminal_search_find_previous (VTE_TERMINAL (priv->active_screen));
   else
     vte_terminal_search_find_next (VTE_TERMINAL (priv->active_screen));
 }
 
+static void
+search_popover_search_cb (TerminalSearchPopover *popover,
+                          gboolean backward,
+                          TerminalWindow *window)
+{
+  terminal_window_search (window, backward);
+}
+
 static void
 search_popover_notify_regex_cb (TerminalSearchPopover *popover,
                                 GParamSpec *pspec G_GNUC_UNUSED,
@@ -1129,6 +1763,8 @@ search_popover_notify_regex_cb (TerminalSearchPopover *popover,
   vte_terminal_search_set_regex (VTE_TERMINAL (priv->active_screen), regex, 0);
 
   terminal_window_update_search_sensitivity (priv->active_screen, window);
+  terminal_window_search_start (window);
+  terminal_window_search_all_start (window);
 }
 
 static void
@@ -1146,6 +1782,21 @@ search_popover_notify_wrap_around_cb (TerminalSearchPopover *popover,
   vte_terminal_search_set_wrap_around (VTE_TERMINAL (priv->active_screen), wrap);
 }
 
+/* Searches keep a copy of the scrollback for the next search; the search
+ * is over once the popover is closed.
+ */
+static void
+search_popover_hide_cb (GtkWidget *popover,
+                        TerminalWindow *window)
+{
+  gs_free_list GList *tabs = NULL;
+  GList *t;
+
+  tabs = terminal_window_list_screen_containers (window);
+  for (t = tabs; t != NULL; t = t->next)
+    terminal_screen_drop_search_snapshot (terminal_screen_container_get_screen (t->data));
+}
+
 static void
 action_find_cb (GSimpleAction *action,
                 GVariant *parameter,
@@ -1178,6 +1829,10 @@ action_find_cb (GSimpleAction *action,
   search_popover_notify_wrap_around_cb (priv->search_popover, NULL, window);
   g_signal_connect (priv->search_popover, "notify::wrap-around", G_CALLBACK (search_popover_notify_wrap_around_cb), window);
 
+  g_signal_connect (priv->search_popover, "notify::all-tabs", G_CALLBACK (search_popover_notify_all_tabs_cb), window);
+  g_signal_connect (priv->search_popover, "result-activated", G_CALLBACK (search_popover_result_activated_cb), window);
+  g_signal_connect (priv->search_popover, "hide", G_CALLBACK (search_popover_hide_cb), window);
+
   g_signal_connect (priv->search_popover, "destroy", G_CALLBACK (gtk_widget_destroyed), &priv->search_popover);
 
   gtk_widget_show (GTK_WIDGET (priv->search_popover));
@@ -1194,7 +1849,7 @@ action_find_forward_cb (GSimpleAction *action,
   if (priv->active_screen == NULL)
     return;
 
-  vte_terminal_search_find_next (VTE_TERMINAL (priv->active_screen));
+  terminal_window_search (window, FALSE);
 }
 
 static void
@@ -1208,7 +1863,7 @@ action_find_backward_cb (GSimpleAction *action,
   if (priv->active_screen == NULL)
     return;
 
-  vte_terminal_search_find_previous (VTE_TERMINAL (priv->active_screen));
+  terminal_window_search (window, TRUE);
 }
 
 static void
@@ -1223,6 +1878,7 @@ action_find_clear_cb (GSimpleAction *action,
     return;
 
   vte_terminal_search_set_regex (VTE_TERMINAL (priv->active_screen), NULL, 0);
+  terminal_window_search_reset (window);
 }
 
 static void
@@ -1582,7 +2238,7 @@ terminal_window_update_zoom_sensitivity (TerminalWindow *window)
   if (screen == NULL)
     return;
 
-  double zoom = vte_terminal_get_font_scale (VTE_TERMINAL (screen));
+  double zoom = terminal_window_get_zoom (window);
 
   g_simple_action_set_enabled (lookup_action (window, "zoom-in"),
                                find_larger_zoom_factor (&zoom));
@@ -1616,12 +2272,10 @@ clipboard_targets_changed_cb (TerminalApp *app,
   if (clipboard != priv->clipboard)
     return;
 
-  GdkAtom *targets;
-  int n_targets;
-  targets = terminal_app_get_clipboard_targets (app, clipboard, &n_targets);
+  guint flags = terminal_app_get_clipboard_flags (app, clipboard);
 
-  gboolean can_paste = gtk_targets_include_text (targets, n_targets);
-  gboolean can_paste_uris = gtk_targets_include_uri (targets, n_targets);
+  gboolean can_paste = (flags & TERMINAL_CLIPBOARD_CAN_PASTE_TEXT) != 0;
+  gboolean can_paste_uris = (flags & TERMINAL_CLIPBOARD_CAN_PASTE_URIS) != 0;
 
   g_simple_action_set_enabled (lookup_action (window, "paste-text"), can_paste);
   g_simple_action_set_enabled (lookup_action (window, "paste-uris"), can_paste_uris);
@@ -1697,6 +2351,7 @@ terminal_window_update_tabs_actions_sensitivity (TerminalWindow *window)
   g_simple_action_set_enabled (lookup_action (window, "tab-move-left"), not_first_lr || wrap);
   g_simple_action_set_enabled (lookup_action (window, "tab-move-right"), not_last_lr || wrap);
   g_simple_action_set_enabled (lookup_action (window, "tab-detach"), not_only);
+  g_simple_action_set_enabled (lookup_action (window, "tab-detach-right"), not_first);
 }
 
 static GtkNotebook *
@@ -1800,10 +2455,11 @@ screen_show_popup_menu_cb (TerminalScreen *screen,
   }
 
   /* Info section */
-  if (info->number_info != NULL) {
+  const char *number_info = terminal_screen_popup_info_get_number_info (info);
+  if (number_info != NULL) {
     gs_unref_object GMenu *section3 = g_menu_new ();
     /* Non-existent action will make this item insensitive */
-    gs_unref_object GMenuItem *item3 = g_menu_item_new (info->number_info, "win.notexist");
+    gs_unref_object GMenuItem *item3 = g_menu_item_new (number_info, "win.notexist");
     g_menu_append_item (section3, item3);
     g_menu_append_section (menu, NULL, G_MENU_MODEL (section3));
   }
@@ -1917,31 +2573,94 @@ screen_close_cb (TerminalScreen *screen,
 }
 
 static void
-notebook_update_tabs_menu_cb (GtkMenuButton *button,
-                              TerminalWindow *window)
+tabs_menu_set_item (TerminalWindow *window,
+                    guint i,
+                    TerminalScreen *screen)
 {
-  gs_unref_object GMenu *menu;
+  TerminalWindowPrivate *priv = window->priv;
+  gs_unref_object GMenuItem *item;
+  const char *title;
+
+  title = terminal_screen_get_title (screen);
+
+  item = g_menu_item_new (title && title[0] ? title : _("Terminal"), NULL);
+  g_menu_item_set_action_and_target (item, "win.active-tab", "i", i);
+
+  if (i < priv->tabs_menu_screens->len) {
+    g_menu_remove (priv->tabs_menu, i);
+    g_ptr_array_index (priv->tabs_menu_screens, i) = screen;
+  } else
+    g_ptr_array_add (priv->tabs_menu_screens, screen);
+
+  g_menu_insert_item (priv->tabs_menu, i, item);
+}
+
+/* Only replaces the items whose page now holds a different screen */
+static void
+terminal_window_update_tabs_menu (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
   gs_free_list GList *tabs;
   GList *t;
-  int i;
+  guint i;
+
+  if (priv->tabs_menu == NULL)
+    return;
 
-  menu = g_menu_new ();
+  gint64 trace_begin = _terminal_trace_begin ();
   tabs = terminal_window_list_screen_containers (window);
 
   for (t = tabs, i = 0; t != NULL; t = t->next, i++) {
-    TerminalScreenContainer *container = t->data;
-    TerminalScreen *screen = terminal_screen_container_get_screen (container);
-    gs_unref_object GMenuItem *item;
-    const char *title;
+    TerminalScreen *screen = terminal_screen_container_get_screen (t->data);
+
+    if (i < priv->tabs_menu_screens->len &&
+        g_ptr_array_index (priv->tabs_menu_screens, i) == screen)
+      continue;
+
+    tabs_menu_set_item (window, i, screen);
+  }
+
+  while (priv->tabs_menu_screens->len > i) {
+    g_menu_remove (priv->tabs_menu, priv->tabs_menu_screens->len - 1);
+    g_ptr_array_set_size (priv->tabs_menu_screens, priv->tabs_menu_screens->len - 1);
+  }
+
+  _terminal_trace_end ("terminal_window_update_tabs_menu", trace_begin);
+}
+
+static void
+screen_title_changed_tabs_menu_cb (TerminalScreen *screen,
+                                   GParamSpec *pspec,
+                                   TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+  guint i;
+
+  if (priv->tabs_menu == NULL)
+    return;
+
+  for (i = 0; i < priv->tabs_menu_screens->len; i++) {
+    if (g_ptr_array_index (priv->tabs_menu_screens, i) == screen) {
+      tabs_menu_set_item (window, i, screen);
+      break;
+    }
+  }
+}
 
-    title = terminal_screen_get_title (screen);
+static void
+notebook_update_tabs_menu_cb (GtkMenuButton *button,
+                              TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
 
-    item = g_menu_item_new (title && title[0] ? title : _("Terminal"), NULL);
-    g_menu_item_set_action_and_target (item, "win.active-tab", "i", i);
-    g_menu_append_item (menu, item);
+  /* From then on, the menu is kept up to date as the tabs change */
+  if (priv->tabs_menu == NULL) {
+    priv->tabs_menu = g_menu_new ();
+    priv->tabs_menu_screens = g_ptr_array_new ();
+    terminal_window_update_tabs_menu (window);
   }
 
-  gtk_menu_button_set_menu_model (button, G_MENU_MODEL (menu));
+  gtk_menu_button_set_menu_model (button, G_MENU_MODEL (priv->tabs_menu));
 
   /* Need this so the menu is positioned correctly */
   gtk_widget_set_halign (GTK_WIDGET (gtk_menu_button_get_popup (button)), GTK_ALIGN_END);
@@ -2030,6 +2749,9 @@ terminal_window_state_event (GtkWidget            *widget,
   gboolean (* window_state_event) (GtkWidget *, GdkEventWindowState *event) =
     GTK_WIDGET_CLASS (terminal_window_parent_class)->window_state_event;
 
+  if (event->changed_mask & (GDK_WINDOW_STATE_MAXIMIZED | GDK_WINDOW_STATE_FULLSCREEN))
+    terminal_app_mark_session_dirty (terminal_app_get ());
+
   if (event->changed_mask & GDK_WINDOW_STATE_FULLSCREEN)
     {
       TerminalWindow *window = TERMINAL_WINDOW (widget);
@@ -2143,6 +2865,7 @@ terminal_window_init (TerminalWindow *window)
     { "select-all",          action_select_all_cb,       NULL,   NULL, NULL },
     { "size-to",             action_size_to_cb,          "(uu)", NULL, NULL },
     { "tab-detach",          action_tab_detach_cb,       NULL,   NULL, NULL },
+    { "tab-detach-right",    action_tab_detach_right_cb, NULL,   NULL, NULL },
     { "tab-move-left",       action_tab_move_left_cb,    NULL,   NULL, NULL },
     { "tab-move-right",      action_tab_move_right_cb,   NULL,   NULL, NULL },
     { "tab-switch-left",     action_tab_switch_left_cb,  NULL,   NULL, NULL },
@@ -2154,9 +2877,7 @@ terminal_window_init (TerminalWindow *window)
 #ifdef ENABLE_EXPORT
     { "export",              action_export_cb,           NULL,   NULL, NULL },
 #endif
-#ifdef ENABLE_PRINT
     { "print",               action_print_cb,            NULL,   NULL, NULL },
-#endif
 #ifdef ENABLE_SAVE
     { "save-contents",       action_save_contents_cb,    NULL,   NULL, NULL },
 #endif
@@ -2368,6 +3089,15 @@ terminal_window_dispose (GObject *object)
 
   priv->disposed = TRUE;
 
+  if (priv->update_tick_id != 0) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (window), priv->update_tick_id);
+    priv->update_tick_id = 0;
+  }
+  if (priv->zoom_tick_id != 0) {
+    gtk_widget_remove_tick_callback (GTK_WIDGET (window), priv->zoom_tick_id);
+    priv->zoom_tick_id = 0;
+  }
+
   if (priv->clipboard != NULL) {
     g_signal_handlers_disconnect_by_func (app,
                                           G_CALLBACK (clipboard_targets_changed_cb),
@@ -2377,6 +3107,9 @@ terminal_window_dispose (GObject *object)
 
   remove_popup_info (window);
 
+  terminal_window_search_reset (window);
+  terminal_window_search_all_cancel (window);
+
   if (priv->search_popover != NULL)
     {
       g_signal_handlers_disconnect_matched (priv->search_popover, G_SIGNAL_MATCH_DATA,
@@ -2400,6 +3133,10 @@ terminal_window_finalize (GObject *object)
 
   g_free (priv->uuid);
 
+  g_clear_object (&priv->tabs_menu);
+  if (priv->tabs_menu_screens)
+    g_ptr_array_unref (priv->tabs_menu_screens);
+
   G_OBJECT_CLASS (terminal_window_parent_class)->finalize (object);
 }
 
@@ -2544,6 +3281,8 @@ screen_font_any_changed_cb (TerminalScreen *screen,
 {
   TerminalWindowPrivate *priv = window->priv;
 
+  terminal_app_mark_session_dirty (terminal_app_get ());
+
   if (!gtk_widget_get_realized (GTK_WIDGET (window)))
     return;
 
@@ -2609,7 +3348,7 @@ terminal_window_add_screen (TerminalWindow *window,
   if (TERMINAL_IS_WINDOW (old_window))
     terminal_window_remove_screen (TERMINAL_WINDOW (old_window), screen);
 
-  terminal_mdi_container_add_screen (priv->mdi_container, screen);
+  terminal_mdi_container_add_screen (priv->mdi_container, screen, position);
 }
 
 void
@@ -2627,33 +3366,101 @@ terminal_window_move_screen (TerminalWindow *source_window,
                              TerminalScreen *screen,
                              int dest_position)
 {
-  TerminalScreenContainer *screen_container;
+  GList screens = { screen, NULL, NULL };
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  terminal_window_move_screens (source_window, dest_window, &screens, dest_position);
+}
+
+/* Updates what depends on the list of screens, after moving screens */
+static void
+terminal_window_screens_moved (TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  priv->moving_screens = FALSE;
+  if (priv->disposed)
+    return;
+
+  terminal_window_update_tabs_actions_sensitivity (window);
+  terminal_window_update_tabs_menu (window);
+  terminal_window_update_size (window);
+}
+
+/**
+ * terminal_window_move_screens:
+ * @source_window: the #TerminalWindow containing @screens
+ * @dest_window: the #TerminalWindow to move @screens to
+ * @screens: (element-type TerminalScreen): the screens to move
+ * @dest_position: the position of the first screen in @dest_window, or -1 to append
+ *
+ * Moves @screens in their screen containers, so their scrollbars and
+ * overlays are kept. The tabs menus and the sizes of both windows are
+ * only updated once, and the first screen becomes the active one.
+ * Nothing happens if @dest_window is @source_window, e.g. when a tab
+ * is dropped onto a terminal of its own window.
+ */
+void
+terminal_window_move_screens (TerminalWindow *source_window,
+                              TerminalWindow *dest_window,
+                              GList *screens,
+                              int dest_position)
+{
+  gs_free_list GList *containers = NULL;
+  GList *l;
+  gint64 trace_begin;
 
   g_return_if_fail (TERMINAL_IS_WINDOW (source_window));
   g_return_if_fail (TERMINAL_IS_WINDOW (dest_window));
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
-  g_return_if_fail (gtk_widget_get_toplevel (GTK_WIDGET (screen)) == GTK_WIDGET (source_window));
   g_return_if_fail (dest_position >= -1);
 
-  screen_container = terminal_screen_container_get_from_screen (screen);
-  g_assert (TERMINAL_IS_SCREEN_CONTAINER (screen_container));
+  if (screens == NULL || source_window == dest_window)
+    return;
+
+  trace_begin = _terminal_trace_begin ();
+
+  /* Keep the source window alive in case it is left without screens */
+  g_object_ref (source_window);
+  source_window->priv->moving_screens = TRUE;
+  dest_window->priv->moving_screens = TRUE;
 
-  /* We have to ref the screen container as well as the screen,
-   * because otherwise removing the screen container from the source
-   * window's notebook will cause the container and its containing
-   * screen to be gtk_widget_destroy()ed!
+  /* We have to ref the screen containers, because otherwise removing
+   * them from the source window's notebook will cause them and their
+   * screens to be gtk_widget_destroy()ed!
    */
-  g_object_ref_sink (screen_container);
-  g_object_ref_sink (screen);
-  terminal_window_remove_screen (source_window, screen);
+  for (l = screens; l != NULL; l = l->next) {
+    TerminalScreen *screen = l->data;
+    TerminalScreenContainer *screen_container;
+
+    g_warn_if_fail (gtk_widget_get_toplevel (GTK_WIDGET (screen)) == GTK_WIDGET (source_window));
+
+    screen_container = terminal_screen_container_get_from_screen (screen);
+    g_assert (TERMINAL_IS_SCREEN_CONTAINER (screen_container));
 
-  /* Now we can safely remove the screen from the container and let the container die */
-  gtk_container_remove (GTK_CONTAINER (gtk_widget_get_parent (GTK_WIDGET (screen))), GTK_WIDGET (screen));
-  g_object_unref (screen_container);
+    containers = g_list_prepend (containers, g_object_ref_sink (screen_container));
+    terminal_window_remove_screen (source_window, screen);
+  }
+  containers = g_list_reverse (containers);
+
+  for (l = containers; l != NULL; l = l->next) {
+    terminal_window_add_screen (dest_window,
+                                terminal_screen_container_get_screen (l->data),
+                                dest_position);
+    if (dest_position != -1)
+      dest_position++;
+  }
+
+  terminal_mdi_container_set_active_screen (dest_window->priv->mdi_container,
+                                            terminal_screen_container_get_screen (containers->data));
+
+  terminal_window_screens_moved (dest_window);
+  terminal_window_screens_moved (source_window);
+  g_object_unref (source_window);
 
-  terminal_window_add_screen (dest_window, screen, dest_position);
-  terminal_mdi_container_set_active_screen (dest_window->priv->mdi_container, screen);
-  g_object_unref (screen);
+  g_list_foreach (containers, (GFunc) g_object_unref, NULL);
+
+  _terminal_trace_end ("terminal_window_move_screens", trace_begin);
 }
 
 GList*
@@ -2704,8 +3511,10 @@ terminal_window_get_mdi_container (TerminalWindow *window)
   return GTK_WIDGET (priv->mdi_container);
 }
 
-void
-terminal_window_update_size (TerminalWindow *window)
+static void terminal_window_do_update_geometry (TerminalWindow *window);
+
+static void
+terminal_window_do_update_size (TerminalWindow *window)
 {
   TerminalWindowPrivate *priv = window->priv;
   int grid_width, grid_height;
@@ -2725,7 +3534,7 @@ terminal_window_update_size (TerminalWindow *window)
     }
 
   /* be sure our geometry is up-to-date */
-  terminal_window_update_geometry (window);
+  terminal_window_do_update_geometry (window);
 
   terminal_screen_get_size (priv->active_screen, &grid_width, &grid_height);
   _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
@@ -2746,6 +3555,69 @@ terminal_window_update_size (TerminalWindow *window)
   gtk_window_resize (GTK_WINDOW (window), pixel_width, pixel_height);
 }
 
+static gboolean
+update_tick_cb (GtkWidget *widget,
+                GdkFrameClock *frame_clock,
+                gpointer user_data)
+{
+  TerminalWindow *window = TERMINAL_WINDOW (widget);
+  TerminalWindowPrivate *priv = window->priv;
+
+  priv->update_tick_id = 0;
+
+  /* Updating the size updates the geometry too */
+  if (priv->update_size_pending)
+    terminal_window_do_update_size (window);
+  else if (priv->update_geometry_pending)
+    terminal_window_do_update_geometry (window);
+
+  priv->update_size_pending = FALSE;
+  priv->update_geometry_pending = FALSE;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+terminal_window_queue_update (TerminalWindow *window,
+                              gboolean update_size)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  /* Before the window is mapped there are no frames to wait for, and
+   * the size needs to be right when it is first shown.
+   */
+  if (!gtk_widget_get_mapped (GTK_WIDGET (window))) {
+    if (update_size)
+      terminal_window_do_update_size (window);
+    else
+      terminal_window_do_update_geometry (window);
+    return;
+  }
+
+  if (update_size)
+    priv->update_size_pending = TRUE;
+  else
+    priv->update_geometry_pending = TRUE;
+
+  if (priv->update_tick_id == 0)
+    priv->update_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (window),
+                                                         update_tick_cb,
+                                                         NULL, NULL);
+}
+
+/**
+ * terminal_window_update_size:
+ * @window: a #TerminalWindow
+ *
+ * Resizes @window to fit the grid size of its active screen. Once the window
+ * is mapped, this happens on the next frame, so many calls only cost one update.
+ */
+void
+terminal_window_update_size (TerminalWindow *window)
+{
+  terminal_window_queue_update (window, TRUE);
+}
+
 void
 terminal_window_switch_screen (TerminalWindow *window,
                                TerminalScreen *screen)
@@ -2851,16 +3723,24 @@ mdi_screen_switched_cb (TerminalMdiContainer *container,
   if (priv->disposed)
     return;
 
+  terminal_app_mark_session_dirty (terminal_app_get ());
+
   if (screen == NULL || old_active_screen == screen)
     return;
 
-  if (priv->search_popover != NULL)
+  /* The results of searching all tabs stay useful in any tab */
+  if (priv->search_popover != NULL &&
+      !terminal_search_popover_get_all_tabs (priv->search_popover))
     gtk_widget_hide (GTK_WIDGET (priv->search_popover));
+  terminal_window_search_reset (window);
 
   _terminal_debug_print (TERMINAL_DEBUG_MDI,
                          "[window %p] MDI: setting active tab to screen %p (old active screen %p)\n",
                          window, screen, priv->active_screen);
 
+  /* A zoom step still pending was for the screen being switched away from */
+  terminal_window_flush_zoom (window);
+
   if (old_active_screen != NULL && screen != NULL) {
     terminal_screen_get_size (old_active_screen, &old_grid_width, &old_grid_height);
 
@@ -2896,6 +3776,16 @@ mdi_screen_switched_cb (TerminalMdiContainer *container,
   terminal_window_update_set_profile_menu_active_profile (window);
   terminal_window_update_copy_sensitivity (screen, window);
   terminal_window_update_zoom_sensitivity (window);
+
+  /* Carry on searching in the new tab */
+  if (priv->search_popover != NULL &&
+      gtk_widget_get_visible (GTK_WIDGET (priv->search_popover))) {
+    vte_terminal_search_set_regex (VTE_TERMINAL (screen),
+                                   terminal_search_popover_get_regex (priv->search_popover), 0);
+    search_popover_notify_wrap_around_cb (priv->search_popover, NULL, window);
+    terminal_window_search_start (window);
+  }
+
   terminal_window_update_search_sensitivity (screen, window);
 }
 
@@ -2907,6 +3797,8 @@ mdi_screen_added_cb (TerminalMdiContainer *container,
   TerminalWindowPrivate *priv = window->priv;
   int pages;
 
+  terminal_app_mark_session_dirty (terminal_app_get ());
+
   _terminal_debug_print (TERMINAL_DEBUG_MDI,
                          "[window %p] MDI: screen %p inserted\n",
                          window, screen);
@@ -2919,6 +3811,8 @@ mdi_screen_added_cb (TerminalMdiContainer *container,
   /* FIXME: only connect on the active screen, not all screens! */
   g_signal_connect (screen, "notify::title",
                     G_CALLBACK (sync_screen_title), window);
+  g_signal_connect (screen, "notify::title",
+                    G_CALLBACK (screen_title_changed_tabs_menu_cb), window);
   g_signal_connect (screen, "notify::icon-title",
                     G_CALLBACK (sync_screen_icon_title), window);
   g_signal_connect (screen, "notify::icon-title-set",
@@ -2948,8 +3842,11 @@ mdi_screen_added_cb (TerminalMdiContainer *container,
   g_signal_connect (screen, "close-screen",
                     G_CALLBACK (screen_close_cb), window);
 
-  terminal_window_update_tabs_actions_sensitivity (window);
   terminal_window_update_search_sensitivity (screen, window);
+  if (!priv->moving_screens) {
+    terminal_window_update_tabs_actions_sensitivity (window);
+    terminal_window_update_tabs_menu (window);
+  }
 
 #if 0
   /* FIXMEchpe: wtf is this doing? */
@@ -2975,7 +3872,7 @@ mdi_screen_added_cb (TerminalMdiContainer *container,
     }
 
   pages = terminal_mdi_container_get_n_screens (container);
-  if (pages == 2)
+  if (pages == 2 && !priv->moving_screens)
     {
       terminal_window_update_size (window);
     }
@@ -2996,14 +3893,23 @@ mdi_screen_removed_cb (TerminalMdiContainer *container,
                          "[window %p] MDI: screen %p removed\n",
                          window, screen);
 
+  terminal_app_mark_session_dirty (terminal_app_get ());
+
   g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
                                         G_CALLBACK (profile_set_cb),
                                         window);
 
+  if (screen == priv->search_screen)
+    terminal_window_search_reset (window);
+
   g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
                                         G_CALLBACK (sync_screen_title),
                                         window);
 
+  g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
+                                        G_CALLBACK (screen_title_changed_tabs_menu_cb),
+                                        window);
+
   g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
                                         G_CALLBACK (sync_screen_icon_title),
                                         window);
@@ -3058,15 +3964,19 @@ mdi_screen_removed_cb (TerminalMdiContainer *container,
       return;
     }
 
-  terminal_window_update_tabs_actions_sensitivity (window);
   terminal_window_update_search_sensitivity (screen, window);
+  if (!priv->moving_screens) {
+    terminal_window_update_tabs_actions_sensitivity (window);
+    terminal_window_update_tabs_menu (window);
+  }
 
   if (pages == 1)
     {
       TerminalScreen *active_screen = terminal_mdi_container_get_active_screen (container);
       gtk_widget_grab_focus (GTK_WIDGET(active_screen));  /* bug 742422 */
 
-      terminal_window_update_size (window);
+      if (!priv->moving_screens)
+        terminal_window_update_size (window);
     }
 }
 
@@ -3074,7 +3984,9 @@ static void
 mdi_screens_reordered_cb (TerminalMdiContainer *container,
                           TerminalWindow  *window)
 {
+  terminal_app_mark_session_dirty (terminal_app_get ());
   terminal_window_update_tabs_actions_sensitivity (window);
+  terminal_window_update_tabs_menu (window);
 }
 
 gboolean
@@ -3087,7 +3999,7 @@ terminal_window_parse_geometry (TerminalWindow *window,
    * and width/height increment to compute the window size from
    * the geometry.
    */
-  terminal_window_update_geometry (window);
+  terminal_window_do_update_geometry (window);
 
   if (!gtk_window_parse_geometry (GTK_WINDOW (window), geometry))
     return FALSE;
@@ -3114,8 +4026,21 @@ terminal_window_parse_geometry (TerminalWindow *window,
   return TRUE;
 }
 
+/**
+ * terminal_window_update_geometry:
+ * @window: a #TerminalWindow
+ *
+ * Updates the geometry hints of @window from its active screen. Like
+ * terminal_window_update_size(), this is coalesced to once per frame.
+ */
 void
 terminal_window_update_geometry (TerminalWindow *window)
+{
+  terminal_window_queue_update (window, FALSE);
+}
+
+static void
+terminal_window_do_update_geometry (TerminalWindow *window)
 {
   TerminalWindowPrivate *priv = window->priv;
   GtkWidget *widget;
@@ -64,6 +64,11 @@ void terminal_window_move_screen (TerminalWindow *source_window,
                                   TerminalScreen *screen,
                                   int dest_position);
 
+void terminal_window_move_screens (TerminalWindow *source_window,
+                                   TerminalWindow *dest_window,
+                                   GList *screens,
+                                   int dest_position);
+
 /* Menubar visibility is part of session state, except that
  * if it isn't restored from session, the window gets the setting
  * from the profile of the first screen added to the window
@@ -26,11 +26,13 @@
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib/gi18n.h>
 
 #include <gtk/gtk.h>
@@ -42,6 +44,9 @@
 #include "terminal-gdbus-generated.h"
 #include "terminal-defines.h"
 #include "terminal-client-utils.h"
+#include "terminal-enums.h"
+#include "terminal-schemas.h"
+#include "terminal-trace.h"
 #include "terminal-libgsystem.h"
 
 GS_DEFINE_CLEANUP_FUNCTION0(TerminalOptions*, gs_local_options_free, terminal_options_free)
@@ -65,6 +70,18 @@ receiver_child_exited_cb (TerminalReceiver *receiver,
     g_main_loop_quit (data->loop);
 }
 
+/* Mangle the exit status */
+static int
+exit_code_from_status (int status)
+{
+  if (WIFEXITED (status))
+    return WEXITSTATUS (status);
+  else if (WIFSIGNALED (status))
+    return 128 + (int) WTERMSIG (status);
+  else
+    return 127;
+}
+
 static int
 run_receiver (TerminalReceiver *receiver)
 {
@@ -75,17 +92,50 @@ run_receiver (TerminalReceiver *receiver)
   g_signal_handler_disconnect (receiver, id);
   g_main_loop_unref (data.loop);
 
-  /* Mangle the exit status */
+  return exit_code_from_status (data.status);
+}
+
+/* Reads exactly @len bytes from @fd. Returns %FALSE on EOF or error. */
+static gboolean
+read_exit_status_fd (int fd,
+                     gpointer data,
+                     gsize len)
+{
+  char *buf = data;
+
+  while (len > 0) {
+    gssize n = read (fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return FALSE;
+
+    buf += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+/* Blocks until the server writes the child's exit status to @fd; no
+ * main loop or D-Bus traffic is needed for that. Takes ownership of @fd.
+ */
+static int
+run_exit_status_fd (int fd)
+{
+  gint32 status;
   int exit_code;
-  if (WIFEXITED (data.status))
-    exit_code = WEXITSTATUS (data.status);
-  else if (WIFSIGNALED (data.status))
-    exit_code = 128 + (int) WTERMSIG (data.status);
-  else if (WCOREDUMP (data.status))
-    exit_code = 127;
-  else
-    exit_code = 127;
 
+  if (read_exit_status_fd (fd, &status, sizeof (status))) {
+    exit_code = exit_code_from_status (status);
+  } else {
+    /* The terminal was closed, or the server went away */
+    _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                           "Exit status FD closed before the child exited\n");
+    exit_code = EXIT_FAILURE;
+  }
+
+  close (fd);
   return exit_code;
 }
 
@@ -170,18 +220,6 @@ handle_create_instance_error (const char *service_name,
   return FALSE; /* don't abort */
 }
 
-static gboolean
-handle_create_receiver_proxy_error (const char *service_name,
-                                    GError *error)
-{
-  if (handle_factory_error (service_name, error))
-    return TRUE;
-
-  g_dbus_error_strip_remote_error (error);
-  terminal_printerr ("Failed to create proxy for terminal: %s\n", error->message);
-  return FALSE; /* don't abort */
-}
-
 static gboolean
 handle_exec_error (const char *service_name,
                    GError *error)
@@ -335,13 +373,613 @@ handle_show_preferences (const char *service_name)
   }
 }
 
+static GVariant *
+build_create_instance_options (TerminalOptions *options,
+                               InitialWindow *iw,
+                               InitialTab *it,
+                               const char *encoding,
+                               const char *parent_screen_object_path,
+                               const char *previous_screen_object_path,
+                               guint window_id,
+                               gboolean window_from_previous)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  terminal_client_append_create_instance_options (&builder,
+                                                  options->display_name,
+                                                  options->startup_id,
+                                                  iw->geometry,
+                                                  iw->role,
+                                                  it->profile ? it->profile : options->default_profile,
+                                                  encoding,
+                                                  it->title ? it->title : options->default_title,
+                                                  it->active,
+                                                  iw->start_maximized,
+                                                  iw->start_fullscreen);
+  terminal_client_append_headless_options (&builder, it->headless, NULL);
+
+  /* This will be used to apply missing defaults */
+  if (parent_screen_object_path != NULL)
+    g_variant_builder_add (&builder, "{sv}",
+                           "parent-screen", g_variant_new_object_path (parent_screen_object_path));
+
+  /* This will be used to get the parent window */
+  if (previous_screen_object_path)
+    g_variant_builder_add (&builder, "{sv}",
+                           "window-from-screen", g_variant_new_object_path (previous_screen_object_path));
+  if (window_from_previous)
+    g_variant_builder_add (&builder, "{sv}",
+                           "window-from-previous", g_variant_new_boolean (TRUE));
+  if (window_id)
+    g_variant_builder_add (&builder, "{sv}",
+                           "window-id", g_variant_new_uint32 (window_id));
+  /* Restored windows shouldn't demand attention; see bug #586308. */
+  if (iw->source_tag == SOURCE_SESSION)
+    g_variant_builder_add (&builder, "{sv}",
+                           "present-window", g_variant_new_boolean (FALSE));
+  if (options->zoom_set || it->zoom_set)
+    g_variant_builder_add (&builder, "{sv}",
+                           "zoom", g_variant_new_double (it->zoom_set ? it->zoom : options->zoom));
+  if (iw->force_menubar_state)
+    g_variant_builder_add (&builder, "{sv}",
+                           "show-menubar", g_variant_new_boolean (iw->menubar_state));
+
+  return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+build_exec_options (TerminalOptions *options,
+                    InitialTab *it,
+                    int exit_status_fd_idx,
+                    GVariant **arguments)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  char **argv = it->exec_argv ? it->exec_argv : options->exec_argv;
+  int argc = argv ? g_strv_length (argv) : 0;
+
+  PassFdElement *fd_array = it->fd_array ? (PassFdElement*)it->fd_array->data : NULL;
+  gsize fd_array_len = it->fd_array ? it->fd_array->len : 0;
+
+  terminal_client_append_exec_options (&builder,
+                                       options->environment_id,
+                                       it->working_dir ? it->working_dir
+                                                       : options->default_working_dir,
+                                       fd_array, fd_array_len,
+                                       argc == 0);
+
+  if (exit_status_fd_idx != -1)
+    g_variant_builder_add (&builder, "{sv}",
+                           "exit-status-fd", g_variant_new_handle (exit_status_fd_idx));
+
+  *arguments = g_variant_new_bytestring_array ((const char * const *) argv, argc);
+
+  return g_variant_builder_end (&builder);
+}
+
+/* The server keeps environments by their ID, so the exec options refer
+ * to ours by its ID right away; the server only needs to be sent the
+ * environment itself if it doesn't have it yet, see environment_register().
+ */
+static void
+prepare_environment (TerminalOptions *options)
+{
+  gs_strfreev char **envv = terminal_client_get_environment ();
+
+  g_free (options->environment_id);
+  options->environment_id = terminal_client_compute_environment_id (envv);
+  options->environment_registered = FALSE;
+}
+
+/* Registers the environment after the server rejected a call with
+ * G_DBUS_ERROR_INVALID_ARGS, which it does for unknown environment IDs;
+ * with a server that can't register environments, it is passed along
+ * with each tab instead.
+ *
+ * Returns: %TRUE if the call should be made again
+ */
+static gboolean
+environment_register (TerminalOptions *options,
+                      GDBusConnection *connection,
+                      const char *factory_unique_name)
+{
+  gs_unref_variant GVariant *rv = NULL;
+  gs_free_error GError *err = NULL;
+  gs_strfreev char **envv = NULL;
+
+  if (options->environment_id == NULL || options->environment_registered)
+    return FALSE;
+
+  options->environment_registered = TRUE;
+
+  envv = terminal_client_get_environment ();
+  rv = g_dbus_connection_call_sync (connection,
+                                    factory_unique_name,
+                                    TERMINAL_FACTORY_OBJECT_PATH,
+                                    TERMINAL_FACTORY_INTERFACE_NAME,
+                                    "RegisterEnvironment",
+                                    g_variant_new ("(@aay)",
+                                                   g_variant_new_bytestring_array ((const char * const *) envv, -1)),
+                                    G_VARIANT_TYPE ("(s)"),
+                                    G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                    -1 /* default timeout */,
+                                    NULL /* cancellable */,
+                                    &err);
+
+  g_clear_pointer (&options->environment_id, g_free);
+  if (rv == NULL) {
+    _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                           "Failed to register the environment: %s\n", err->message);
+    return TRUE;
+  }
+
+  g_variant_get (rv, "(s)", &options->environment_id);
+  return TRUE;
+}
+
+/* Execs the tab's command the old way, through a receiver proxy; for
+ * tabs to wait for, its ChildExited signal is subscribed to before the exec.
+ */
+static gboolean
+exec_tab_with_receiver (TerminalOptions *options,
+                        InitialTab *it,
+                        const char *factory_unique_name,
+                        const char *object_path,
+                        gboolean exec,
+                        TerminalReceiver **wait_for_receiver,
+                        GError **error)
+{
+  gs_unref_object TerminalReceiver *receiver =
+    terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
+                                              G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                              (it->wait ? 0 : G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS),
+                                              factory_unique_name,
+                                              object_path,
+                                              NULL /* cancellable */,
+                                              error);
+  if (receiver == NULL)
+    return FALSE;
+
+  while (exec) {
+    gs_free_error GError *err = NULL;
+    GVariant *arguments;
+    GVariant *exec_options = build_exec_options (options, it, -1, &arguments);
+
+    if (terminal_receiver_call_exec_sync (receiver,
+                                          exec_options,
+                                          arguments,
+                                          it->fd_list, NULL /* outfdlist */,
+                                          NULL /* cancellable */,
+                                          &err))
+      break;
+
+    if (!g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS) ||
+        !environment_register (options,
+                               g_dbus_proxy_get_connection (G_DBUS_PROXY (receiver)),
+                               factory_unique_name)) {
+      g_propagate_error (error, err);
+      err = NULL;
+      return FALSE;
+    }
+  }
+
+  if (it->wait) {
+    g_clear_object (wait_for_receiver);
+    gs_transfer_out_value (wait_for_receiver, &receiver);
+  }
+
+  return TRUE;
+}
+
+/* Execs the tab's command in the terminal at @object_path, calling Exec
+ * directly on @connection instead of creating a receiver proxy first.
+ *
+ * For a tab to wait for, one end of a socket pair is passed along as the
+ * "exit-status-fd" option; the server writes one byte to it once the exec
+ * succeeded, and the child's exit status when it exits, so the client
+ * doesn't need to subscribe to ChildExited. Older servers either reject
+ * the option, or close the socket without the ack; in those cases, fall
+ * back to the receiver proxy.
+ */
+static gboolean
+exec_tab (TerminalOptions *options,
+          InitialTab *it,
+          GDBusConnection *connection,
+          const char *factory_unique_name,
+          const char *object_path,
+          int *wait_fd,
+          TerminalReceiver **wait_for_receiver,
+          GError **error)
+{
+  gs_unref_object GUnixFDList *fd_list = NULL;
+  gs_unref_variant GVariant *rv = NULL;
+  gs_free_error GError *err = NULL;
+  GVariant *arguments, *exec_options;
+  int sv[2] = { -1, -1 };
+  int exit_status_fd_idx = -1;
+
+  if (it->wait &&
+      socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0) {
+    fd_list = g_unix_fd_list_new ();
+
+    if (it->fd_list != NULL) {
+      const int *fds;
+      int n_fds, i;
+
+      /* Copy the list, so the "fd-set" indices stay valid */
+      fds = g_unix_fd_list_peek_fds (it->fd_list, &n_fds);
+      for (i = 0; i < n_fds; i++) {
+        if (g_unix_fd_list_append (fd_list, fds[i], error) == -1)
+          goto fail;
+      }
+    }
+
+    exit_status_fd_idx = g_unix_fd_list_append (fd_list, sv[1], error);
+    if (exit_status_fd_idx == -1)
+      goto fail;
+
+    close (sv[1]);
+    sv[1] = -1;
+  } else if (it->wait) {
+    return exec_tab_with_receiver (options, it, factory_unique_name, object_path,
+                                   TRUE, wait_for_receiver, error);
+  } else if (it->fd_list != NULL) {
+    fd_list = g_object_ref (it->fd_list);
+  }
+
+  exec_options = build_exec_options (options, it, exit_status_fd_idx, &arguments);
+
+  rv = g_dbus_connection_call_with_unix_fd_list_sync (connection,
+                                                       factory_unique_name,
+                                                       object_path,
+                                                       TEMRINAL_RECEIVER_INTERFACE_NAME,
+                                                       "Exec",
+                                                       g_variant_new ("(@a{sv}@aay)",
+                                                                      exec_options,
+                                                                      arguments),
+                                                       G_VARIANT_TYPE ("()"),
+                                                       G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                                       -1 /* default timeout */,
+                                                       fd_list,
+                                                       NULL /* outfdlist */,
+                                                       NULL /* cancellable */,
+                                                       &err);
+
+  /* Drop our copy of the server's end, so we see EOF when it closes it */
+  g_clear_object (&fd_list);
+
+  if (rv == NULL) {
+    if (g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS) &&
+        environment_register (options, connection, factory_unique_name)) {
+      if (sv[0] != -1)
+        close (sv[0]);
+      return exec_tab (options, it, connection, factory_unique_name, object_path,
+                       wait_fd, wait_for_receiver, error);
+    }
+
+    if (exit_status_fd_idx != -1 &&
+        g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS)) {
+      _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                             "Server rejected exit-status-fd, falling back\n");
+      close (sv[0]);
+      return exec_tab_with_receiver (options, it, factory_unique_name, object_path,
+                                     TRUE, wait_for_receiver, error);
+    }
+
+    g_propagate_error (error, err);
+    err = NULL;
+    goto fail;
+  }
+
+  if (exit_status_fd_idx != -1) {
+    char ack;
+
+    if (read_exit_status_fd (sv[0], &ack, sizeof (ack))) {
+      if (*wait_fd != -1)
+        close (*wait_fd);
+      *wait_fd = sv[0];
+      return TRUE;
+    }
+
+    /* The server ignored the option. The child is already running, so
+     * this may miss its exit if it is very short-lived.
+     */
+    _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                           "Server ignored exit-status-fd, falling back\n");
+    close (sv[0]);
+    return exec_tab_with_receiver (options, it, factory_unique_name, object_path,
+                                   FALSE, wait_for_receiver, error);
+  }
+
+  return TRUE;
+
+ fail:
+  if (sv[0] != -1)
+    close (sv[0]);
+  if (sv[1] != -1)
+    close (sv[1]);
+  return FALSE;
+}
+
+/* Whether all the tabs can be created with one CreateInstances call.
+ * Tabs we need to wait for need their own exit status FD, and the FD
+ * lists of the tabs would have to be merged; so don't batch these.
+ */
+static gboolean
+can_batch_options (TerminalOptions *options)
+{
+  guint n_tabs = 0;
+
+  for (GList *lw = options->initial_windows;  lw != NULL; lw = lw->next) {
+    InitialWindow *iw = lw->data;
+
+    for (GList *lt = iw->tabs; lt != NULL; lt = lt->next) {
+      InitialTab *it = lt->data;
+
+      if (it->wait || it->fd_list != NULL)
+        return FALSE;
+
+      n_tabs++;
+    }
+  }
+
+  return n_tabs > 1;
+}
+
+/**
+ * handle_options_batched:
+ * @options: a #TerminalOptions
+ * @unsupported: location to store whether the server does not support
+ *   the CreateInstances method
+ *
+ * Opens the windows and tabs of @options with one factory call. If the
+ * server is too old for that, sets @unsupported to %TRUE; the caller
+ * should then fall back to creating them one at a time.
+ *
+ * Returns: %FALSE on fatal error
+ */
+static gboolean
+handle_options_batched (TerminalOptions *options,
+                        TerminalFactory *factory,
+                        const char *service_name,
+                        const char *parent_screen_object_path,
+                        const char *encoding,
+                        gboolean *unsupported)
+{
+  GVariantBuilder builder;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(a{sv}a{sv}aay)"));
+
+  for (GList *lw = options->initial_windows;  lw != NULL; lw = lw->next)
+    {
+      InitialWindow *iw = lw->data;
+
+      for (GList *lt = iw->tabs; lt != NULL; lt = lt->next)
+        {
+          InitialTab *it = lt->data;
+          gboolean first_tab = (lt == iw->tabs);
+
+          GVariant *arguments;
+          GVariant *exec_options = build_exec_options (options, it, -1, &arguments);
+          GVariant *instance_options =
+            build_create_instance_options (options, iw, it, encoding,
+                                           parent_screen_object_path,
+                                           first_tab && iw->implicit_first_window ? parent_screen_object_path : NULL,
+                                           0,
+                                           !first_tab);
+
+          g_variant_builder_add (&builder, "(@a{sv}@a{sv}@aay)",
+                                 instance_options, exec_options, arguments);
+        }
+    }
+
+  *unsupported = FALSE;
+  gs_free_error GError *err = NULL;
+  gs_strfreev char **object_paths = NULL;
+  gs_strfreev char **errors = NULL;
+  if (!terminal_factory_call_create_instances_sync (factory,
+                                                    g_variant_builder_end (&builder),
+                                                    NULL /* fd list */,
+                                                    &object_paths,
+                                                    &errors,
+                                                    NULL /* outfdlist */,
+                                                    NULL /* cancellable */,
+                                                    &err)) {
+    if (g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+      _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                             "Server does not support CreateInstances\n");
+      *unsupported = TRUE;
+      return TRUE;
+    }
+
+    /* The server checks the environment IDs before creating anything */
+    gs_free char *name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (factory));
+    if (g_error_matches (err, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS) &&
+        name_owner != NULL &&
+        environment_register (options,
+                              g_dbus_proxy_get_connection (G_DBUS_PROXY (factory)),
+                              name_owner))
+      return handle_options_batched (options, factory, service_name,
+                                     parent_screen_object_path, encoding,
+                                     unsupported);
+
+    return !handle_create_instance_error (service_name, err);
+  }
+
+  for (guint i = 0; object_paths[i] != NULL; i++) {
+    if (errors[i] != NULL && errors[i][0] != '\0') {
+      terminal_printerr ("Error creating terminal: %s\n", errors[i]);
+      continue; /* Continue processing the remaining options! */
+    }
+
+    if (options->print_environment)
+      g_print ("%s=%s\n", TERMINAL_ENV_SCREEN, object_paths[i]);
+  }
+
+  return TRUE;
+}
+
+/*
+ * handle_restore_snapshot:
+ *
+ * Returns: %TRUE if the server restored at least one terminal
+ */
+static gboolean
+handle_restore_snapshot (TerminalOptions *options,
+                         TerminalFactory *factory)
+{
+  gs_free_error GError *err = NULL;
+  gs_strfreev char **object_paths = NULL;
+
+  if (!terminal_factory_call_restore_snapshot_sync (factory,
+                                                    &object_paths,
+                                                    NULL /* cancellable */,
+                                                    &err)) {
+    g_dbus_error_strip_remote_error (err);
+    terminal_printerr ("Error restoring the session snapshot: %s\n", err->message);
+    return FALSE;
+  }
+
+  if (options->print_environment) {
+    for (guint i = 0; object_paths[i] != NULL; i++)
+      g_print ("%s=%s\n", TERMINAL_ENV_SCREEN, object_paths[i]);
+  }
+
+  return object_paths[0] != NULL;
+}
+
+/* What handle_options() got for a tab. The windows are opened in
+ * parallel, so this is only looked at once all are done, in the order
+ * of the options.
+ */
+typedef struct {
+  char *object_path;
+  int wait_fd;
+  TerminalReceiver *wait_for_receiver;
+} TabResult;
+
+/* The windows of handle_options() being opened */
+typedef struct {
+  TerminalOptions *options;
+  TerminalFactory *factory;
+  const char *service_name;
+  const char *parent_screen_object_path;
+  const char *encoding;
+  TabResult *results; /* one per tab */
+  GMainLoop *loop;
+  guint n_pending; /* windows */
+  gboolean failed; /* stop creating tabs */
+} HandleOptionsData;
+
+typedef struct {
+  HandleOptionsData *data;
+  InitialWindow *iw;
+  GList *lt; /* the tab being created */
+  guint tab_index; /* in HandleOptionsData.results */
+  char *previous_screen_object_path;
+  guint window_id;
+} WindowData;
+
+static void window_create_next_tab (WindowData *wd);
+
+static void
+create_instance_cb (TerminalFactory *factory,
+                    GAsyncResult *result,
+                    WindowData *wd)
+{
+  HandleOptionsData *data = wd->data;
+  InitialTab *it = wd->lt->data;
+  TabResult *tr = &data->results[wd->tab_index];
+  gs_free_error GError *err = NULL;
+  gs_free char *object_path = NULL;
+  gs_free char *factory_unique_name = NULL;
+
+  if (!terminal_factory_call_create_instance_finish (factory, &object_path, result, &err)) {
+    if (handle_create_instance_error (data->service_name, err))
+      data->failed = TRUE;
+    goto next; /* Continue processing the remaining options! */
+  }
+
+  /* Deprecated and not working on new server anymore */
+  char *p = strstr (object_path, "/window/");
+  if (p) {
+    char *end = NULL;
+    guint64 value;
+
+    errno = 0;
+    p += strlen ("/window/");
+    value = g_ascii_strtoull (p, &end, 10);
+    if (errno == 0 && end != p && *end == '/')
+      wd->window_id = (guint) value;
+  }
+
+  g_free (wd->previous_screen_object_path);
+  wd->previous_screen_object_path = g_strdup (object_path);
+
+  /* The first call started the server if it wasn't running, so only now
+   * is its unique name known for sure.
+   */
+  factory_unique_name = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (factory));
+  if (!exec_tab (data->options, it,
+                 g_dbus_proxy_get_connection (G_DBUS_PROXY (factory)),
+                 factory_unique_name,
+                 object_path,
+                 &tr->wait_fd, &tr->wait_for_receiver, &err)) {
+    if (handle_exec_error (data->service_name, err))
+      data->failed = TRUE;
+    goto next; /* Continue processing the remaining options! */
+  }
+
+  gs_transfer_out_value (&tr->object_path, &object_path);
+
+ next:
+  wd->lt = wd->lt->next;
+  wd->tab_index++;
+  window_create_next_tab (wd);
+}
+
+/* Starts creating the next tab of the window, or finishes the window */
+static void
+window_create_next_tab (WindowData *wd)
+{
+  HandleOptionsData *data = wd->data;
+
+  if (wd->lt == NULL || data->failed) {
+    if (--data->n_pending == 0)
+      g_main_loop_quit (data->loop);
+
+    g_free (wd->previous_screen_object_path);
+    g_slice_free (WindowData, wd);
+    return;
+  }
+
+  InitialTab *it = wd->lt->data;
+  g_assert_nonnull (it);
+
+  GVariant *instance_options =
+    build_create_instance_options (data->options, wd->iw, it, data->encoding,
+                                   data->parent_screen_object_path,
+                                   wd->previous_screen_object_path,
+                                   wd->window_id,
+                                   FALSE);
+
+  terminal_factory_call_create_instance (data->factory,
+                                         instance_options,
+                                         NULL /* cancellable */,
+                                         (GAsyncReadyCallback) create_instance_cb,
+                                         wd);
+}
+
 /**
  * handle_options:
  * @app:
  * @options: a #TerminalOptions
  * @allow_resume: whether to merge the terminal configuration from the
  *   saved session on resume
- * @wait_for_receiver: location to store the #TerminalReceiver to wait for
+ * @wait_fd: location to store the exit status FD to wait on
+ * @wait_for_receiver: location to store the #TerminalReceiver to wait for,
+ *   if the server does not support exit status FDs
  *
  * Processes @options. It loads or saves the terminal configuration, or
  * opens the specified windows and tabs.
@@ -354,6 +992,7 @@ handle_options (TerminalOptions *options,
                 TerminalFactory *factory,
                 const char *service_name,
                 const char *parent_screen_object_path,
+                int *wait_fd,
                 TerminalReceiver **wait_for_receiver)
 {
 
@@ -363,156 +1002,488 @@ handle_options (TerminalOptions *options,
 
   if (options->show_preferences) {
     handle_show_preferences (service_name);
+  } else if (options->restore_snapshot &&
+             options->initial_windows == NULL &&
+             handle_restore_snapshot (options, factory)) {
+    return TRUE;
   } else {
     /* Make sure we open at least one window */
     terminal_options_ensure_window (options);
   }
 
-  const char *factory_unique_name = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (factory));
+  prepare_environment (options);
+
+  if (can_batch_options (options)) {
+    gboolean unsupported;
+
+    if (!handle_options_batched (options, factory, service_name,
+                                 parent_screen_object_path, encoding,
+                                 &unsupported))
+      return FALSE;
+    if (!unsupported)
+      return TRUE;
+  }
 
+  /* Open the windows in parallel; within a window, each tab needs the
+   * object path of the one before it.
+   */
+  guint n_tabs = 0;
+  for (GList *lw = options->initial_windows;  lw != NULL; lw = lw->next)
+    n_tabs += g_list_length (((InitialWindow *) lw->data)->tabs);
+
+  HandleOptionsData data = {
+    options, factory, service_name, parent_screen_object_path, encoding,
+    g_new0 (TabResult, n_tabs),
+    g_main_loop_new (NULL, FALSE), 0, FALSE
+  };
+  for (guint i = 0; i < n_tabs; i++)
+    data.results[i].wait_fd = -1;
+
+  guint tab_index = 0;
   for (GList *lw = options->initial_windows;  lw != NULL; lw = lw->next)
     {
       InitialWindow *iw = lw->data;
 
       g_assert_nonnull (iw);
 
-      guint window_id = 0;
-
-      gs_free char *previous_screen_object_path = NULL;
+      WindowData *wd = g_slice_new0 (WindowData);
+      wd->data = &data;
+      wd->iw = iw;
+      wd->lt = iw->tabs;
+      wd->tab_index = tab_index;
       if (iw->implicit_first_window)
-        previous_screen_object_path = g_strdup (parent_screen_object_path);
+        wd->previous_screen_object_path = g_strdup (parent_screen_object_path);
 
-      /* Now add the tabs */
-      for (GList *lt = iw->tabs; lt != NULL; lt = lt->next)
-        {
-          InitialTab *it = lt->data;
-          g_assert_nonnull (it);
-
-          GVariantBuilder builder;
-          g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
-
-          terminal_client_append_create_instance_options (&builder,
-                                                          options->display_name,
-                                                          options->startup_id,
-                                                          iw->geometry,
-                                                          iw->role,
-                                                          it->profile ? it->profile : options->default_profile,
-                                                          encoding,
-                                                          it->title ? it->title : options->default_title,
-                                                          it->active,
-                                                          iw->start_maximized,
-                                                          iw->start_fullscreen);
-
-          /* This will be used to apply missing defaults */
-          if (parent_screen_object_path != NULL)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "parent-screen", g_variant_new_object_path (parent_screen_object_path));
-
-          /* This will be used to get the parent window */
-          if (previous_screen_object_path)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "window-from-screen", g_variant_new_object_path (previous_screen_object_path));
-          if (window_id)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "window-id", g_variant_new_uint32 (window_id));
-          /* Restored windows shouldn't demand attention; see bug #586308. */
-          if (iw->source_tag == SOURCE_SESSION)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "present-window", g_variant_new_boolean (FALSE));
-          if (options->zoom_set || it->zoom_set)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "zoom", g_variant_new_double (it->zoom_set ? it->zoom : options->zoom));
-          if (iw->force_menubar_state)
-            g_variant_builder_add (&builder, "{sv}",
-                                   "show-menubar", g_variant_new_boolean (iw->menubar_state));
-
-          gs_free_error GError *err = NULL;
-          gs_free char *object_path = NULL;
-          if (!terminal_factory_call_create_instance_sync
-                 (factory,
-                  g_variant_builder_end (&builder),
-                  &object_path,
-                  NULL /* cancellable */,
-                  &err)) {
-            if (handle_create_instance_error (service_name, err))
-              return FALSE;
-            else
-              continue; /* Continue processing the remaining options! */
-          }
-
-          /* Deprecated and not working on new server anymore */
-          char *p = strstr (object_path, "/window/");
-          if (p) {
-            char *end = NULL;
-            guint64 value;
-
-            errno = 0;
-            p += strlen ("/window/");
-            value = g_ascii_strtoull (p, &end, 10);
-            if (errno == 0 && end != p && *end == '/')
-              window_id = (guint) value;
-          }
-
-          g_free (previous_screen_object_path);
-          previous_screen_object_path = g_strdup (object_path);
-
-          gs_unref_object TerminalReceiver *receiver =
-            terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                                      G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                                      (it->wait ? 0 : G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS),
-                                                      factory_unique_name,
-                                                      object_path,
-                                                      NULL /* cancellable */,
-                                                      &err);
-          if (receiver == NULL) {
-            if (handle_create_receiver_proxy_error (service_name, err))
-              return FALSE;
-            else
-              continue; /* Continue processing the remaining options! */
-          }
-
-          g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
-
-          char **argv = it->exec_argv ? it->exec_argv : options->exec_argv;
-          int argc = argv ? g_strv_length (argv) : 0;
-
-          PassFdElement *fd_array = it->fd_array ? (PassFdElement*)it->fd_array->data : NULL;
-          gsize fd_array_len = it->fd_array ? it->fd_array->len : 0;
-
-          terminal_client_append_exec_options (&builder,
-                                               it->working_dir ? it->working_dir
-                                                               : options->default_working_dir,
-                                               fd_array, fd_array_len,
-                                               argc == 0);
-
-          if (!terminal_receiver_call_exec_sync (receiver,
-                                                 g_variant_builder_end (&builder),
-                                                 g_variant_new_bytestring_array ((const char * const *) argv, argc),
-                                                 it->fd_list, NULL /* outfdlist */,
-                                                 NULL /* cancellable */,
-                                                 &err)) {
-            if (handle_exec_error (service_name, err))
-              return FALSE;
-            else
-              continue; /* Continue processing the remaining options! */
-          }
-
-          if (it->wait)
-            gs_transfer_out_value (wait_for_receiver, &receiver);
-
-          if (options->print_environment)
-            g_print ("%s=%s\n", TERMINAL_ENV_SCREEN, object_path);
-        }
+      tab_index += g_list_length (iw->tabs);
+      data.n_pending++;
+      window_create_next_tab (wd);
     }
 
+  if (data.n_pending > 0)
+    g_main_loop_run (data.loop);
+  g_main_loop_unref (data.loop);
+
+  /* As when the tabs were created one after the other, the last tab to
+   * wait for is the one that's waited for.
+   */
+  for (guint i = 0; i < n_tabs; i++) {
+    TabResult *tr = &data.results[i];
+
+    if (tr->object_path != NULL && options->print_environment)
+      g_print ("%s=%s\n", TERMINAL_ENV_SCREEN, tr->object_path);
+    g_free (tr->object_path);
+
+    if (tr->wait_fd != -1 || tr->wait_for_receiver != NULL) {
+      if (*wait_fd != -1)
+        close (*wait_fd);
+      *wait_fd = tr->wait_fd;
+      g_clear_object (wait_for_receiver);
+      *wait_for_receiver = tr->wait_for_receiver;
+    }
+  }
+  g_free (data.results);
+
+  return !data.failed;
+}
+
+/* Server sharding
+ *
+ * New windows may be spread over several server processes, so that a
+ * terminal flooding its server with output doesn't slow down the others.
+ * Each shard is a gnome-terminal-server with its own app ID, started on
+ * demand; like the main server, it exits after its last window closes.
+ */
+
+#define SHARD_APP_ID_PREFIX TERMINAL_APPLICATION_ID ".Shard."
+#define SHARD_START_TIMEOUT (10 * 1000 /* 10s */)
+
+static gboolean
+shard_name_has_owner (GDBusConnection *bus,
+                      const char *name)
+{
+  gs_unref_variant GVariant *v =
+    g_dbus_connection_call_sync (bus,
+                                 "org.freedesktop.DBus",
+                                 "/org/freedesktop/DBus",
+                                 "org.freedesktop.DBus",
+                                 "NameHasOwner",
+                                 g_variant_new ("(s)", name),
+                                 G_VARIANT_TYPE ("(b)"),
+                                 G_DBUS_CALL_FLAGS_NONE,
+                                 -1, NULL, NULL);
+  gboolean has_owner = FALSE;
+
+  if (v != NULL)
+    g_variant_get (v, "(b)", &has_owner);
+  return has_owner;
+}
+
+/* The shards' terminals are counted with concurrent calls, so asking
+ * many shards costs about one round trip
+ */
+typedef struct {
+  GMainLoop *loop;
+  guint n_pending;
+} ShardCountData;
+
+typedef struct {
+  ShardCountData *data;
+  const char *name;
+  guint count; /* G_MAXUINT on error */
+} ShardCount;
+
+/* Returns the number of terminals in the GetManagedObjects reply @v */
+static guint
+shard_count_screens (GVariant *v)
+{
+  /* Only count the terminals, not the factory and the other objects */
+  gs_unref_variant GVariant *objects = g_variant_get_child_value (v, 0);
+  GVariantIter iter;
+  const char *object_path;
+  GVariant *interfaces;
+  guint count = 0;
+
+  g_variant_iter_init (&iter, objects);
+  while (g_variant_iter_loop (&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+    gs_unref_variant GVariant *receiver =
+      g_variant_lookup_value (interfaces, TEMRINAL_RECEIVER_INTERFACE_NAME, NULL);
+
+    if (g_str_has_prefix (object_path, TERMINAL_RECEIVER_OBJECT_PATH_PREFIX) &&
+        receiver != NULL)
+      count++;
+  }
+
+  return count;
+}
+
+static void
+shard_count_screens_cb (GDBusConnection *bus,
+                        GAsyncResult *result,
+                        ShardCount *sc)
+{
+  gs_unref_variant GVariant *v = g_dbus_connection_call_finish (bus, result, NULL);
+
+  sc->count = v != NULL ? shard_count_screens (v) : G_MAXUINT;
+
+  if (--sc->data->n_pending == 0)
+    g_main_loop_quit (sc->data->loop);
+}
+
+static char *
+shard_app_id_for_profile (TerminalOptions *options)
+{
+  const char *profile = options->default_profile;
+  gs_free char *uuid = NULL;
+
+  if (options->initial_windows != NULL) {
+    InitialWindow *iw = options->initial_windows->data;
+
+    if (iw->tabs != NULL && ((InitialTab *) iw->tabs->data)->profile != NULL)
+      profile = ((InitialTab *) iw->tabs->data)->profile;
+  }
+
+  if (options->profiles_list == NULL)
+    return NULL;
+
+  if (profile != NULL)
+    uuid = terminal_profiles_list_dup_uuid_or_name (options->profiles_list, profile, NULL);
+  else
+    uuid = terminal_profiles_list_dup_uuid (options->profiles_list, NULL, NULL);
+  if (uuid == NULL)
+    return NULL;
+
+  /* '-' isn't allowed in app IDs */
+  g_strdelimit (uuid, "-", '_');
+  return g_strconcat (SHARD_APP_ID_PREFIX "Profile_", uuid, NULL);
+}
+
+/* Returns the shard with the fewest terminals, if any has room */
+static char *
+shard_app_id_round_robin (GDBusConnection *bus,
+                          guint max_screens,
+                          guint *n_shards)
+{
+  gs_unref_variant GVariant *v =
+    g_dbus_connection_call_sync (bus,
+                                 "org.freedesktop.DBus",
+                                 "/org/freedesktop/DBus",
+                                 "org.freedesktop.DBus",
+                                 "ListNames",
+                                 NULL,
+                                 G_VARIANT_TYPE ("(as)"),
+                                 G_DBUS_CALL_FLAGS_NONE,
+                                 -1, NULL, NULL);
+  if (v == NULL)
+    return NULL;
+
+  gs_free const char **names = NULL;
+  g_variant_get (v, "(^a&s)", &names);
+
+  guint n_names = g_strv_length ((char **) names);
+  gs_free ShardCount *counts = g_new0 (ShardCount, n_names);
+  ShardCountData data = { NULL, 0 };
+  *n_shards = 0;
+  for (guint i = 0; names[i] != NULL; i++) {
+    if (!g_str_has_prefix (names[i], SHARD_APP_ID_PREFIX "RoundRobin"))
+      continue;
+
+    ShardCount *sc = &counts[(*n_shards)++];
+    sc->data = &data;
+    sc->name = names[i];
+    data.n_pending++;
+
+    g_dbus_connection_call (bus,
+                            names[i],
+                            TERMINAL_OBJECT_PATH_PREFIX,
+                            "org.freedesktop.DBus.ObjectManager",
+                            "GetManagedObjects",
+                            NULL,
+                            G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+                            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                            1000 /* 1s */, NULL,
+                            (GAsyncReadyCallback) shard_count_screens_cb,
+                            sc);
+  }
+
+  if (data.n_pending > 0) {
+    data.loop = g_main_loop_new (NULL, FALSE);
+    g_main_loop_run (data.loop);
+    g_main_loop_unref (data.loop);
+  }
+
+  const char *best = NULL;
+  guint best_count = G_MAXUINT;
+  for (guint i = 0; i < *n_shards; i++) {
+    guint count = counts[i].count;
+
+    if (count == G_MAXUINT ||
+        (max_screens > 0 && count >= max_screens))
+      continue;
+
+    if (count < best_count) {
+      best = counts[i].name;
+      best_count = count;
+    }
+  }
+
+  return g_strdup (best);
+}
+
+/* Returns the first shard app ID with @kind that isn't in use */
+static char *
+shard_app_id_new (GDBusConnection *bus,
+                  const char *kind,
+                  guint start)
+{
+  for (guint i = start; i < G_MAXUINT; i++) {
+    char *app_id = g_strdup_printf (SHARD_APP_ID_PREFIX "%s%u", kind, i);
+
+    if (!shard_name_has_owner (bus, app_id))
+      return app_id;
+
+    g_free (app_id);
+  }
+
+  return NULL;
+}
+
+static void
+shard_name_appeared_cb (GDBusConnection *bus,
+                        const char *name,
+                        const char *name_owner,
+                        GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+}
+
+static gboolean
+shard_start_timeout_cb (GMainLoop *loop)
+{
+  g_main_loop_quit (loop);
+  return G_SOURCE_CONTINUE; /* removed by shard_ensure_running() */
+}
+
+static gboolean
+shard_ensure_running (GDBusConnection *bus,
+                      const char *app_id,
+                      GError **error)
+{
+  if (shard_name_has_owner (bus, app_id))
+    return TRUE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Starting server shard %s\n", app_id);
+
+  char *argv[] = {
+    (char *) TERM_LIBEXECDIR "/gnome-terminal-server",
+    (char *) "--app-id",
+    (char *) app_id,
+    NULL
+  };
+
+  /* Without DO_NOT_REAP_CHILD the server is reparented, so it can outlive us;
+   * it must not keep writing to our stderr after we exited either.
+   */
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                      NULL, NULL, NULL, error))
+    return FALSE;
+
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  guint watch_id = g_bus_watch_name_on_connection (bus, app_id,
+                                                   G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                   (GBusNameAppearedCallback) shard_name_appeared_cb,
+                                                   NULL,
+                                                   loop, NULL);
+  guint timeout_id = g_timeout_add (SHARD_START_TIMEOUT,
+                                    (GSourceFunc) shard_start_timeout_cb,
+                                    loop);
+  g_main_loop_run (loop);
+  g_source_remove (timeout_id);
+  g_bus_unwatch_name (watch_id);
+  g_main_loop_unref (loop);
+
+  if (!shard_name_has_owner (bus, app_id)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                 "Timed out waiting for %s", app_id);
+    return FALSE;
+  }
+
   return TRUE;
 }
 
+/*
+ * maybe_use_server_shard:
+ *
+ * Picks the server shard for the new windows in @options, according to
+ * the sharding settings, and makes sure it is running.
+ */
+static void
+maybe_use_server_shard (TerminalOptions *options)
+{
+  /* An explicit app ID wins, and new tabs go to their window's server */
+  if (options->server_app_id != NULL || options->show_preferences ||
+      options->restore_snapshot)
+    return;
+
+  if (options->server_unique_name != NULL) {
+    for (GList *l = options->initial_windows; l != NULL; l = l->next) {
+      if (((InitialWindow *) l->data)->implicit_first_window)
+        return;
+    }
+  }
+
+  gs_unref_object GSettings *global_settings =
+    g_settings_new (TERMINAL_SETTING_SCHEMA);
+  TerminalServerSharding sharding =
+    g_settings_get_enum (global_settings, TERMINAL_SETTING_SERVER_SHARDING_KEY);
+  if (sharding == TERMINAL_SERVER_SHARDING_NONE)
+    return;
+
+  gs_free_error GError *error = NULL;
+  gs_unref_object GDBusConnection *bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+  if (bus == NULL)
+    return;
+
+  gs_free char *app_id = NULL;
+  switch (sharding) {
+  case TERMINAL_SERVER_SHARDING_PROFILE:
+    app_id = shard_app_id_for_profile (options);
+    break;
+  case TERMINAL_SERVER_SHARDING_WINDOW:
+    app_id = shard_app_id_new (bus, "Window", 0);
+    break;
+  case TERMINAL_SERVER_SHARDING_ROUND_ROBIN: {
+    guint n_shards = 0;
+    guint max_screens = g_settings_get_uint (global_settings,
+                                             TERMINAL_SETTING_SERVER_SHARD_MAX_SCREENS_KEY);
+
+    app_id = shard_app_id_round_robin (bus, max_screens, &n_shards);
+    if (app_id == NULL)
+      app_id = shard_app_id_new (bus, "RoundRobin", n_shards);
+    break;
+  }
+  case TERMINAL_SERVER_SHARDING_NONE:
+  default:
+    break;
+  }
+
+  if (app_id == NULL)
+    return;
+
+  if (!shard_ensure_running (bus, app_id, &error)) {
+    terminal_printerr ("Failed to start server shard %s: %s\n", app_id, error->message);
+    terminal_printerr ("Falling back to default server.\n");
+    return;
+  }
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Using server shard %s\n", app_id);
+
+  gs_transfer_out_value (&options->server_app_id, &app_id);
+}
+
+/*
+ * prestart_server:
+ *
+ * Asks the bus to start the default server without waiting for it, so
+ * that it starts up while the options are parsed. This is skipped when
+ * the options may pick a different server, i.e. with --app-id, from the
+ * environment of a terminal, or with server sharding.
+ *
+ * Returns: (transfer full): the session bus connection to keep open
+ *   until the server is used, or %NULL
+ */
+static GDBusConnection *
+prestart_server (int argc,
+                 char **argv)
+{
+  for (int i = 1; i < argc; i++) {
+    if (g_str_has_prefix (argv[i], "--app-id") ||
+        g_str_has_prefix (argv[i], "--help") ||
+        g_str_equal (argv[i], "-h") ||
+        g_str_equal (argv[i], "-?"))
+      return NULL;
+  }
+
+  if (g_getenv (TERMINAL_ENV_SERVICE_NAME) != NULL)
+    return NULL;
+
+  gs_unref_object GSettings *global_settings =
+    g_settings_new (TERMINAL_SETTING_SCHEMA);
+  if (g_settings_get_enum (global_settings, TERMINAL_SETTING_SERVER_SHARDING_KEY) !=
+      TERMINAL_SERVER_SHARDING_NONE)
+    return NULL;
+
+  GDBusConnection *bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  if (bus == NULL)
+    return NULL;
+
+  _terminal_debug_print (TERMINAL_DEBUG_SERVER,
+                         "Starting %s while parsing the options\n", TERMINAL_APPLICATION_ID);
+
+  /* Without a callback, no reply is expected */
+  g_dbus_connection_call (bus,
+                          "org.freedesktop.DBus",
+                          "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus",
+                          "StartServiceByName",
+                          g_variant_new ("(su)", TERMINAL_APPLICATION_ID, 0u),
+                          NULL,
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1, NULL, NULL, NULL);
+
+  return bus;
+}
+
 int
 main (int argc, char **argv)
 {
   int exit_code = EXIT_FAILURE;
 
+  _terminal_trace_init ("gnome-terminal");
+  gint64 trace_begin = _terminal_trace_begin ();
+
 #if GLIB_CHECK_VERSION (2, 50, 0)
   g_log_set_writer_func (terminal_log_writer, NULL, NULL);
 #endif
@@ -532,6 +1503,8 @@ main (int argc, char **argv)
     argv_copy [i] = argv [i];
   argv_copy [i] = NULL;
 
+  gs_unref_object GDBusConnection *prestart_bus = prestart_server (argc, argv);
+
   gs_free_error GError *error = NULL;
   gs_free_options TerminalOptions *options = terminal_options_parse (&argc, &argv, &error);
   if (options == NULL) {
@@ -541,15 +1514,19 @@ main (int argc, char **argv)
 
   g_set_application_name (_("Terminal"));
 
+  maybe_use_server_shard (options);
+
   gs_unref_object TerminalFactory *factory = NULL;
   gs_free char *service_name = NULL;
   gs_free char *parent_screen_object_path = NULL;
+  gint64 factory_trace_begin = _terminal_trace_begin ();
   if (!factory_proxy_new (options,
                           &factory,
                           &service_name,
                           &parent_screen_object_path,
                           &error))
     return exit_code;
+  _terminal_trace_end ("factory_proxy_new", factory_trace_begin);
 
   if (options->print_environment) {
     const char *name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (factory));
@@ -560,10 +1537,18 @@ main (int argc, char **argv)
   }
 
   TerminalReceiver *receiver = NULL;
-  if (!handle_options (options, factory, service_name, parent_screen_object_path, &receiver))
+  int wait_fd = -1;
+  gint64 handle_trace_begin = _terminal_trace_begin ();
+  if (!handle_options (options, factory, service_name, parent_screen_object_path,
+                       &wait_fd, &receiver))
     return exit_code;
+  _terminal_trace_end ("handle_options", handle_trace_begin);
+  _terminal_trace_end ("main", trace_begin);
 
-  if (receiver != NULL) {
+  if (wait_fd != -1) {
+    exit_code = run_exit_status_fd (wait_fd);
+    g_clear_object (&receiver);
+  } else if (receiver != NULL) {
     exit_code = run_receiver (receiver);
     g_object_unref (receiver);
   } else